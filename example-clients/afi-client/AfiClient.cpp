@@ -20,6 +20,18 @@
 //
 
 #include "AfiClient.h"
+#include <fstream>
+#include <poll.h>
+
+#ifdef AFI_HAVE_IO_URING
+#include <sys/eventfd.h>
+#endif
+
+//
+// io_uring receive completion tags
+//
+#define AFI_HP_URING_RECV       1
+#define AFI_HP_URING_STOP       2
 
 //
 // @fn
@@ -88,6 +100,34 @@ AfiClient::openSandbox (const std::string &sandbox_name,
     return 0;
 }
 
+//
+// @fn
+// closeSandbox
+//
+// @brief
+// Close and release the sandbox opened with openSandbox
+//
+// @return 0 - Success, -1 - Failure
+//
+
+int
+AfiClient::closeSandbox (void)
+{
+    if (_sandbox == nullptr) {
+        return -1;
+    }
+
+    _transport->close();
+    bool status = _transport->release(_sandbox->name());
+    _sandbox.reset();
+    if (!status) {
+        std::cout << "_transport->release failed!" << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
 //
 // @fn
 // addRouteTable
@@ -138,6 +178,51 @@ AfiClient::addRouteTable (const std::string &rttName,
     return rttNodeToken;
 }
 
+//
+// @fn
+// routeKey
+//
+// @brief
+// Routing table key of an IPv4 prefix
+//
+// @param[in]
+//     prefix Route prefix, a.b.c.d/len
+// @param[out]
+//     key Key
+// @param[out]
+//     prefixBytes Prefix address bytes
+// @param[out]
+//     prefixLen Prefix length
+// @return 0 - Success, -1 - Invalid prefix
+//
+
+static int
+routeKey (const std::string &prefix, AftKey &key, AftDataBytes &prefixBytes,
+          uint32_t &prefixLen)
+{
+    std::vector<std::string> prefix_sub_strings;
+    boost::split(prefix_sub_strings, prefix, boost::is_any_of("./"));
+
+    if (prefix_sub_strings.size() != 5) {
+        std::cout << "Invalid prefix" << std::endl;
+        return -1;
+    }
+
+    for(int t = 0; t < (prefix_sub_strings.size() - 1); ++t){
+        uint8_t byte = std::strtoul(prefix_sub_strings.at(t).c_str(), NULL, 0);
+        prefixBytes.push_back(byte);
+    }
+    prefixLen = std::strtoul(prefix_sub_strings.at(4).c_str(), NULL, 0);
+    if (prefixLen > 32) {
+        std::cout << "Invalid prefix length" << std::endl;
+        return -1;
+    }
+
+    AftDataPtr  data_prefix = AftDataPrefix::create(prefixBytes, prefixLen);
+    key = AftKey(AftField("packet.ip4.daddr"), data_prefix);
+    return 0;
+}
+
 //
 // @fn
 // addRoute
@@ -151,43 +236,42 @@ AfiClient::addRouteTable (const std::string &rttName,
 //     prefix Route prefix
 // @param[in]
 //     routeTragetToken Route target token
+// @param[in]
+//     batch Insert to add to, sent by the caller (NULL - send now)
 // @return 0 - Success, -1 - Error
 //
 
 int
 AfiClient::addRoute (AftNodeToken       rttNodeToken,
                      const std::string &prefix,
-                     AftNodeToken       routeTragetToken)
+                     AftNodeToken       routeTragetToken,
+                     const AftInsertPtr &batch)
 {
     AftInsertPtr        insert;
-    AftNodeToken        outputPortToken;
+    AftKey              key;
+    AftDataBytes        prefix_bytes;
+    uint32_t            prefix_len;
 
-    std::vector<std::string> prefix_sub_strings;
-    boost::split(prefix_sub_strings, prefix, boost::is_any_of("./"));
+    //
+    // Route parameters are the same for every route: created once and
+    // shared by all entries (AftData is not changed once created, and
+    // entries only hold references), two allocations less per route
+    //
+    static const AftDataPtr routeString = AftDataString::create("IPv4 route");
+    static const AftDataPtr routeHwFlush = AftDataInt::create((uint8_t)0);
 
-    if (prefix_sub_strings.size() != 5) {
-        std::cout << "Invalid prefix" << std::endl;
+    if (routeKey(prefix, key, prefix_bytes, prefix_len) != 0) {
         return -1;
     }
 
-    AftDataBytes prefix_bytes;
-    for(int t = 0; t < (prefix_sub_strings.size() - 1); ++t){
-        uint8_t byte = std::strtoul(prefix_sub_strings.at(t).c_str(), NULL, 0);
-        prefix_bytes.push_back(byte);
-    }
-
-    AftDataPtr  data_prefix = AftDataPrefix::create(prefix_bytes,
-                       (uint32_t)(std::strtoul(prefix_sub_strings.at(4).c_str(),
-                        NULL, 0)));
-    AftKey      key     = AftKey(AftField("packet.ip4.daddr"), data_prefix);
-
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = batch ? batch : AftInsert::create(_sandbox);
 
-    std::cout <<"Adding route ";
-    std::cout << prefix << " ---> Node token " << routeTragetToken << std::endl;
+    AFI_TRACE(AFI_TRACE_EV_ROUTE_ADD, 0, 0,
+              rttNodeToken, routeTragetToken,
+              prefix_bytes.data(), prefix_bytes.size(), prefix_len);
 
     //
     // Create a route
@@ -198,18 +282,57 @@ AfiClient::addRoute (AftNodeToken       rttNodeToken,
     //
     // Set the optional params for Entry
     //
-    uint8_t hwFlush = 0;
-    entryPtr->setEntryParameter("route.string",
-                                AftDataString::create("IPv4 route"));
-    entryPtr->setEntryParameter("route.hwFlush",
-                                AftDataInt::create(hwFlush));
+    entryPtr->setEntryParameter("route.string", routeString);
+    entryPtr->setEntryParameter("route.hwFlush", routeHwFlush);
 
     insert->push(entryPtr);
 
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    if (batch == nullptr) {
+        _sandbox->send(insert);
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// removeRoute
+//
+// @brief
+// Remove route from a routing table
+//
+// @param[in]
+//     rttNodeToken Routing table node token
+// @param[in]
+//     prefix Route prefix
+// @param[in]
+//     batch Remove to add to, sent by the caller (NULL - send now)
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::removeRoute (AftNodeToken       rttNodeToken,
+                        const std::string &prefix,
+                        const AftRemovePtr &batch)
+{
+    AftRemovePtr        remove;
+    AftKey              key;
+    AftDataBytes        prefix_bytes;
+    uint32_t            prefix_len;
+
+    if (routeKey(prefix, key, prefix_bytes, prefix_len) != 0) {
+        return -1;
+    }
+
+    remove = batch ? batch : AftRemove::create();
+    remove->push(AftEntry::create(rttNodeToken, key, AFT_NODE_TOKEN_NONE));
+
+    if (batch == nullptr) {
+        _sandbox->send(remove);
+    }
 
     return 0;
 }
@@ -266,33 +389,38 @@ AfiClient::createIndexTable (const std::string &field_name,
 //     entryIndex Index at which entry is to be added
 // @param[in]
 //     entryTargetToken Entry target token
+// @param[in]
+//     batch Insert to add to, sent by the caller (NULL - send now)
 // @return 0 - Success, -1 - Error
 //
 
 int
 AfiClient::addIndexTableEntry (AftNodeToken iTableToken,
                                u_int32_t    entryIndex,
-                               AftNodeToken entryTargetToken)
+                               AftNodeToken entryTargetToken,
+                               const AftInsertPtr &batch)
 {
     AftInsertPtr        insert;
 
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = batch ? batch : AftInsert::create(_sandbox);
 
     AftEntryPtr entry = AftEntry::create(iTableToken,
                                          entryIndex, 
                                          entryTargetToken);
 
     insert->push(entry);
-    std::cout << "Index table entry pushed. ";
-    std::cout <<"(Index: " << entryIndex << " target token: "<< entryTargetToken << ")" << std::endl;
+    AFI_TRACE(AFI_TRACE_EV_INDEX_ENTRY_ADD, 0, entryIndex,
+              iTableToken, entryTargetToken, NULL, 0);
 
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    if (batch == nullptr) {
+        _sandbox->send(insert);
+    }
 
     return 0;
 }
@@ -307,18 +435,21 @@ AfiClient::addIndexTableEntry (AftNodeToken iTableToken,
 //
 // @param[in]
 //     tokVec Token vector
+// @param[in]
+//     batch Insert to add to, sent by the caller (NULL - send now)
 // @return List token
 //
 
 AftNodeToken
-AfiClient::createList (AftTokenVector tokVec)
+AfiClient::createList (AftTokenVector tokVec,
+                       const AftInsertPtr &batch)
 {
     AftInsertPtr        insert;
 
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = batch ? batch : AftInsert::create(_sandbox);
 
     //
     // Build a list of provided tokens
@@ -331,7 +462,9 @@ AfiClient::createList (AftTokenVector tokVec)
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    if (batch == nullptr) {
+        _sandbox->send(insert);
+    }
 
     return list->nodeToken();
 }
@@ -397,6 +530,8 @@ AfiClient::getOuputPortToken(AftIndex outputPortIndex)
 //     ovlanStr Outer vlan
 // @param[in]
 //     nextToken Next node token 
+// @param[in]
+//     batch Insert to add to, sent by the caller (NULL - send now)
 // @return Ethernet encap node's token
 //
 
@@ -405,7 +540,8 @@ AfiClient::addEtherEncapNode(const std::string &dst_mac,
                              const std::string &src_mac,
                              const std::string &ivlanStr,
                              const std::string &ovlanStr,
-                             AftNodeToken       nextToken)
+                             AftNodeToken       nextToken,
+                             const AftInsertPtr &batch)
 {
     AftNodeToken        outListToken;
     AftInsertPtr        insert;
@@ -413,7 +549,7 @@ AfiClient::addEtherEncapNode(const std::string &dst_mac,
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = batch ? batch : AftInsert::create(_sandbox);
     //
     // Create a key vector of ethernet data
     //
@@ -455,7 +591,9 @@ AfiClient::addEtherEncapNode(const std::string &dst_mac,
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    if (batch == nullptr) {
+        _sandbox->send(insert);
+    }
 
     return nhEncapToken;
 }
@@ -473,13 +611,16 @@ AfiClient::addEtherEncapNode(const std::string &dst_mac,
 //     innerLabelStr Inner label
 // @param[in]
 //     nextToken Next node token 
+// @param[in]
+//     batch Insert to add to, sent by the caller (NULL - send now)
 // @return Label encap node's token
 //
 
 AftNodeToken
 AfiClient::addLabelEncap(const std::string &outerLabelStr,
                          const std::string &innerLabelStr,
-                         AftNodeToken nextToken)
+                         AftNodeToken nextToken,
+                         const AftInsertPtr &batch)
 {
 
     uint64_t outerLabel = std::strtoull(outerLabelStr.c_str(),NULL,0);
@@ -496,7 +637,7 @@ AfiClient::addLabelEncap(const std::string &outerLabelStr,
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = batch ? batch : AftInsert::create(_sandbox);
 
     //
     // Create a key vector of ethernet data
@@ -560,7 +701,9 @@ AfiClient::addLabelEncap(const std::string &outerLabelStr,
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    if (batch == nullptr) {
+        _sandbox->send(insert);
+    }
 
     return listToken;
 }
@@ -671,216 +814,2679 @@ AfiClient::addDiscardNode (void)
 
 //
 // @fn
-// recvHostPathPacket
+// addPuntPolicer
 //
 // @brief
-// Receive hostpath packet
+// Add a policer in front of the punt output port for the packets of
+// an input port. The policer is bracketed by counters of the offered
+// and the passed packets, so that policer drops show as the difference
+// of the two counters.
 //
 // @param[in]
-//     pkt Aft packet where received packet will be copied to
-// @return 0 - Success, -1 - Error
+//     inputPortIndex Input port index (names the nodes)
+// @param[in]
+//     puntPortIndex Punt (output) port index
+// @param[in]
+//     rate Policer rate (packets or bits per second)
+// @param[in]
+//     burstSize Policer burst size (packets or bytes)
+// @param[in]
+//     packetMode True if policer is packet-oriented
+// @return Token to use instead of the punt port token
 //
 
-int 
-AfiClient::recvHostPathPacket(AftPacketPtr &pkt)
+AftNodeToken
+AfiClient::addPuntPolicer (AftIndex inputPortIndex,
+                           AftIndex puntPortIndex,
+                           uint64_t rate,
+                           uint64_t burstSize,
+                           bool     packetMode)
 {
-    size_t recvlen;
-    enum { max_length = 2000 };
-    char _data[max_length];
-    BOOST_UDP::endpoint sender_endpoint;
-
-    // Block until data has been received successfully or an error occurs. 
-    recvlen = _hpUdpSock.receive_from(
-                boost::asio::buffer(_data, max_length), sender_endpoint);
+    AftNodeToken        listToken;
+    AftInsertPtr        insert;
+    std::string         name = "PuntPolicer" + std::to_string(inputPortIndex);
 
-    pktTrace("Received (hostpath) pkt ", _data, recvlen);
+    AftNodeToken puntPortToken = getOuputPortToken(puntPortIndex);
 
-    memcpy(pkt->header(), _data, pkt->headerSize());
-    memcpy(pkt->data(), _data + pkt->headerSize(), (recvlen - pkt->headerSize()));
+    insert = AftInsert::create(_sandbox);
 
-    pktTrace("packet header", (char *)(pkt->header()), pkt->headerSize());
+    AftNodePtr offered = AftCounter::create(0, 0, false);
+    AftNodeToken offeredToken = insert->push(offered, name + "Offered");
 
-    std::cout << std::endl;
-    std::cout << std::endl;
-    std::cout << "pkt->headerSize(): " << pkt->headerSize() << " bytes" << std::endl;
-    std::cout << "Header: Received " << recvlen << " bytes" << std::endl;
+    AftNodePtr policer = AftPolicer::create(burstSize, rate, packetMode);
+    AftNodeToken policerToken = insert->push(policer, name);
 
-    pkt->headerParse();
+    AftNodePtr passed = AftCounter::create(0, 0, false);
+    AftNodeToken passedToken = insert->push(passed, name + "Passed");
 
-    std::cout << "Received packet:" << std::endl;
-    std::cout << "----------------" << std::endl;
-    std::cout << "Sandbox Id : " << pkt->sandboxId() << std::endl;
-    std::cout << "Port Index : " << pkt->portIndex() << std::endl;
-    std::cout << "Data Size  : " << pkt->dataSize()  << std::endl;
+    AftTokenVector tokVec = {offeredToken, policerToken,
+                             passedToken, puntPortToken};
 
+    AftNodePtr list = AftList::create(tokVec);
+    listToken = insert->push(list);
 
-    std::cout << "pkt->dataSize(): " << pkt->dataSize() << " bytes" << std::endl;
+    //
+    // Send all the nodes to the sandbox
+    //
+    _sandbox->send(insert);
 
+    return listToken;
+}
 
-    std::cout << "Data: Received " << recvlen << "bytes" << std::endl;
+//
+// Wait for fd to become readable until deadlineNs (CLOCK_MONOTONIC,
+// 0 - no deadline). Returns 0 - Readable (or interrupted), -1 - Error
+// or, with errno ETIMEDOUT, deadline passed.
+//
+static int
+hpRecvWait (int fd, uint64_t deadlineNs, const char *what)
+{
+    int timeoutMs = -1;
 
-    pktTrace("pkt data", (char *)(pkt->data()), pkt->dataSize());
+    if (deadlineNs != 0) {
+        uint64_t nowNs = afiMonotonicNs();
+        if (nowNs >= deadlineNs) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        timeoutMs = (deadlineNs - nowNs + 999999) / 1000000;
+    }
 
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int           ret = poll(&pfd, 1, timeoutMs);
+    if (ret == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    if ((ret < 0) && (errno != EINTR)) {
+        perror(what);
+        return -1;
+    }
     return 0;
 }
 
 //
 // @fn
-// hostPathUDPSrvr
+// recvHostPathPacket
 //
 // @brief
-// Hostpath UDP server
+// Receive hostpath packet, waiting for one. The hostpath socket is
+// non-blocking once the receivers run.
 //
-// @param[in] void
-// @return void
+// @param[in]
+//     pkt Aft packet the received packet is scattered into
+// @param[in]
+//     timeoutMs Longest wait, < 0: no limit
+// @return 0 - Success, -1 - Error (errno ETIMEDOUT: timed out)
 //
 
-void
-AfiClient::hostPathUDPSrvr(void)
+int 
+AfiClient::recvHostPathPacket(AftPacketPtr &pkt, int timeoutMs)
 {
-    if (_tracing) {
-        std::cout << std::endl;
-        std::cout << std::endl;
-        std::cout << "!!!Hostpath Receiver started!!! ";
-        std::cout << std::endl;
-        std::cout << std::endl;
-    }
-
-    enum { max_length = 2000 };
-    char _data[max_length];
-
-    for (;;)
-    {
-        size_t recvlen;
-        int ret;
-        BOOST_UDP::endpoint sender_endpoint;
+    uint64_t rxNs;
+    int      fd = _hpUdpSock.native_handle();
+    uint64_t deadlineNs = (timeoutMs < 0) ? 0 :
+                          afiMonotonicNs() + timeoutMs * 1000000ULL;
 
-        //
-        // Allocate packet context *and* buffer
-        //
-        AftPacketPtr pkt = AftPacket::createReceive();
+    if (_hpEngine == AfiHpEngineShm) {
+        return hpShmRecvSync(pkt, deadlineNs);
+    }
 
-        ret = recvHostPathPacket(pkt);
+    for (;;) {
+        if (hpRecv(fd, pkt, rxNs) == 0) {
+            return 0;
+        }
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            return -1;
+        }
+        if (hpRecvWait(fd, deadlineNs, "poll(hostpath)") != 0) {
+            return -1;
+        }
     }
 }
 
 //
 // @fn
-// startAfiPktRcvr
+// hpRxTimestamp
 //
 // @brief
-// Start AFI packer receiver
+// Kernel receive timestamp (SCM_TIMESTAMPNS) of a received message
 //
-// @param[in] void
+// @param[in]
+//     msg Received message
+// @param[out]
+//     rxNs Receive time (CLOCK_REALTIME ns), unchanged if none
 // @return void
 //
 
-void
-AfiClient::startAfiPktRcvr(void)
+static void
+hpRxTimestamp (struct msghdr &msg, uint64_t &rxNs)
 {
-    std::thread udpSrvr( [this] { this->hostPathUDPSrvr(); } );
-    udpSrvr.detach();
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+        if ((cm->cmsg_level == SOL_SOCKET) &&
+            (cm->cmsg_type == SCM_TIMESTAMPNS)) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            rxNs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+            return;
+        }
+    }
 }
 
 //
 // @fn
-// injectL2Packet
+// hpRecv
 //
 // @brief
-// Inject layer 2 packet on specified (output) 
-// port of specified sandbox
+// Receive one hostpath packet from a socket
 //
-// @param[in] 
-//     sandboxId Sandbox index
-// @param[in] 
-//     portIndex Output port index
-// @param[in] 
-//     l2Packet Pointer to layer 2 packet to be injected
-// @param[in] 
-//     l2PacketLen Length of layer 2 packet
-// @return void
+// @param[in]
+//     fd Hostpath socket
+// @param[in]
+//     pkt Aft packet the received packet is scattered into
+// @param[out]
+//     rxNs Kernel receive time, unchanged if the socket has none
+// @return 0 - Success, -1 - Error (errno EAGAIN: nothing to receive)
 //
 
 int
-AfiClient::injectL2Packet(AftSandboxId  sandboxId,
-                          AftIndex      portIndex,
-                          uint8_t      *l2Packet,
-                          int           l2PacketLen)
+AfiClient::hpRecv(int fd, AftPacketPtr &pkt, uint64_t &rxNs)
 {
-    std::cout << "Injecting layer2 packet - " ;
-    std::cout << "Sandbox index:" << sandboxId  <<" ";
-    std::cout << "Port index: "<< portIndex << std::endl;
-
-    if (!l2Packet) {
-        std::cout << "l2Packet NULL" << std::endl;
+    ssize_t       recvlen;
+    struct iovec  iov[2];
+    struct msghdr msg;
+    char          control[AFI_HP_RX_CTRL_SIZE];
+
+    //
+    // Scatter the datagram straight into the packet's own storage:
+    // AftPacket header into header(), packet bytes into data().
+    //
+    iov[0].iov_base = pkt->header();
+    iov[0].iov_len  = pkt->headerSize();
+    iov[1].iov_base = pkt->data();
+    iov[1].iov_len  = AFI_HP_PKT_MAX - pkt->headerSize();
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = iov;
+    msg.msg_iovlen     = 2;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    // Block (unless fd is non-blocking) until data has been received
+    // successfully or an error occurs.
+    do {
+        recvlen = recvmsg(fd, &msg, 0);
+    } while ((recvlen < 0) && (errno == EINTR));
+
+    if (recvlen < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            perror("recvmsg");
+        }
+        return -1;
     }
 
-    AftPacketPtr pkt = AftPacket::createTransmit(
-                                       l2PacketLen, sandboxId,
-                                       portIndex, AftPacket::PacketTypeL2);
+    hpRxTimestamp(msg, rxNs);
 
-    //
-    // Get base of packet data.
-    // This is in the buffer immediately after the header.
-    //
-    uint8_t *pktData = pkt->data();
+    return hpRecvParse(pkt, recvlen, (msg.msg_flags & MSG_TRUNC) != 0);
+}
+
+//
+// @fn
+// hpRecvParse
+//
+// @brief
+// Validate and parse a hostpath packet received into an AftPacket
+//
+// @param[in]
+//     pkt Aft packet the packet was received into
+// @param[in]
+//     recvlen Received length
+// @param[in]
+//     truncated True if the datagram did not fit into the packet
+// @return 0 - Success, -1 - Error (errno EBADMSG)
+//
+
+int
+AfiClient::hpRecvParse(AftPacketPtr &pkt, size_t recvlen, bool truncated)
+{
+    if ((recvlen < pkt->headerSize()) || truncated) {
+        AFI_TRACE(AFI_TRACE_EV_HP_DROP, 0, 0, 0, truncated ? MSG_TRUNC : 0,
+                  pkt->header(), std::min<size_t>(recvlen, AFI_HP_PKT_MAX));
+        errno = EBADMSG;
+        return -1;
+    }
+
+    pkt->headerParse();
 
     //
-    // Fill the pktData with 'L2 packet to be injected'
+    // The header's data size must be covered by what was received
     //
-    memcpy(pktData, l2Packet, l2PacketLen);
-
-    pktTrace("xmit pkt ", (char *)(pkt->header()), pkt->size());
+    if ((size_t)pkt->dataSize() > recvlen - pkt->headerSize()) {
+        AFI_TRACE(AFI_TRACE_EV_HP_DROP, 0, 0, 0, EBADMSG,
+                  pkt->header(), recvlen);
+        errno = EBADMSG;
+        return -1;
+    }
 
-    _hpUdpSock.send_to(boost::asio::buffer(pkt->header(), pkt->size()),
-                                      _vmxtHostpathEndpoint);
+    AFI_TRACE(AFI_TRACE_EV_HP_RECV, pkt->sandboxId(), pkt->portIndex(), 0, 0,
+              pkt->data(), pkt->dataSize());
 
     return 0;
 }
 
 //
 // @fn
-// handleCliCommand
+// hpRecvMmsg
 //
 // @brief
-// Handle CLI command
+// Receive and queue up to maxPkts hostpath packets with one recvmmsg.
+// Packets left over (not received into) stay with the receiver for the
+// next call.
 //
-// @param[in] 
-//     command_str CLI command string
-// @return void
+// @param[in]
+//     rcvr Receiver
+// @param[in]
+//     maxPkts Maximum number of packets
+// @param[in]
+//     nowNs Receive time (CLOCK_MONOTONIC)
+// @return Number of packets received
 //
 
-void
-AfiClient::handleCliCommand(std::string const & command_str)
+int
+AfiClient::hpRecvMmsg(AfiHpRcvr &rcvr, int maxPkts, uint64_t nowNs)
 {
-    std::vector<std::string> command_sub_strings;
-    boost::split(command_sub_strings, command_str, boost::is_any_of("\t "));
+    for (int i = 0; i < maxPkts; i++) {
+        AftPacketPtr &pkt = rcvr.mmsgPkts[i];
+        if (pkt) {
+            continue;
+        }
 
-    std::string command = command_sub_strings.at(0);
+        pkt = rcvr.pool.getReceive();
+        rcvr.mmsgIov[i][0].iov_base = pkt->header();
+        rcvr.mmsgIov[i][0].iov_len  = pkt->headerSize();
+        rcvr.mmsgIov[i][1].iov_base = pkt->data();
+        rcvr.mmsgIov[i][1].iov_len  = AFI_HP_PKT_MAX - pkt->headerSize();
+
+        memset(&rcvr.mmsg[i], 0, sizeof(rcvr.mmsg[i]));
+        rcvr.mmsg[i].msg_hdr.msg_iov        = rcvr.mmsgIov[i];
+        rcvr.mmsg[i].msg_hdr.msg_iovlen     = 2;
+        rcvr.mmsg[i].msg_hdr.msg_control    = rcvr.mmsgCtrl[i];
+        rcvr.mmsg[i].msg_hdr.msg_controllen = AFI_HP_RX_CTRL_SIZE;
+    }
 
-    std::vector<std::string> command_args;
-    for(int t=0; t < command_sub_strings.size(); ++t){
-        if ((t != 0) && (!command_sub_strings.at(t).empty())) {
-            command_args.push_back(command_sub_strings.at(t));
+    int ret;
+    do {
+        ret = recvmmsg(rcvr.sock->native_handle(), rcvr.mmsg, maxPkts,
+                       MSG_DONTWAIT, NULL);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            perror("recvmmsg");
+            afiStatBump(rcvr.stats.rxErrors);
         }
+        return 0;
     }
 
-    if (command_args.size() > 0) {
-        std::string command_arg1 = command_args.at(0);
-    }
-    if (command_args.size() > 1) {
-        std::string command_arg1 = command_args.at(1);
+    uint64_t batchNs = afiRealtimeNs();
+    for (int i = 0; i < ret; i++) {
+        AftPacketPtr pkt;
+        uint64_t     rxNs = batchNs;
+        pkt.swap(rcvr.mmsgPkts[i]);
+
+        if (hpRecvParse(pkt, rcvr.mmsg[i].msg_len,
+                        (rcvr.mmsg[i].msg_hdr.msg_flags & MSG_TRUNC) != 0)
+            != 0) {
+            afiStatBump(rcvr.stats.rxErrors);
+            pkt.swap(rcvr.mmsgPkts[i]);
+            continue;
+        }
+
+        afiStatBump(rcvr.stats.rxPkts);
+        afiStatBump(rcvr.stats.rxBytes, pkt->headerSize() + pkt->dataSize());
+
+        hpRxTimestamp(rcvr.mmsg[i].msg_hdr, rxNs);
+        hpQueue(rcvr, pkt, nowNs, rxNs);
     }
 
-    if ((command.compare("help") == 0) ||
-        (command.compare("h")    == 0) ||
-        (command.compare("?")    == 0)) {
-        std::cout << "\tSupported commands:" << std::endl;
-        std::cout << "\t open-sb <sandbox-name> <num-configured-ports>" << std::endl;
-        std::cout << "\t          num-configured-ports : Number of configured ports through Junos CLI" << std::endl;
-        std::cout << "\t create-rtt <rtt-name> <default-target-node-token>" << std::endl;
-        std::cout << "\t create-index-table <table-size>" << std::endl;
-        std::cout << "\t add-index-table-entry <index-table-token> <entry-index> <entry-target-token>" << std::endl;
+    return ret;
+}
+
+//
+// @fn
+// hpRcvStart
+//
+// @brief
+// Start an asynchronous receive into a packet from the receiver's pool.
+// MSG_TRUNC makes the completion report the full datagram length, so
+// that datagrams larger than the packet are detected.
+//
+// @param[in]
+//     rcvr Receiver
+// @return void
+//
+
+void
+AfiClient::hpRcvStart(AfiHpRcvr &rcvr)
+{
+    rcvr.rcvPkt     = rcvr.pool.getReceive();
+    rcvr.rcvBufs[0] = boost::asio::buffer(rcvr.rcvPkt->header(),
+                                          rcvr.rcvPkt->headerSize());
+    rcvr.rcvBufs[1] = boost::asio::buffer(rcvr.rcvPkt->data(),
+                              AFI_HP_PKT_MAX - rcvr.rcvPkt->headerSize());
+
+    rcvr.sock->async_receive_from(rcvr.rcvBufs, rcvr.sender, MSG_TRUNC,
+        afiMakeAllocHandler(rcvr.rcvMem,
+            [this, &rcvr](const boost::system::error_code &ec,
+                          size_t                           recvlen) {
+                this->hpRcvDone(rcvr, ec, recvlen);
+            }));
+}
+
+//
+// Receive errors that can pass: anything else (e.g. a closed socket)
+// would fail again on every receive
+//
+static bool
+hpRcvErrTransient (const boost::system::error_code &ec)
+{
+    return (ec == boost::asio::error::would_block) ||
+           (ec == boost::asio::error::try_again) ||
+           (ec == boost::asio::error::interrupted) ||
+           (ec == boost::asio::error::no_buffer_space) ||
+           (ec == boost::asio::error::no_memory) ||
+           (ec == boost::asio::error::message_size);
+}
+
+//
+// @fn
+// hpRcvDone
+//
+// @brief
+// Receive completion. Queues the received packet, then reads what
+// else is pending on the socket (up to AFI_HP_RCV_BUDGET packets)
+// before the next asynchronous receive is started. The asynchronous
+// receive does not return the kernel timestamp; its packet counts as
+// received at completion. The receiver stops on an error that is not
+// transient.
+//
+// @param[in]
+//     rcvr Receiver
+// @param[in]
+//     ec Receive status
+// @param[in]
+//     recvlen Received (datagram) length
+// @return void
+//
+
+void
+AfiClient::hpRcvDone(AfiHpRcvr                       &rcvr,
+                     const boost::system::error_code &ec,
+                     size_t                           recvlen)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    if (ec && !hpRcvErrTransient(ec)) {
+        afiStatBump(rcvr.stats.rxErrors);
+        std::cout << "Hostpath receiver " << rcvr.id << " stopped: ";
+        std::cout << ec.message() << std::endl;
+        return;
+    }
+
+    AftPacketPtr pkt;
+    uint64_t     nowNs   = afiMonotonicNs();
+    uint64_t     batchNs = afiRealtimeNs();
+    pkt.swap(rcvr.rcvPkt);
+
+    for (int numRcvd = 0; numRcvd < AFI_HP_RCV_BUDGET; numRcvd++) {
+        uint64_t rxNs = batchNs;
+
+        if (numRcvd == 0) {
+            if (ec ||
+                (hpRecvParse(pkt, recvlen, recvlen > AFI_HP_PKT_MAX) != 0)) {
+                afiStatBump(rcvr.stats.rxErrors);
+                continue;
+            }
+        } else if (_hpEngine.load(std::memory_order_relaxed) ==
+                   AfiHpEngineRecvmmsg) {
+            hpRecvMmsg(rcvr, AFI_HP_RCV_BUDGET - numRcvd, nowNs);
+            break;
+        } else {
+            pkt = rcvr.pool.getReceive();
+            if (hpRecv(rcvr.sock->native_handle(), pkt, rxNs) != 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                    break;
+                }
+                afiStatBump(rcvr.stats.rxErrors);
+                continue;
+            }
+        }
+
+        afiStatBump(rcvr.stats.rxPkts);
+        afiStatBump(rcvr.stats.rxBytes, pkt->headerSize() + pkt->dataSize());
+
+        hpQueue(rcvr, pkt, nowNs, rxNs);
+    }
+
+    hpRcvStart(rcvr);
+}
+
+//
+// @fn
+// hpUringStart
+//
+// @brief
+// Set up the io_uring engine: a receive ring with a provided buffer
+// ring and a multishot recvmsg on the receiver's socket, run by its
+// own thread, and a send ring for injected packets
+//
+// @param[in]
+//     rcvr Receiver
+// @return 0 - Success, -1 - io_uring not available
+//
+
+int
+AfiClient::hpUringStart(AfiHpRcvr &rcvr)
+{
+#ifdef AFI_HAVE_IO_URING
+    _hpRxUring.reset(new AfiUring());
+    if ((_hpRxUring->init(AFI_HP_URING_ENTRIES) != 0) ||
+        (_hpRxUring->bufRingSetup(0, AFI_HP_URING_BUFS,
+                                  AFI_HP_URING_BUF_SIZE) != 0)) {
+        perror("io_uring(receive)");
+        _hpRxUring.reset();
+        return -1;
+    }
+
+    _hpUringStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_hpUringStopFd < 0) {
+        perror("eventfd");
+        _hpRxUring.reset();
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe = _hpRxUring->getSqe();
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = _hpUringStopFd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data     = AFI_HP_URING_STOP;
+
+    //
+    // Completions carry sender address, receive timestamp and datagram
+    // in one buffer
+    //
+    memset(&_hpUringMsg, 0, sizeof(_hpUringMsg));
+    _hpUringMsg.msg_namelen    = sizeof(struct sockaddr_in);
+    _hpUringMsg.msg_controllen = AFI_HP_RX_CTRL_SIZE;
+
+    if ((hpUringRecvArm(rcvr) != 0) || (_hpRxUring->submit() < 0)) {
+        perror("io_uring_enter(receive)");
+        _hpRxUring.reset();
+        return -1;
+    }
+
+    //
+    // Injected packets: without a send ring they go out with sendmmsg
+    //
+    _hpTxUring.reset(new AfiUring());
+    if (_hpTxUring->init(AFI_HP_TX_BATCH_MAX) != 0) {
+        perror("io_uring(send)");
+        _hpTxUring.reset();
+    }
+
+    _threads.push_back(std::thread( [this, &rcvr] {
+                                        this->hpUringLoop(rcvr);
+                                    } ));
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+//
+// @fn
+// hpUringRecvArm
+//
+// @brief
+// Queue a multishot recvmsg: it completes once per datagram, each into
+// a buffer of the provided buffer ring, until it runs out of buffers
+//
+// @param[in]
+//     rcvr Receiver
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpUringRecvArm(AfiHpRcvr &rcvr)
+{
+#ifdef AFI_HAVE_IO_URING
+    struct io_uring_sqe *sqe = _hpRxUring->getSqe();
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = rcvr.sock->native_handle();
+    sqe->addr      = (uint64_t)(uintptr_t)&_hpUringMsg;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = AFI_HP_URING_RECV;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+//
+// @fn
+// hpUringLoop
+//
+// @brief
+// io_uring receive thread: handles receive completions in batches,
+// gives the buffers back to the kernel once per batch. Falls back to
+// reactor receives if the kernel does not do multishot recvmsg.
+//
+// @param[in]
+//     rcvr Receiver
+// @return void
+//
+
+void
+AfiClient::hpUringLoop(AfiHpRcvr &rcvr)
+{
+#ifdef AFI_HAVE_IO_URING
+    AfiUring &ring = *_hpRxUring;
+    bool      stop = false;
+
+    while (!stop) {
+        if (ring.submit(1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("io_uring_enter(receive)");
+            break;
+        }
+
+        uint64_t nowNs       = afiMonotonicNs();
+        bool     rearm       = false;
+        bool     unsupported = false;
+
+        ring.reap([&](const struct io_uring_cqe &cqe) {
+            if (cqe.user_data == AFI_HP_URING_STOP) {
+                stop = true;
+                return;
+            }
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                uint16_t bufId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe.res > 0) {
+                    hpUringRecv(rcvr, ring.buf(bufId), cqe.res, nowNs);
+                }
+                ring.bufReturn(bufId);
+            } else if (cqe.res == -EINVAL) {
+                unsupported = true;
+            } else if (cqe.res < 0) {
+                //
+                // -ENOBUFS: all buffers in use, datagrams wait in the
+                // socket until the multishot receive is queued again
+                //
+                if (cqe.res != -ENOBUFS) {
+                    afiStatBump(rcvr.stats.rxErrors);
+                }
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                rearm = true;
+            }
+        });
+        ring.bufCommit();
+
+        if (unsupported) {
+            std::cout << "io_uring multishot recvmsg not supported, ";
+            std::cout << "using reactor receives" << std::endl;
+            _hpIoService.post([this, &rcvr] {
+                this->_hpEngine = AfiHpEngineAsio;
+                this->hpRcvStart(rcvr);
+            });
+            break;
+        }
+
+        if (rearm && !stop && (hpUringRecvArm(rcvr) != 0)) {
+            std::cout << "io_uring receive ring full" << std::endl;
+            break;
+        }
+    }
+#endif
+}
+
+//
+// @fn
+// hpUringRecv
+//
+// @brief
+// Copy a datagram received by io_uring into a packet and queue it
+//
+// @param[in]
+//     rcvr Receiver
+// @param[in]
+//     buf Receive buffer (io_uring_recvmsg_out, address, control,
+//         datagram)
+// @param[in]
+//     len Bytes used in receive buffer
+// @param[in]
+//     nowNs Receive time (CLOCK_MONOTONIC)
+// @return void
+//
+
+void
+AfiClient::hpUringRecv(AfiHpRcvr     &rcvr,
+                       const uint8_t *buf,
+                       size_t         len,
+                       uint64_t       nowNs)
+{
+#ifdef AFI_HAVE_IO_URING
+    const struct io_uring_recvmsg_out *out =
+                                (const struct io_uring_recvmsg_out *)buf;
+    size_t off = sizeof(*out) + _hpUringMsg.msg_namelen +
+                 _hpUringMsg.msg_controllen;
+
+    if (len < off) {
+        afiStatBump(rcvr.stats.rxErrors);
+        return;
+    }
+
+    AftPacketPtr   pkt     = rcvr.pool.getReceive();
+    const uint8_t *dgram   = buf + off;
+    uint64_t       rxNs    = 0;
+    struct msghdr  ctrl;
+    size_t         avail   = std::min<size_t>(len - off, AFI_HP_PKT_MAX);
+    size_t         hdrLen  = std::min<size_t>(avail, pkt->headerSize());
+
+    memcpy(pkt->header(), dgram, hdrLen);
+    memcpy(pkt->data(), dgram + hdrLen, avail - hdrLen);
+
+    if (hpRecvParse(pkt, out->payloadlen,
+                    (out->flags & MSG_TRUNC) ||
+                    (out->payloadlen > AFI_HP_PKT_MAX)) != 0) {
+        afiStatBump(rcvr.stats.rxErrors);
+        return;
+    }
+
+    afiStatBump(rcvr.stats.rxPkts);
+    afiStatBump(rcvr.stats.rxBytes, pkt->headerSize() + pkt->dataSize());
+
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.msg_control    = (void *)(buf + sizeof(*out) + _hpUringMsg.msg_namelen);
+    ctrl.msg_controllen = out->controllen;
+    hpRxTimestamp(ctrl, rxNs);
+    if (rxNs == 0) {
+        rxNs = afiRealtimeNs();
+    }
+
+    hpQueue(rcvr, pkt, nowNs, rxNs);
+#endif
+}
+
+//
+// @fn
+// hpUringStop
+//
+// @brief
+// Stop the io_uring receive thread
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiClient::hpUringStop(void)
+{
+#ifdef AFI_HAVE_IO_URING
+    uint64_t one = 1;
+
+    if ((_hpUringStopFd >= 0) &&
+        (write(_hpUringStopFd, &one, sizeof(one)) < 0)) {
+        perror("write(eventfd)");
+    }
+#endif
+}
+
+//
+// @fn
+// hpShmCopy
+//
+// @brief
+// Copy a frame of the shared memory channel into a receive packet
+// (header and data, as hostpath datagrams are scattered)
+//
+// @param[in]
+//     pkt Receive packet
+// @param[in]
+//     frame Frame
+// @param[in]
+//     frameLen Frame length
+// @return void
+//
+
+static void
+hpShmCopy (AftPacketPtr &pkt, const uint8_t *frame, size_t frameLen)
+{
+    size_t avail  = std::min<size_t>(frameLen, AFI_HP_PKT_MAX);
+    size_t hdrLen = std::min<size_t>(avail, pkt->headerSize());
+
+    memcpy(pkt->header(), frame, hdrLen);
+    memcpy(pkt->data(), frame + hdrLen, avail - hdrLen);
+}
+
+//
+// @fn
+// hpShmStart
+//
+// @brief
+// Start receiving punted packets from the shared memory channel on
+// the reactor. The channel's doorbell eventfd is watched by the
+// reactor while the punt ring is empty.
+//
+// @param[in]
+//     rcvr Receiver
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpShmStart(AfiHpRcvr &rcvr)
+{
+    if (!_hpShm) {
+        return -1;
+    }
+
+    //
+    // The descriptor closes its own duplicate of the doorbell
+    //
+    boost::system::error_code ec;
+    int fd = dup(_hpShm->recvFd());
+    if (fd < 0) {
+        perror("dup(hostpath doorbell)");
+        return -1;
+    }
+    _hpShmDoorbell.reset(new boost::asio::posix::stream_descriptor(_hpIoService));
+    _hpShmDoorbell->assign(fd, ec);
+    if (ec) {
+        close(fd);
+        std::cout << "Hostpath doorbell: " << ec.message() << std::endl;
+        return -1;
+    }
+
+    _hpIoService.post(afiMakeAllocHandler(rcvr.rcvMem,
+                        [this, &rcvr] { this->hpShmRecv(rcvr); }));
+    return 0;
+}
+
+//
+// @fn
+// hpShmRecv
+//
+// @brief
+// Queue up to AFI_HP_RCV_BUDGET packets from the punt ring. Goes on
+// right away when there may be more, otherwise sleeps on the doorbell.
+// Packets of a batch count as received when the batch is taken.
+//
+// @param[in]
+//     rcvr Receiver
+// @return void
+//
+
+void
+AfiClient::hpShmRecv(AfiHpRcvr &rcvr)
+{
+    if (!_hpShmDoorbell->is_open()) {
+        return;                 // Client going away
+    }
+
+    uint64_t    nowNs = afiMonotonicNs();
+    uint64_t    rxNs  = afiRealtimeNs();
+    AfiShmRing &ring  = _hpShm->recvRing();
+    uint64_t    bad   = ring.badRecords();
+
+    unsigned numRcvd = ring.pop(
+        [this, &rcvr, nowNs, rxNs](const uint8_t *frame, uint32_t len) {
+            AftPacketPtr pkt = rcvr.pool.getReceive();
+
+            hpShmCopy(pkt, frame, len);
+            if (hpRecvParse(pkt, len, len > AFI_HP_PKT_MAX) != 0) {
+                afiStatBump(rcvr.stats.rxErrors);
+                return;
+            }
+
+            afiStatBump(rcvr.stats.rxPkts);
+            afiStatBump(rcvr.stats.rxBytes, len);
+            hpQueue(rcvr, pkt, nowNs, rxNs);
+        }, AFI_HP_RCV_BUDGET);
+
+    if (ring.badRecords() != bad) {
+        afiStatBump(rcvr.stats.rxErrors, ring.badRecords() - bad);
+    }
+
+    if ((numRcvd == AFI_HP_RCV_BUDGET) || !ring.waitArm()) {
+        _hpIoService.post(afiMakeAllocHandler(rcvr.rcvMem,
+                            [this, &rcvr] { this->hpShmRecv(rcvr); }));
+        return;
+    }
+
+    _hpShmDoorbell->async_read_some(boost::asio::null_buffers(),
+        afiMakeAllocHandler(rcvr.rcvMem,
+            [this, &rcvr](const boost::system::error_code &ec, size_t) {
+                if (ec) {
+                    return;     // Aborted or closed
+                }
+                this->_hpShm->recvAck();
+                this->hpShmRecv(rcvr);
+            }));
+}
+
+//
+// @fn
+// hpShmRecvSync
+//
+// @brief
+// Receive one punted packet from the shared memory channel, waiting
+// for it if the punt ring is empty
+//
+// @param[in]
+//     pkt Aft packet the received packet is copied into
+// @param[in]
+//     deadlineNs Wait until (CLOCK_MONOTONIC), 0 - no limit
+// @return 0 - Success, -1 - Error (errno ETIMEDOUT: timed out)
+//
+
+int
+AfiClient::hpShmRecvSync(AftPacketPtr &pkt, uint64_t deadlineNs)
+{
+    if (!_hpShm) {
+        return -1;
+    }
+
+    AfiShmRing &ring = _hpShm->recvRing();
+    int         ret  = -1;
+    auto        copy = [this, &pkt, &ret](const uint8_t *frame, uint32_t len) {
+        hpShmCopy(pkt, frame, len);
+        ret = hpRecvParse(pkt, len, len > AFI_HP_PKT_MAX);
+    };
+
+    while (ring.pop(copy, 1) == 0) {
+        if (ring.waitArm()) {
+            if (hpRecvWait(_hpShm->recvFd(), deadlineNs,
+                           "poll(hostpath doorbell)") != 0) {
+                return -1;
+            }
+            _hpShm->recvAck();
+        }
+    }
+
+    return ret;
+}
+
+//
+// @fn
+// hpShmSend
+//
+// @brief
+// Append a frame to the inject ring of the shared memory channel. A
+// full ring is waited on (the peer is kicked) for up to
+// AFI_HP_SHM_TX_WAIT_MS.
+//
+// @param[in]
+//     frame Frame (AftPacket header and layer 2 packet)
+// @param[in]
+//     frameLen Frame length
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpShmSend(const void *frame, size_t frameLen)
+{
+    uint64_t startNs = 0;
+
+    if (!_hpShm) {
+        std::cout << "No hostpath channel" << std::endl;
+        return -1;
+    }
+    if (frameLen > AFI_SHM_FRAME_MAX) {
+        std::cout << "l2Packet too large for hostpath channel" << std::endl;
+        return -1;
+    }
+
+    while (!_hpShm->send(frame, frameLen)) {
+        uint64_t nowNs = afiMonotonicNs();
+
+        if (startNs == 0) {
+            startNs = nowNs;
+            _hpShm->kick();
+        } else if (nowNs - startNs > AFI_HP_SHM_TX_WAIT_MS * 1000000ULL) {
+            std::cout << "Hostpath channel full" << std::endl;
+            return -1;
+        }
+        std::this_thread::yield();
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// hpSandbox
+//
+// @brief
+// Hostpath context of a sandbox, created on first packet
+//
+// @param[in]
+//     rcvr Receiver (caches the last sandbox it used)
+// @param[in]
+//     sandboxId Sandbox Id
+// @return Sandbox hostpath context
+//
+
+AfiHpSandboxPtr &
+AfiClient::hpSandbox(AfiHpRcvr &rcvr, AftSandboxId sandboxId)
+{
+    if (rcvr.sbCache && (rcvr.sbCache->id == sandboxId) &&
+        !rcvr.sbCache->aged.load(std::memory_order_relaxed)) {
+        return rcvr.sbCache;
+    }
+
+    std::lock_guard<spinlock> guard(_hpSbLock);
+    AfiHpSandboxPtr &sb = _hpSandboxes[sandboxId];
+    if (!sb) {
+        sb = std::make_shared<AfiHpSandbox>(_hpIoService, sandboxId);
+        hpRateApply(*sb);
+    }
+    rcvr.sbCache = sb;
+
+    return rcvr.sbCache;
+}
+
+//
+// @fn
+// hpQueue
+//
+// @brief
+// Queue a received packet to its sandbox unless it exceeds its port's
+// rate limit. The first packet queued to an empty queue posts a drain
+// to the sandbox strand.
+//
+// @param[in]
+//     rcvr Receiver that received the packet
+// @param[in]
+//     pkt Received packet
+// @param[in]
+//     nowNs Time the packet was received (CLOCK_MONOTONIC)
+// @param[in]
+//     rxNs Time the packet was received (CLOCK_REALTIME, kernel's
+//          timestamp if available)
+// @return void
+//
+
+void
+AfiClient::hpQueue(AfiHpRcvr    &rcvr,
+                   AftPacketPtr &pkt,
+                   uint64_t      nowNs,
+                   uint64_t      rxNs)
+{
+    AfiHpSandboxPtr &sb = hpSandbox(rcvr, pkt->sandboxId());
+    bool             post;
+
+    //
+    // Dropped packets keep the sandbox from aging out too: a sandbox
+    // created anew would start with full token buckets
+    //
+    if (!sb->active.load(std::memory_order_relaxed)) {
+        sb->active.store(true, std::memory_order_relaxed);
+    }
+
+    if (!sb->portBucket(pkt->portIndex()).admit(nowNs)) {
+        sb->stats.rateDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    {
+        std::lock_guard<spinlock> guard(sb->queueLock);
+        if (sb->queue.size() >= AFI_HP_SB_Q_MAX) {
+            sb->stats.queueDrops.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        post = sb->queue.empty();
+        sb->queue.push_back(pkt);
+        sb->queueTs.push_back(rxNs);
+    }
+    sb->stats.queued.fetch_add(1, std::memory_order_relaxed);
+
+    if (post) {
+        AfiHpSandboxPtr sbRef = sb;
+        sb->strand.post(afiMakeAllocHandler(sb->drainMem,
+                            [this, sbRef] { this->hpDrain(sbRef); }));
+    }
+}
+
+//
+// @fn
+// hpDrain
+//
+// @brief
+// Process the packets queued to a sandbox. Runs on the sandbox strand.
+//
+// @param[in]
+//     sb Sandbox hostpath context
+// @return void
+//
+
+void
+AfiClient::hpDrain(AfiHpSandboxPtr sb)
+{
+    {
+        std::lock_guard<spinlock> guard(sb->queueLock);
+        sb->queue.swap(sb->batch);
+        sb->queueTs.swap(sb->batchTs);
+    }
+
+    afiStatBump(sb->stats.drains);
+    hpProcess(*sb, sb->batch, sb->batchTs);
+
+    // Keeps capacity: queueing does not allocate in steady state
+    sb->batch.clear();
+    sb->batchTs.clear();
+}
+
+//
+// @fn
+// hpProcess
+//
+// @brief
+// Process a batch of hostpath packets on their sandbox strand:
+// capture them if capturing, then hand them to the punt handlers
+// registered for them. Each packet's latencies are recorded in its
+// port's statistics; the handlers of a batch complete together.
+//
+// @param[in]
+//     sb Sandbox hostpath context
+// @param[in]
+//     pkts Received packets (cleared on return)
+// @param[in]
+//     rxTs Receive times of the packets (CLOCK_REALTIME)
+// @return void
+//
+
+void
+AfiClient::hpProcess(AfiHpSandbox                &sb,
+                     AfiPktBatch                 &pkts,
+                     const std::vector<uint64_t> &rxTs)
+{
+    uint64_t dispatchNs = afiRealtimeNs();
+    size_t   numPkts    = pkts.size();
+
+    afiStatBump(sb.stats.processed, numPkts);
+
+    sb.batchStats.clear();
+    for (size_t i = 0; i < numPkts; i++) {
+        AfiHpPortStats &ps = hpPortStats(sb, pkts[i]->portIndex());
+
+        ps.punt.add(pkts[i]->dataSize());
+        ps.puntQueue.record((dispatchNs > rxTs[i]) ? dispatchNs - rxTs[i] : 0);
+        sb.batchStats.push_back(&ps);
+    }
+
+    if (_capture.isOpen()) {
+        for (auto &pkt : pkts) {
+            _capture.capture(pkt->sandboxId(), pkt->portIndex(),
+                             AfiPcapWriter::DirInbound,
+                             pkt->data(), pkt->dataSize());
+        }
+    }
+
+    _puntDispatcher.dispatch(pkts, sb.puntScratch);
+
+    uint64_t doneNs = afiRealtimeNs();
+    for (size_t i = 0; i < numPkts; i++) {
+        sb.batchStats[i]->puntHandler.record(doneNs - dispatchNs);
+        sb.batchStats[i]->puntTotal.record((doneNs > rxTs[i]) ?
+                                           doneNs - rxTs[i] : 0);
+    }
+}
+
+//
+// @fn
+// hpPortStats
+//
+// @brief
+// Latency and rate statistics of a sandbox port, created on first use.
+// Ports beyond AFI_HP_SB_PORTS_MAX - 1 share the last port's.
+//
+// @param[in]
+//     sandboxId Sandbox Id
+// @param[in]
+//     portIndex Port index
+// @return Port statistics
+//
+
+AfiHpPortStats &
+AfiClient::hpPortStats (AftSandboxId sandboxId, AftIndex portIndex)
+{
+    AfiSbPort key(sandboxId, std::min<AftIndex>(portIndex,
+                                                AFI_HP_SB_PORTS_MAX - 1));
+
+    std::lock_guard<spinlock> guard(_hpStatsLock);
+    std::unique_ptr<AfiHpPortStats> &ps = _hpPortStats[key];
+    if (!ps) {
+        ps.reset(new AfiHpPortStats());
+    }
+
+    return *ps;
+}
+
+//
+// @fn
+// hpPortStats
+//
+// @brief
+// Port statistics of a sandbox, cached in the sandbox context (on the
+// sandbox strand)
+//
+// @param[in]
+//     sb Sandbox hostpath context
+// @param[in]
+//     portIndex Port index
+// @return Port statistics
+//
+
+AfiHpPortStats &
+AfiClient::hpPortStats (AfiHpSandbox &sb, AftIndex portIndex)
+{
+    AfiHpPortStats *&ps = sb.portStats[std::min<AftIndex>(portIndex,
+                                                 AFI_HP_SB_PORTS_MAX - 1)];
+    if (!ps) {
+        ps = &hpPortStats(sb.id, portIndex);
+    }
+
+    return *ps;
+}
+
+//
+// @fn
+// hpPortStatsList
+//
+// @brief
+// Statistics of all ports that punted or injected packets. Port
+// statistics live as long as the client, so they can be read
+// without holding _hpStatsLock.
+//
+// @param[in] void
+// @return (sandbox, port) and statistics, in sandbox and port order
+//
+
+std::vector<std::pair<AfiClient::AfiSbPort, AfiHpPortStats *>>
+AfiClient::hpPortStatsList (void)
+{
+    std::vector<std::pair<AfiSbPort, AfiHpPortStats *>> list;
+
+    std::lock_guard<spinlock> guard(_hpStatsLock);
+    for (auto &it : _hpPortStats) {
+        list.push_back(std::make_pair(it.first, it.second.get()));
+    }
+
+    return list;
+}
+
+//
+// @fn
+// hpPortStatsShow
+//
+// @brief
+// Display punt and inject latency percentiles (in microseconds) and
+// rates of the last second per sandbox port
+//
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+AfiClient::hpPortStatsShow (std::ostream &os)
+{
+    struct {
+        const char                    *name;
+        AfiHistogram AfiHpPortStats::*hist;
+        AfiRateMeter AfiHpPortStats::*meter;
+    } const stages[] = {
+        { "punt-queue",   &AfiHpPortStats::puntQueue,   &AfiHpPortStats::punt },
+        { "punt-handler", &AfiHpPortStats::puntHandler, nullptr },
+        { "punt-total",   &AfiHpPortStats::puntTotal,   nullptr },
+        { "inject-send",  &AfiHpPortStats::injectSend,  &AfiHpPortStats::inject },
+    };
+
+    os << "Sandbox  Port  Stage              Count    p50 us    p99 us";
+    os << "  p99.9 us    max us       pps          bps" << std::endl;
+
+    for (auto &it : hpPortStatsList()) {
+        for (auto &stage : stages) {
+            const AfiHistogram &h = (*it.second).*(stage.hist);
+            if (h.count() == 0) {
+                continue;
+            }
+
+            os << std::setw(7) << it.first.first;
+            os << std::setw(6) << it.first.second << "  ";
+            os << std::left << std::setw(13) << stage.name << std::right;
+            os << std::setw(11) << h.count();
+            os << std::fixed << std::setprecision(1);
+            os << std::setw(10) << h.percentile(0.50)  / 1e3;
+            os << std::setw(10) << h.percentile(0.99)  / 1e3;
+            os << std::setw(10) << h.percentile(0.999) / 1e3;
+            os << std::setw(10) << h.max() / 1e3;
+            if (stage.meter) {
+                const AfiRateMeter &m = (*it.second).*(stage.meter);
+                os << std::setw(10) << m.pps.load();
+                os << std::setw(13) << m.bps.load();
+            }
+            os << std::endl;
+        }
+    }
+}
+
+//
+// @fn
+// hpPortStatsDump
+//
+// @brief
+// Write punt and inject latency percentiles (in ns) and rates per
+// sandbox port as JSON
+//
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+AfiClient::hpPortStatsDump (std::ostream &os)
+{
+    auto hist = [&os](const char *name, const AfiHistogram &h) {
+        os << "\"" << name << "\": {\"count\": " << h.count();
+        os << ", \"mean\": " << h.mean();
+        os << ", \"p50\": " << h.percentile(0.50);
+        os << ", \"p99\": " << h.percentile(0.99);
+        os << ", \"p999\": " << h.percentile(0.999);
+        os << ", \"max\": " << h.max() << "}";
+    };
+    auto meter = [&os](const AfiRateMeter &m) {
+        os << "\"pkts\": " << m.pkts.load();
+        os << ", \"bytes\": " << m.bytes.load();
+        os << ", \"pps\": " << m.pps.load();
+        os << ", \"bps\": " << m.bps.load();
+    };
+
+    os << "{\"hostpath_port_stats\": [";
+
+    const char *sep = "";
+    for (auto &it : hpPortStatsList()) {
+        const AfiHpPortStats &ps = *it.second;
+
+        os << sep << std::endl;
+        os << "  {\"sandbox\": " << it.first.first;
+        os << ", \"port\": " << it.first.second << "," << std::endl;
+        os << "   \"punt\": {";
+        meter(ps.punt);
+        os << ", ";
+        hist("queue_ns", ps.puntQueue);
+        os << ", ";
+        hist("handler_ns", ps.puntHandler);
+        os << ", ";
+        hist("total_ns", ps.puntTotal);
+        os << "}," << std::endl;
+        os << "   \"inject\": {";
+        meter(ps.inject);
+        os << ", ";
+        hist("send_ns", ps.injectSend);
+        os << "}}";
+        sep = ",";
+    }
+    os << std::endl << "]}" << std::endl;
+}
+
+//
+// @fn
+// setPuntRateLimit
+//
+// @brief
+// Limit the rate of packets punted by a sandbox port that the client
+// accepts. The most specific limit applies to a port: (sandbox, port),
+// (sandbox, any port), (any sandbox, port), (any sandbox, any port).
+// Ports without a limit (the default) are not limited.
+//
+// @param[in]
+//     sandboxId Sandbox Id or AfiPuntDispatcher::AnySandbox
+// @param[in]
+//     portIndex Input port index or AfiPuntDispatcher::AnyPort
+// @param[in]
+//     pps Packets per second, 0 - Unlimited
+// @param[in]
+//     burst Burst size in packets
+// @return void
+//
+
+void
+AfiClient::setPuntRateLimit (AftSandboxId sandboxId,
+                             AftIndex     portIndex,
+                             uint64_t     pps,
+                             uint64_t     burst)
+{
+    {
+        std::lock_guard<spinlock> guard(_hpRateLock);
+        _hpRateLimits[AfiSbPort(sandboxId, portIndex)] =
+                                                AfiRateBurst(pps, burst);
+    }
+
+    std::lock_guard<spinlock> guard(_hpSbLock);
+    for (auto &it : _hpSandboxes) {
+        hpRateApply(*it.second);
+    }
+}
+
+//
+// @fn
+// hpRateApply
+//
+// @brief
+// Configure the port token buckets of a sandbox from the rate limits
+//
+// @param[in]
+//     sb Sandbox hostpath context
+// @return void
+//
+
+void
+AfiClient::hpRateApply (AfiHpSandbox &sb)
+{
+    const AftSandboxId anySb   = AfiPuntDispatcher::AnySandbox;
+    const AftIndex     anyPort = AfiPuntDispatcher::AnyPort;
+
+    std::lock_guard<spinlock> guard(_hpRateLock);
+
+    for (AftIndex port = 0; port < AFI_HP_SB_PORTS_MAX; port++) {
+        const AfiSbPort keys[] = { AfiSbPort(sb.id,  port),
+                                   AfiSbPort(sb.id,  anyPort),
+                                   AfiSbPort(anySb, port),
+                                   AfiSbPort(anySb, anyPort) };
+        AfiRateBurst    limit(0, 0);
+
+        for (const AfiSbPort &key : keys) {
+            auto it = _hpRateLimits.find(key);
+            if (it != _hpRateLimits.end()) {
+                limit = it->second;
+                break;
+            }
+        }
+        sb.portBucket(port).configure(limit.first, limit.second);
+    }
+}
+
+//
+// @fn
+// hpRateStats
+//
+// @brief
+// Display punt rate limits and per port rate limit drops
+//
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+AfiClient::hpRateStats (std::ostream &os)
+{
+    {
+        std::lock_guard<spinlock> guard(_hpRateLock);
+
+        os << "Rate limits (sandbox port pps burst):" << std::endl;
+        for (auto &it : _hpRateLimits) {
+            os << "  ";
+            if (it.first.first == AfiPuntDispatcher::AnySandbox) {
+                os << "any";
+            } else {
+                os << it.first.first;
+            }
+            os << " ";
+            if (it.first.second == AfiPuntDispatcher::AnyPort) {
+                os << "any";
+            } else {
+                os << it.first.second;
+            }
+            os << " " << it.second.first << " " << it.second.second;
+            os << std::endl;
+        }
+    }
+
+    std::lock_guard<spinlock> guard(_hpSbLock);
+
+    os << "Sandbox   Port       Drops" << std::endl;
+    for (auto &it : _hpSandboxes) {
+        for (AftIndex port = 0; port < AFI_HP_SB_PORTS_MAX; port++) {
+            uint64_t drops = it.second->portBucket(port).drops.load();
+            if (drops) {
+                os << std::setw(7) << it.first << std::setw(7) << port;
+                os << std::setw(12) << drops << std::endl;
+            }
+        }
+    }
+}
+
+//
+// Add the counters of a sandbox to totals
+//
+static void
+afiHpSbStatsAdd (AfiHpSandbox::Stats &to, const AfiHpSandbox::Stats &from)
+{
+    to.queued.fetch_add(from.queued.load(), std::memory_order_relaxed);
+    to.rateDrops.fetch_add(from.rateDrops.load(), std::memory_order_relaxed);
+    to.queueDrops.fetch_add(from.queueDrops.load(),
+                            std::memory_order_relaxed);
+    to.drains.fetch_add(from.drains.load(), std::memory_order_relaxed);
+    to.processed.fetch_add(from.processed.load(), std::memory_order_relaxed);
+}
+
+//
+// Sandbox counter columns of the hostpath statistics
+//
+static void
+afiHpSbStatsShow (std::ostream &os, const AfiHpSandbox::Stats &s)
+{
+    os << std::setw(12) << s.queued.load();
+    os << std::setw(11) << s.rateDrops.load();
+    os << std::setw(11) << s.queueDrops.load();
+    os << std::setw(11) << s.drains.load();
+    os << std::setw(12) << s.processed.load() << std::endl;
+}
+
+//
+// @fn
+// hpAgeStart
+//
+// @brief
+// Arm the sandbox aging timer
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiClient::hpAgeStart(void)
+{
+    _hpAgeTimer.expires_from_now(
+                    std::chrono::milliseconds(AFI_HP_AGE_INTERVAL_MS));
+    _hpAgeTimer.async_wait(afiMakeAllocHandler(_hpAgeMem,
+        [this](const boost::system::error_code &ec) {
+            if (!ec) {
+                this->hpAge();
+                this->hpAgeStart();
+            }
+        }));
+}
+
+//
+// @fn
+// hpAge
+//
+// @brief
+// Remove hostpath contexts of sandboxes that did not punt packets
+// for AFI_HP_SB_AGE_INTERVALS aging intervals, adding their counters
+// to the aged out totals, and update the port rate meters
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiClient::hpAge(void)
+{
+    {
+        std::lock_guard<spinlock> guard(_hpStatsLock);
+        uint64_t                  nowNs = afiMonotonicNs();
+
+        for (auto &it : _hpPortStats) {
+            it.second->punt.tick(nowNs);
+            it.second->inject.tick(nowNs);
+        }
+    }
+
+    std::lock_guard<spinlock> guard(_hpSbLock);
+
+    for (auto it = _hpSandboxes.begin(); it != _hpSandboxes.end(); ) {
+        AfiHpSandbox &sb = *it->second;
+
+        if (sb.active.exchange(false, std::memory_order_relaxed)) {
+            sb.idleIntervals = 0;
+            ++it;
+        } else if (++sb.idleIntervals < AFI_HP_SB_AGE_INTERVALS) {
+            ++it;
+        } else {
+            sb.aged.store(true, std::memory_order_relaxed);
+            afiHpSbStatsAdd(_hpAgedStats, sb.stats);
+            it = _hpSandboxes.erase(it);
+        }
+    }
+}
+
+//
+// @fn
+// afiHpEngineName
+//
+// @brief
+// Hostpath I/O engine name
+//
+// @param[in]
+//     engine Engine
+// @return Engine name
+//
+
+const char *
+afiHpEngineName (AfiHpEngine engine)
+{
+    switch (engine) {
+    case AfiHpEngineAsio:
+        return "asio";
+    case AfiHpEngineRecvmmsg:
+        return "recvmmsg";
+    case AfiHpEngineUring:
+        return "io_uring";
+    case AfiHpEngineShm:
+        return "shm";
+    }
+    return "unknown";
+}
+
+//
+// @fn
+// afiHpEngineParse
+//
+// @brief
+// Hostpath I/O engine by name
+//
+// @param[in]
+//     name Engine name
+// @param[out]
+//     engine Engine
+// @return 0 - Success, -1 - Unknown engine
+//
+
+int
+afiHpEngineParse (const std::string &name, AfiHpEngine &engine)
+{
+    const AfiHpEngine engines[] = { AfiHpEngineAsio, AfiHpEngineRecvmmsg,
+                                    AfiHpEngineUring, AfiHpEngineShm };
+
+    for (AfiHpEngine e : engines) {
+        if (name.compare(afiHpEngineName(e)) == 0) {
+            engine = e;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//
+// @fn
+// startAfiPktRcvr
+//
+// @brief
+// Start AFI packet receivers and the reactor threads running them.
+// Receiver 0 reads the client's hostpath socket, further receivers
+// open their own SO_REUSEPORT sockets on the hostpath port. One
+// reactor thread is started per receiver; thread i is pinned to
+// core i (modulo core count).
+//
+// The io_uring engine has one receiver, run by its own thread, and
+// numHpRcvrs reactor threads for the sandbox strands. If io_uring is
+// not available the reactor receives instead.
+//
+// @param[in]
+//     numHpRcvrs Number of receivers (and reactor threads)
+// @return void
+//
+
+void
+AfiClient::startAfiPktRcvr(int numHpRcvrs)
+{
+    int numThreads = std::max(1, numHpRcvrs);
+
+    if ((_hpEngine == AfiHpEngineUring) || (_hpEngine == AfiHpEngineShm)) {
+        numHpRcvrs = 1;
+    }
+
+    for (int i = 0; i < std::max(1, numHpRcvrs); i++) {
+        std::unique_ptr<AfiHpRcvr> rcvr(new AfiHpRcvr(i));
+
+        if (_hpEngine == AfiHpEngineShm) {
+            _hpRcvrs.push_back(std::move(rcvr));
+            break;
+        }
+
+        if (i == 0) {
+            rcvr->sock = &_hpUdpSock;
+        } else {
+            boost::system::error_code ec;
+
+            rcvr->ownSock.reset(new BOOST_UDP::socket(_hpIoService));
+            rcvr->ownSock->open(BOOST_UDP::v4(), ec);
+            if (!ec && (afiSockOptOn(*rcvr->ownSock, SOL_SOCKET,
+                                     SO_REUSEPORT) != 0)) {
+                ec = boost::system::error_code(errno,
+                                               boost::system::system_category());
+            }
+            if (!ec) {
+                rcvr->ownSock->bind(
+                    BOOST_UDP::endpoint(BOOST_UDP::v4(), _hpPort), ec);
+            }
+            if (ec) {
+                std::cout << "Hostpath receiver socket: " << ec.message();
+                std::cout << std::endl;
+                break;
+            }
+            rcvr->sock = rcvr->ownSock.get();
+        }
+
+        //
+        // Absorb punt bursts while the reactor is busy. Kernel receive
+        // timestamps measure punt latency from when packets arrive.
+        // Sends on the client's socket (receiver 0) wait for room
+        // (hpTxWaitIfFull).
+        //
+        boost::system::error_code ec;
+        rcvr->sock->non_blocking(true, ec);
+        rcvr->sock->set_option(
+            boost::asio::socket_base::receive_buffer_size(AFI_HP_RCVBUF_SIZE),
+            ec);
+        afiSockOptOn(*rcvr->sock, SOL_SOCKET, SO_TIMESTAMPNS);
+
+        _hpRcvrs.push_back(std::move(rcvr));
+    }
+
+    if ((_hpEngine == AfiHpEngineUring) && (hpUringStart(*_hpRcvrs[0]) != 0)) {
+        std::cout << "Hostpath io_uring engine unavailable, using ";
+        std::cout << afiHpEngineName(AfiHpEngineAsio) << std::endl;
+        _hpEngine = AfiHpEngineAsio;
+    }
+
+    if ((_hpEngine == AfiHpEngineShm) && (hpShmStart(*_hpRcvrs[0]) != 0)) {
+        std::cout << "Hostpath channel to " << _afiHostpathAddr;
+        std::cout << " unavailable, punted packets are not received";
+        std::cout << std::endl;
+    }
+
+    //
+    // Receives run on the reactor only once the receiver set is final
+    //
+    if ((_hpEngine != AfiHpEngineUring) && (_hpEngine != AfiHpEngineShm)) {
+        for (auto &rcvr : _hpRcvrs) {
+            hpRcvStart(*rcvr);
+        }
+    }
+    hpAgeStart();
+    hpReactorStart(numThreads);
+
+    if (_tracing) {
+        std::cout << std::endl;
+        std::cout << "!!!" << _hpRcvrs.size() << " hostpath receiver(s) ";
+        std::cout << "started, " << afiHpEngineName(_hpEngine);
+        std::cout << " engine!!!" << std::endl;
+        std::cout << std::endl;
+    }
+}
+
+//
+// @fn
+// hpReactorStart
+//
+// @brief
+// Start the reactor threads running the client's own hostpath
+// io_service: receivers, sandbox strands and timers (e.g. the flush
+// of queued inject packets). Thread i is pinned to core i (modulo
+// core count).
+//
+// @param[in]
+//     numThreads Number of reactor threads
+// @return void
+//
+
+void
+AfiClient::hpReactorStart(int numThreads)
+{
+    int numCpus = std::max(1u, std::thread::hardware_concurrency());
+
+    _work.reset(new boost::asio::io_service::work(_hpIoService));
+
+    for (int i = 0; i < numThreads; i++) {
+        _threads.push_back(std::thread( [this] { this->_hpIoService.run(); } ));
+
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(i % numCpus, &cpuset);
+        pthread_setaffinity_np(_threads.back().native_handle(),
+                               sizeof(cpu_set_t), &cpuset);
+    }
+}
+
+//
+// @fn
+// ~AfiClient
+//
+// @brief
+// Destructor. Stops the reactor and waits for its threads, then
+// closes the hostpath sockets, timers and doorbell and runs the
+// handlers of their aborted operations: stop() leaves them pending,
+// and they use handler memory of the client.
+//
+
+AfiClient::~AfiClient()
+{
+    _work.reset();
+    _hpIoService.stop();
+    hpUringStop();
+
+    for (auto &thread : _threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    boost::system::error_code ec;
+    _hpTxTimer.cancel(ec);
+    _hpAgeTimer.cancel(ec);
+    for (auto &rcvr : _hpRcvrs) {
+        if (rcvr->sock != nullptr) {
+            rcvr->sock->close(ec);
+        }
+    }
+    _hpUdpSock.close(ec);
+    if (_hpShmDoorbell) {
+        _hpShmDoorbell->close(ec);
+    }
+
+    _hpIoService.restart();
+    _hpIoService.poll();
+
+    //
+    // Receivers are declared before the reactor (their handler memory
+    // must outlive it), their sockets must not
+    //
+    _hpShmDoorbell.reset();
+    _hpRcvrs.clear();
+
+#ifdef AFI_HAVE_IO_URING
+    if (_hpUringStopFd >= 0) {
+        close(_hpUringStopFd);
+    }
+#endif
+}
+
+//
+// @fn
+// hpRcvrStats
+//
+// @brief
+// Display per receiver and per sandbox hostpath statistics
+//
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+AfiClient::hpRcvrStats(std::ostream &os)
+{
+    os << "Engine: " << afiHpEngineName(_hpEngine) << std::endl;
+    os << "Rcvr      RxPkts        RxBytes   RxErrs" << std::endl;
+
+    for (auto &rcvr : _hpRcvrs) {
+        const AfiHpRcvr::Stats &s = rcvr->stats;
+
+        os << std::setw(4)  << rcvr->id;
+        os << std::setw(12) << s.rxPkts.load();
+        os << std::setw(15) << s.rxBytes.load();
+        os << std::setw(9)  << s.rxErrors.load() << std::endl;
+    }
+
+    os << "Sandbox      Queued   RateDrop  QueueDrop     Drains   Processed";
+    os << std::endl;
+
+    std::lock_guard<spinlock> guard(_hpSbLock);
+    for (auto &it : _hpSandboxes) {
+        os << std::setw(7) << it.first;
+        afiHpSbStatsShow(os, it.second->stats);
+    }
+    os << std::setw(7) << "aged";
+    afiHpSbStatsShow(os, _hpAgedStats);
+}
+
+//
+// @fn
+// injectL2Packet
+//
+// @brief
+// Inject layer 2 packet on specified (output) 
+// port of specified sandbox
+//
+// @param[in] 
+//     sandboxId Sandbox index
+// @param[in] 
+//     portIndex Output port index
+// @param[in] 
+//     l2Packet Pointer to layer 2 packet to be injected
+// @param[in] 
+//     l2PacketLen Length of layer 2 packet
+// @return void
+//
+
+int
+AfiClient::injectL2Packet(AftSandboxId  sandboxId,
+                          AftIndex      portIndex,
+                          uint8_t      *l2Packet,
+                          int           l2PacketLen)
+{
+    if (!l2Packet) {
+        std::cout << "l2Packet NULL" << std::endl;
+        return -1;
+    }
+
+    uint64_t submitNs = afiMonotonicNs();
+
+    std::lock_guard<std::mutex> guard(_hpTxLock);
+
+    //
+    // Keep the order with packets queued before
+    //
+    hpTxFlushStaged();
+
+    AftPacketPtr pkt = _hpTxPool.getTransmit(
+                                       l2PacketLen, sandboxId,
+                                       portIndex, AftPacket::PacketTypeL2);
+
+    //
+    // Get base of packet data.
+    // This is in the buffer immediately after the header.
+    //
+    uint8_t *pktData = pkt->data();
+
+    //
+    // Fill the pktData with 'L2 packet to be injected'
+    //
+    memcpy(pktData, l2Packet, l2PacketLen);
+
+    AFI_TRACE(AFI_TRACE_EV_HP_XMIT, sandboxId, portIndex, 0, 0,
+              l2Packet, l2PacketLen);
+    _capture.capture(sandboxId, portIndex, AfiPcapWriter::DirOutbound,
+                     l2Packet, l2PacketLen);
+
+    if (hpTxSend(pkt->header(), pkt->size()) != 0) {
+        return -1;
+    }
+
+    AfiHpPortStats &ps = hpTxPortStats(sandboxId, portIndex);
+    ps.inject.add(l2PacketLen);
+    ps.injectSend.record(afiMonotonicNs() - submitNs);
+
+    return 0;
+}
+
+//
+// @fn
+// injectL2Packets
+//
+// @brief
+// Inject a batch of layer 2 packets on specified (output)
+// ports of specified sandbox. Frames are serialized back to
+// back into the hostpath send ring and flushed with one
+// UDP GSO send when all frames have the same size, or with
+// sendmmsg otherwise.
+//
+// @param[in]
+//     sandboxId Sandbox index
+// @param[in]
+//     pkts Layer 2 packets (and their output port indexes)
+// @return Number of packets injected, -1 - Error
+//
+
+int
+AfiClient::injectL2Packets(AftSandboxId          sandboxId,
+                           const AfiL2PktVector &pkts)
+{
+    uint64_t submitNs = afiMonotonicNs();
+
+    std::lock_guard<std::mutex> guard(_hpTxLock);
+
+    for (size_t i = 0; i < pkts.size(); i++) {
+        const AfiL2Pkt &l2Pkt = pkts.at(i);
+
+        if (hpTxStage(sandboxId, l2Pkt.portIndex, l2Pkt.l2Packet,
+                      l2Pkt.l2PacketLen, submitNs) != 0) {
+            std::cout << "Failed to inject l2Packet at batch index " << i;
+            std::cout << std::endl;
+            return -1;
+        }
+    }
+
+    if (hpTxFlushStaged() != 0) {
+        return -1;
+    }
+
+    return pkts.size();
+}
+
+//
+// @fn
+// queueL2Packet
+//
+// @brief
+// Queue layer 2 packet for injection on specified (output) port of
+// specified sandbox. The packet is staged in the hostpath send ring
+// and sent, without blocking the caller, once a batch is full or at
+// the latest AFI_HP_TX_FLUSH_USEC later from the reactor.
+//
+// @param[in]
+//     sandboxId Sandbox index
+// @param[in]
+//     portIndex Output port index
+// @param[in]
+//     l2Packet Pointer to layer 2 packet to be injected
+// @param[in]
+//     l2PacketLen Length of layer 2 packet
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::queueL2Packet(AftSandboxId  sandboxId,
+                         AftIndex      portIndex,
+                         uint8_t      *l2Packet,
+                         int           l2PacketLen)
+{
+    uint64_t submitNs = afiMonotonicNs();
+
+    std::lock_guard<std::mutex> guard(_hpTxLock);
+
+    if (hpTxStage(sandboxId, portIndex, l2Packet, l2PacketLen,
+                  submitNs) != 0) {
+        return -1;
+    }
+
+    if ((_hpTxStaged > 0) && !_hpTxTimerArmed) {
+        hpTxTimerStart();
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// injectTemplate
+//
+// @brief
+// Inject a packet template on its sandbox port. The template's
+// AftPacket is sent as it is: no header is built and no frame copied.
+//
+// @param[in]
+//     tmpl Packet template
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::injectTemplate(const AfiPktTemplate &tmpl)
+{
+    if (!tmpl.valid()) {
+        std::cout << "Packet template not built" << std::endl;
+        return -1;
+    }
+
+    const AftPacketPtr &pkt      = tmpl.packet();
+    uint64_t            submitNs = afiMonotonicNs();
+
+    std::lock_guard<std::mutex> guard(_hpTxLock);
+
+    //
+    // Keep the order with packets queued before
+    //
+    hpTxFlushStaged();
+
+    AFI_TRACE(AFI_TRACE_EV_HP_XMIT, pkt->sandboxId(), pkt->portIndex(), 0, 0,
+              pkt->data(), pkt->dataSize());
+    _capture.capture(pkt->sandboxId(), pkt->portIndex(),
+                     AfiPcapWriter::DirOutbound, pkt->data(), pkt->dataSize());
+
+    if (hpTxSend(pkt->header(), pkt->size()) != 0) {
+        return -1;
+    }
+
+    AfiHpPortStats &ps = hpTxPortStats(pkt->sandboxId(), pkt->portIndex());
+    ps.inject.add(pkt->dataSize());
+    ps.injectSend.record(afiMonotonicNs() - submitNs);
+
+    return 0;
+}
+
+//
+// @fn
+// queueTemplate
+//
+// @brief
+// Queue a packet template for injection, like queueL2Packet: the
+// template's AftPacket is copied into the hostpath send ring as it
+// is, so the template may be changed as soon as this returns.
+//
+// @param[in]
+//     tmpl Packet template
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::queueTemplate(const AfiPktTemplate &tmpl)
+{
+    if (!tmpl.valid()) {
+        std::cout << "Packet template not built" << std::endl;
+        return -1;
+    }
+
+    uint64_t submitNs = afiMonotonicNs();
+
+    std::lock_guard<std::mutex> guard(_hpTxLock);
+
+    if (hpTxStageFrame(tmpl.packet(), tmpl.frame(), submitNs) != 0) {
+        return -1;
+    }
+
+    if ((_hpTxStaged > 0) && !_hpTxTimerArmed) {
+        hpTxTimerStart();
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// flushL2Packets
+//
+// @brief
+// Send the packets queued by queueL2Packet and queueTemplate so far
+// right away, instead of from the reactor once the flush timer fires
+//
+// @param[in] void
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::flushL2Packets(void)
+{
+    std::lock_guard<std::mutex> guard(_hpTxLock);
+
+    return hpTxFlushStaged();
+}
+
+//
+// @fn
+// hpTxStage
+//
+// @brief
+// Serialize a frame into the hostpath send ring (_hpTxLock held).
+// Consecutive frames for the same port and of the same length share
+// one AftPacket header. The ring is flushed when it is full.
+//
+// @param[in]
+//     sandboxId Sandbox index
+// @param[in]
+//     portIndex Output port index
+// @param[in]
+//     l2Packet Pointer to layer 2 packet
+// @param[in]
+//     l2PacketLen Length of layer 2 packet
+// @param[in]
+//     submitNs Time the packet was submitted (CLOCK_MONOTONIC)
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxStage(AftSandboxId   sandboxId,
+                     AftIndex       portIndex,
+                     const uint8_t *l2Packet,
+                     int            l2PacketLen,
+                     uint64_t       submitNs)
+{
+    if ((!l2Packet) || (l2PacketLen <= 0)) {
+        std::cout << "Invalid l2Packet" << std::endl;
+        return -1;
+    }
+
+    if ((!_hpTxHdr) ||
+        (_hpTxHdr->sandboxId() != sandboxId) ||
+        (_hpTxHdr->portIndex() != portIndex) ||
+        (_hpTxHdr->dataSize()  != l2PacketLen)) {
+        _hpTxHdr = _hpTxPool.getTransmit(l2PacketLen, sandboxId,
+                                         portIndex, AftPacket::PacketTypeL2);
+    }
+
+    return hpTxStageFrame(_hpTxHdr, l2Packet, submitNs);
+}
+
+//
+// @fn
+// hpTxStageFrame
+//
+// @brief
+// Copy an AftPacket header and a layer 2 packet into the hostpath send
+// ring (_hpTxLock held). The ring is flushed when it is full.
+//
+// @param[in]
+//     hdr Packet with the serialized AftPacket header
+// @param[in]
+//     l2Packet Layer 2 packet, hdr->dataSize() bytes
+// @param[in]
+//     submitNs Time the packet was submitted (CLOCK_MONOTONIC)
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxStageFrame(const AftPacketPtr &hdr,
+                          const uint8_t      *l2Packet,
+                          uint64_t            submitNs)
+{
+    AftSandboxId sandboxId   = hdr->sandboxId();
+    AftIndex     portIndex   = hdr->portIndex();
+    int          l2PacketLen = hdr->dataSize();
+
+    size_t frameLen = hdr->headerSize() + l2PacketLen;
+    if (frameLen > _hpTxRing.size()) {
+        std::cout << "l2Packet too large for hostpath send ring" << std::endl;
+        return -1;
+    }
+
+    if ((_hpTxStagedLen + frameLen > _hpTxRing.size()) &&
+        (hpTxFlushStaged() != 0)) {
+        return -1;
+    }
+
+    uint8_t *frame = &_hpTxRing[_hpTxStagedLen];
+    memcpy(frame, hdr->header(), hdr->headerSize());
+    memcpy(frame + hdr->headerSize(), l2Packet, l2PacketLen);
+
+    AFI_TRACE(AFI_TRACE_EV_HP_XMIT, sandboxId, portIndex, 0, 0,
+              l2Packet, l2PacketLen);
+    _capture.capture(sandboxId, portIndex, AfiPcapWriter::DirOutbound,
+                     l2Packet, l2PacketLen);
+
+    AfiHpPortStats &ps = hpTxPortStats(sandboxId, portIndex);
+    ps.inject.add(l2PacketLen);
+
+    _hpTxIov[_hpTxStaged].iov_base = frame;
+    _hpTxIov[_hpTxStaged].iov_len  = frameLen;
+    _hpTxStagedNs[_hpTxStaged]     = submitNs;
+    _hpTxStagedStats[_hpTxStaged]  = &ps;
+    _hpTxStagedLen += frameLen;
+    _hpTxStaged++;
+
+    if (_hpTxStaged == AFI_HP_TX_BATCH_MAX) {
+        return hpTxFlushStaged();
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// hpTxFlushStaged
+//
+// @brief
+// Send all frames staged in the hostpath send ring (_hpTxLock held)
+// and record their inject latencies
+//
+// @param[in] void
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxFlushStaged(void)
+{
+    int ret = 0;
+
+    if (_hpTxStaged > 0) {
+        ret = hpTxFlush(_hpTxStaged);
+
+        uint64_t sentNs = afiMonotonicNs();
+        for (int f = 0; f < _hpTxStaged; f++) {
+            _hpTxStagedStats[f]->injectSend.record(sentNs - _hpTxStagedNs[f]);
+        }
+    }
+    _hpTxStaged    = 0;
+    _hpTxStagedLen = 0;
+
+    return ret;
+}
+
+//
+// @fn
+// hpTxPortStats
+//
+// @brief
+// Port statistics of injected packets, cached for the sandbox last
+// injected to (_hpTxLock held)
+//
+// @param[in]
+//     sandboxId Sandbox index
+// @param[in]
+//     portIndex Output port index
+// @return Port statistics
+//
+
+AfiHpPortStats &
+AfiClient::hpTxPortStats(AftSandboxId sandboxId, AftIndex portIndex)
+{
+    if (sandboxId != _hpTxStatsSb) {
+        std::fill(_hpTxStats.begin(), _hpTxStats.end(), nullptr);
+        _hpTxStatsSb = sandboxId;
+    }
+
+    AfiHpPortStats *&ps = _hpTxStats[std::min<AftIndex>(portIndex,
+                                                AFI_HP_SB_PORTS_MAX - 1)];
+    if (!ps) {
+        ps = &hpPortStats(sandboxId, portIndex);
+    }
+
+    return *ps;
+}
+
+//
+// @fn
+// hpTxTimerStart
+//
+// @brief
+// Arm the timer flushing queued inject packets (_hpTxLock held)
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiClient::hpTxTimerStart(void)
+{
+    _hpTxTimerArmed = true;
+    _hpTxTimer.expires_from_now(
+                    std::chrono::microseconds(AFI_HP_TX_FLUSH_USEC));
+    _hpTxTimer.async_wait(afiMakeAllocHandler(_hpTxTimerMem,
+        [this](const boost::system::error_code &ec) {
+            std::lock_guard<std::mutex> guard(this->_hpTxLock);
+            this->_hpTxTimerArmed = false;
+            if (!ec) {
+                this->hpTxFlushStaged();
+            }
+        }));
+}
+
+//
+// The hostpath socket is non-blocking for the receivers: a send that
+// finds the socket buffer full waits for room and is retried. Returns
+// 0 - Retry, -1 - Other error (errno kept) or the wait failed.
+//
+static int
+hpTxWaitIfFull (int fd)
+{
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        return -1;
+    }
+
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) {
+            perror("poll(hostpath send)");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//
+// @fn
+// hpTxSend
+//
+// @brief
+// Send one frame right away (_hpTxLock held)
+//
+// @param[in]
+//     frame Frame (AftPacket header and layer 2 packet)
+// @param[in]
+//     frameLen Frame length
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxSend(const uint8_t *frame, size_t frameLen)
+{
+    if (_hpEngine == AfiHpEngineShm) {
+        if (!_hpShm) {
+            return -1;
+        }
+        int ret = hpShmSend(frame, frameLen);
+        _hpShm->kick();
+        return ret;
+    }
+
+    boost::system::error_code ec;
+    for (;;) {
+        _hpUdpSock.send_to(boost::asio::buffer(frame, frameLen),
+                           _vmxtHostpathEndpoint, 0, ec);
+        if ((ec != boost::asio::error::would_block) &&
+            (ec != boost::asio::error::try_again)) {
+            break;
+        }
+        errno = EAGAIN;
+        if (hpTxWaitIfFull(_hpUdpSock.native_handle()) != 0) {
+            break;
+        }
+    }
+    if (ec) {
+        std::cout << "Inject failed: " << ec.message() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// hpTxFlushShm
+//
+// @brief
+// Append frames staged in the hostpath send ring to the inject ring
+// of the shared memory channel; the peer is kicked once per batch
+//
+// @param[in]
+//     numFrames Number of staged frames
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxFlushShm(int numFrames)
+{
+    int ret = 0;
+
+    for (int f = 0; (f < numFrames) && (ret == 0); f++) {
+        ret = hpShmSend(_hpTxIov[f].iov_base, _hpTxIov[f].iov_len);
+    }
+    if (_hpShm) {
+        _hpShm->kick();
+    }
+
+    return ret;
+}
+
+//
+// @fn
+// hpTxFlush
+//
+// @brief
+// Send frames staged in the hostpath send ring
+//
+// @param[in]
+//     numFrames Number of staged frames
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxFlush(int numFrames)
+{
+    if (_hpEngine == AfiHpEngineShm) {
+        return hpTxFlushShm(numFrames);
+    }
+
+    int fd = _hpUdpSock.native_handle();
+    int frameLen = _hpTxIov[0].iov_len;
+    int numSent = 0;
+
+    //
+    // Equally sized frames are laid out contiguously in the ring
+    // and can go out as UDP GSO super-datagrams.
+    //
+    bool useGso = _hpTxGso && (numFrames > 1) &&
+                  (frameLen <= AFI_HP_TX_GSO_SEG_MAX);
+    for (int f = 1; useGso && (f < numFrames); f++) {
+        useGso = (_hpTxIov[f].iov_len == frameLen);
+    }
+
+    if (useGso) {
+        int segsPerSend = AFI_HP_UDP_PAYLOAD_MAX / frameLen;
+
+        while (numSent < numFrames) {
+            int numSegs = std::min(segsPerSend, numFrames - numSent);
+            if (hpTxFlushGso(numSent, numSegs) != 0) {
+                break;
+            }
+            numSent += numSegs;
+        }
+        if (numSent == numFrames) {
+            return 0;
+        }
+    }
+
+    for (int f = numSent; f < numFrames; f++) {
+        memset(&_hpTxMsg[f], 0, sizeof(_hpTxMsg[f]));
+        _hpTxMsg[f].msg_hdr.msg_name    = _vmxtHostpathEndpoint.data();
+        _hpTxMsg[f].msg_hdr.msg_namelen = _vmxtHostpathEndpoint.size();
+        _hpTxMsg[f].msg_hdr.msg_iov     = &_hpTxIov[f];
+        _hpTxMsg[f].msg_hdr.msg_iovlen  = 1;
+    }
+
+#ifdef AFI_HAVE_IO_URING
+    if (_hpTxUring) {
+        return hpTxFlushUring(numSent, numFrames - numSent);
+    }
+#endif
+
+    while (numSent < numFrames) {
+        int ret = sendmmsg(fd, &_hpTxMsg[numSent], numFrames - numSent, 0);
+        if (ret < 0) {
+            if ((errno == EINTR) || (hpTxWaitIfFull(fd) == 0)) {
+                continue;
+            }
+            perror("sendmmsg");
+            return -1;
+        }
+        numSent += ret;
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// hpTxFlushGso
+//
+// @brief
+// Send equally sized, contiguous frames from the hostpath
+// send ring as one UDP GSO datagram. Disables GSO for this
+// client if the kernel or device does not support it.
+//
+// @param[in]
+//     firstFrame Index of first frame to send
+// @param[in]
+//     numFrames Number of frames to send
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxFlushGso(int firstFrame, int numFrames)
+{
+    uint16_t     gsoSize = _hpTxIov[firstFrame].iov_len;
+    char         control[CMSG_SPACE(sizeof(uint16_t))];
+    struct iovec iov;
+    struct msghdr msg;
+
+    iov.iov_base = _hpTxIov[firstFrame].iov_base;
+    iov.iov_len  = gsoSize * numFrames;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_name       = _vmxtHostpathEndpoint.data();
+    msg.msg_namelen    = _vmxtHostpathEndpoint.size();
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type  = UDP_SEGMENT;
+    cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cm), &gsoSize, sizeof(gsoSize));
+
+    int     fd = _hpUdpSock.native_handle();
+    ssize_t ret;
+    do {
+        ret = sendmsg(fd, &msg, 0);
+    } while ((ret < 0) && ((errno == EINTR) || (hpTxWaitIfFull(fd) == 0)));
+
+    if (ret < 0) {
+        if (_tracing) {
+            perror("sendmsg(UDP_SEGMENT)");
+        }
+        //
+        // Only errors saying the kernel or device cannot segment
+        // disable GSO; others are left to the fallback
+        //
+        if ((errno == EINVAL) || (errno == EIO) || (errno == ENOPROTOOPT)) {
+            _hpTxGso = false;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// hpTxFlushUring
+//
+// @brief
+// Send frames of the hostpath send ring with one io_uring submission
+// of one sendmsg per frame, and wait for them to complete, as the
+// ring is reused right after (_hpTxLock held). Frames the non-blocking
+// socket had no room for are sent again with sendmsg, in order, once
+// there is room.
+//
+// @param[in]
+//     firstFrame Index of first frame to send
+// @param[in]
+//     numFrames Number of frames to send
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiClient::hpTxFlushUring(int firstFrame, int numFrames)
+{
+#ifdef AFI_HAVE_IO_URING
+    AfiUring &ring   = *_hpTxUring;
+    int       fd     = _hpUdpSock.native_handle();
+    int       queued = 0;
+    int       err    = 0;
+
+    for (int f = firstFrame; f < firstFrame + numFrames; f++) {
+        struct io_uring_sqe *sqe = ring.getSqe();
+        if (!sqe) {
+            break;
+        }
+        sqe->opcode    = IORING_OP_SENDMSG;
+        sqe->fd        = fd;
+        sqe->addr      = (uint64_t)(uintptr_t)&_hpTxMsg[f].msg_hdr;
+        sqe->len       = 1;
+        sqe->user_data = f;
+        queued++;
+    }
+
+    while (ring.submit(queued) < 0) {
+        if (errno != EINTR) {
+            perror("io_uring_enter(send)");
+            return -1;
+        }
+    }
+
+    std::vector<int> again;
+    ring.reap([&err, &again](const struct io_uring_cqe &cqe) {
+        if ((cqe.res == -EAGAIN) || (cqe.res == -EWOULDBLOCK)) {
+            again.push_back(cqe.user_data);
+        } else if (cqe.res < 0) {
+            err = -cqe.res;
+        }
+    });
+
+    std::sort(again.begin(), again.end());
+    for (int f : again) {
+        ssize_t ret;
+        do {
+            ret = sendmsg(fd, &_hpTxMsg[f].msg_hdr, 0);
+        } while ((ret < 0) &&
+                 ((errno == EINTR) || (hpTxWaitIfFull(fd) == 0)));
+        if (ret < 0) {
+            err = errno;
+        }
+    }
+
+    if (err) {
+        errno = err;
+        perror("io_uring sendmsg");
+        return -1;
+    }
+
+    return (queued == numFrames) ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+//
+// @fn
+// handleCliCommand
+//
+// @brief
+// Handle CLI command
+//
+// @param[in] 
+//     command_str CLI command string
+// @return void
+//
+
+void
+AfiClient::handleCliCommand(std::string const & command_str)
+{
+    std::vector<std::string> command_sub_strings;
+    boost::split(command_sub_strings, command_str, boost::is_any_of("\t "));
+
+    std::string command = command_sub_strings.at(0);
+
+    std::vector<std::string> command_args;
+    for(int t=0; t < command_sub_strings.size(); ++t){
+        if ((t != 0) && (!command_sub_strings.at(t).empty())) {
+            command_args.push_back(command_sub_strings.at(t));
+        }
+    }
+
+    if (command_args.size() > 0) {
+        std::string command_arg1 = command_args.at(0);
+    }
+    if (command_args.size() > 1) {
+        std::string command_arg1 = command_args.at(1);
+    }
+
+    if ((command.compare("help") == 0) ||
+        (command.compare("h")    == 0) ||
+        (command.compare("?")    == 0)) {
+        std::cout << "\tSupported commands:" << std::endl;
+        std::cout << "\t open-sb <sandbox-name> <num-configured-ports>" << std::endl;
+        std::cout << "\t          num-configured-ports : Number of configured ports through Junos CLI" << std::endl;
+        std::cout << "\t create-rtt <rtt-name> <default-target-node-token>" << std::endl;
+        std::cout << "\t create-index-table <table-size>" << std::endl;
+        std::cout << "\t add-index-table-entry <index-table-token> <entry-index> <entry-target-token>" << std::endl;
         std::cout << "\t set-input-port-next-node <port-index> <next-node-token>" << std::endl;
         std::cout << "\t add-ether-encap <src-mac> <dst-mac> <0 or inner-vlan-id> <0 or outer-vlan-id> <output-port-token>" << std::endl;
         std::cout << "\t add-label-encap <outer-label> <0 or inner-label> <next-node-token>" << std::endl;
@@ -888,6 +3494,25 @@ AfiClient::handleCliCommand(std::string const & command_str)
         std::cout << "\t get-output-port-token <ouput-port-index>" << std::endl;
         std::cout << "\t add-route <rtt-token> <prefix> <next-node-token>" << std::endl;
         std::cout << "\t inject-l2-pkt <sandbox-index> <port-index>: Inject layer 2 packet" << std::endl;
+        std::cout << "\t inject-l2-pkts <sandbox-index> <port-index> <count>: Inject a burst of layer 2 packets" << std::endl;
+        std::cout << "\t trace <on|off>: Enable/disable binary tracing" << std::endl;
+        std::cout << "\t trace-show : Display trace records" << std::endl;
+        std::cout << "\t trace-dump <file>: Write trace records to file (see afi-trace-decode)" << std::endl;
+        std::cout << "\t pkt-pool-stats : Display hostpath packet pool statistics" << std::endl;
+        std::cout << "\t hostpath-rcvr-stats : Display per receiver hostpath statistics" << std::endl;
+        std::cout << "\t hostpath-stats : Display per port punt/inject latency percentiles and rates" << std::endl;
+        std::cout << "\t hostpath-stats-dump [<file>]: Write per port hostpath statistics as JSON" << std::endl;
+        std::cout << "\t punt-stats : Display punt dispatch statistics and handlers" << std::endl;
+        std::cout << "\t add-punt-policer <input-port-index> <punt-port-index> <rate> <burst> <pps|bps>" << std::endl;
+        std::cout << "\t punt-rate-limit <sandbox-index|any> <port-index|any> <pps> <burst>: 0 pps for no limit" << std::endl;
+        std::cout << "\t punt-rate-stats : Display punt rate limits and drops" << std::endl;
+        std::cout << "\t punt-fallback-show [<count> [hex]]: Display packets no punt handler took" << std::endl;
+        std::cout << "\t capture-start <file> [<rotate-MB> [<rotate-sec> [<max-files>]]]: Capture punted and injected packets (pcapng)" << std::endl;
+        std::cout << "\t capture-stop : Stop capturing packets" << std::endl;
+        std::cout << "\t capture-stats : Display packet capture statistics" << std::endl;
+        std::cout << "\t local-server-show : Display the local AFI server's sandbox models" << std::endl;
+        std::cout << "\t local-server-delay <rpc|hostpath> <latency-us> [<jitter-us>]: Set local AFI server latency" << std::endl;
+        std::cout << "\t local-server-echo <on|off>: Return injected packets as punts (local AFI server)" << std::endl;
         std::cout << "\t history " << std::endl;
         std::cout << "\t clear-history " << std::endl;
         std::cout << "\t quit/exit " << std::endl;
@@ -940,6 +3565,8 @@ AfiClient::handleCliCommand(std::string const & command_str)
         AftNodeToken entryTargetToken = std::strtoull(command_args.at(2).c_str(),NULL,0);
 
         addIndexTableEntry(iTableToken, entryIndex, entryTargetToken);
+        std::cout << "Index table entry pushed. ";
+        std::cout <<"(Index: " << entryIndex << " target token: "<< entryTargetToken << ")" << std::endl;
 
     } else  if (command.compare("set-input-port-next-node") == 0) {
         if (command_args.size() != 2) {
@@ -1019,40 +3646,248 @@ AfiClient::handleCliCommand(std::string const & command_str)
         AftNodeToken rttToken = std::strtoull(command_args.at(0).c_str(), NULL, 0);
         AftNodeToken routeTragetToken = std::strtoull(command_args.at(2).c_str(), NULL, 0);
 
+        std::cout << "Adding route ";
+        std::cout << command_args.at(1) << " ---> Node token " << routeTragetToken << std::endl;
         addRoute(rttToken, command_args.at(1), routeTragetToken);
 
     } else  if ((command.compare("pkt") == 0) ||
-                (command.compare("inject-l2-pkt") == 0)) {
-        if (command_args.size() != 2) {
+                (command.compare("inject-l2-pkt") == 0) ||
+                (command.compare("inject-l2-pkts") == 0)) {
+        bool burst = (command.compare("inject-l2-pkts") == 0);
+        if ((!burst) && (command_args.size() != 2)) {
             std::cout << "Please provide sandbox-index and port-index" << std::endl;
             std::cout << "Example: inject-l2-pkt 0 0" << std::endl;
             return;
         }
+        if ((burst) && (command_args.size() != 3)) {
+            std::cout << "Please provide sandbox-index, port-index and packet count" << std::endl;
+            std::cout << "Example: inject-l2-pkts 0 0 100" << std::endl;
+            return;
+        }
         AftSandboxId  sandboxId = std::strtoull(command_args.at(0).c_str(), NULL, 0); // Sandbox ID
         AftIndex      portIndex = std::strtoull(command_args.at(1).c_str(), NULL, 0);    // Port Index
 
-#define PKT_BUFF_SIZE 1500
-#define ETHERNET_PACKET_BUF_SIZE 5000
+        //
+        // ICMP echo request, built once. Packets of a burst get
+        // consecutive echo sequence numbers.
+        //
         // Mac tap1 a2:24:4f:ce:94:b4
         // Src IP : 103.30.70.1
         // Dst IP : 103.30.70.3
-        char ethernet_pkt[ETHERNET_PACKET_BUF_SIZE] =
-            "a224 4fce 94b4 3226 0a2e fff1 0800 4500"
-            "0054 dacc 4000 4001 059c 671e 4601 671e"
-            "4603 0800 5cba 492b 3942 ee7c 5658 0000"
-            "0000 0a30 0b00 0000 0000 1011 1213 1415"
-            "1617 1819 1a1b 1c1d 1e1f 2021 2223 2425"
-            "2627 2829 2a2b 2c2d 2e2f 3031 3233 3435"
-            "3637";
+        if (!_cliInjectTmpl.valid()) {
+            _cliInjectTmpl.build(sandboxId, portIndex,
+                "a224 4fce 94b4 3226 0a2e fff1 0800 4500"
+                "0054 dacc 4000 4001 059c 671e 4601 671e"
+                "4603 0800 5cba 492b 3942 ee7c 5658 0000"
+                "0000 0a30 0b00 0000 0000 1011 1213 1415"
+                "1617 1819 1a1b 1c1d 1e1f 2021 2223 2425"
+                "2627 2829 2a2b 2c2d 2e2f 3031 3233 3435"
+                "3637");
+            _cliInjectSeq = _cliInjectTmpl.addField(AfiPktTemplate::FieldL4,
+                                                    6, 2);
+        }
+        _cliInjectTmpl.retarget(sandboxId, portIndex);
+
+        if (burst) {
+            uint64_t  numPkts = std::strtoull(command_args.at(2).c_str(), NULL, 0);
+            if (numPkts > AFI_HP_INJECT_BURST_MAX) {
+                std::cout << "Packet count too large, max ";
+                std::cout << AFI_HP_INJECT_BURST_MAX << std::endl;
+                return;
+            }
+            u_int32_t numSent = 0;
+            uint32_t  seq     = _cliInjectTmpl.get(_cliInjectSeq);
+
+            //
+            // Staged in batches, the last one sent before reporting
+            //
+            while ((numSent < numPkts) &&
+                   (queueTemplate(_cliInjectTmpl) == 0)) {
+                _cliInjectTmpl.set(_cliInjectSeq, ++seq);
+                numSent++;
+            }
+            if ((flushL2Packets() != 0) || (numSent < numPkts)) {
+                std::cout << "Inject failed after " << numSent;
+                std::cout << " packets" << std::endl;
+            } else {
+                std::cout << "Injected " << numSent << " packets" << std::endl;
+            }
+        } else {
+            injectTemplate(_cliInjectTmpl);
+        }
+
+    } else  if (command.compare("trace") == 0) {
+        if ((command_args.size() != 1) ||
+            ((command_args.at(0).compare("on") != 0) &&
+             (command_args.at(0).compare("off") != 0))) {
+            std::cout << "Please provide on or off" << std::endl;
+            std::cout << "Example: trace on" << std::endl;
+            return;
+        }
+        _tracing = (command_args.at(0).compare("on") == 0);
+        afiTraceEnable(_tracing);
+
+    } else  if (command.compare("trace-show") == 0) {
+        std::vector<AfiTraceRecord> records;
+        AfiTraceClock               clock;
+
+        afiTraceSnapshot(records, clock);
+        afiTraceRender(records, clock, std::cout);
+
+    } else  if (command.compare("trace-dump") == 0) {
+        if (command_args.size() != 1) {
+            std::cout << "Please provide trace file name" << std::endl;
+            std::cout << "Example: trace-dump /tmp/afi-client.trc" << std::endl;
+            return;
+        }
+        if (afiTraceDump(command_args.at(0)) == 0) {
+            std::cout << "Trace written to " << command_args.at(0) << std::endl;
+        }
+
+    } else  if (command.compare("pkt-pool-stats") == 0) {
+        for (auto &rcvr : _hpRcvrs) {
+            std::cout << "Receiver " << rcvr->id << " ";
+            rcvr->pool.description(std::cout) << std::endl;
+        }
+        {
+            std::lock_guard<std::mutex> guard(_hpTxLock);
+            _hpTxPool.description(std::cout) << std::endl;
+        }
+
+    } else  if (command.compare("hostpath-rcvr-stats") == 0) {
+        hpRcvrStats(std::cout);
+
+    } else  if (command.compare("hostpath-stats") == 0) {
+        hpPortStatsShow(std::cout);
+
+    } else  if (command.compare("hostpath-stats-dump") == 0) {
+        if (command_args.size() < 1) {
+            hpPortStatsDump(std::cout);
+            return;
+        }
+        std::ofstream file(command_args.at(0).c_str());
+        if (!file) {
+            std::cout << "Cannot open " << command_args.at(0) << std::endl;
+            return;
+        }
+        hpPortStatsDump(file);
+        std::cout << "Hostpath statistics written to " << command_args.at(0);
+        std::cout << std::endl;
+
+    } else  if (command.compare("punt-stats") == 0) {
+        _puntDispatcher.description(std::cout);
 
-        char pktBuff[PKT_BUFF_SIZE];
-        int pktLen;
+    } else  if (command.compare("add-punt-policer") == 0) {
+        if ((command_args.size() != 5) ||
+            ((command_args.at(4).compare("pps") != 0) &&
+             (command_args.at(4).compare("bps") != 0))) {
+            std::cout << "Please provide input port index, punt port index, rate, burst and pps or bps" << std::endl;
+            std::cout << "Example: add-punt-policer 2 7 1000 100 pps" << std::endl;
+            return;
+        }
+        AftIndex inputPortIndex = std::strtoull(command_args.at(0).c_str(), NULL, 0);
+        AftIndex puntPortIndex  = std::strtoull(command_args.at(1).c_str(), NULL, 0);
+        uint64_t rate           = std::strtoull(command_args.at(2).c_str(), NULL, 0);
+        uint64_t burst          = std::strtoull(command_args.at(3).c_str(), NULL, 0);
+        bool     packetMode     = (command_args.at(4).compare("pps") == 0);
+
+        std::cout << "Adding punt policer" << std::endl;
+        AftNodeToken token = addPuntPolicer(inputPortIndex, puntPortIndex,
+                                            rate, burst, packetMode);
+        std::cout << "Punt policer token: " << token << std::endl;
+
+    } else  if (command.compare("punt-rate-limit") == 0) {
+        if (command_args.size() != 4) {
+            std::cout << "Please provide sandbox index, port index, pps and burst" << std::endl;
+            std::cout << "Example: punt-rate-limit any any 20000 2048" << std::endl;
+            return;
+        }
+        AftSandboxId sandboxId = (command_args.at(0).compare("any") == 0) ?
+                        AfiPuntDispatcher::AnySandbox :
+                        std::strtoull(command_args.at(0).c_str(), NULL, 0);
+        AftIndex     portIndex = (command_args.at(1).compare("any") == 0) ?
+                        AfiPuntDispatcher::AnyPort :
+                        std::strtoull(command_args.at(1).c_str(), NULL, 0);
+        uint64_t     pps       = std::strtoull(command_args.at(2).c_str(), NULL, 0);
+        uint64_t     burst     = std::strtoull(command_args.at(3).c_str(), NULL, 0);
+
+        setPuntRateLimit(sandboxId, portIndex, pps, burst);
+
+    } else  if (command.compare("punt-rate-stats") == 0) {
+        hpRateStats(std::cout);
+
+    } else  if (command.compare("punt-fallback-show") == 0) {
+        u_int32_t    count = (command_args.size() > 0) ?
+                     std::strtoul(command_args.at(0).c_str(), NULL, 0) : 10;
+        bool         hex   = (command_args.size() > 1) &&
+                             (command_args.at(1).compare("hex") == 0);
+        AftPacketPtr pkt;
+
+        for (u_int32_t i = 0; (i < count) && _puntDispatcher.fallbackPop(pkt); i++) {
+            AfiPuntClass puntClass = _puntDispatcher.classify(pkt->data(),
+                                                              pkt->dataSize());
+            std::cout << "Sandbox Id : " << pkt->sandboxId();
+            std::cout << " Port Index : " << pkt->portIndex();
+            std::cout << " Class : " << AfiPuntDispatcher::className(puntClass);
+            std::cout << std::endl;
+            std::cout << "  " << AfiPktDissector(pkt->data(), pkt->dataSize());
+            std::cout << std::endl;
+            if (hex) {
+                pktTrace("pkt data", (char *)(pkt->data()), pkt->dataSize());
+            }
+        }
 
-        pktLen = convertHexPktStrToPkt(ethernet_pkt,
-                                       pktBuff,
-                                       PKT_BUFF_SIZE);
+    } else  if (command.compare("capture-start") == 0) {
+        if (command_args.size() < 1) {
+            std::cout << "Please provide file name" << std::endl;
+            std::cout << "Example: capture-start /tmp/afi.pcapng 100 60 10" << std::endl;
+            return;
+        }
+        uint64_t rotateMB  = (command_args.size() > 1) ?
+                    std::strtoull(command_args.at(1).c_str(), NULL, 0) : 0;
+        uint32_t rotateSec = (command_args.size() > 2) ?
+                    std::strtoul(command_args.at(2).c_str(), NULL, 0) : 0;
+        uint32_t maxFiles  = (command_args.size() > 3) ?
+                    std::strtoul(command_args.at(3).c_str(), NULL, 0) : 0;
+
+        if (_capture.open(command_args.at(0), rotateMB * 1024 * 1024,
+                          rotateSec, maxFiles) == 0) {
+            std::cout << "Capturing to " << command_args.at(0) << std::endl;
+        }
 
-        injectL2Packet(sandboxId, portIndex, (uint8_t *)pktBuff, pktLen);
+    } else  if (command.compare("capture-stop") == 0) {
+        _capture.close();
+        _capture.description(std::cout) << std::endl;
+
+    } else  if (command.compare("capture-stats") == 0) {
+        _capture.description(std::cout) << std::endl;
+
+    } else  if ((command.compare("local-server-show") == 0) ||
+                (command.compare("local-server-delay") == 0) ||
+                (command.compare("local-server-echo") == 0)) {
+        if (_localServer == nullptr) {
+            std::cout << "Not using the local AFI server" << std::endl;
+        } else  if (command.compare("local-server-show") == 0) {
+            _localServer->description(std::cout);
+        } else  if (command.compare("local-server-echo") == 0) {
+            _localServer->setHostpathEcho((command_args.size() > 0) &&
+                                (command_args.at(0).compare("on") == 0));
+        } else  if ((command_args.size() < 2) || (command_args.size() > 3) ||
+                    ((command_args.at(0).compare("rpc") != 0) &&
+                     (command_args.at(0).compare("hostpath") != 0))) {
+            std::cout << "Please provide rpc or hostpath, latency and jitter" << std::endl;
+            std::cout << "Example: local-server-delay rpc 200 50" << std::endl;
+        } else {
+            AfiLocalDelay delay;
+            delay.latencyUs = std::strtoul(command_args.at(1).c_str(), NULL, 0);
+            delay.jitterUs  = (command_args.size() > 2) ?
+                    std::strtoul(command_args.at(2).c_str(), NULL, 0) : 0;
+            if (command_args.at(0).compare("rpc") == 0) {
+                _localServer->setRpcDelay(delay);
+            } else {
+                _localServer->setHostpathDelay(delay);
+            }
+        }
 
     } else  if (command.compare("history") == 0) {
         std::cout << "Command history: " << std::endl;
@@ -1066,7 +3901,7 @@ AfiClient::handleCliCommand(std::string const & command_str)
     } else  if ((command.compare("quit") == 0) ||
                 (command.compare("exit") == 0)) {
         std::cout << "Exiting... " << std::endl;
-        exit(1);
+        _cliQuit = true;
     } else {
         std::cout << "Invalid command '" << command << "'" << std::endl;
     }
@@ -1086,7 +3921,11 @@ AfiClient::handleCliCommand(std::string const & command_str)
 // cli
 //
 // @brief
-// This example afi client's command line interface
+// This example afi client's command line interface. Commands are
+// read from standard input (terminal, pipe or file) and run on the
+// calling thread, so that commands waiting on the AFI server do not
+// hold up the hostpath reactor threads. Returns on 'quit' or at the
+// end of input.
 //
 // @param[in] void
 // @return void
@@ -1104,13 +3943,16 @@ AfiClient::cli(void) {
     std::cout << std::endl;
     std::cout << std::endl;
 
-    for (std::string command_str; std::cout << "____AFIClient____ > " &&
-         std::getline(std::cin, command_str); )
-    {
+    std::string command_str;
+
+    while (!_cliQuit) {
+        std::cout << "____AFIClient____ > " << std::flush;
+        if (!std::getline(std::cin, command_str)) {
+            break;
+        }
         if ((!command_str.empty()) &&
             (command_str.find_first_not_of(' ') != std::string::npos)) {
             handleCliCommand(command_str);
         }
     }
 }
-
@@ -49,19 +49,259 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <mutex>
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+#include <netinet/udp.h>
+#include <pthread.h>
+#include <chrono>
+#include <map>
+#include <unordered_map>
 
 #include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/atomic.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include "jnx/Aft.h"
 #include "jnx/AfiTransport.h"
 #include "Utils.h"
+#include "AfiTrace.h"
+#include "AfiPacketPool.h"
+#include "AfiHandlerAlloc.h"
+#include "AfiHistogram.h"
+#include "AfiLocalServer.h"
+#include "AfiPcapWriter.h"
+#include "AfiPktDissector.h"
+#include "AfiPktTemplate.h"
+#include "AfiPuntDispatcher.h"
+#include "AfiShmChannel.h"
+#include "AfiTokenBucket.h"
+#include "AfiUring.h"
 
 #define BOOST_UDP boost::asio::ip::udp::udp
 
+//
+// UDP generic segmentation offload (Linux 4.18+). Defined here so that
+// the client still builds against older kernel headers; availability
+// is detected at run time.
+//
+#ifndef SOL_UDP
+#define SOL_UDP                 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT             103
+#endif
+
+#define AFI_HP_TX_BATCH_MAX     64      // Frames per sendmmsg/GSO flush
+#define AFI_HP_TX_RING_SIZE     (AFI_HP_TX_BATCH_MAX * 2048)
+#define AFI_HP_TX_GSO_SEG_MAX   1472    // Largest GSO segment (1500 MTU)
+#define AFI_HP_UDP_PAYLOAD_MAX  65507   // Largest IPv4 UDP payload
+#define AFI_HP_PKT_MAX          AFI_PKT_POOL_DATA_MAX // Largest datagram
+#define AFI_HP_INJECT_BURST_MAX 1000000 // Packets of one inject-l2-pkts
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT            15
+#endif
+#ifndef SO_TIMESTAMPNS
+#define SO_TIMESTAMPNS          35
+#define SCM_TIMESTAMPNS         SO_TIMESTAMPNS
+#endif
+
+#define AFI_HP_RX_CTRL_SIZE     CMSG_SPACE(sizeof(struct timespec))
+
+#define AFI_HP_RCV_BUDGET       64      // Packets received per completion
+#define AFI_HP_SB_Q_MAX         4096    // Packets queued to a sandbox strand
+#define AFI_HP_RCVBUF_SIZE      (4 * 1024 * 1024)
+#define AFI_HP_TX_FLUSH_USEC    200     // Max delay of queued inject packets
+#define AFI_HP_AGE_INTERVAL_MS  1000    // Sandbox context aging interval
+#define AFI_HP_SB_AGE_INTERVALS 60      // Idle intervals before aging out
+#define AFI_HP_SB_PORTS_MAX     256     // Rate limited ports per sandbox
+#define AFI_HP_URING_ENTRIES    256     // io_uring receive ring entries
+#define AFI_HP_URING_BUFS       4096    // io_uring receive buffers
+#define AFI_HP_URING_BUF_SIZE   2048    // recvmsg_out, address, datagram
+#define AFI_HP_SHM_TX_WAIT_MS   100     // Max wait for shm send ring space
+
+//
+// Hostpath I/O engine
+//
+typedef enum {
+    AfiHpEngineAsio = 0,        //< Reactor receive, then recvmsg per packet
+    AfiHpEngineRecvmmsg,        //< Reactor receive, then recvmmsg batches
+    AfiHpEngineUring,           //< io_uring multishot recvmsg on one thread
+                                //  and batched sends (AFI_HAVE_IO_URING)
+    AfiHpEngineShm,             //< Shared memory channel to a co-located
+                                //  peer (AfiShmChannel); the hostpath
+                                //  address is the peer's socket path
+} AfiHpEngine;
+
+extern const char *afiHpEngineName(AfiHpEngine engine);
+extern int afiHpEngineParse(const std::string &name, AfiHpEngine &engine);
+
+//
+// Turn on a boolean socket option (SO_REUSEPORT, SO_TIMESTAMPNS).
+// Returns 0 - Success, -1 - Error (errno).
+//
+static inline int
+afiSockOptOn (BOOST_UDP::socket &sock, int level, int name)
+{
+    int on = 1;
+    return setsockopt(sock.native_handle(), level, name, &on, sizeof(on));
+}
+
+//
+// Counter update by the (single) thread owning the counter
+//
+static inline void
+afiStatBump (std::atomic<uint64_t> &counter, uint64_t n = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+}
+
+//
+// @struct  AfiHpPortStats
+// @brief   Hostpath latencies and rates of one sandbox port
+//
+// Punted packets are timestamped when received (by the kernel, with
+// SO_TIMESTAMPNS), when their batch is dispatched and when the punt
+// handlers of the batch are done; injected packets when submitted and
+// when sent. Punt statistics are updated on the sandbox strand, inject
+// statistics with the hostpath send ring locked. Latencies are in ns.
+//
+struct AfiHpPortStats {
+    AfiHistogram      puntQueue;    //< Receive to dispatch
+    AfiHistogram      puntHandler;  //< Dispatch to handlers done
+    AfiHistogram      puntTotal;    //< Receive to handlers done
+    AfiHistogram      injectSend;   //< Submit to sent
+    AfiRateMeter      punt;         //< Punted packets and bytes
+    AfiRateMeter      inject;       //< Injected packets and bytes
+};
+
+//
+// @struct  AfiHpSandbox
+// @brief   Hostpath context of one sandbox
+//
+// Packets punted by a sandbox are processed on the sandbox's strand:
+// any reactor thread may run them, but never two at a time, so that
+// per port ordering is kept without a thread per sandbox. Receivers
+// queue packets and post one drain per batch to the strand; the drain
+// hands the batch to the punt dispatcher.
+//
+// Before a packet is queued it has to pass its port's token bucket, so
+// that a flood of punted packets costs no more than a header parse.
+//
+struct AfiHpSandbox {
+    //
+    // Sandbox hostpath statistics
+    //
+    struct Stats {
+        std::atomic<uint64_t>  queued;      //< Packets queued to the strand
+        std::atomic<uint64_t>  rateDrops;   //< Dropped by port rate limit
+        std::atomic<uint64_t>  queueDrops;  //< Dropped, queue full
+        std::atomic<uint64_t>  drains;      //< Strand drains (batches)
+        std::atomic<uint64_t>  processed;   //< Packets processed
+    };
+
+    AfiHpSandbox(boost::asio::io_service &ioService, AftSandboxId sandboxId)
+        : id(sandboxId), strand(ioService),
+          portBuckets(new AfiTokenBucket[AFI_HP_SB_PORTS_MAX]),
+          portStats(new AfiHpPortStats *[AFI_HP_SB_PORTS_MAX]()),
+          active(true), aged(false), idleIntervals(0), stats() {
+        queue.reserve(AFI_HP_SB_Q_MAX);
+        batch.reserve(AFI_HP_SB_Q_MAX);
+        queueTs.reserve(AFI_HP_SB_Q_MAX);
+        batchTs.reserve(AFI_HP_SB_Q_MAX);
+        batchStats.reserve(AFI_HP_SB_Q_MAX);
+    }
+
+    //
+    // Token bucket of an input port (ports beyond the last share one)
+    //
+    AfiTokenBucket &portBucket(AftIndex portIndex) {
+        return portBuckets[std::min<AftIndex>(portIndex,
+                                              AFI_HP_SB_PORTS_MAX - 1)];
+    }
+
+    AftSandboxId                     id;
+    boost::asio::io_service::strand  strand;        //< Serializes processing
+    AfiHandlerMemory                 drainMem;      //< Drain handler memory
+    spinlock                         queueLock;     //< Protects queue
+    std::vector<AftPacketPtr>        queue;         //< Packets to process
+    std::vector<AftPacketPtr>        batch;         //< queue being processed
+    std::vector<uint64_t>            queueTs;       //< Receive times of queue
+    std::vector<uint64_t>            batchTs;       //< Receive times of batch
+    std::vector<AfiHpPortStats *>    batchStats;    //< Port stats of batch
+    AfiPuntDispatcher::Scratch       puntScratch;   //< Dispatch scratch space
+    std::unique_ptr<AfiTokenBucket[]> portBuckets;  //< Punt rate limits
+    std::unique_ptr<AfiHpPortStats *[]> portStats;  //< Strand only, owned
+                                                    //  by the client
+    std::atomic<bool>                active;        //< Packets since aging ran
+    std::atomic<bool>                aged;          //< Removed from client
+    int                              idleIntervals; //< Aging timer only
+    Stats                            stats;
+};
+
+typedef std::shared_ptr<AfiHpSandbox> AfiHpSandboxPtr;
+
+//
+// @struct  AfiHpRcvr
+// @brief   Hostpath receiver context
+//
+// Each receiver owns a SO_REUSEPORT socket bound to the hostpath port
+// and keeps one asynchronous receive outstanding on it. The receive
+// completes on whichever reactor thread is free; the receiver then
+// reads what else is queued on the socket (up to AFI_HP_RCV_BUDGET
+// packets) and hands the packets to their sandbox strands.
+//
+struct AfiHpRcvr {
+    //
+    // Receiver statistics
+    //
+    struct Stats {
+        std::atomic<uint64_t>  rxPkts;      //< Packets received on socket
+        std::atomic<uint64_t>  rxBytes;     //< Bytes received on socket
+        std::atomic<uint64_t>  rxErrors;    //< Receive/parse errors
+    };
+
+    AfiHpRcvr(int rcvrId)
+        : id(rcvrId), sock(nullptr),
+          pool(AftPacket::PacketDirReceive),
+          mmsgPkts(AFI_HP_RCV_BUDGET), stats() {
+    }
+
+    int                                 id;         //< Receiver index
+    BOOST_UDP::socket                  *sock;       //< Hostpath socket
+    std::unique_ptr<BOOST_UDP::socket>  ownSock;    //< Unless client's own
+    BOOST_UDP::endpoint                 sender;     //< Sender of rcvPkt
+    boost::array<boost::asio::mutable_buffer, 2> rcvBufs; //< Into rcvPkt
+    AftPacketPtr                        rcvPkt;     //< Async receive target
+    AfiHandlerMemory                    rcvMem;     //< Receive handler memory
+    AfiPacketPool                       pool;       //< Receive packets
+    AfiHpSandboxPtr                     sbCache;    //< Last sandbox used
+    std::vector<AftPacketPtr>           mmsgPkts;   //< recvmmsg targets
+    struct mmsghdr                      mmsg[AFI_HP_RCV_BUDGET];
+    struct iovec                        mmsgIov[AFI_HP_RCV_BUDGET][2];
+    char                                mmsgCtrl[AFI_HP_RCV_BUDGET]
+                                                [AFI_HP_RX_CTRL_SIZE];
+    Stats                               stats;
+};
+
+//
+// @struct  AfiL2Pkt
+// @brief   Layer 2 packet to be injected as part of a batch
+//
+struct AfiL2Pkt {
+    AftIndex     portIndex;     //< Output port index
+    uint8_t     *l2Packet;      //< Layer 2 packet
+    int          l2PacketLen;   //< Layer 2 packet length
+};
+
+typedef std::vector<AfiL2Pkt> AfiL2PktVector;
+
 //
 // @class   AfiClient
 // @brief   Implements a sample AFI client 
@@ -77,39 +317,107 @@ public:
               const std::string       &afiHostpathAddr,
               short                    port,
               bool                     startHospathSrvr,
-              bool                     tracing)
+              bool                     tracing,
+              int                      numHpRcvrs = 1,
+              AfiHpEngine              hpEngine   = AfiHpEngineAsio)
               : _afiServerAddr(afiServerAddr),
                 _afiHostpathAddr(afiHostpathAddr),
                 _ioService(ioService),
-                _hpUdpSock(ioService, BOOST_UDP::endpoint(BOOST_UDP::v4(), port)),
+                _hpUdpSock(_hpIoService),
+                _hpPort(port),
+                _hpTxRing(AFI_HP_TX_RING_SIZE),
+                _hpTxGso(true),
+                _hpTxPool(AftPacket::PacketDirTransmit),
+                _hpTxStaged(0),
+                _hpTxStagedLen(0),
+                _hpTxStatsSb(0),
+                _hpTxStats(AFI_HP_SB_PORTS_MAX),
+                _hpTxTimer(_hpIoService),
+                _hpTxTimerArmed(false),
+                _hpAgedStats(),
+                _hpAgeTimer(_hpIoService),
+                _hpEngine(hpEngine),
+#ifdef AFI_HAVE_IO_URING
+                _hpUringStopFd(-1),
+#endif
+                _cliInjectSeq(-1),
+                _cliQuit(false),
                 _tracing(tracing) {
 
-        BOOST_UDP::resolver resolver(_ioService);
-
-        std::vector<std::string> hostpathAddr_substrings;
-        boost::split(hostpathAddr_substrings, _afiHostpathAddr,
-                     boost::is_any_of(":"));
-        std::string &hpIpStr      =  hostpathAddr_substrings.at(0);
-        std::string &hpUDPPortStr =  hostpathAddr_substrings.at(1);
-
-        BOOST_UDP::resolver::query query(BOOST_UDP::v4(), hpIpStr, hpUDPPortStr);
-        BOOST_UDP::resolver::iterator iterator =
-                         resolver.resolve(query);
-        _vmxtHostpathEndpoint = *iterator;
+        if (_hpEngine == AfiHpEngineShm) {
+            //
+            // Hostpath channel of the co-located peer: no UDP socket
+            //
+            _hpShm.reset(new AfiShmChannel());
+            if (_hpShm->connect(_afiHostpathAddr) != 0) {
+                _hpShm.reset();
+            }
+        } else {
+            //
+            // Hostpath socket. With several receivers all of them bind
+            // the hostpath port with SO_REUSEPORT.
+            //
+            _hpUdpSock.open(BOOST_UDP::v4());
+            if ((numHpRcvrs > 1) &&
+                (afiSockOptOn(_hpUdpSock, SOL_SOCKET, SO_REUSEPORT) != 0)) {
+                perror("setsockopt(SO_REUSEPORT)");
+            }
+            _hpUdpSock.bind(BOOST_UDP::endpoint(BOOST_UDP::v4(), port));
+
+            BOOST_UDP::resolver resolver(_ioService);
+
+            std::vector<std::string> hostpathAddr_substrings;
+            boost::split(hostpathAddr_substrings, _afiHostpathAddr,
+                         boost::is_any_of(":"));
+            std::string &hpIpStr      =  hostpathAddr_substrings.at(0);
+            std::string &hpUDPPortStr =  hostpathAddr_substrings.at(1);
+
+            BOOST_UDP::resolver::query query(BOOST_UDP::v4(), hpIpStr,
+                                             hpUDPPortStr);
+            BOOST_UDP::resolver::iterator iterator =
+                             resolver.resolve(query);
+            _vmxtHostpathEndpoint = *iterator;
+        }
 
         //
-        // Initialize transport connection to AFI server
+        // Initialize transport connection to AFI server, or to the
+        // local stand-in (offline runs), which answers the hostpath too.
+        // An invalid local server address is taken for a server's.
         //
-        _transport = AfiTransport::create(_afiServerAddr);
+        AfiLocalDelay localDelay;
+        if (AfiLocalServer::parseAddr(_afiServerAddr, localDelay) > 0) {
+            _localServer = AfiLocalServer::create();
+            _localServer->setRpcDelay(localDelay);
+            _localServer->setHostpathDelay(localDelay);
+            if ((_hpEngine != AfiHpEngineShm) &&
+                (_localServer->startHostpath(_afiHostpathAddr, port) != 0)) {
+                std::cout << "Local AFI server not answering the hostpath on ";
+                std::cout << _afiHostpathAddr << std::endl;
+            }
+            _transport = _localServer->transport();
+        } else {
+            _transport = AfiTransport::create(_afiServerAddr);
+        }
         assert(_transport != nullptr);
 
+        //
+        // Tracing is process wide: a client without it leaves it to
+        // the others (and to the trace command)
+        //
+        if (_tracing) {
+            afiTraceEnable(true);
+        }
+
         if (startHospathSrvr) {
-            startAfiPktRcvr();
+            startAfiPktRcvr(numHpRcvrs);
+        } else {
+            hpReactorStart(1);
         }
     }
 
     //  
-    // Destructor
+    // Destructor: stops the reactor threads, aborts pending hostpath
+    // operations
     //
     ~AfiClient();
 
@@ -118,6 +426,18 @@ public:
     //
     int openSandbox(const std::string &sandbox_name, u_int32_t numPorts);
 
+    //
+    // Close and release the open sandbox
+    //
+    int closeSandbox(void);
+
+    //
+    // Open sandbox, and the local AFI server (NULL unless the server
+    // address is "local")
+    //
+    const AftSandboxPtr &sandbox(void) const { return _sandbox; }
+    const AfiLocalServerPtr &localServer(void) const { return _localServer; }
+
     //
     // Add a routing table to the sandbox
     //
@@ -125,11 +445,21 @@ public:
                                AftNodeToken defaultTragetToken);
 
     //
-    // Add route to a routing table
+    // Add route to a routing table. Given a batch insert, this and the
+    // other calls that take one add their objects to it instead of
+    // sending them; the caller sends it with sandbox()->send().
     //
     int addRoute(AftNodeToken      rttNodeToken,
                  const std::string &prefix,
-                 AftNodeToken       routeTragetToken);
+                 AftNodeToken       routeTragetToken,
+                 const AftInsertPtr &batch = AftInsertPtr());
+
+    //
+    // Remove route from a routing table (batch: as for addRoute)
+    //
+    int removeRoute(AftNodeToken       rttNodeToken,
+                    const std::string &prefix,
+                    const AftRemovePtr &batch = AftRemovePtr());
 
     //
     // Create Index table
@@ -142,13 +472,14 @@ public:
     //
     int addIndexTableEntry(AftNodeToken iTableToken,
                            u_int32_t    entryIndex,
-                           AftNodeToken entryTargetToken);
-
+                           AftNodeToken entryTargetToken,
+                           const AftInsertPtr &batch = AftInsertPtr());
 
     //
     // Create list
     //
-    AftNodeToken createList (AftTokenVector tokVec);
+    AftNodeToken createList (AftTokenVector tokVec,
+                             const AftInsertPtr &batch = AftInsertPtr());
 
     //
     // Set next node for an input port
@@ -167,14 +498,16 @@ public:
                                    const std::string &src_mac,
                                    const std::string &ivlanStr,
                                    const std::string &ovlanStr,
-                                   AftNodeToken       nextToken);
+                                   AftNodeToken       nextToken,
+                                   const AftInsertPtr &batch = AftInsertPtr());
 
     //
     // Add MPLS label encapsulation node
     //
     AftNodeToken addLabelEncap(const std::string &outerLabelStr,
                                const std::string &innerLabelStr,
-                               AftNodeToken       nextToken);
+                               AftNodeToken       nextToken,
+                               const AftInsertPtr &batch = AftInsertPtr());
 
     //
     // Add MPLS label decapsulation node
@@ -192,9 +525,10 @@ public:
     AftNodeToken addDiscardNode(void);
 
     //
-    // Handler hostpath packet from sandbox
+    // Handler hostpath packet from sandbox, waiting up to timeoutMs
+    // (< 0: as long as it takes; errno ETIMEDOUT when it expires)
     //
-    int recvHostPathPacket(AftPacketPtr &pkt);
+    int recvHostPathPacket(AftPacketPtr &pkt, int timeoutMs = -1);
 
     //
     // Inject layer 2 packet to a port
@@ -203,21 +537,146 @@ public:
                        AftIndex      portIndex,
                        uint8_t      *l2Packet,
                        int           l2PacketLen);
+
+    //
+    // Inject a batch of layer 2 packets
+    //
+    int injectL2Packets(AftSandboxId sandboxId, const AfiL2PktVector &pkts);
+
+    //
+    // Queue layer 2 packet for injection without blocking; queued
+    // packets are sent in batches by the reactor
+    //
+    int queueL2Packet(AftSandboxId  sandboxId,
+                      AftIndex      portIndex,
+                      uint8_t      *l2Packet,
+                      int           l2PacketLen);
+
+    //
+    // Inject a packet template now, or queue it like queueL2Packet
+    //
+    int injectTemplate(const AfiPktTemplate &tmpl);
+    int queueTemplate(const AfiPktTemplate &tmpl);
+
+    //
+    // Send the packets queued so far now, from the calling thread
+    //
+    int flushL2Packets(void);
+
+    //
+    // Install a policer (and offered/passed counters) in front of the
+    // punt output port for packets of an input port. Returns the token
+    // to use instead of the punt port token in that port's pipeline.
+    //
+    AftNodeToken addPuntPolicer(AftIndex inputPortIndex,
+                                AftIndex puntPortIndex,
+                                uint64_t rate,
+                                uint64_t burstSize,
+                                bool     packetMode);
+
+    //
+    // Limit packets punted by a sandbox port (AfiPuntDispatcher::
+    // AnySandbox/AnyPort for all) that the client accepts. pps 0
+    // removes the limit.
+    //
+    void setPuntRateLimit(AftSandboxId sandboxId,
+                          AftIndex     portIndex,
+                          uint64_t     pps,
+                          uint64_t     burst);
+
+    //
+    // Punt dispatcher: register handlers for punted packets here
     //
-    // Command line interface for this AFI client
+    AfiPuntDispatcher &puntDispatcher(void) { return _puntDispatcher; }
+
+    //
+    // pcapng capture of punted and injected packets
+    //
+    AfiPcapWriter &capture(void) { return _capture; }
+
+    //
+    // Command line interface for this AFI client. Reads and runs
+    // commands on the calling thread until 'quit' or end of input.
     //
     void cli(void);
 
 private:
     std::string                 _afiServerAddr;   //< AFI server address
     std::string                 _afiHostpathAddr; //< AFI hostpath address
-    boost::asio::io_service&    _ioService;
+    boost::asio::io_service&    _ioService;     //< Caller's (resolver)
+
+    //
+    // Memory of hostpath handlers, declared before the reactor so that
+    // it outlives the operations using it
+    //
+    AfiHandlerMemory            _hpTxTimerMem;
+    AfiHandlerMemory            _hpAgeMem;
+    std::vector<std::unique_ptr<AfiHpRcvr>> _hpRcvrs; //< Hostpath receivers
+
+    boost::asio::io_service     _hpIoService;   //< Hostpath reactor (own)
     BOOST_UDP::socket           _hpUdpSock;     //< Hospath UDP socket
+    short                       _hpPort;        //< Hostpath UDP port
 
     BOOST_UDP::endpoint         _vmxtHostpathEndpoint;
 
+    //
+    // Protects the hostpath send ring. A mutex: it is held across the
+    // send syscalls, which may block.
+    //
+    std::mutex                  _hpTxLock;
+    std::vector<uint8_t>        _hpTxRing;  //< Hostpath send ring
+    struct iovec                _hpTxIov[AFI_HP_TX_BATCH_MAX];
+    struct mmsghdr              _hpTxMsg[AFI_HP_TX_BATCH_MAX];
+    bool                        _hpTxGso;   //< False if UDP GSO unsupported
+    AfiPacketPool               _hpTxPool;  //< Inject packets (_hpTxLock)
+    AftPacketPtr                _hpTxHdr;   //< Header of last staged frame
+    int                         _hpTxStaged;    //< Frames staged in ring
+    size_t                      _hpTxStagedLen; //< Bytes staged in ring
+    uint64_t                    _hpTxStagedNs[AFI_HP_TX_BATCH_MAX];
+    AfiHpPortStats             *_hpTxStagedStats[AFI_HP_TX_BATCH_MAX];
+    AftSandboxId                _hpTxStatsSb;   //< Sandbox of _hpTxStats
+    std::vector<AfiHpPortStats *> _hpTxStats;   //< Port stats cache
+    boost::asio::steady_timer   _hpTxTimer;     //< Flushes queued packets
+    bool                        _hpTxTimerArmed;
+
+    spinlock                    _hpSbLock;  //< Protects _hpSandboxes
+    std::unordered_map<AftSandboxId, AfiHpSandboxPtr> _hpSandboxes;
+    AfiHpSandbox::Stats         _hpAgedStats;   //< Sandboxes aged out
+    boost::asio::steady_timer   _hpAgeTimer;    //< Ages idle sandboxes
+    AfiPuntDispatcher           _puntDispatcher; //< Punted packet handlers
+    AfiPcapWriter               _capture;       //< Packet capture
+
+    typedef std::pair<AftSandboxId, AftIndex> AfiSbPort;
+    typedef std::pair<uint64_t, uint64_t>     AfiRateBurst;
+    spinlock                    _hpRateLock;    //< Protects _hpRateLimits
+    std::map<AfiSbPort, AfiRateBurst> _hpRateLimits; //< Punt rate limits
+    spinlock                    _hpStatsLock;   //< Protects _hpPortStats
+    std::map<AfiSbPort, std::unique_ptr<AfiHpPortStats>> _hpPortStats;
+
+    //
+    // Hostpath I/O engine; the io_uring receive thread falls back to
+    // the reactor while reactor receivers read it
+    //
+    std::atomic<AfiHpEngine>    _hpEngine;
+#ifdef AFI_HAVE_IO_URING
+    std::unique_ptr<AfiUring>   _hpRxUring; //< Receive ring (own thread)
+    std::unique_ptr<AfiUring>   _hpTxUring; //< Send ring (_hpTxLock)
+    struct msghdr               _hpUringMsg;    //< Multishot recvmsg layout
+    int                         _hpUringStopFd; //< Stops receive thread
+#endif
+    std::unique_ptr<AfiShmChannel> _hpShm;      //< Shared memory channel
+    std::unique_ptr<boost::asio::posix::stream_descriptor> _hpShmDoorbell;
+
+    std::unique_ptr<boost::asio::io_service::work> _work; //< Keeps run() up
+    std::vector<std::thread>    _threads;   //< Reactor (and io_uring) threads
+
+    AfiPktTemplate              _cliInjectTmpl; //< inject-l2-pkt(s) packet
+    int                         _cliInjectSeq;  //< Its ICMP sequence field
+    bool                        _cliQuit;       //< 'quit' entered
+
     AftSandboxPtr               _sandbox;
     AftTransportPtr             _transport;
+    AfiLocalServerPtr           _localServer;   //< Local AFI server, if used
 
     std::vector<std::string>    _commandHistory;
     bool                        _tracing;  //< True if debug tracing is enabled
@@ -228,11 +687,83 @@ private:
     void handleCliCommand(std::string const & command_str);
 
     //
-    // Hostpath UDP server
+    // Hostpath receivers and reactor threads
+    //
+    void startAfiPktRcvr(int numHpRcvrs);
+    void hpReactorStart(int numThreads);
+    void hpRcvStart(AfiHpRcvr &rcvr);
+    void hpRcvDone(AfiHpRcvr                      &rcvr,
+                   const boost::system::error_code &ec,
+                   size_t                          recvlen);
+
+    //
+    // Receive one hostpath packet from a socket
     //
-    void hostPathUDPSrvr(void);
+    int hpRecv(int fd, AftPacketPtr &pkt, uint64_t &rxNs);
+    int hpRecvParse(AftPacketPtr &pkt, size_t recvlen, bool truncated);
+    int hpRecvMmsg(AfiHpRcvr &rcvr, int maxPkts, uint64_t nowNs);
 
-    void startAfiPktRcvr(void);
+    //
+    // io_uring engine
+    //
+    int hpUringStart(AfiHpRcvr &rcvr);
+    void hpUringLoop(AfiHpRcvr &rcvr);
+    int hpUringRecvArm(AfiHpRcvr &rcvr);
+    void hpUringRecv(AfiHpRcvr &rcvr, const uint8_t *buf, size_t len,
+                     uint64_t nowNs);
+    void hpUringStop(void);
+
+    //
+    // Shared memory channel engine
+    //
+    int hpShmStart(AfiHpRcvr &rcvr);
+    void hpShmRecv(AfiHpRcvr &rcvr);
+    int hpShmRecvSync(AftPacketPtr &pkt, uint64_t deadlineNs);
+    int hpShmSend(const void *frame, size_t frameLen);
+    int hpTxFlushShm(int numFrames);
+
+    //
+    // Hostpath sandbox strands and processing
+    //
+    AfiHpSandboxPtr &hpSandbox(AfiHpRcvr &rcvr, AftSandboxId sandboxId);
+    void hpQueue(AfiHpRcvr &rcvr, AftPacketPtr &pkt, uint64_t nowNs,
+                 uint64_t rxNs);
+    void hpRateApply(AfiHpSandbox &sb);
+    void hpRateStats(std::ostream &os);
+    void hpDrain(AfiHpSandboxPtr sb);
+    void hpProcess(AfiHpSandbox &sb, AfiPktBatch &pkts,
+                   const std::vector<uint64_t> &rxTs);
+    void hpAgeStart(void);
+    void hpAge(void);
+    void hpRcvrStats(std::ostream &os);
+
+    //
+    // Per port hostpath latencies and rates
+    //
+    AfiHpPortStats &hpPortStats(AftSandboxId sandboxId, AftIndex portIndex);
+    AfiHpPortStats &hpPortStats(AfiHpSandbox &sb, AftIndex portIndex);
+    std::vector<std::pair<AfiSbPort, AfiHpPortStats *>> hpPortStatsList(void);
+    void hpPortStatsShow(std::ostream &os);
+    void hpPortStatsDump(std::ostream &os);
+
+    //
+    // Stage frames in and flush hostpath send ring
+    //
+    int hpTxStage(AftSandboxId  sandboxId,
+                  AftIndex      portIndex,
+                  const uint8_t *l2Packet,
+                  int           l2PacketLen,
+                  uint64_t      submitNs);
+    int hpTxStageFrame(const AftPacketPtr &hdr,
+                       const uint8_t      *l2Packet,
+                       uint64_t            submitNs);
+    int hpTxFlushStaged(void);
+    int hpTxSend(const uint8_t *frame, size_t frameLen);
+    AfiHpPortStats &hpTxPortStats(AftSandboxId sandboxId, AftIndex portIndex);
+    void hpTxTimerStart(void);
+    int hpTxFlush(int numFrames);
+    int hpTxFlushGso(int firstFrame, int numFrames);
+    int hpTxFlushUring(int firstFrame, int numFrames);
 };
 
 #endif // __AfiClient__
@@ -0,0 +1,888 @@
+//
+// AfiDataplane.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <string.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "AfiDataplane.h"
+
+#define AFI_DP_ETH_P_IPV4       0x0800
+#define AFI_DP_ETH_P_VLAN       0x8100
+#define AFI_DP_ETH_P_QINQ       0x88a8
+#define AFI_DP_ETH_P_IPV6       0x86dd
+#define AFI_DP_ETH_P_MPLS       0x8847
+#define AFI_DP_ETH_P_MPLS_MC    0x8848
+#define AFI_DP_LABEL_TTL        255     // TTL of pushed labels
+
+const char *
+afiDpVerdictName (AfiDpVerdict verdict)
+{
+    switch (verdict) {
+    case AfiDpForward:      return "forward";
+    case AfiDpDiscard:      return "discard";
+    case AfiDpPoliced:      return "policed";
+    case AfiDpNoNext:       return "no-next";
+    case AfiDpUnsupported:  return "unsupported";
+    case AfiDpError:        return "error";
+    }
+    return "?";
+}
+
+static inline uint16_t
+get16 (const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+get32 (const uint8_t *p)
+{
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static inline bool
+isVlanTpid (uint16_t type)
+{
+    return (type == AFI_DP_ETH_P_VLAN) || (type == AFI_DP_ETH_P_QINQ);
+}
+
+//
+// Packet kind of an ethertype, PktL2 if not IP or MPLS
+//
+static uint8_t
+kindOfEtherType (uint16_t etherType)
+{
+    switch (etherType) {
+    case AFI_DP_ETH_P_IPV4:     return AfiDataplane::PktIpv4;
+    case AFI_DP_ETH_P_IPV6:     return AfiDataplane::PktIpv6;
+    case AFI_DP_ETH_P_MPLS:
+    case AFI_DP_ETH_P_MPLS_MC:  return AfiDataplane::PktMpls;
+    }
+    return AfiDataplane::PktL2;
+}
+
+//
+// @fn
+// load
+//
+// @brief
+// Load a layer 2 frame received on an input port. Untagged IPv4,
+// IPv6 and MPLS frames lose their Ethernet header.
+//
+// @param[in]
+//     port Input port index
+// @param[in]
+//     frame Layer 2 frame
+// @param[in]
+//     frameLen Frame length
+// @return 0 - Success, -1 - Frame too short or too long
+//
+
+int
+AfiDpPkt::load (AftIndex port, const uint8_t *frame, size_t frameLen)
+{
+    if ((frameLen < 14) || (frameLen > AFI_DP_PKT_MAX)) {
+        return -1;
+    }
+
+    data    = buf + AFI_DP_HEADROOM;
+    len     = frameLen;
+    kind    = kindOfEtherType(get16(frame + 12));
+    verdict = AfiDpNoNext;
+    steps   = 0;
+    inPort  = port;
+    outPort = 0;
+    path    = 0;
+    memcpy(data, frame, frameLen);
+
+    if (kind != AfiDataplane::PktL2) {
+        data += 14;
+        len  -= 14;
+    }
+    return 0;
+}
+
+//
+// Controlled prefix expansion: routes have to be inserted shortest
+// first, so that a longer prefix overwrites the ranges it covers and
+// chunks are only created below leaves. The prefix is masked to its
+// length first: host bits would move the ranges filled past the table
+// or chunk end.
+//
+int
+AfiDataplane::Lpm::insert (uint32_t prefix, int len, uint32_t value)
+{
+    if ((len < 0) || (len > 32)) {
+        return -1;
+    }
+    prefix &= len ? ~0u << (32 - len) : 0;
+
+    if (len <= 16) {
+        uint32_t first = prefix >> 16;
+        uint32_t count = 1u << (16 - len);
+        std::fill(tbl.begin() + first, tbl.begin() + first + count, value);
+        return 0;
+    }
+
+    //
+    // Chunk below entry e, created from the leaf it replaces
+    //
+    uint32_t e = prefix >> 16;
+    for (int level = 1; ; level++) {
+        if (!(tbl[e] & LpmChunk)) {
+            uint32_t chunk = tbl.size();
+            tbl.resize(chunk + 256, tbl[e]);
+            tbl[e] = chunk | LpmChunk;
+        }
+        uint32_t base  = tbl[e] & ~LpmChunk;
+        int      shift = (level == 1) ? 8 : 0;
+        int      bits  = (level == 1) ? 24 : 32;
+        uint32_t index = (prefix >> shift) & 0xff;
+
+        if (len <= bits) {
+            uint32_t count = 1u << (bits - len);
+            std::fill(tbl.begin() + base + index,
+                      tbl.begin() + base + index + count, value);
+            return 0;
+        }
+        e = base + index;
+    }
+}
+
+//
+// Op of a node token, -1 for none. Tokens the model does not have get
+// an unsupported op.
+//
+int32_t
+AfiDataplane::opFor (AftNodeToken token)
+{
+    if (token == AFT_NODE_TOKEN_NONE) {
+        return -1;
+    }
+
+    auto it = _opByToken.find(token);
+    if (it != _opByToken.end()) {
+        return it->second;
+    }
+
+    Op op;
+    memset(&op, 0, sizeof(op));
+    op.type = OpUnsupported;
+    op.next = op.miss = -1;
+    if (token == AFT_NODE_TOKEN_DISCARD) {
+        op.type = OpDiscard;
+    }
+
+    int32_t index = _ops.size();
+    _ops.push_back(op);
+    _opTokens.push_back(token);
+    _opNames.push_back((op.type == OpDiscard) ? std::string("discard") :
+                       "missing " + std::to_string(token));
+    _opByToken[token] = index;
+    return index;
+}
+
+//
+// Lookup field of a table by its name
+//
+uint8_t
+AfiDataplane::fieldOf (const std::string &name)
+{
+    static const std::map<std::string, uint8_t> fields = {
+        { "packet.lookupkey",   FieldIpv4Dst },
+        { "packet.ip4.daddr",   FieldIpv4Dst },
+        { "packet.ether.vlan1", FieldVlan1 },
+        { "packet.ether.vlan2", FieldVlan2 },
+        { "packet.mpls.label",  FieldMplsLabel },
+    };
+
+    auto it = fields.find(name);
+    return (it != fields.end()) ? it->second : (uint8_t)FieldNone;
+}
+
+//
+// @fn
+// compileNode
+//
+// @brief
+// Compile a node of the model into op, its lookup structures and
+// templates into their arrays
+//
+// @param[in]
+//     node Node
+// @param[out]
+//     op Op
+// @param[in]
+//     model Sandbox model (entries)
+// @return 0 - Compiled, -1 - Unsupported node
+//
+
+int
+AfiDataplane::compileNode (const AftNodePtr      &node,
+                           Op                    &op,
+                           const AfiLocalSandbox &model)
+{
+    static const AfiLocalSandbox::EntryMap noEntries;
+
+    auto containerIt = model.entries.find(node->nodeToken());
+    const AfiLocalSandbox::EntryMap &entries =
+        (containerIt != model.entries.end()) ? containerIt->second :
+                                               noEntries;
+
+    memset(&op, 0, sizeof(op));
+    op.next = opFor(node->nodeNext());
+    op.miss = -1;
+
+    if (auto list = std::dynamic_pointer_cast<AftList>(node)) {
+        op.type = OpList;
+        op.arg  = _lists.size();
+        op.size = list->listNodes().size();
+        for (AftNodeToken token : list->listNodes()) {
+            int32_t member = opFor(token);
+            _lists.push_back(member);
+        }
+
+    } else if (auto tree = std::dynamic_pointer_cast<AftTree>(node)) {
+        op.type  = OpTree;
+        op.field = FieldIpv4Dst;
+        op.miss  = opFor(tree->treeDefaultNode());
+        op.arg   = _lpms.size();
+
+        struct Route {
+            uint32_t prefix;
+            int      len;
+            int32_t  op;
+        };
+        std::vector<Route> routes;
+        for (const auto &entry : entries) {
+            const AftKeyVector &keys = entry.second->entryKeys();
+            AftDataPrefix::Ptr  data = keys.empty() ? nullptr :
+                std::dynamic_pointer_cast<AftDataPrefix>(keys[0].data());
+            if ((data == nullptr) || (data->data().size() != 4) ||
+                (data->bitLength() > 32)) {
+                _skipped++;
+                continue;
+            }
+            Route r = { get32(data->dataArray()), (int)data->bitLength(),
+                        opFor(entry.second->entryNode()) };
+            routes.push_back(r);
+        }
+        std::stable_sort(routes.begin(), routes.end(),
+                         [](const Route &a, const Route &b) {
+                             return a.len < b.len;
+                         });
+
+        _lpms.push_back(Lpm());
+        for (const Route &r : routes) {
+            if (_lpms.back().insert(r.prefix, r.len, r.op + 1) != 0) {
+                _skipped++;
+                continue;
+            }
+            _routes++;
+        }
+
+    } else if (auto table = std::dynamic_pointer_cast<AftTable>(node)) {
+        op.type  = OpTable;
+        op.field = table->tableFields().empty() ? FieldNone :
+                   fieldOf(table->tableFields()[0].name());
+        op.miss  = opFor(table->tableDefaultNode());
+        op.arg   = _slots.size();
+        op.size  = table->tableMaximum();
+        _slots.resize(_slots.size() + op.size, -1);
+
+        for (const auto &entry : entries) {
+            const AftKeyVector &keys = entry.second->entryKeys();
+            AftDataInt::Ptr     data = keys.empty() ? nullptr :
+                std::dynamic_pointer_cast<AftDataInt>(keys[0].data());
+            if ((data == nullptr) || (data->value() >= op.size)) {
+                _skipped++;
+                continue;
+            }
+            int32_t target = opFor(entry.second->entryNode());
+            _slots[op.arg + data->value()] = target;
+        }
+
+    } else if (auto encap = std::dynamic_pointer_cast<AftEncap>(node)) {
+        op.arg = _templates.size();
+
+        if (encap->encapName() == "ethernet") {
+            //
+            // Destination, source, outer and inner tag, ethertype (set
+            // when the packet is encapsulated)
+            //
+            uint8_t tmpl[22];
+            memset(tmpl, 0, sizeof(tmpl));
+            for (const AftKey &key : encap->encapKeys()) {
+                auto addr = std::dynamic_pointer_cast<AftDataEtherAddr>(
+                                                                key.data());
+                if ((addr == nullptr) || (addr->data().size() != 6)) {
+                    continue;
+                }
+                if (key.field().name() == "packet.ether.daddr") {
+                    memcpy(tmpl, addr->dataArray(), 6);
+                } else if (key.field().name() == "packet.ether.saddr") {
+                    memcpy(tmpl + 6, addr->dataArray(), 6);
+                }
+            }
+            op.len = 12;
+            for (const char *param : { "encap.ether.ovlan",
+                                       "encap.ether.ivlan" }) {
+                AftDataInt::Ptr vlan = node->nodeParameter<AftDataInt>(param);
+                if (vlan != nullptr) {
+                    tmpl[op.len++] = AFI_DP_ETH_P_VLAN >> 8;
+                    tmpl[op.len++] = AFI_DP_ETH_P_VLAN & 0xff;
+                    tmpl[op.len++] = (vlan->value() >> 8) & 0x0f;
+                    tmpl[op.len++] = vlan->value() & 0xff;
+                }
+            }
+            op.len += 2;
+            op.type = OpEncapEther;
+            _templates.insert(_templates.end(), tmpl, tmpl + op.len);
+
+        } else if (encap->encapName() == "label") {
+            AftDataInt::Ptr label = node->nodeParameter<AftDataInt>(
+                                                            "label.value");
+            uint32_t lse = label ? ((label->value() & 0xfffff) << 12) : 0;
+            lse |= AFI_DP_LABEL_TTL;
+
+            uint8_t tmpl[4] = { (uint8_t)(lse >> 24), (uint8_t)(lse >> 16),
+                                (uint8_t)(lse >> 8), (uint8_t)lse };
+            op.type = OpEncapLabel;
+            op.len  = sizeof(tmpl);
+            _templates.insert(_templates.end(), tmpl, tmpl + op.len);
+        } else {
+            op.type = OpUnsupported;
+        }
+
+    } else if (auto decap = std::dynamic_pointer_cast<AftDecap>(node)) {
+        op.type = (decap->decapName() == "label") ? OpDecapLabel :
+                                                    OpUnsupported;
+
+    } else if (auto counter = std::dynamic_pointer_cast<AftCounter>(node)) {
+        Counter c = { counter->initialPackets(), counter->initialBytes() };
+        op.type = OpCounter;
+        op.arg  = _counters.size();
+        _counters.push_back(c);
+
+    } else if (auto policer = std::dynamic_pointer_cast<AftPolicer>(node)) {
+        //
+        // Rate in packets or bits per second, burst in packets or bytes
+        //
+        Policer p;
+        p.tat        = 0;
+        p.packetMode = policer->packetMode();
+        p.nsPerUnit  = !policer->rate() ? 0 :
+                       (p.packetMode ? 1e9 : 8e9) / policer->rate();
+        p.tolerance  = p.nsPerUnit * policer->burstSize();
+        op.type = OpPolicer;
+        op.arg  = _policers.size();
+        _policers.push_back(p);
+
+    } else if (std::dynamic_pointer_cast<AftDiscard>(node)) {
+        op.type = OpDiscard;
+
+    } else if (auto port = std::dynamic_pointer_cast<AftOutputPort>(node)) {
+        op.type = OpOutput;
+        op.arg  = port->portIndex();
+
+    } else {
+        op.type = OpUnsupported;
+    }
+
+    return (op.type == OpUnsupported) ? -1 : 0;
+}
+
+//
+// @fn
+// compile
+//
+// @brief
+// Compile the node graph of a sandbox
+//
+// @param[in]
+//     sandbox Sandbox (input ports and their next nodes), NULL to take
+//     them from the model's input port nodes
+// @param[in]
+//     model Local AFI server's model of the sandbox
+// @return 0 - Success, -1 - Failure
+//
+
+int
+AfiDataplane::compile (const AftSandboxPtr   &sandbox,
+                       const AfiLocalSandbox &model)
+{
+    static const char *opTypeNames[] = {
+        "list", "tree", "table", "encap ethernet", "encap label",
+        "decap label", "counter", "policer", "discard", "output",
+        "unsupported",
+    };
+
+    _ops.clear();
+    _lists.clear();
+    _slots.clear();
+    _templates.clear();
+    _lpms.clear();
+    _counters.clear();
+    _policers.clear();
+    _inPorts.clear();
+    _opByToken.clear();
+    _opTokens.clear();
+    _opNames.clear();
+    _inPortNames.clear();
+    _paths.clear();
+    _skipped = 0;
+    _routes  = 0;
+
+    //
+    // An op per node first, so that nodes can refer to each other
+    //
+    Op blank;
+    memset(&blank, 0, sizeof(blank));
+    for (const auto &node : model.nodes) {
+        _opByToken[node.first] = _ops.size();
+        _ops.push_back(blank);
+        _opTokens.push_back(node.first);
+        _opNames.push_back("");
+    }
+
+    for (const auto &node : model.nodes) {
+        int32_t index = _opByToken[node.first];
+        Op      op;
+
+        compileNode(node.second, op, model);
+        _ops[index] = op;
+
+        std::string &name = _opNames[index];
+        name = opTypeNames[op.type];
+        if (op.type == OpUnsupported) {
+            name += " " + node.second->nodeType();
+        }
+        if (!node.second->nodeName().empty()) {
+            name += " " + node.second->nodeName();
+        } else if (op.type == OpOutput) {
+            name += " " + std::to_string(op.arg);
+        }
+    }
+
+    //
+    // Input ports
+    //
+    AftPortTablePtr inputPorts = sandbox ? sandbox->inputPortTable() :
+                                           nullptr;
+    if (inputPorts != nullptr) {
+        for (AftIndex i = 0; i < inputPorts->maxIndex(); i++) {
+            AftPortEntryPtr port;
+            _inPorts.push_back(-1);
+            _inPortNames.push_back("port " + std::to_string(i));
+            if (inputPorts->portForIndex(i, port)) {
+                _inPorts[i]     = opFor(port->portNext());
+                _inPortNames[i] = port->portName();
+            }
+        }
+    } else {
+        for (const auto &node : model.nodes) {
+            auto port = std::dynamic_pointer_cast<AftInputPort>(node.second);
+            if (port == nullptr) {
+                continue;
+            }
+            if (port->portIndex() >= _inPorts.size()) {
+                _inPorts.resize(port->portIndex() + 1, -1);
+                _inPortNames.resize(port->portIndex() + 1);
+            }
+            _inPorts[port->portIndex()]     = opFor(port->portNext());
+            _inPortNames[port->portIndex()] = port->nodeName();
+        }
+    }
+
+    return 0;
+}
+
+//
+// Lookup key of a packet, false if the packet has no such field
+//
+bool
+AfiDataplane::lookupKey (const AfiDpPkt &pkt, uint8_t field,
+                         uint32_t &key) const
+{
+    const uint8_t *p = pkt.data;
+
+    switch (field) {
+    case FieldIpv4Dst:
+        if (pkt.kind == PktL2) {
+            //
+            // Tagged frame: IPv4 after the tags
+            //
+            size_t off = 12;
+            while ((off + 6 <= pkt.len) && isVlanTpid(get16(p + off))) {
+                off += 4;
+            }
+            if ((off + 22 > pkt.len) ||
+                (get16(p + off) != AFI_DP_ETH_P_IPV4)) {
+                return false;
+            }
+            p += off + 2;
+        } else if ((pkt.kind != PktIpv4) || (pkt.len < 20)) {
+            return false;
+        }
+        key = get32(p + 16);
+        return true;
+
+    case FieldVlan1:
+    case FieldVlan2: {
+        size_t off = (field == FieldVlan1) ? 12 : 16;
+        if ((pkt.kind != PktL2) || (pkt.len < off + 4) ||
+            !isVlanTpid(get16(p + 12)) || !isVlanTpid(get16(p + off))) {
+            return false;
+        }
+        key = get16(p + off + 2) & 0x0fff;
+        return true;
+    }
+
+    case FieldMplsLabel:
+        if ((pkt.kind != PktMpls) || (pkt.len < 4)) {
+            return false;
+        }
+        key = get32(p) >> 12;
+        return true;
+    }
+
+    return false;
+}
+
+//
+// Ethernet encapsulation: a frame's own header is replaced
+//
+bool
+AfiDataplane::encapEther (AfiDpPkt &pkt, const Op &op) const
+{
+    uint16_t etherType;
+
+    switch (pkt.kind) {
+    case PktIpv4:   etherType = AFI_DP_ETH_P_IPV4;  break;
+    case PktIpv6:   etherType = AFI_DP_ETH_P_IPV6;  break;
+    case PktMpls:   etherType = AFI_DP_ETH_P_MPLS;  break;
+    default: {
+        size_t off = 12;
+        while ((off + 2 <= pkt.len) && isVlanTpid(get16(pkt.data + off))) {
+            off += 4;
+        }
+        if (off + 2 > pkt.len) {
+            return false;
+        }
+        etherType = get16(pkt.data + off);
+        pkt.data += off + 2;
+        pkt.len  -= off + 2;
+        break;
+    }
+    }
+
+    if ((size_t)(pkt.data - pkt.buf) < op.len) {
+        return false;
+    }
+    pkt.data -= op.len;
+    pkt.len  += op.len;
+    memcpy(pkt.data, &_templates[op.arg], op.len - 2);
+    pkt.data[op.len - 2] = etherType >> 8;
+    pkt.data[op.len - 1] = etherType & 0xff;
+    pkt.kind = PktL2;
+    return true;
+}
+
+//
+// Label push, bottom of stack if the packet is not MPLS yet
+//
+bool
+AfiDataplane::encapLabel (AfiDpPkt &pkt, const Op &op) const
+{
+    if ((size_t)(pkt.data - pkt.buf) < op.len) {
+        return false;
+    }
+    pkt.data -= op.len;
+    pkt.len  += op.len;
+    memcpy(pkt.data, &_templates[op.arg], op.len);
+    if (pkt.kind != PktMpls) {
+        pkt.data[2] |= 1;
+    }
+    pkt.kind = PktMpls;
+    return true;
+}
+
+//
+// Label stack pop, the payload is IPv4 or IPv6 as its version nibble
+// says, else Ethernet (pseudowire)
+//
+bool
+AfiDataplane::decapLabel (AfiDpPkt &pkt) const
+{
+    if (pkt.kind != PktMpls) {
+        return true;
+    }
+
+    bool bottom = false;
+    while (!bottom) {
+        if (pkt.len < 4) {
+            return false;
+        }
+        bottom    = pkt.data[2] & 1;
+        pkt.data += 4;
+        pkt.len  -= 4;
+    }
+
+    uint8_t version = pkt.len ? (pkt.data[0] >> 4) : 0;
+    pkt.kind = (version == 4) ? PktIpv4 : (version == 6) ? PktIpv6 : PktL2;
+    return true;
+}
+
+//
+// GCRA: a packet conforms if the bucket, after adding it, holds no
+// more than the burst
+//
+bool
+AfiDataplane::police (const Op &op, const AfiDpPkt &pkt, uint64_t nowNs)
+{
+    Policer &p = _policers[op.arg];
+
+    if (p.nsPerUnit == 0) {
+        return true;
+    }
+    uint64_t tat = std::max(p.tat, nowNs) +
+                   (uint64_t)(p.nsPerUnit * (p.packetMode ? 1 : pkt.len));
+    if (tat - nowNs > p.tolerance) {
+        return false;
+    }
+    p.tat = tat;
+    return true;
+}
+
+//
+// @fn
+// runPkt
+//
+// @brief
+// Run a packet through the graph from its input port. A list runs its
+// members in order: members after the first and the list's own next
+// node wait on a stack while the first runs, and an op without a next
+// op returns to the stack.
+//
+// @param[in]
+//     pkt Loaded packet, with its verdict when done
+// @param[in]
+//     nowNs Time (policers)
+// @return void
+//
+
+void
+AfiDataplane::runPkt (AfiDpPkt &pkt, uint64_t nowNs)
+{
+    int32_t stack[AFI_DP_STACK_MAX];
+    int     sp = 0;
+    int32_t op = (pkt.inPort < _inPorts.size()) ? _inPorts[pkt.inPort] : -1;
+
+    pkt.path = pkt.inPort + 1;
+
+    for (;;) {
+        if (op < 0) {
+            if (sp == 0) {
+                pkt.verdict = AfiDpNoNext;
+                return;
+            }
+            op = stack[--sp];
+            continue;
+        }
+        if (pkt.steps == AFI_DP_STEPS_MAX) {
+            pkt.verdict = AfiDpError;
+            return;
+        }
+        if (pkt.steps < AFI_DP_TRACE_MAX) {
+            pkt.trace[pkt.steps] = op;
+        }
+        pkt.steps++;
+        pkt.path = pkt.path * 1000003 + op;
+
+        const Op &o = _ops[op];
+        uint32_t  key;
+
+        switch (o.type) {
+        case OpList:
+            if (sp + o.size + 1 > AFI_DP_STACK_MAX) {
+                pkt.verdict = AfiDpError;
+                return;
+            }
+            if (o.next >= 0) {
+                stack[sp++] = o.next;
+            }
+            for (uint32_t i = o.size; i > 1; i--) {
+                stack[sp++] = _lists[o.arg + i - 1];
+            }
+            op = o.size ? _lists[o.arg] : -1;
+            break;
+
+        case OpTree: {
+            uint32_t r = lookupKey(pkt, o.field, key) ?
+                         _lpms[o.arg].lookup(key) : 0;
+            op = r ? (int32_t)(r - 1) : o.miss;
+            break;
+        }
+
+        case OpTable:
+            op = (lookupKey(pkt, o.field, key) && (key < o.size)) ?
+                 _slots[o.arg + key] : -1;
+            if (op < 0) {
+                op = o.miss;
+            }
+            break;
+
+        case OpEncapEther:
+        case OpEncapLabel:
+        case OpDecapLabel: {
+            bool ok = (o.type == OpEncapEther) ? encapEther(pkt, o) :
+                      (o.type == OpEncapLabel) ? encapLabel(pkt, o) :
+                                                 decapLabel(pkt);
+            if (!ok) {
+                pkt.verdict = AfiDpError;
+                return;
+            }
+            op = o.next;
+            break;
+        }
+
+        case OpCounter:
+            _counters[o.arg].pkts++;
+            _counters[o.arg].bytes += pkt.len;
+            op = o.next;
+            break;
+
+        case OpPolicer:
+            if (!police(o, pkt, nowNs)) {
+                pkt.verdict = AfiDpPoliced;
+                return;
+            }
+            op = o.next;
+            break;
+
+        case OpDiscard:
+            pkt.verdict = AfiDpDiscard;
+            return;
+
+        case OpOutput:
+            pkt.verdict = AfiDpForward;
+            pkt.outPort = o.arg;
+            return;
+
+        default:
+            pkt.verdict = AfiDpUnsupported;
+            return;
+        }
+    }
+}
+
+//
+// @fn
+// run
+//
+// @brief
+// Run a batch of packets and account them to their paths
+//
+// @param[in]
+//     pkts Loaded packets
+// @param[in]
+//     numPkts Number of packets
+// @param[in]
+//     nowNs Time (policers)
+// @return void
+//
+
+void
+AfiDataplane::run (AfiDpPkt *pkts, size_t numPkts, uint64_t nowNs)
+{
+    for (size_t i = 0; i < numPkts; i++) {
+        runPkt(pkts[i], nowNs);
+    }
+
+    for (size_t i = 0; i < numPkts; i++) {
+        const AfiDpPkt &pkt = pkts[i];
+        auto            it  = _paths.find(pkt.path);
+        if (it == _paths.end()) {
+            AfiDpPath path;
+            path.description = pathDescription(pkt);
+            path.verdict     = (AfiDpVerdict)pkt.verdict;
+            path.outPort     = pkt.outPort;
+            it = _paths.insert(std::make_pair(pkt.path, path)).first;
+        }
+        it->second.pkts++;
+        it->second.bytes += pkt.len;
+    }
+}
+
+std::string
+AfiDataplane::pathDescription (const AfiDpPkt &pkt) const
+{
+    std::ostringstream os;
+
+    os << ((pkt.inPort < _inPortNames.size()) ? _inPortNames[pkt.inPort] :
+           "port " + std::to_string(pkt.inPort));
+    for (int i = 0; i < std::min<int>(pkt.steps, AFI_DP_TRACE_MAX); i++) {
+        if (_ops[pkt.trace[i]].type != OpList) {
+            os << " > " << _opNames[pkt.trace[i]];
+        }
+    }
+    if (pkt.steps > AFI_DP_TRACE_MAX) {
+        os << " > ...";
+    }
+    return os.str();
+}
+
+bool
+AfiDataplane::counter (AftNodeToken token, uint64_t &pkts,
+                       uint64_t &bytes) const
+{
+    auto it = _opByToken.find(token);
+    if ((it == _opByToken.end()) || (_ops[it->second].type != OpCounter)) {
+        return false;
+    }
+    pkts  = _counters[_ops[it->second].arg].pkts;
+    bytes = _counters[_ops[it->second].arg].bytes;
+    return true;
+}
+
+void
+AfiDataplane::description (std::ostream &os) const
+{
+    size_t lpmBytes = 0;
+    for (const Lpm &lpm : _lpms) {
+        lpmBytes += lpm.tbl.size() * sizeof(uint32_t);
+    }
+
+    os << "Dataplane: " << _ops.size() << " ops, " << _inPorts.size();
+    os << " input ports, " << _routes << " routes in " << _lpms.size();
+    os << " trees (" << lpmBytes / 1024 << " KB), " << _slots.size();
+    os << " index slots, " << _templates.size() << " template bytes, ";
+    os << _skipped << " entries skipped" << std::endl;
+
+    for (const auto &path : _paths) {
+        os << "  " << std::setw(12) << path.second.pkts << " pkts ";
+        os << std::setw(11) << afiDpVerdictName(path.second.verdict);
+        os << "  " << path.second.description << std::endl;
+    }
+}
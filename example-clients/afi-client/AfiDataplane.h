@@ -0,0 +1,282 @@
+//
+// AfiDataplane.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __AfiDataplane__
+#define __AfiDataplane__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "jnx/Aft.h"
+#include "AfiLocalServer.h"
+
+//
+// Software dataplane
+// ==================
+//
+// Runs packets through the node graph programmed into a sandbox, so
+// that forwarding can be checked and measured without a vMX. The graph
+// is compiled once from the sandbox (input port table) and the local
+// AFI server's model of it (nodes and entries) into a flat program:
+//
+//   AftTree        IPv4 destination LPM, DIR-16-8-8: one 64K entry
+//                  table indexed by the top 16 bits and 256 entry
+//                  chunks for the next 8 bits and the last 8, so a
+//                  lookup is at most 3 dependent loads
+//   AftTable       dense array of the table's size, indexed by the
+//                  lookup field (outer/inner VLAN id, top MPLS label)
+//   AftList        run of op indices, executed in order
+//   AftEncap       byte template prepended as it is: ethernet (with
+//                  VLAN tags) or one MPLS label
+//   AftDecap       label: pops the label stack
+//   AftCounter, AftPolicer, AftDiscard, output ports
+//
+// Ops are 24 byte records in one array and refer to each other by
+// index; lookups, lists and templates live in their own arrays.
+//
+// As on the vMX, untagged IPv4, IPv6 and MPLS frames enter without
+// their Ethernet header; other frames (VLAN tagged ones) are switched
+// as they are. A packet leaves an output port as it is then.
+//
+// Running is single threaded; a dataplane is recompiled after the
+// sandbox changed.
+//
+
+#define AFI_DP_HEADROOM     128     // Bytes for encapsulations
+#define AFI_DP_PKT_MAX      2048    // Largest packet
+#define AFI_DP_STACK_MAX    16      // Nested lists
+#define AFI_DP_STEPS_MAX    64      // Ops per packet (loops)
+#define AFI_DP_TRACE_MAX    16      // Ops recorded per packet
+
+//
+// Packet verdicts
+//
+typedef enum {
+    AfiDpForward,           //< Sent to an output port
+    AfiDpDiscard,           //< Discard node
+    AfiDpPoliced,           //< Dropped by a policer
+    AfiDpNoNext,            //< Graph ended without an output port
+    AfiDpUnsupported,       //< Node the dataplane does not run
+    AfiDpError,             //< Malformed packet, no headroom, loop
+} AfiDpVerdict;
+
+extern const char *afiDpVerdictName(AfiDpVerdict verdict);
+
+//
+// @struct  AfiDpPkt
+// @brief   Packet run through the dataplane, in its own buffer
+//
+struct AfiDpPkt {
+    //
+    // Load a layer 2 frame received on an input port
+    //
+    int load(AftIndex port, const uint8_t *frame, size_t frameLen);
+
+    uint8_t        *data;       //< Current start of the packet
+    uint32_t        len;
+    uint8_t         kind;       //< AfiDataplane::PktKind
+    uint8_t         verdict;    //< AfiDpVerdict
+    uint8_t         steps;      //< Ops run
+    AftIndex        inPort;
+    AftIndex        outPort;    //< Forwarded: output port index
+    uint64_t        path;       //< Hash of the ops run
+    int32_t         trace[AFI_DP_TRACE_MAX];    //< First ops run
+    uint8_t         buf[AFI_DP_HEADROOM + AFI_DP_PKT_MAX];
+};
+
+//
+// @struct  AfiDpPath
+// @brief   Packets that took the same way through the graph
+//
+struct AfiDpPath {
+    AfiDpPath() : verdict(AfiDpForward), outPort(0), pkts(0), bytes(0) {
+    }
+
+    std::string     description;    //< e.g. "p2 > tree rtt0 > ..."
+    AfiDpVerdict    verdict;
+    AftIndex        outPort;
+    uint64_t        pkts;
+    uint64_t        bytes;
+};
+
+//
+// @class   AfiDataplane
+// @brief   Compiled sandbox node graph and its packet engine
+//
+class AfiDataplane
+{
+public:
+    typedef enum {
+        PktL2,              //< Ethernet frame
+        PktIpv4,
+        PktIpv6,
+        PktMpls,
+    } PktKind;
+
+    AfiDataplane() : _skipped(0), _routes(0) {
+    }
+
+    //
+    // Compile the graph of sandbox, whose nodes and entries are in
+    // model. Returns 0 - Success, -1 - Failure.
+    //
+    int compile(const AftSandboxPtr &sandbox, const AfiLocalSandbox &model);
+
+    //
+    // Run a batch of loaded packets (at nowNs, for policers) and
+    // account them to their paths
+    //
+    void run(AfiDpPkt *pkts, size_t numPkts, uint64_t nowNs);
+
+    //
+    // Run one packet, no accounting
+    //
+    void runPkt(AfiDpPkt &pkt, uint64_t nowNs);
+
+    //
+    // Statistics
+    //
+    const std::map<uint64_t, AfiDpPath> &paths(void) const { return _paths; }
+    void clearPaths(void) { _paths.clear(); }
+    bool counter(AftNodeToken token, uint64_t &pkts, uint64_t &bytes) const;
+    std::string pathDescription(const AfiDpPkt &pkt) const;
+    void description(std::ostream &os) const;
+
+private:
+    typedef enum {
+        OpList,
+        OpTree,
+        OpTable,
+        OpEncapEther,
+        OpEncapLabel,
+        OpDecapLabel,
+        OpCounter,
+        OpPolicer,
+        OpDiscard,
+        OpOutput,
+        OpUnsupported,
+    } OpType;
+
+    typedef enum {
+        FieldNone,          //< Always misses
+        FieldIpv4Dst,
+        FieldVlan1,         //< Outer VLAN id
+        FieldVlan2,         //< Inner VLAN id
+        FieldMplsLabel,     //< Top label
+    } Field;
+
+    //
+    // Compiled node, 24 bytes
+    //
+    struct Op {
+        uint8_t     type;   //< OpType
+        uint8_t     field;  //< Lookup field
+        uint16_t    len;    //< Template length
+        int32_t     next;   //< Op run next, -1: back to the list
+        int32_t     miss;   //< Lookup miss (tree and table default)
+        uint32_t    arg;    //< Index into the op type's array
+        uint32_t    size;   //< Table size, list length
+    };
+
+    //
+    // IPv4 DIR-16-8-8 LPM: entries are op index + 1 (0: miss) or,
+    // with LpmChunk set, the offset of a 256 entry chunk
+    //
+    struct Lpm {
+        enum { LpmChunk = 0x80000000u };
+
+        Lpm() : tbl(1 << 16, 0) {
+        }
+
+        uint32_t lookup(uint32_t addr) const {
+            uint32_t e = tbl[addr >> 16];
+            if (e & LpmChunk) {
+                e = tbl[(e & ~LpmChunk) + ((addr >> 8) & 0xff)];
+                if (e & LpmChunk) {
+                    e = tbl[(e & ~LpmChunk) + (addr & 0xff)];
+                }
+            }
+            return e;
+        }
+
+        //
+        // Bits of prefix past len are ignored. Returns 0 - Inserted,
+        // -1 - Invalid length.
+        //
+        int insert(uint32_t prefix, int len, uint32_t value);
+
+        std::vector<uint32_t> tbl;
+    };
+
+    struct Counter {
+        uint64_t    pkts;
+        uint64_t    bytes;
+    };
+
+    //
+    // GCRA over packets or bytes
+    //
+    struct Policer {
+        uint64_t    tat;        //< Theoretical arrival time (ns)
+        double      nsPerUnit;  //< Per packet or byte
+        uint64_t    tolerance;  //< Burst (ns)
+        bool        packetMode;
+    };
+
+    static uint8_t fieldOf(const std::string &name);
+    int32_t opFor(AftNodeToken token);
+    int compileNode(const AftNodePtr &node, Op &op,
+                    const AfiLocalSandbox &model);
+    bool lookupKey(const AfiDpPkt &pkt, uint8_t field, uint32_t &key) const;
+    bool encapEther(AfiDpPkt &pkt, const Op &op) const;
+    bool encapLabel(AfiDpPkt &pkt, const Op &op) const;
+    bool decapLabel(AfiDpPkt &pkt) const;
+    bool police(const Op &op, const AfiDpPkt &pkt, uint64_t nowNs);
+
+    std::vector<Op>             _ops;
+    std::vector<int32_t>        _lists;     //< List members
+    std::vector<int32_t>        _slots;     //< Index table slots, -1: miss
+    std::vector<uint8_t>        _templates; //< Encap bytes
+    std::vector<Lpm>            _lpms;
+    std::vector<Counter>        _counters;
+    std::vector<Policer>        _policers;
+    std::vector<int32_t>        _inPorts;   //< Op per input port, -1: none
+
+    //
+    // Cold: tokens and names of ops (descriptions), compile results
+    //
+    std::unordered_map<AftNodeToken, int32_t> _opByToken;
+    std::vector<AftNodeToken>   _opTokens;
+    std::vector<std::string>    _opNames;
+    std::vector<std::string>    _inPortNames;
+    uint64_t                    _skipped;   //< Entries not compiled
+    uint64_t                    _routes;
+
+    std::map<uint64_t, AfiDpPath> _paths;
+};
+
+#endif // __AfiDataplane__
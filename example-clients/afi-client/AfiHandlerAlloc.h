@@ -0,0 +1,174 @@
+//
+// AfiHandlerAlloc.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiHandlerAlloc__
+#define __AfiHandlerAlloc__
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#define AFI_HANDLER_MEM_SIZE    512     // Bytes, enough for any AFI handler
+
+//
+// Recycled asio handler memory
+// ============================
+//
+// Each asynchronous operation makes asio allocate memory for the
+// operation and its handler. For a chain of operations that has at most
+// one operation outstanding at a time (a socket's receive loop, a
+// timer, a strand's drain) that memory can be reused: wrap the handler
+// with afiMakeAllocHandler() and the operation is built in the chain's
+// AfiHandlerMemory instead of on the heap. asio releases operation
+// memory before it calls the handler, so the next operation started by
+// the handler finds the memory free again.
+//
+// Both asio customization points are provided: the handler allocation
+// hooks used by older boost releases and an associated allocator
+// (allocator_type/get_allocator) used by boost 1.66 and later.
+//
+
+//
+// @class   AfiHandlerMemory
+// @brief   Storage for one outstanding asio handler
+//
+class AfiHandlerMemory
+{
+public:
+    AfiHandlerMemory() : _inUse(false) {
+    }
+
+    AfiHandlerMemory(const AfiHandlerMemory &) = delete;
+    AfiHandlerMemory &operator=(const AfiHandlerMemory &) = delete;
+
+    void *allocate(size_t size) {
+        if (!_inUse && (size <= sizeof(_storage))) {
+            _inUse = true;
+            return &_storage;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void *pointer) {
+        if (pointer == &_storage) {
+            _inUse = false;
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+    std::aligned_storage<AFI_HANDLER_MEM_SIZE>::type  _storage;
+    bool                                              _inUse;
+};
+
+//
+// @class   AfiHandlerAllocator
+// @brief   Standard allocator on top of AfiHandlerMemory
+//
+template <typename T>
+class AfiHandlerAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit AfiHandlerAllocator(AfiHandlerMemory &mem) : _mem(&mem) {
+    }
+
+    template <typename U>
+    AfiHandlerAllocator(const AfiHandlerAllocator<U> &other)
+        : _mem(other._mem) {
+    }
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(_mem->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T *p, size_t) {
+        _mem->deallocate(p);
+    }
+
+    bool operator==(const AfiHandlerAllocator &other) const {
+        return _mem == other._mem;
+    }
+
+    bool operator!=(const AfiHandlerAllocator &other) const {
+        return _mem != other._mem;
+    }
+
+private:
+    template <typename U> friend class AfiHandlerAllocator;
+
+    AfiHandlerMemory *_mem;
+};
+
+//
+// @class   AfiAllocHandler
+// @brief   Handler wrapper allocating from AfiHandlerMemory
+//
+template <typename Handler>
+class AfiAllocHandler
+{
+public:
+    typedef AfiHandlerAllocator<Handler> allocator_type;
+
+    AfiAllocHandler(AfiHandlerMemory &mem, Handler handler)
+        : _mem(mem), _handler(std::move(handler)) {
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(_mem);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        _handler(std::forward<Args>(args)...);
+    }
+
+    friend void *asio_handler_allocate(size_t size,
+                                       AfiAllocHandler<Handler> *h) {
+        return h->_mem.allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void *pointer, size_t,
+                                        AfiAllocHandler<Handler> *h) {
+        h->_mem.deallocate(pointer);
+    }
+
+private:
+    AfiHandlerMemory &_mem;
+    Handler           _handler;
+};
+
+//
+// Wrap a handler so that its operation uses the given handler memory
+//
+template <typename Handler>
+inline AfiAllocHandler<Handler>
+afiMakeAllocHandler (AfiHandlerMemory &mem, Handler handler)
+{
+    return AfiAllocHandler<Handler>(mem, std::move(handler));
+}
+
+#endif // __AfiHandlerAlloc__
@@ -0,0 +1,624 @@
+//
+// AfiHex.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string.h>
+#include <algorithm>
+
+#include "AfiHex.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AFI_HEX_X86     1
+#include <immintrin.h>
+#endif
+
+#define AFI_HEX_SPACE   16      // Decode table: white space
+#define AFI_HEX_BAD     17      // Decode table: not a hex digit
+
+static const char afiHexDigits[] = "0123456789ABCDEF";
+
+//
+// Decode state: where the vector kernels hand over to the scalar loop
+//
+struct AfiHexState {
+    size_t  in;         //< Next source offset
+    size_t  out;        //< Bytes decoded
+    int     nibble;     //< Pending high nibble, -1: none
+};
+
+//
+// Character class / digit value of every character
+//
+struct AfiHexTable {
+    AfiHexTable() {
+        memset(val, AFI_HEX_BAD, sizeof(val));
+        for (int c = 0; c < 10; c++) {
+            val['0' + c] = c;
+        }
+        for (int c = 0; c < 6; c++) {
+            val['a' + c] = val['A' + c] = 10 + c;
+        }
+        val[' '] = val['\t'] = val['\r'] = val['\n'] = AFI_HEX_SPACE;
+    }
+
+    uint8_t val[256];
+};
+
+static const AfiHexTable afiHexTable;
+
+//
+// @fn
+// afiHexDecodeTail
+//
+// @brief
+// Scalar decode from a decode state to the end of the source
+//
+// @param[in]
+//     src Hex string
+// @param[in]
+//     srcLen Hex string length
+// @param[out]
+//     dst Decoded bytes
+// @param[in]
+//     dstLen Room in dst
+// @param[in]
+//     st Decode state
+// @param[out]
+//     errPos Offset of error
+// @return Number of bytes, -1 - Error
+//
+
+static int
+afiHexDecodeTail (const char  *src,
+                  size_t       srcLen,
+                  uint8_t     *dst,
+                  size_t       dstLen,
+                  AfiHexState &st,
+                  size_t      *errPos)
+{
+    for (; st.in < srcLen; st.in++) {
+        int v = afiHexTable.val[(uint8_t)src[st.in]];
+
+        if (v == AFI_HEX_SPACE) {
+            continue;
+        }
+        if ((v == AFI_HEX_BAD) || ((st.nibble < 0) && (st.out >= dstLen))) {
+            if (errPos) {
+                *errPos = st.in;
+            }
+            return -1;
+        }
+        if (st.nibble < 0) {
+            st.nibble = v;
+        } else {
+            dst[st.out++] = (st.nibble << 4) | v;
+            st.nibble = -1;
+        }
+    }
+
+    if (st.nibble >= 0) {
+        if (errPos) {
+            *errPos = srcLen;
+        }
+        return -1;
+    }
+    return st.out;
+}
+
+static int
+afiHexDecodeScalar (const char *src,
+                    size_t      srcLen,
+                    uint8_t    *dst,
+                    size_t      dstLen,
+                    size_t     *errPos)
+{
+    AfiHexState st = { 0, 0, -1 };
+
+    return afiHexDecodeTail(src, srcLen, dst, dstLen, st, errPos);
+}
+
+static void
+afiHexEncodeScalar (const uint8_t *src, size_t srcLen, char *dst)
+{
+    for (size_t i = 0; i < srcLen; i++) {
+        dst[0] = afiHexDigits[src[i] >> 4];
+        dst[1] = afiHexDigits[src[i] & 0x0f];
+        dst[2] = ' ';
+        dst += 3;
+    }
+}
+
+#ifdef AFI_HEX_X86
+
+#define AFI_HEX_SSE42   __attribute__((target("sse4.2,popcnt")))
+#define AFI_HEX_AVX2    __attribute__((target("avx2,sse4.2,popcnt")))
+
+//
+// Vector tables: byte shuffles that compact the kept characters of
+// 8 (one shuffle per keep mask), and that spread 16 encoded byte pairs
+// over 48 "XY " characters
+//
+struct AfiHexVecTables {
+    AfiHexVecTables() {
+        for (int m = 0; m < 256; m++) {
+            uint8_t *idx = (uint8_t *)&compact[m];
+            int      n   = 0;
+
+            memset(idx, 0x80, 8);
+            for (int b = 0; b < 8; b++) {
+                if (m & (1 << b)) {
+                    idx[n++] = b;
+                }
+            }
+        }
+
+        for (int c = 0; c < 48; c++) {
+            int j = c / 3;
+            int r = c % 3;
+            int o = c / 16;
+
+            spread[o][0][c % 16] = 0x80;
+            spread[o][1][c % 16] = 0x80;
+            spaces[o][c % 16]    = (r == 2) ? ' ' : 0;
+            if (r < 2) {
+                spread[o][j / 8][c % 16] = 2 * (j % 8) + r;
+            }
+        }
+    }
+
+    uint64_t  compact[256];
+    uint8_t   spread[3][2][16];     //< Output vector, source pair vector
+    uint8_t   spaces[3][16];
+};
+
+static const AfiHexVecTables afiHexVec;
+
+//
+// 16 hex digits to 8 bytes
+//
+static inline AFI_HEX_SSE42 void
+afiHexDecode16 (__m128i v, uint8_t *dst)
+{
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                                 _mm_set1_epi8('a' - 10));
+    __m128i isNum = _mm_cmplt_epi8(v, _mm_set1_epi8('A'));
+    __m128i nib   = _mm_blendv_epi8(alpha, digit, isNum);
+    __m128i bytes = _mm_maddubs_epi16(nib, _mm_set1_epi16(0x0110));
+
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(bytes, bytes));
+}
+
+//
+// Append the characters of v kept by keep (16 bits) to stage
+//
+static inline AFI_HEX_SSE42 int
+afiHexCompact16 (__m128i v, unsigned keep, uint8_t *stage)
+{
+    __m128i lo = _mm_shuffle_epi8(v,
+                     _mm_loadl_epi64((const __m128i *)
+                                     &afiHexVec.compact[keep & 0xff]));
+    __m128i hi = _mm_shuffle_epi8(_mm_srli_si128(v, 8),
+                     _mm_loadl_epi64((const __m128i *)
+                                     &afiHexVec.compact[keep >> 8]));
+    int     n  = __builtin_popcount(keep & 0xff);
+
+    _mm_storeu_si128((__m128i *)stage, lo);
+    _mm_storeu_si128((__m128i *)(stage + n), hi);
+    return n + __builtin_popcount(keep >> 8);
+}
+
+//
+// Decode what the vector loop left staged (all valid digits), then
+// hand over to the scalar loop
+//
+static int
+afiHexDecodeFinish (const char    *src,
+                    size_t         srcLen,
+                    uint8_t       *dst,
+                    size_t         dstLen,
+                    const uint8_t *stage,
+                    int            numStaged,
+                    AfiHexState   &st,
+                    size_t        *errPos)
+{
+    int i = 0;
+
+    for (; i + 1 < numStaged; i += 2) {
+        dst[st.out++] = (afiHexTable.val[stage[i]] << 4) |
+                        afiHexTable.val[stage[i + 1]];
+    }
+    if (i < numStaged) {
+        st.nibble = afiHexTable.val[stage[i]];
+    }
+
+    return afiHexDecodeTail(src, srcLen, dst, dstLen, st, errPos);
+}
+
+//
+// @fn
+// afiHexDecodeSse42
+//
+// @brief
+// Decode 16 characters at a time: PCMPESTRM classifies them as white
+// space and hex digits, white space is squeezed out into a small stage
+// with PSHUFB, and every 16 staged digits are decoded at once. Blocks
+// without white space are decoded in place. A block with an invalid
+// character, or one that may not fit into dst, goes to the scalar loop
+// that reports the error.
+//
+
+static AFI_HEX_SSE42 int
+afiHexDecodeSse42 (const char *src,
+                   size_t      srcLen,
+                   uint8_t    *dst,
+                   size_t      dstLen,
+                   size_t     *errPos)
+{
+    const __m128i spaceSet = _mm_setr_epi8(' ', '\t', '\r', '\n',
+                                           0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i hexRange = _mm_setr_epi8('0', '9', 'A', 'F', 'a', 'f',
+                                           0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    AfiHexState   st = { 0, 0, -1 };
+    uint8_t       stage[48];
+    int           numStaged = 0;
+
+    //
+    // A block is taken only if all staged digits will fit into dst, a
+    // pending high nibble included: overflows are found by the scalar
+    // loop at the digit that does not fit
+    //
+    while ((st.in + 16 <= srcLen) &&
+           (st.out + (numStaged + 17) / 2 <= dstLen)) {
+        __m128i  v     = _mm_loadu_si128((const __m128i *)(src + st.in));
+        unsigned space = _mm_cvtsi128_si32(_mm_cmpestrm(spaceSet, 4, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                                 _SIDD_BIT_MASK));
+        unsigned digit = _mm_cvtsi128_si32(_mm_cmpestrm(hexRange, 6, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                 _SIDD_BIT_MASK));
+
+        if ((space | digit) != 0xffff) {
+            break;
+        }
+
+        if ((digit == 0xffff) && (numStaged == 0)) {
+            afiHexDecode16(v, dst + st.out);
+            st.out += 8;
+        } else {
+            numStaged += afiHexCompact16(v, digit, stage + numStaged);
+            if (numStaged >= 16) {
+                afiHexDecode16(_mm_loadu_si128((const __m128i *)stage),
+                               dst + st.out);
+                st.out    += 8;
+                numStaged -= 16;
+                memmove(stage, stage + 16, numStaged);
+            }
+        }
+        st.in += 16;
+    }
+
+    return afiHexDecodeFinish(src, srcLen, dst, dstLen, stage, numStaged,
+                              st, errPos);
+}
+
+//
+// 32 hex digits to 16 bytes
+//
+static inline AFI_HEX_AVX2 void
+afiHexDecode32 (__m256i v, uint8_t *dst)
+{
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(v,
+                                                    _mm256_set1_epi8(0x20)),
+                                    _mm256_set1_epi8('a' - 10));
+    __m256i isNum = _mm256_cmpgt_epi8(_mm256_set1_epi8('A'), v);
+    __m256i nib   = _mm256_blendv_epi8(alpha, digit, isNum);
+    __m256i bytes = _mm256_maddubs_epi16(nib, _mm256_set1_epi16(0x0110));
+    __m256i packed = _mm256_permute4x64_epi64(
+                         _mm256_packus_epi16(bytes, bytes), 0xd8);
+
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(packed));
+}
+
+//
+// @fn
+// afiHexDecodeAvx2
+//
+// @brief
+// Decode 32 characters at a time, as afiHexDecodeSse42. Characters
+// are classified with unsigned range compares.
+//
+
+static AFI_HEX_AVX2 int
+afiHexDecodeAvx2 (const char *src,
+                  size_t      srcLen,
+                  uint8_t    *dst,
+                  size_t      dstLen,
+                  size_t     *errPos)
+{
+    AfiHexState st = { 0, 0, -1 };
+    uint8_t     stage[96];
+    int         numStaged = 0;
+
+    while ((st.in + 32 <= srcLen) &&
+           (st.out + (numStaged + 33) / 2 <= dstLen)) {
+        __m256i v     = _mm256_loadu_si256((const __m256i *)(src + st.in));
+        __m256i num   = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+        __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(v,
+                                                _mm256_set1_epi8(0x20)),
+                                        _mm256_set1_epi8('a'));
+        __m256i isHex = _mm256_or_si256(
+                _mm256_cmpeq_epi8(_mm256_min_epu8(num, _mm256_set1_epi8(9)),
+                                  num),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)),
+                                  alpha));
+        __m256i isSpace = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        uint32_t digit = _mm256_movemask_epi8(isHex);
+        uint32_t space = _mm256_movemask_epi8(isSpace);
+
+        if ((space | digit) != 0xffffffffu) {
+            break;
+        }
+
+        if ((digit == 0xffffffffu) && (numStaged == 0)) {
+            afiHexDecode32(v, dst + st.out);
+            st.out += 16;
+        } else {
+            numStaged += afiHexCompact16(_mm256_castsi256_si128(v),
+                                         digit & 0xffff, stage + numStaged);
+            numStaged += afiHexCompact16(_mm256_extracti128_si256(v, 1),
+                                         digit >> 16, stage + numStaged);
+            if (numStaged >= 32) {
+                afiHexDecode32(_mm256_loadu_si256((const __m256i *)stage),
+                               dst + st.out);
+                st.out    += 16;
+                numStaged -= 32;
+                memmove(stage, stage + 32, numStaged);
+            }
+        }
+        st.in += 32;
+    }
+
+    return afiHexDecodeFinish(src, srcLen, dst, dstLen, stage, numStaged,
+                              st, errPos);
+}
+
+//
+// @fn
+// afiHexEncodeSse42
+//
+// @brief
+// Encode 16 bytes at a time: nibbles are looked up as digits with
+// PSHUFB, interleaved to "XY" pairs and spread over 48 "XY " characters
+//
+
+static AFI_HEX_SSE42 void
+afiHexEncodeSse42 (const uint8_t *src, size_t srcLen, char *dst)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i *)afiHexDigits);
+    const __m128i low    = _mm_set1_epi8(0x0f);
+    size_t        i      = 0;
+
+    for (; i + 16 <= srcLen; i += 16) {
+        __m128i b  = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_shuffle_epi8(digits,
+                         _mm_and_si128(_mm_srli_epi16(b, 4), low));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(b, low));
+        __m128i pairs[2] = { _mm_unpacklo_epi8(hi, lo),
+                             _mm_unpackhi_epi8(hi, lo) };
+
+        for (int o = 0; o < 3; o++) {
+            __m128i out = _mm_or_si128(
+                _mm_shuffle_epi8(pairs[0], _mm_loadu_si128(
+                    (const __m128i *)afiHexVec.spread[o][0])),
+                _mm_shuffle_epi8(pairs[1], _mm_loadu_si128(
+                    (const __m128i *)afiHexVec.spread[o][1])));
+            out = _mm_or_si128(out, _mm_loadu_si128(
+                    (const __m128i *)afiHexVec.spaces[o]));
+            _mm_storeu_si128((__m128i *)(dst + 3 * i + 16 * o), out);
+        }
+    }
+
+    afiHexEncodeScalar(src + i, srcLen - i, dst + 3 * i);
+}
+
+#endif // AFI_HEX_X86
+
+typedef int (*AfiHexDecodeFn)(const char *, size_t, uint8_t *, size_t,
+                              size_t *);
+typedef void (*AfiHexEncodeFn)(const uint8_t *, size_t, char *);
+
+//
+// Kernel in use, scalar until the best one is picked at startup
+//
+static AfiHexKernel   afiHexKernelCur = AfiHexScalar;
+static AfiHexDecodeFn afiHexDecodeCur = afiHexDecodeScalar;
+static AfiHexEncodeFn afiHexEncodeCur = afiHexEncodeScalar;
+
+const char *
+afiHexKernelName (AfiHexKernel kernel)
+{
+    switch (kernel) {
+    case AfiHexScalar:
+        return "scalar";
+    case AfiHexSse42:
+        return "sse4.2";
+    case AfiHexAvx2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+bool
+afiHexKernelSupported (AfiHexKernel kernel)
+{
+#ifdef AFI_HEX_X86
+    __builtin_cpu_init();
+#endif
+
+    switch (kernel) {
+    case AfiHexScalar:
+        return true;
+#ifdef AFI_HEX_X86
+    case AfiHexSse42:
+        return __builtin_cpu_supports("sse4.2") &&
+               __builtin_cpu_supports("popcnt");
+    case AfiHexAvx2:
+        return __builtin_cpu_supports("avx2") &&
+               afiHexKernelSupported(AfiHexSse42);
+#endif
+    default:
+        return false;
+    }
+}
+
+AfiHexKernel
+afiHexKernelGet (void)
+{
+    return afiHexKernelCur;
+}
+
+int
+afiHexKernelSet (AfiHexKernel kernel)
+{
+    if (!afiHexKernelSupported(kernel)) {
+        return -1;
+    }
+
+    afiHexKernelCur = kernel;
+    afiHexDecodeCur = afiHexDecodeScalar;
+    afiHexEncodeCur = afiHexEncodeScalar;
+#ifdef AFI_HEX_X86
+    if (kernel == AfiHexSse42) {
+        afiHexDecodeCur = afiHexDecodeSse42;
+        afiHexEncodeCur = afiHexEncodeSse42;
+    } else if (kernel == AfiHexAvx2) {
+        afiHexDecodeCur = afiHexDecodeAvx2;
+        afiHexEncodeCur = afiHexEncodeSse42;
+    }
+#endif
+    return 0;
+}
+
+//
+// Pick the best kernel at startup
+//
+static struct AfiHexKernelInit {
+    AfiHexKernelInit() {
+        if (afiHexKernelSet(AfiHexAvx2) != 0) {
+            afiHexKernelSet(AfiHexSse42);
+        }
+    }
+} afiHexKernelInit;
+
+//
+// @fn
+// afiHexDecode
+//
+// @brief
+// Decode a hex string, skipping white space
+//
+// @param[in]
+//     src Hex string
+// @param[in]
+//     srcLen Hex string length
+// @param[out]
+//     dst Decoded bytes
+// @param[in]
+//     dstLen Room in dst
+// @param[out]
+//     errPos Offset of error (unless NULL)
+// @return Number of bytes, -1 - Error
+//
+
+int
+afiHexDecode (const char *src,
+              size_t      srcLen,
+              uint8_t    *dst,
+              size_t      dstLen,
+              size_t     *errPos)
+{
+    return afiHexDecodeCur(src, srcLen, dst, dstLen, errPos);
+}
+
+//
+// @fn
+// afiHexEncode
+//
+// @brief
+// Encode bytes as "%02X " columns
+//
+// @param[in]
+//     src Bytes
+// @param[in]
+//     srcLen Number of bytes
+// @param[out]
+//     dst Hex string
+// @param[in]
+//     dstLen Room in dst (including NUL)
+// @param[in]
+//     numCol Bytes per line, <= 0: one line
+// @return String length
+//
+
+size_t
+afiHexEncode (const uint8_t *src,
+              size_t         srcLen,
+              char          *dst,
+              size_t         dstLen,
+              int            numCol)
+{
+    size_t cols = (numCol > 0) ? numCol : (srcLen ? srcLen : 1);
+    size_t len  = 0;
+
+    if (dstLen == 0) {
+        return 0;
+    }
+
+    //
+    // Rows of cols bytes, each 3 characters and a newline between rows
+    //
+    while (srcLen > 0) {
+        size_t row = std::min(srcLen, cols);
+        size_t sep = (len > 0) ? 1 : 0;
+
+        if (len + sep + 3 * row + 1 > dstLen) {
+            row = (len + sep + 3 < dstLen) ? (dstLen - 1 - len - sep) / 3 : 0;
+            if (row == 0) {
+                break;
+            }
+        }
+        if (sep) {
+            dst[len++] = '\n';
+        }
+        afiHexEncodeCur(src, row, dst + len);
+        len    += 3 * row;
+        src    += row;
+        srcLen -= row;
+    }
+
+    dst[len] = '\0';
+    return len;
+}
@@ -0,0 +1,68 @@
+//
+// AfiHex.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiHex__
+#define __AfiHex__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Hex encode/decode kernels. The best kernel the CPU supports is
+// picked at startup; AVX2 and SSE4.2 kernels are built with per
+// function target attributes, so no compiler flags are needed.
+//
+typedef enum {
+    AfiHexScalar,       //< Table driven, one byte at a time
+    AfiHexSse42,        //< 16 characters at a time
+    AfiHexAvx2,         //< 32 characters at a time (decode)
+} AfiHexKernel;
+
+extern const char *afiHexKernelName(AfiHexKernel kernel);
+extern bool afiHexKernelSupported(AfiHexKernel kernel);
+extern AfiHexKernel afiHexKernelGet(void);
+
+//
+// Use another kernel (benchmarks, tests). Returns 0 - Success,
+// -1 - Not supported by the CPU.
+//
+extern int afiHexKernelSet(AfiHexKernel kernel);
+
+//
+// Decode hex digits (either case) to bytes in one pass, skipping white
+// space (space, tab, CR, LF) anywhere. Returns number of bytes, -1 on
+// error with errPos (unless NULL) the offset of the invalid character,
+// of the digit that does not fit into dst, or srcLen if the number of
+// digits is odd.
+//
+extern int afiHexDecode(const char *src, size_t srcLen,
+                        uint8_t *dst, size_t dstLen,
+                        size_t *errPos = NULL);
+
+//
+// Encode bytes as "%02X " each, numCol bytes per line (no line breaks
+// if numCol <= 0), NUL terminated. Encodes as many bytes as fit.
+// Returns string length.
+//
+extern size_t afiHexEncode(const uint8_t *src, size_t srcLen,
+                           char *dst, size_t dstLen, int numCol);
+
+#endif // __AfiHex__
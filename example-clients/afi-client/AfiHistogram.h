@@ -0,0 +1,176 @@
+//
+// AfiHistogram.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiHistogram__
+#define __AfiHistogram__
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+
+#include "Utils.h"
+
+#define AFI_HIST_SUB_BITS       4       // 16 buckets per power of 2 (6.25%)
+#define AFI_HIST_MAX_BITS       40      // Values up to 2^40 (ns: 18 minutes)
+
+//
+// @class   AfiHistogram
+// @brief   HDR style log-linear histogram
+//
+// Values below 2^AFI_HIST_SUB_BITS have a bucket each; above, every
+// power of 2 is split into 2^AFI_HIST_SUB_BITS equally wide buckets,
+// so that any recorded value is reported within 1/16 of itself.
+// Values of AFI_HIST_MAX_BITS bits and more go to the last bucket.
+//
+// Recording is done by one thread at a time (counters are bumped
+// without read-modify-write), reading by any thread.
+//
+class AfiHistogram
+{
+public:
+    static const int SubBuckets = 1 << AFI_HIST_SUB_BITS;
+    static const int Buckets    = (AFI_HIST_MAX_BITS - AFI_HIST_SUB_BITS + 1) *
+                                  SubBuckets;
+
+    AfiHistogram() : _count(0), _sum(0), _max(0) {
+        for (int b = 0; b < Buckets; b++) {
+            _counts[b].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t value) {
+        bump(_counts[bucket(value)], 1);
+        bump(_count, 1);
+        bump(_sum, value);
+        if (value > _max.load(std::memory_order_relaxed)) {
+            _max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count(void) const { return _count.load(std::memory_order_relaxed); }
+    uint64_t max(void) const { return _max.load(std::memory_order_relaxed); }
+
+    uint64_t mean(void) const {
+        uint64_t n = count();
+        return n ? _sum.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    //
+    // Smallest value that p (0.0 - 1.0) of the recorded values do not
+    // exceed, as the highest value of its bucket (at most max())
+    //
+    uint64_t percentile(double p) const {
+        uint64_t n = 0;
+        for (int b = 0; b < Buckets; b++) {
+            n += _counts[b].load(std::memory_order_relaxed);
+        }
+        if (n == 0) {
+            return 0;
+        }
+
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p * n + 0.5));
+        uint64_t seen = 0;
+        for (int b = 0; b < Buckets; b++) {
+            seen += _counts[b].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(bucketHigh(b), max());
+            }
+        }
+        return max();
+    }
+
+private:
+    static void bump(std::atomic<uint64_t> &counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+    static int bucket(uint64_t value) {
+        if (value < (uint64_t)SubBuckets) {
+            return value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        if (msb >= AFI_HIST_MAX_BITS) {
+            return Buckets - 1;
+        }
+        int shift = msb - AFI_HIST_SUB_BITS;
+        return (shift + 1) * SubBuckets +
+               ((value >> shift) & (SubBuckets - 1));
+    }
+
+    static uint64_t bucketHigh(int b) {
+        if (b < SubBuckets) {
+            return b;
+        }
+        int      shift = b / SubBuckets - 1;
+        uint64_t low   = (uint64_t)(SubBuckets + b % SubBuckets) << shift;
+        return low + ((1ULL << shift) - 1);
+    }
+
+    std::atomic<uint64_t>  _counts[Buckets];
+    std::atomic<uint64_t>  _count;
+    std::atomic<uint64_t>  _sum;
+    std::atomic<uint64_t>  _max;
+};
+
+//
+// @struct  AfiRateMeter
+// @brief   Packet and byte counters with the rates of the last interval
+//
+// Counted by one thread at a time; tick() is called periodically by
+// another (single) thread and sets the rates since its last call.
+//
+struct AfiRateMeter {
+    AfiRateMeter() : pkts(0), bytes(0), pps(0), bps(0),
+                     lastPkts(0), lastBytes(0), lastNs(0) {
+    }
+
+    void add(uint64_t len) {
+        pkts.store(pkts.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+        bytes.store(bytes.load(std::memory_order_relaxed) + len,
+                    std::memory_order_relaxed);
+    }
+
+    void tick(uint64_t nowNs) {
+        uint64_t p = pkts.load(std::memory_order_relaxed);
+        uint64_t b = bytes.load(std::memory_order_relaxed);
+
+        if (lastNs && (nowNs > lastNs)) {
+            double secs = (nowNs - lastNs) / 1e9;
+            pps.store((p - lastPkts) / secs, std::memory_order_relaxed);
+            bps.store((b - lastBytes) * 8 / secs, std::memory_order_relaxed);
+        }
+        lastPkts  = p;
+        lastBytes = b;
+        lastNs    = nowNs;
+    }
+
+    std::atomic<uint64_t>  pkts;
+    std::atomic<uint64_t>  bytes;
+    std::atomic<uint64_t>  pps;         //< Packets/s, last interval
+    std::atomic<uint64_t>  bps;         //< Bits/s, last interval
+    uint64_t               lastPkts;    //< tick() only
+    uint64_t               lastBytes;
+    uint64_t               lastNs;
+};
+
+#endif // __AfiHistogram__
@@ -0,0 +1,970 @@
+//
+// AfiLocalServer.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include "AfiLocalServer.h"
+#include "AfiTokenBucket.h"
+
+#define AFI_LOCAL_PORT_TYPE     "local"
+#define AFI_LOCAL_RCVBUF_SIZE   (4 * 1024 * 1024)
+
+//
+// Model key of an entry within its container: its keys
+//
+static std::string
+entryKey (const AftEntryPtr &entry)
+{
+    std::ostringstream os;
+    for (const AftKey &key : entry->entryKeys()) {
+        os << key << ";";
+    }
+    return os.str();
+}
+
+//
+// Wire size estimate: field sizes
+//
+static size_t
+wireVarint (uint64_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static size_t
+wireInt (uint64_t value)
+{
+    return 1 + wireVarint(value);
+}
+
+static size_t
+wireBytes (size_t len)
+{
+    return 1 + wireVarint(len) + len;
+}
+
+static size_t
+wireData (const AftDataPtr &data)
+{
+    AftDataBytes bytes;
+
+    if (data == nullptr) {
+        return wireBytes(0);
+    }
+    data->append(bytes);
+    return wireBytes(wireInt(data->bitLength()) + wireBytes(bytes.size()));
+}
+
+static size_t
+wireKey (const AftKey &key)
+{
+    return wireBytes(wireBytes(key.field().name().size()) +
+                     wireData(key.data()));
+}
+
+static size_t
+wireParams (const AftParameters::Ptr &params)
+{
+    size_t n = 0;
+
+    if (params != nullptr) {
+        for (const auto &param : params->params()) {
+            n += wireBytes(wireBytes(param.first.size()) +
+                           wireData(param.second));
+        }
+    }
+    return n;
+}
+
+static size_t
+wireFields (const AftFieldVector &fields)
+{
+    size_t n = 0;
+
+    for (const AftField &field : fields) {
+        n += wireBytes(field.name().size());
+    }
+    return n;
+}
+
+//
+// Node: token, next, type, name, parameters and the fields of its type
+//
+static size_t
+wireNode (const AftNodePtr &node)
+{
+    size_t n = wireInt(node->nodeToken()) + wireInt(node->nodeNext()) +
+               wireBytes(node->nodeType().size()) +
+               wireBytes(node->nodeName().size()) +
+               wireParams(node->nodeParameters());
+
+    if (auto tree = std::dynamic_pointer_cast<AftTree>(node)) {
+        n += wireFields(tree->treeFields()) +
+             wireInt(tree->treeDefaultNode());
+    } else if (auto table = std::dynamic_pointer_cast<AftTable>(node)) {
+        n += wireFields(table->tableFields()) +
+             wireInt(table->tableMaximum()) +
+             wireInt(table->tableDefaultNode());
+    } else if (auto list = std::dynamic_pointer_cast<AftList>(node)) {
+        size_t tokens = 0;
+        for (AftNodeToken token : list->listNodes()) {
+            tokens += wireVarint(token);
+        }
+        n += wireBytes(tokens);
+    } else if (auto encap = std::dynamic_pointer_cast<AftEncap>(node)) {
+        n += wireBytes(encap->encapName().size());
+        for (const AftKey &key : encap->encapKeys()) {
+            n += wireKey(key);
+        }
+    } else if (auto decap = std::dynamic_pointer_cast<AftDecap>(node)) {
+        n += wireBytes(decap->decapName().size());
+    } else if (auto counter = std::dynamic_pointer_cast<AftCounter>(node)) {
+        n += wireInt(counter->initialBytes()) +
+             wireInt(counter->initialPackets()) + wireInt(counter->l3Mode());
+    } else if (auto policer = std::dynamic_pointer_cast<AftPolicer>(node)) {
+        n += wireInt(policer->burstSize()) + wireInt(policer->rate()) +
+             wireInt(policer->packetMode());
+    } else if (auto port = std::dynamic_pointer_cast<AftPort>(node)) {
+        n += wireBytes(port->portType().size()) +
+             wireInt(port->portIndex()) + wireInt(port->portNext());
+    }
+    return wireBytes(n);
+}
+
+//
+// Entry: parent, keys, node, parameters
+//
+static size_t
+wireEntry (const AftEntryPtr &entry)
+{
+    size_t n = wireInt(entry->parentNode()) + wireInt(entry->entryNode()) +
+               wireParams(entry->entryParameters());
+
+    for (const AftKey &key : entry->entryKeys()) {
+        n += wireKey(key);
+    }
+    return wireBytes(n);
+}
+
+//
+// @fn
+// wireSize
+//
+// @brief
+// Estimated size of an insert on the wire: its nodes and entries,
+// each a nested message
+//
+// @param[in]
+//     insert Insert
+// @return Bytes
+//
+
+size_t
+AfiLocalServer::wireSize (const AftInsertPtr &insert)
+{
+    size_t n = 0;
+
+    for (const AftNodePtr &node : insert->nodes()) {
+        n += wireNode(node);
+    }
+    for (const AftEntryPtr &entry : insert->entries()) {
+        n += wireEntry(entry);
+    }
+    return n;
+}
+
+size_t
+AfiLocalServer::wireSize (const AftRemovePtr &remove)
+{
+    size_t n = 0;
+
+    for (AftNodeToken token : remove->nodes()) {
+        n += wireInt(token);
+    }
+    for (const AftEntryPtr &entry : remove->entries()) {
+        n += wireEntry(entry);
+    }
+    return n;
+}
+
+size_t
+AfiLocalSandbox::numEntries (void) const
+{
+    size_t n = 0;
+    for (const auto &container : entries) {
+        n += container.second.size();
+    }
+    return n;
+}
+
+void
+AfiLocalSandbox::description (std::ostream &os) const
+{
+    std::map<std::string, uint64_t> nodeTypes;
+    for (const auto &node : nodes) {
+        nodeTypes[node.second->nodeType()]++;
+    }
+
+    os << "Sandbox " << name << " (" << engineName << ", id " << id;
+    os << ", " << inputPorts << " input ports, " << outputPorts;
+    os << " output ports" << (opened ? ", open" : "") << ")" << std::endl;
+    os << "  Nodes: " << nodes.size() << ", entries: " << numEntries();
+    os << std::endl;
+    for (const auto &type : nodeTypes) {
+        os << "    " << type.first << ": " << type.second << std::endl;
+    }
+    os << "  Inserts: " << inserts << " (nodes " << nodesInserted;
+    os << ", entries " << entriesInserted << ")" << std::endl;
+    os << "  Removes: " << removes << " (nodes " << nodesRemoved;
+    os << ", entries " << entriesRemoved << ")" << std::endl;
+    os << "  Wire: " << wireBytes << " bytes (estimated)" << std::endl;
+    os << "  Hostpath: " << hpPackets << " packets, " << hpBytes;
+    os << " bytes, echoed " << hpEchoed << ", dropped " << hpDrops;
+    os << std::endl;
+    for (const auto &port : hpPortPackets) {
+        os << "    port " << port.first << ": " << port.second << std::endl;
+    }
+}
+
+//
+// @fn
+// open
+//
+// @brief
+// Open a sandbox of the local server
+//
+// @param[in]
+//     name Sandbox name
+// @param[out]
+//     sandbox Sandbox, with its ports
+// @return true - Success, false - Failure
+//
+
+bool
+AfiLocalTransport::open (const std::string &name, AftSandboxPtr &sandbox)
+{
+    AfiLocalServerPtr server = _server.lock();
+
+    if (!server || !server->open(name, shared_from_this(), sandbox)) {
+        return false;
+    }
+    _sandboxName = name;
+    return true;
+}
+
+void
+AfiLocalTransport::close (void)
+{
+    AfiLocalServerPtr server = _server.lock();
+
+    if (server && !_sandboxName.empty()) {
+        server->close(_sandboxName);
+    }
+    _sandboxName.clear();
+}
+
+bool
+AfiLocalTransport::alloc (const std::string &engineName,
+                          const std::string &name,
+                          const uint32_t     inputPorts,
+                          const uint32_t     outputPorts)
+{
+    AfiLocalServerPtr server = _server.lock();
+
+    if (!server || (inputPorts > UINT16_MAX) || (outputPorts > UINT16_MAX)) {
+        return false;
+    }
+    return server->alloc(engineName, name, inputPorts, outputPorts);
+}
+
+bool
+AfiLocalTransport::release (const std::string &name)
+{
+    AfiLocalServerPtr server = _server.lock();
+
+    return server && server->release(name);
+}
+
+//
+// @fn
+// send
+//
+// @brief
+// Send an insert to the opened sandbox. Returns when the server has
+// applied it, after the RPC delay.
+//
+// @param[in]
+//     newInsert Insert
+// @return void
+//
+
+void
+AfiLocalTransport::send (const AftInsertPtr &newInsert)
+{
+    AfiLocalServerPtr server = _server.lock();
+
+    if (!server || !server->insert(_sandboxName, newInsert)) {
+        std::cout << "Local server: insert to sandbox '" << _sandboxName;
+        std::cout << "' failed" << std::endl;
+    }
+}
+
+void
+AfiLocalTransport::send (const AftRemovePtr &newRemove)
+{
+    AfiLocalServerPtr server = _server.lock();
+
+    if (!server || !server->remove(_sandboxName, newRemove)) {
+        std::cout << "Local server: remove from sandbox '" << _sandboxName;
+        std::cout << "' failed" << std::endl;
+    }
+}
+
+AfiLocalServer::~AfiLocalServer ()
+{
+    stopHostpath();
+}
+
+//
+// Microseconds of a local server address: decimal digits, at most
+// AFI_LOCAL_DELAY_MAX_US
+//
+static bool
+afiLocalParseUs (const char *str, char **end, uint32_t &us)
+{
+    if ((*str < '0') || (*str > '9')) {
+        return false;
+    }
+
+    errno = 0;
+    unsigned long val = std::strtoul(str, end, 10);
+    if ((errno != 0) || (val > AFI_LOCAL_DELAY_MAX_US)) {
+        return false;
+    }
+    us = val;
+    return true;
+}
+
+//
+// @fn
+// parseAddr
+//
+// @brief
+// Check for a local server address: local[:<latency-us>[:<jitter-us>]]
+//
+// @param[in]
+//     addr AFI server address
+// @param[out]
+//     delay RPC latency and jitter
+// @return 1 - Local server address, 0 - Other address, -1 - Invalid
+//         local server address
+//
+
+int
+AfiLocalServer::parseAddr (const std::string &addr, AfiLocalDelay &delay)
+{
+    std::string prefix(AFI_LOCAL_ADDR_PREFIX);
+
+    if ((addr.compare(0, prefix.size(), prefix) != 0) ||
+        ((addr.size() > prefix.size()) && (addr[prefix.size()] != ':'))) {
+        return 0;
+    }
+
+    delay = AfiLocalDelay();
+    if (addr.size() == prefix.size()) {
+        return 1;
+    }
+
+    char *end;
+    bool  valid = afiLocalParseUs(addr.c_str() + prefix.size() + 1, &end,
+                                  delay.latencyUs);
+    if (valid && (*end == ':')) {
+        valid = afiLocalParseUs(end + 1, &end, delay.jitterUs);
+    }
+    if (!valid || (end != addr.c_str() + addr.size())) {
+        std::cout << "Invalid local AFI server address '" << addr;
+        std::cout << "', expected " << AFI_LOCAL_ADDR_PREFIX;
+        std::cout << "[:<latency-us>[:<jitter-us>]] (at most ";
+        std::cout << AFI_LOCAL_DELAY_MAX_US << " us)" << std::endl;
+        delay = AfiLocalDelay();
+        return -1;
+    }
+    return 1;
+}
+
+AftTransportPtr
+AfiLocalServer::transport (void)
+{
+    return std::make_shared<AfiLocalTransport>(shared_from_this());
+}
+
+//
+// @fn
+// alloc
+//
+// @brief
+// Allocate a sandbox. Allocating an existing sandbox with the same
+// ports succeeds, like opening one configured on the router.
+//
+// @param[in]
+//     engineName Forwarding engine name
+// @param[in]
+//     name Sandbox name
+// @param[in]
+//     inputPorts Number of input ports
+// @param[in]
+//     outputPorts Number of output ports
+// @return true - Success, false - Failure
+//
+
+bool
+AfiLocalServer::alloc (const std::string &engineName,
+                       const std::string &name,
+                       const uint16_t     inputPorts,
+                       const uint16_t     outputPorts)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if (it != _sandboxes.end()) {
+        return (it->second.inputPorts == inputPorts) &&
+               (it->second.outputPorts == outputPorts);
+    }
+
+    AfiLocalSandbox &sb = _sandboxes[name];
+    sb.engineName  = engineName;
+    sb.name        = name;
+    sb.id          = _nextId++;
+    sb.inputPorts  = inputPorts;
+    sb.outputPorts = outputPorts;
+    return true;
+}
+
+//
+// @fn
+// open
+//
+// @brief
+// Open an allocated sandbox: create the client's sandbox on the
+// transport and hand it the port nodes, recorded in the model too
+//
+// @param[in]
+//     name Sandbox name
+// @param[in]
+//     transport Transport of the client
+// @param[out]
+//     sandbox Sandbox
+// @return true - Success, false - Failure
+//
+
+bool
+AfiLocalServer::open (const std::string     &name,
+                      const AftTransportPtr &transport,
+                      AftSandboxPtr         &sandbox)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if (it == _sandboxes.end()) {
+        return false;
+    }
+    AfiLocalSandbox &sb = it->second;
+
+    sandbox = AftSandbox::create(name);
+    sandbox->setTransport(transport);
+    sandbox->setMaxInputPort(sb.inputPorts);
+    sandbox->setMaxOutputPort(sb.outputPorts);
+
+    //
+    // Port nodes named like the router's (p0, p1, ..., the last output
+    // port punt), tokens allocated by the sandbox
+    //
+    AftInsertPtr ports = AftInsert::create(sandbox);
+    for (AftIndex i = 0; i < sb.inputPorts; i++) {
+        ports->push(AftInputPort::create(AFI_LOCAL_PORT_TYPE, i,
+                                         AFT_NODE_TOKEN_DISCARD),
+                    "p" + std::to_string(i));
+    }
+    for (AftIndex i = 0; i < sb.outputPorts; i++) {
+        ports->push(AftOutputPort::create(AFI_LOCAL_PORT_TYPE, i,
+                                          AFT_NODE_TOKEN_NONE),
+                    (i + 1 < sb.outputPorts) ? "p" + std::to_string(i) :
+                                               std::string("punt"));
+    }
+
+    sb.nodes.clear();
+    sb.entries.clear();
+    for (const AftNodePtr &node : ports->nodes()) {
+        sandbox->receive(node);
+        sb.nodes[node->nodeToken()] = node;
+    }
+
+    sb.opened    = true;
+    sb.transport = transport;
+    return true;
+}
+
+bool
+AfiLocalServer::release (const std::string &name)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    return _sandboxes.erase(name) != 0;
+}
+
+//
+// @fn
+// close
+//
+// @brief
+// Close a sandbox. Its model stays until it is released.
+//
+// @param[in]
+//     name Sandbox name
+// @return void
+//
+
+void
+AfiLocalServer::close (const std::string &name)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if (it != _sandboxes.end()) {
+        it->second.opened = false;
+        it->second.transport.reset();
+    }
+}
+
+bool
+AfiLocalServer::find (const std::string &name, AftTransportPtr &transport)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if ((it == _sandboxes.end()) || !it->second.opened) {
+        return false;
+    }
+    transport = it->second.transport;
+    return true;
+}
+
+//
+// @fn
+// insert
+//
+// @brief
+// Apply an insert to a sandbox's model after the RPC delay. Nodes and
+// entries replace those with the same token or container and keys.
+//
+// @param[in]
+//     name Sandbox name
+// @param[in]
+//     insert Insert
+// @return true - Success, false - Sandbox not open
+//
+
+bool
+AfiLocalServer::insert (const std::string &name, const AftInsertPtr &insert)
+{
+    rpcDelay();
+
+    size_t wire = wireSize(insert);
+
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if ((it == _sandboxes.end()) || !it->second.opened) {
+        return false;
+    }
+    AfiLocalSandbox &sb = it->second;
+
+    if (_keepModel.load(std::memory_order_relaxed)) {
+        for (const AftNodePtr &node : insert->nodes()) {
+            sb.nodes[node->nodeToken()] = node;
+        }
+        for (const AftEntryPtr &entry : insert->entries()) {
+            sb.entries[entry->parentNode()][entryKey(entry)] = entry;
+        }
+    }
+
+    sb.inserts++;
+    sb.nodesInserted   += insert->nodes().size();
+    sb.entriesInserted += insert->entries().size();
+    sb.wireBytes       += wire;
+    return true;
+}
+
+//
+// @fn
+// remove
+//
+// @brief
+// Apply a remove to a sandbox's model after the RPC delay. Removing a
+// container removes its entries.
+//
+// @param[in]
+//     name Sandbox name
+// @param[in]
+//     remove Remove
+// @return true - Success, false - Sandbox not open
+//
+
+bool
+AfiLocalServer::remove (const std::string &name, const AftRemovePtr &remove)
+{
+    rpcDelay();
+
+    size_t wire = wireSize(remove);
+
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if ((it == _sandboxes.end()) || !it->second.opened) {
+        return false;
+    }
+    AfiLocalSandbox &sb = it->second;
+
+    for (AftNodeToken token : remove->nodes()) {
+        sb.nodesRemoved += sb.nodes.erase(token);
+        sb.entries.erase(token);
+    }
+    for (const AftEntryPtr &entry : remove->entries()) {
+        auto container = sb.entries.find(entry->parentNode());
+        if (container != sb.entries.end()) {
+            sb.entriesRemoved += container->second.erase(entryKey(entry));
+        }
+    }
+
+    sb.removes++;
+    sb.wireBytes += wire;
+    return true;
+}
+
+void
+AfiLocalServer::setRpcDelay (const AfiLocalDelay &delay)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    _rpcDelay = delay;
+}
+
+void
+AfiLocalServer::setHostpathDelay (const AfiLocalDelay &delay)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    _hpDelay = delay;
+}
+
+bool
+AfiLocalServer::sandbox (const std::string &name, AfiLocalSandbox &model,
+                         bool withModel)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    auto it = _sandboxes.find(name);
+    if (it == _sandboxes.end()) {
+        return false;
+    }
+    if (withModel) {
+        model = it->second;
+        return true;
+    }
+
+    //
+    // Statistics only: the model is moved aside while copying
+    //
+    AfiLocalSandbox &sb = it->second;
+    std::map<AftNodeToken, AftNodePtr>               nodes;
+    std::map<AftNodeToken, AfiLocalSandbox::EntryMap> entries;
+    nodes.swap(sb.nodes);
+    entries.swap(sb.entries);
+    model = sb;
+    nodes.swap(sb.nodes);
+    entries.swap(sb.entries);
+    return true;
+}
+
+void
+AfiLocalServer::description (std::ostream &os)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    os << "Local AFI server: RPC delay " << _rpcDelay.latencyUs << "+";
+    os << _rpcDelay.jitterUs << " us, hostpath delay ";
+    os << _hpDelay.latencyUs << "+" << _hpDelay.jitterUs << " us, echo ";
+    os << (_hpEcho ? "on" : "off") << ", unknown sandbox packets ";
+    os << _hpUnknown << std::endl;
+    for (const auto &sb : _sandboxes) {
+        sb.second.description(os);
+    }
+}
+
+//
+// Latency plus jitter in ns, _lock held
+//
+uint64_t
+AfiLocalServer::delayNs (const AfiLocalDelay &delay)
+{
+    uint64_t us = delay.latencyUs;
+    if (delay.jitterUs) {
+        us += _rand() % (delay.jitterUs + 1);
+    }
+    return us * 1000;
+}
+
+//
+// Block the sending client like a synchronous RPC would
+//
+void
+AfiLocalServer::rpcDelay (void)
+{
+    uint64_t ns;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        ns = delayNs(_rpcDelay);
+    }
+    if (ns) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+    }
+}
+
+//
+// Sandbox by hostpath id, _lock held
+//
+AfiLocalSandbox *
+AfiLocalServer::sandboxById (AftSandboxId id)
+{
+    for (auto &sb : _sandboxes) {
+        if (sb.second.id == id) {
+            return &sb.second;
+        }
+    }
+    return NULL;
+}
+
+//
+// @fn
+// startHostpath
+//
+// @brief
+// Start answering the hostpath UDP protocol
+//
+// @param[in]
+//     addr Hostpath address (ip:port) the client sends to
+// @param[in]
+//     clientPort Client's hostpath port, packets are returned to it on
+//     the loopback address
+// @return 0 - Success, -1 - Failure
+//
+
+int
+AfiLocalServer::startHostpath (const std::string &addr, uint16_t clientPort)
+{
+    std::string::size_type colon = addr.rfind(':');
+    struct addrinfo        hints, *local;
+    int                    rcvbuf = AFI_LOCAL_RCVBUF_SIZE;
+
+    if (_hpFd >= 0) {
+        return -1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if ((colon == std::string::npos) ||
+        (getaddrinfo(addr.substr(0, colon).c_str(),
+                     addr.substr(colon + 1).c_str(), &hints, &local) != 0)) {
+        std::cout << "Invalid hostpath address " << addr << std::endl;
+        return -1;
+    }
+
+    _hpFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if ((_hpFd < 0) ||
+        (bind(_hpFd, local->ai_addr, local->ai_addrlen) < 0)) {
+        perror("local server hostpath socket");
+        freeaddrinfo(local);
+        if (_hpFd >= 0) {
+            ::close(_hpFd);
+            _hpFd = -1;
+        }
+        return -1;
+    }
+    freeaddrinfo(local);
+    setsockopt(_hpFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    _hpClientPort = clientPort;
+    _hpStop       = false;
+    _hpThread     = std::thread([this] { this->hpRun(); });
+    return 0;
+}
+
+void
+AfiLocalServer::stopHostpath (void)
+{
+    _hpStop = true;
+    if (_hpThread.joinable()) {
+        _hpThread.join();
+    }
+    if (_hpFd >= 0) {
+        ::close(_hpFd);
+        _hpFd = -1;
+    }
+}
+
+//
+// Hostpath thread: receive injected packets, return echoed ones when
+// they are due
+//
+void
+AfiLocalServer::hpRun (void)
+{
+    std::deque<HpDelayed> queue;
+
+    while (!_hpStop.load(std::memory_order_relaxed)) {
+        int timeoutMs = AFI_LOCAL_POLL_MS;
+        if (!queue.empty()) {
+            uint64_t nowNs = afiMonotonicNs();
+            timeoutMs = (queue.front().dueNs > nowNs) ?
+                        std::min<uint64_t>(AFI_LOCAL_POLL_MS,
+                            (queue.front().dueNs - nowNs + 999999) / 1000000) :
+                        0;
+        }
+
+        struct pollfd pfd = { _hpFd, POLLIN, 0 };
+        if ((poll(&pfd, 1, timeoutMs) < 0) && (errno != EINTR)) {
+            perror("local server poll");
+            return;
+        }
+        if (pfd.revents & POLLIN) {
+            hpRecvBatch(queue);
+        }
+        hpSendDue(queue);
+    }
+}
+
+//
+// Receive a batch of injected packets, count them and queue echoes
+//
+void
+AfiLocalServer::hpRecvBatch (std::deque<HpDelayed> &queue)
+{
+    struct iovec    iov[AFI_LOCAL_HP_BATCH];
+    struct mmsghdr  msgs[AFI_LOCAL_HP_BATCH];
+    AftPacketPtr    pkt = AftPacket::createReceive();
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < AFI_LOCAL_HP_BATCH; i++) {
+        iov[i].iov_base = _hpBufs[i];
+        iov[i].iov_len  = sizeof(_hpBufs[i]);
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(_hpFd, msgs, AFI_LOCAL_HP_BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0) {
+        return;
+    }
+
+    bool     echo  = _hpEcho.load(std::memory_order_relaxed);
+    uint64_t nowNs = afiMonotonicNs();
+
+    std::lock_guard<std::mutex> guard(_lock);
+
+    for (int i = 0; i < n; i++) {
+        size_t len = msgs[i].msg_len;
+        if (len < (size_t)pkt->headerSize()) {
+            continue;
+        }
+        memcpy(pkt->header(), _hpBufs[i], pkt->headerSize());
+        pkt->headerParse();
+
+        AfiLocalSandbox *sb = sandboxById(pkt->sandboxId());
+        if (sb == NULL) {
+            _hpUnknown++;
+            continue;
+        }
+        sb->hpPackets++;
+        sb->hpBytes += len - pkt->headerSize();
+        sb->hpPortPackets[pkt->portIndex()]++;
+
+        if (!echo) {
+            continue;
+        }
+        if (queue.size() >= AFI_LOCAL_HP_Q_MAX) {
+            sb->hpDrops++;
+            continue;
+        }
+
+        //
+        // Echoes keep their order: none is due before the one ahead
+        //
+        HpDelayed d;
+        d.dueNs = nowNs + delayNs(_hpDelay);
+        if (!queue.empty()) {
+            d.dueNs = std::max(d.dueNs, queue.back().dueNs);
+        }
+        d.data.assign(_hpBufs[i], _hpBufs[i] + len);
+        queue.push_back(std::move(d));
+        sb->hpEchoed++;
+    }
+}
+
+//
+// Return the echoes that are due to the client's hostpath port
+//
+void
+AfiLocalServer::hpSendDue (std::deque<HpDelayed> &queue)
+{
+    struct sockaddr_in dst;
+    uint64_t           nowNs = afiMonotonicNs();
+
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family      = AF_INET;
+    dst.sin_port        = htons(_hpClientPort);
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    while (!queue.empty() && (queue.front().dueNs <= nowNs)) {
+        const std::vector<uint8_t> &data = queue.front().data;
+        sendto(_hpFd, data.data(), data.size(), 0, (struct sockaddr *)&dst,
+               sizeof(dst));
+        queue.pop_front();
+    }
+}
@@ -0,0 +1,283 @@
+//
+// AfiLocalServer.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __AfiLocalServer__
+#define __AfiLocalServer__
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "jnx/Aft.h"
+
+//
+// Local AFI server
+// ================
+//
+// Stands in for the forwarding engine's AFI server so that the client
+// runs on a plain Linux box: afi-client local[:<latency-us>[:<jitter-us>]]
+// <hostpath-address> uses it instead of connecting to a vMX.
+//
+// The server implements AftServer; clients talk to it through an
+// AftTransport (AfiLocalTransport) like through the gRPC transport.
+// Sandboxes are allocated with their ports, opened sandboxes get their
+// port nodes, and every insert and remove sent is applied to an in
+// memory model of the sandbox (nodes by token, entries by container
+// and keys), unless keeping the model is turned off (statistics only,
+// for measuring the client alone). Nothing is forwarded.
+//
+// The hostpath side answers the hostpath UDP protocol on the hostpath
+// address: injected AftPackets are counted per sandbox port and, with
+// echo on, returned to the client's hostpath port as punted packets.
+//
+// Each send blocks its caller for the RPC latency plus a random jitter
+// (uniform, 0 to jitter), the way a synchronous RPC would; concurrent
+// senders wait concurrently. Echoed packets are delayed the hostpath
+// latency plus jitter, in order.
+//
+
+#define AFI_LOCAL_ADDR_PREFIX   "local"
+#define AFI_LOCAL_DELAY_MAX_US  10000000 // Latency or jitter at most 10 s
+#define AFI_LOCAL_HP_BATCH      64      // Datagrams per recvmmsg
+#define AFI_LOCAL_HP_PKT_MAX    2048    // Largest hostpath datagram
+#define AFI_LOCAL_HP_Q_MAX      65536   // Echoed packets waiting
+#define AFI_LOCAL_POLL_MS       100     // Stop check interval
+
+class AfiLocalServer;
+typedef std::shared_ptr<AfiLocalServer> AfiLocalServerPtr;
+
+//
+// @struct  AfiLocalDelay
+// @brief   Injected latency: latency plus uniform 0 to jitter
+//
+struct AfiLocalDelay {
+    AfiLocalDelay() : latencyUs(0), jitterUs(0) {
+    }
+
+    uint32_t latencyUs;
+    uint32_t jitterUs;
+};
+
+//
+// @struct  AfiLocalSandbox
+// @brief   In memory model of one sandbox
+//
+struct AfiLocalSandbox {
+    AfiLocalSandbox() : id(0), inputPorts(0), outputPorts(0), opened(false),
+                        inserts(0), removes(0), nodesInserted(0),
+                        nodesRemoved(0), entriesInserted(0),
+                        entriesRemoved(0), hpPackets(0), hpBytes(0),
+                        hpEchoed(0), hpDrops(0), wireBytes(0) {
+    }
+
+    typedef std::map<std::string, AftEntryPtr> EntryMap;
+
+    std::string     engineName;
+    std::string     name;
+    AftSandboxId    id;             //< Hostpath sandbox id
+    uint32_t        inputPorts;
+    uint32_t        outputPorts;
+    bool            opened;
+    AftTransportPtr transport;      //< Transport it was opened with
+
+    std::map<AftNodeToken, AftNodePtr>  nodes;      //< By token
+    std::map<AftNodeToken, EntryMap>    entries;    //< By container, keys
+
+    //
+    // Statistics
+    //
+    uint64_t        inserts;        //< Insert blocks
+    uint64_t        removes;        //< Remove blocks
+    uint64_t        nodesInserted;
+    uint64_t        nodesRemoved;
+    uint64_t        entriesInserted;
+    uint64_t        entriesRemoved;
+    uint64_t        hpPackets;      //< Injected packets
+    uint64_t        hpBytes;
+    uint64_t        hpEchoed;
+    uint64_t        hpDrops;        //< Echo queue full
+    std::map<AftIndex, uint64_t> hpPortPackets;
+    uint64_t        wireBytes;      //< Inserts and removes, wireSize()
+
+    size_t numEntries(void) const;
+    void description(std::ostream &os) const;
+};
+
+//
+// @class   AfiLocalTransport
+// @brief   Transport of one client to the local server
+//
+// Inserts and removes go to the sandbox opened last.
+//
+class AfiLocalTransport : public AftTransport,
+                          public std::enable_shared_from_this<AfiLocalTransport>
+{
+public:
+    AfiLocalTransport(const AfiLocalServerPtr &server) : _server(server) {
+    }
+
+    bool open(const std::string &name, AftSandboxPtr &sandbox);
+    void close(void);
+    bool alloc(const std::string &engineName, const std::string &name,
+               const uint32_t inputPorts,
+               const uint32_t outputPorts);
+    bool release(const std::string &name);
+    void send(const AftInsertPtr &newInsert);
+    void send(const AftRemovePtr &newRemove);
+
+private:
+    std::weak_ptr<AfiLocalServer> _server;  //< Server keeps transports
+    std::string                   _sandboxName;   //< Opened sandbox
+};
+
+//
+// @class   AfiLocalServer
+// @brief   In-process AFI server with an in memory sandbox model
+//
+class AfiLocalServer : public AftServer,
+                       public std::enable_shared_from_this<AfiLocalServer>
+{
+public:
+    static AfiLocalServerPtr create(void) {
+        return AfiLocalServerPtr(new AfiLocalServer());
+    }
+
+    ~AfiLocalServer();
+
+    //
+    // Check whether addr names the local server, with the latency and
+    // jitter it gives (local[:<latency-us>[:<jitter-us>]], decimal).
+    // Returns 1 - Local server, 0 - Other address, -1 - Invalid local
+    // server address.
+    //
+    static int parseAddr(const std::string &addr, AfiLocalDelay &delay);
+
+    //
+    // Transport for a client
+    //
+    AftTransportPtr transport(void);
+
+    //
+    // AftServer
+    //
+    bool alloc(const std::string &engineName, const std::string &name,
+               const uint16_t inputPorts,
+               const uint16_t outputPorts);
+    bool open(const std::string &name, const AftTransportPtr &transport,
+              AftSandboxPtr &sandbox);
+    bool release(const std::string &name);
+    void close(const std::string &name);
+    bool find(const std::string &name, AftTransportPtr &transport);
+
+    //
+    // Apply an insert or remove to a sandbox's model after the RPC
+    // delay. Returns false if the sandbox is not open.
+    //
+    bool insert(const std::string &name, const AftInsertPtr &insert);
+    bool remove(const std::string &name, const AftRemovePtr &remove);
+
+    //
+    // Latency injection
+    //
+    void setRpcDelay(const AfiLocalDelay &delay);
+    void setHostpathDelay(const AfiLocalDelay &delay);
+
+    //
+    // Hostpath: answer on addr (ip:port), return punts to the client's
+    // hostpath port on the loopback address. Returns 0 - Success,
+    // -1 - Failure.
+    //
+    int startHostpath(const std::string &addr, uint16_t clientPort);
+    void stopHostpath(void);
+    void setHostpathEcho(bool echo) { _hpEcho = echo; }
+
+    //
+    // Keep the nodes and entries of inserts in the sandbox models
+    // (default), or only count them
+    //
+    void setKeepModel(bool keep) { _keepModel = keep; }
+
+    //
+    // Copy of a sandbox's model, false if not allocated. Without
+    // withModel nodes and entries are left out (statistics only).
+    //
+    bool sandbox(const std::string &name, AfiLocalSandbox &model,
+                 bool withModel = true);
+
+    //
+    // Estimated size of an insert or remove on the wire, protobuf
+    // style: a 1 byte tag per field, integers as varints, strings,
+    // data (as AftData::append() writes it) and nested messages
+    // length delimited
+    //
+    static size_t wireSize(const AftInsertPtr &insert);
+    static size_t wireSize(const AftRemovePtr &remove);
+
+    void description(std::ostream &os);
+
+private:
+    AfiLocalServer() : _nextId(0), _hpUnknown(0), _keepModel(true),
+                       _hpFd(-1), _hpClientPort(0), _hpEcho(true),
+                       _hpStop(false) {
+    }
+
+    //
+    // An echoed packet waiting for its delay
+    //
+    struct HpDelayed {
+        uint64_t             dueNs;
+        std::vector<uint8_t> data;
+    };
+
+    uint64_t delayNs(const AfiLocalDelay &delay);
+    void rpcDelay(void);
+    AfiLocalSandbox *sandboxById(AftSandboxId id);
+    void hpRun(void);
+    void hpRecvBatch(std::deque<HpDelayed> &queue);
+    void hpSendDue(std::deque<HpDelayed> &queue);
+
+    std::mutex                              _lock;      //< Protects below
+    std::map<std::string, AfiLocalSandbox>  _sandboxes; //< By name
+    AftSandboxId                            _nextId;
+    AfiLocalDelay                           _rpcDelay;
+    AfiLocalDelay                           _hpDelay;
+    std::mt19937_64                         _rand;
+    uint64_t                                _hpUnknown; //< No such sandbox
+    std::atomic<bool>                       _keepModel;
+
+    int                     _hpFd;          //< Hostpath socket
+    uint8_t                 _hpBufs[AFI_LOCAL_HP_BATCH][AFI_LOCAL_HP_PKT_MAX]; //< Hostpath thread
+    uint16_t                _hpClientPort;
+    std::atomic<bool>       _hpEcho;
+    std::atomic<bool>       _hpStop;
+    std::thread             _hpThread;
+};
+
+#endif // __AfiLocalServer__
@@ -0,0 +1,292 @@
+//
+// AfiPacketPool.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string.h>
+#include <atomic>
+#include "AfiPacketPool.h"
+
+//
+// @fn
+// AfiPacketPool
+//
+// @brief
+// Constructor. Preallocates all packets of the pool.
+//
+// @param[in]
+//     dir PacketDirReceive or PacketDirTransmit
+// @param[in]
+//     size Number of packets in the pool
+//
+
+AfiPacketPool::AfiPacketPool (AftPacket::PacketDirEnum dir,
+                              size_t                   size)
+    : _dir(dir),
+      _pkts(size),
+      _next(0),
+      _gets(0),
+      _exhausted(0),
+      _oversize(0),
+      _reshaped(0)
+{
+    for (auto &pkt : _pkts) {
+        if (_dir == AftPacket::PacketDirReceive) {
+            pkt = createReceive();
+        } else {
+            pkt = AftPacket::createTransmit(AFI_PKT_POOL_DATA_MAX, 0, 0,
+                                            AftPacket::PacketTypeL2);
+        }
+    }
+}
+
+//
+// @fn
+// createReceive
+//
+// @brief
+// Create a receive packet. AftPacket::createReceive() does not tell
+// how much data its packet holds, while transmit packets are created
+// with room for their data size: a receive packet is created as a
+// transmit packet of AFI_PKT_POOL_DATA_MAX bytes, its fields are then
+// set by headerParse() from the received header.
+//
+// @return Receive packet
+//
+
+AftPacketPtr
+AfiPacketPool::createReceive (void)
+{
+    return AftPacket::createTransmit(AFI_PKT_POOL_DATA_MAX, 0, 0,
+                                     AftPacket::PacketTypeL2);
+}
+
+//
+// @fn
+// findFree
+//
+// @brief
+// Find next packet not held by any consumer
+//
+// @return Index of free packet, -1 if all packets are in use
+//
+
+int
+AfiPacketPool::findFree (void)
+{
+    for (size_t n = 0; n < _pkts.size(); n++) {
+        size_t i = _next;
+
+        _next = (_next + 1 == _pkts.size()) ? 0 : _next + 1;
+
+        if (_pkts[i].use_count() == 1) {
+            //
+            // Last consumer has dropped its reference; make its
+            // writes to the packet visible before we reuse it.
+            //
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return i;
+        }
+    }
+    return -1;
+}
+
+//
+// @fn
+// getReceive
+//
+// @brief
+// Get a receive packet from the pool
+//
+// @return Receive packet
+//
+
+AftPacketPtr
+AfiPacketPool::getReceive (void)
+{
+    bump(_gets);
+
+    int i = findFree();
+    if (i < 0) {
+        bump(_exhausted);
+        return createReceive();
+    }
+    return _pkts[i];
+}
+
+//
+// @fn
+// getTransmit
+//
+// @brief
+// Get a transmit packet from the pool. A free packet whose header
+// already matches is preferred; otherwise a free packet is reshaped
+// in place to the requested header. Data too big for a pooled packet
+// gets a packet from the heap.
+//
+// @param[in]
+//     dataSize Packet data size
+// @param[in]
+//     sandboxId Sandbox Id
+// @param[in]
+//     portIndex Port index
+// @param[in]
+//     packetType Packet Type
+// @return Transmit packet
+//
+
+AftPacketPtr
+AfiPacketPool::getTransmit (AftLength                 dataSize,
+                            AftSandboxId              sandboxId,
+                            AftIndex                  portIndex,
+                            AftPacket::PacketTypeEnum packetType)
+{
+    int first = -1;
+
+    bump(_gets);
+
+    if (dataSize > AFI_PKT_POOL_DATA_MAX) {
+        bump(_oversize);
+        return AftPacket::createTransmit(dataSize, sandboxId,
+                                         portIndex, packetType);
+    }
+
+    for (int n = 0; n < AFI_PKT_POOL_MATCH_SCAN; n++) {
+        int i = findFree();
+        if ((i < 0) || (i == first)) {
+            break;
+        }
+        if (first < 0) {
+            first = i;
+        }
+
+        const AftPacketPtr &pkt = _pkts[i];
+        if ((pkt->dataSize()        == (int)dataSize) &&
+            (pkt->sandboxId()       == sandboxId)     &&
+            (pkt->portIndex()       == portIndex)     &&
+            (pkt->innerPacketType() == packetType)) {
+            return pkt;
+        }
+    }
+
+    if (first < 0) {
+        bump(_exhausted);
+        return AftPacket::createTransmit(dataSize, sandboxId,
+                                         portIndex, packetType);
+    }
+
+    const AftPacketPtr         &pkt = _pkts[first];
+    const std::vector<uint8_t> &hdr = shapeHeader(Shape(dataSize, sandboxId,
+                                                        portIndex,
+                                                        packetType));
+    bump(_reshaped);
+    memcpy(pkt->header(), hdr.data(), hdr.size());
+    pkt->headerParse();
+    return pkt;
+}
+
+//
+// @fn
+// shapeHeader
+//
+// @brief
+// Serialized transmit header of a shape, made (with a packet of that
+// shape) the first time the shape is asked for
+//
+// @param[in]
+//     shape Data size, sandbox id, port index and packet type
+// @return Header bytes
+//
+
+const std::vector<uint8_t> &
+AfiPacketPool::shapeHeader (const Shape &shape)
+{
+    auto it = _shapeHdrs.find(shape);
+    if (it != _shapeHdrs.end()) {
+        return it->second;
+    }
+
+    if (_shapeHdrs.size() >= AFI_PKT_POOL_SHAPES_MAX) {
+        _shapeHdrs.clear();
+    }
+
+    AftPacketPtr pkt = AftPacket::createTransmit(std::get<0>(shape),
+                                                 std::get<1>(shape),
+                                                 std::get<2>(shape),
+                                                 std::get<3>(shape));
+    std::vector<uint8_t> &hdr = _shapeHdrs[shape];
+    hdr.assign(pkt->header(), pkt->header() + pkt->headerSize());
+    return hdr;
+}
+
+//
+// @fn
+// stats
+//
+// @brief
+// Get pool statistics
+//
+// @param[out]
+//     stats Pool statistics
+// @return void
+//
+
+void
+AfiPacketPool::stats (Stats &stats) const
+{
+    stats.size      = _pkts.size();
+    stats.inUse     = 0;
+    stats.gets      = _gets.load(std::memory_order_relaxed);
+    stats.exhausted = _exhausted.load(std::memory_order_relaxed);
+    stats.oversize  = _oversize.load(std::memory_order_relaxed);
+    stats.reshaped  = _reshaped.load(std::memory_order_relaxed);
+
+    for (const auto &pkt : _pkts) {
+        if (pkt.use_count() > 1) {
+            stats.inUse++;
+        }
+    }
+}
+
+//
+// @fn
+// description
+//
+// @brief
+// Append pool statistics to an output stream
+//
+// @param[in]
+//     os Output stream
+// @return Output stream
+//
+
+std::ostream &
+AfiPacketPool::description (std::ostream &os) const
+{
+    Stats s;
+
+    stats(s);
+    os << ((_dir == AftPacket::PacketDirReceive) ? "Receive" : "Transmit");
+    os << " pool: size " << s.size << " in use " << s.inUse;
+    os << " gets " << s.gets << " exhausted " << s.exhausted;
+    if (_dir == AftPacket::PacketDirTransmit) {
+        os << " oversize " << s.oversize << " reshaped " << s.reshaped;
+    }
+    return os;
+}
@@ -0,0 +1,136 @@
+//
+// AfiPacketPool.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiPacketPool__
+#define __AfiPacketPool__
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+#include "jnx/Aft.h"
+
+#define AFI_PKT_POOL_DEFAULT_SIZE   256
+#define AFI_PKT_POOL_MATCH_SCAN     8   // Free slots checked for a shape match
+#define AFI_PKT_POOL_DATA_MAX       2000    // Data bytes of a pooled packet
+#define AFI_PKT_POOL_SHAPES_MAX     256     // Transmit headers kept for reuse
+
+//
+// @class   AfiPacketPool
+// @brief   Fixed size pool of preallocated AftPackets
+//
+// The pool creates all its packets up front and hands out shared
+// pointers to them. A packet is back in the pool as soon as the
+// consumer drops its last reference, i.e. when the pool again holds
+// the only reference. Handing out and returning a packet therefore
+// costs a reference count update: no heap allocation and no new
+// shared_ptr control block.
+//
+// A pool is meant to be used by a single thread (e.g. one hostpath
+// receiver); consumers on other threads may hold and release packets,
+// and read the statistics. When every packet is in use the pool falls
+// back to the heap and counts the exhaustion; a transmit packet too
+// big for a pooled one is allocated from the heap and counted apart.
+//
+// Pooled packets have room for AFI_PKT_POOL_DATA_MAX bytes of data. A
+// transmit packet is given a new shape (data size, sandbox, port,
+// type) in place: the serialized header of the shape is copied into
+// the packet and parsed. Headers are serialized once per shape.
+//
+class AfiPacketPool
+{
+public:
+    //
+    // Pool statistics
+    //
+    struct Stats {
+        uint64_t  size;         //< Number of packets in the pool
+        uint64_t  inUse;        //< Packets currently held by consumers
+        uint64_t  gets;         //< Packets handed out
+        uint64_t  exhausted;    //< Gets served from the heap (pool empty)
+        uint64_t  oversize;     //< Gets served from the heap (data size
+                                //  above AFI_PKT_POOL_DATA_MAX)
+        uint64_t  reshaped;     //< Transmit packets given a new shape
+    };
+
+    //
+    // Constructor: preallocates 'size' receive or transmit packets
+    //
+    AfiPacketPool(AftPacket::PacketDirEnum dir,
+                  size_t                   size = AFI_PKT_POOL_DEFAULT_SIZE);
+
+    //
+    // Get a receive packet
+    //
+    AftPacketPtr getReceive(void);
+
+    //
+    // Get a transmit packet with the given header
+    //
+    AftPacketPtr getTransmit(AftLength                 dataSize,
+                             AftSandboxId              sandboxId,
+                             AftIndex                  portIndex,
+                             AftPacket::PacketTypeEnum packetType);
+
+    //
+    // Create a receive packet with room for AFI_PKT_POOL_DATA_MAX bytes
+    // of data
+    //
+    static AftPacketPtr createReceive(void);
+
+    //
+    // Pool statistics
+    //
+    void stats(Stats &stats) const;
+    std::ostream &description(std::ostream &os) const;
+
+private:
+    //
+    // Index of next free packet, -1 if the pool is exhausted
+    //
+    int findFree(void);
+
+    //
+    // Serialized transmit header of a shape
+    //
+    typedef std::tuple<AftLength, AftSandboxId, AftIndex,
+                       AftPacket::PacketTypeEnum> Shape;
+    const std::vector<uint8_t> &shapeHeader(const Shape &shape);
+
+    static void bump(std::atomic<uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    AftPacket::PacketDirEnum   _dir;        //< Receive or transmit pool
+    std::vector<AftPacketPtr>  _pkts;       //< Pooled packets
+    size_t                     _next;       //< Next slot to consider
+    std::map<Shape, std::vector<uint8_t>> _shapeHdrs;
+    std::atomic<uint64_t>      _gets;
+    std::atomic<uint64_t>      _exhausted;
+    std::atomic<uint64_t>      _oversize;
+    std::atomic<uint64_t>      _reshaped;
+};
+
+#endif // __AfiPacketPool__
@@ -0,0 +1,511 @@
+//
+// AfiPcapWriter.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include "AfiTokenBucket.h"
+#include "AfiPcapWriter.h"
+
+//
+// pcapng block types, options and sizes
+//
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BOM              0x1A2B3C4D
+#define PCAPNG_OPT_END          0
+#define PCAPNG_OPT_SHB_USERAPPL 4
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_IF_DESCR     3
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_OPT_EPB_FLAGS    2
+#define PCAPNG_LINKTYPE_ETHER   1
+#define PCAPNG_EPB_HDR_LEN      28
+#define PCAPNG_EPB_TRL_LEN      16      // epb_flags, end of options, length
+
+static inline uint32_t
+pcapngPad (uint32_t len)
+{
+    return (len + 3) & ~3u;
+}
+
+static inline void
+pcapngPut16 (std::vector<uint8_t> &buf, uint16_t val)
+{
+    buf.insert(buf.end(), (uint8_t *)&val, (uint8_t *)&val + sizeof(val));
+}
+
+static inline void
+pcapngPut32 (std::vector<uint8_t> &buf, uint32_t val)
+{
+    buf.insert(buf.end(), (uint8_t *)&val, (uint8_t *)&val + sizeof(val));
+}
+
+static void
+pcapngPutOpt (std::vector<uint8_t> &buf, uint16_t code,
+              const void *data, uint16_t len)
+{
+    pcapngPut16(buf, code);
+    pcapngPut16(buf, len);
+    buf.insert(buf.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+    buf.resize(buf.size() + pcapngPad(len) - len, 0);
+}
+
+//
+// Close a block started at 'start': fill in and append total length
+//
+static void
+pcapngEndBlock (std::vector<uint8_t> &buf, size_t start)
+{
+    pcapngPutOpt(buf, PCAPNG_OPT_END, NULL, 0);
+
+    uint32_t blockLen = buf.size() - start + sizeof(uint32_t);
+    memcpy(&buf[start + sizeof(uint32_t)], &blockLen, sizeof(blockLen));
+    pcapngPut32(buf, blockLen);
+}
+
+//
+// @fn
+// AfiPcapWriter
+//
+// @brief
+// Constructor
+//
+// @param[in]
+//     bufSize Size of each of the two capture buffers
+// @param[in]
+//     snapLen Bytes captured per packet
+//
+
+AfiPcapWriter::AfiPcapWriter (size_t bufSize, uint32_t snapLen)
+    : _bufSize(bufSize),
+      _snapLen(snapLen),
+      _buf(bufSize),
+      _bufLen(0),
+      _pkts(0),
+      _drops(0),
+      _open(false),
+      _stop(false),
+      _wbuf(bufSize),
+      _rotateBytes(0),
+      _rotateSec(0),
+      _maxFiles(0),
+      _fileSeq(0),
+      _fd(-1),
+      _fileBytes(0),
+      _fileStartNs(0),
+      _ifsWritten(0),
+      _bytes(0),
+      _files(0)
+{
+}
+
+AfiPcapWriter::~AfiPcapWriter ()
+{
+    close();
+
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _stop = true;
+    }
+    _cv.notify_one();
+
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+//
+// @fn
+// open
+//
+// @brief
+// Start capturing to a pcapng file
+//
+// @param[in]
+//     fileName File name (base name of rotated files)
+// @param[in]
+//     rotateBytes Rotate when file reaches this size, 0 - Never
+// @param[in]
+//     rotateSec Rotate when file is this old, 0 - Never
+// @param[in]
+//     maxFiles Rotated files kept, 0 - All
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiPcapWriter::open (const std::string &fileName,
+                     uint64_t           rotateBytes,
+                     uint32_t           rotateSec,
+                     uint32_t           maxFiles)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    if (_fd >= 0) {
+        std::cout << "Capture to " << _fileName << " is running" << std::endl;
+        return -1;
+    }
+
+    _fileName    = fileName;
+    _rotateBytes = rotateBytes;
+    _rotateSec   = rotateSec;
+    _maxFiles    = maxFiles;
+    _fileSeq     = 0;
+
+    if (fileOpen() != 0) {
+        return -1;
+    }
+
+    if (!_thread.joinable()) {
+        _thread = std::thread( [this] { this->writerLoop(); } );
+    }
+
+    _open.store(true, std::memory_order_relaxed);
+
+    return 0;
+}
+
+//
+// @fn
+// close
+//
+// @brief
+// Stop capturing, write out buffered packets and close the file
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiPcapWriter::close (void)
+{
+    _open.store(false, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (_fd >= 0) {
+        flush();
+        fileClose();
+    }
+}
+
+//
+// @fn
+// append
+//
+// @brief
+// Format an enhanced packet block into the capture buffer
+//
+
+void
+AfiPcapWriter::append (uint32_t       sandboxId,
+                       uint32_t       portIndex,
+                       Direction      dir,
+                       const uint8_t *pkt,
+                       uint32_t       pktLen)
+{
+    uint32_t capLen   = std::min(pktLen, _snapLen);
+    uint32_t blockLen = PCAPNG_EPB_HDR_LEN + pcapngPad(capLen) +
+                        PCAPNG_EPB_TRL_LEN;
+    uint64_t ts       = afiRealtimeNs();
+    size_t   half     = _bufSize / 2;
+    bool     wake;
+
+    {
+        std::lock_guard<spinlock> guard(_lock);
+
+        if (!_open.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        uint64_t key = ((uint64_t)sandboxId << 32) | portIndex;
+        uint32_t ifId;
+        auto     it  = _ifIds.find(key);
+        if (it != _ifIds.end()) {
+            ifId = it->second;
+        } else {
+            Interface ifc = { sandboxId, portIndex };
+            ifId = _ifs.size();
+            _ifs.push_back(ifc);
+            _ifIds[key] = ifId;
+        }
+
+        if (_bufLen + blockLen > _bufSize) {
+            _drops++;
+            return;
+        }
+
+        uint8_t  *b = &_buf[_bufLen];
+        uint32_t  hdr[] = { PCAPNG_EPB, blockLen, ifId,
+                            (uint32_t)(ts >> 32), (uint32_t)ts,
+                            capLen, pktLen };
+        memcpy(b, hdr, sizeof(hdr));
+        memcpy(b + PCAPNG_EPB_HDR_LEN, pkt, capLen);
+        memset(b + PCAPNG_EPB_HDR_LEN + capLen, 0, pcapngPad(capLen) - capLen);
+
+        uint32_t  trl[] = { PCAPNG_OPT_EPB_FLAGS | (4 << 16), (uint32_t)dir,
+                            PCAPNG_OPT_END, blockLen };
+        memcpy(b + PCAPNG_EPB_HDR_LEN + pcapngPad(capLen), trl, sizeof(trl));
+
+        wake = (_bufLen < half) && (_bufLen + blockLen >= half);
+        _bufLen += blockLen;
+        _pkts++;
+    }
+
+    //
+    // Writer wakes up on its own every AFI_PCAP_FLUSH_MS; wake it
+    // early only when the buffer is half full
+    //
+    if (wake) {
+        _cv.notify_one();
+    }
+}
+
+//
+// @fn
+// writerLoop
+//
+// @brief
+// Writer thread: writes the capture buffer out when it is half full
+// or every AFI_PCAP_FLUSH_MS
+//
+
+void
+AfiPcapWriter::writerLoop (void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!_stop) {
+        _cv.wait_for(lock, std::chrono::milliseconds(AFI_PCAP_FLUSH_MS));
+        if (_fd >= 0) {
+            flush();
+        }
+    }
+}
+
+//
+// @fn
+// flush
+//
+// @brief
+// Swap capture buffers and write the captured blocks, preceded by the
+// interface blocks the file does not have yet (_mutex held)
+//
+
+void
+AfiPcapWriter::flush (void)
+{
+    std::vector<Interface> ifs;
+    size_t                 len;
+
+    {
+        std::lock_guard<spinlock> guard(_lock);
+        _buf.swap(_wbuf);
+        len     = _bufLen;
+        _bufLen = 0;
+        ifs     = _ifs;
+    }
+
+    if (len == 0) {
+        return;
+    }
+
+    bool rotate = (_rotateBytes && (_fileBytes >= _rotateBytes)) ||
+                  (_rotateSec &&
+                   (afiMonotonicNs() - _fileStartNs >=
+                    (uint64_t)_rotateSec * 1000000000ULL));
+    if (rotate) {
+        fileClose();
+        _fileSeq++;
+        if (fileOpen() != 0) {
+            return;
+        }
+    }
+
+    for (; _ifsWritten < ifs.size(); _ifsWritten++) {
+        writeInterface(ifs[_ifsWritten]);
+    }
+
+    fileWrite(_wbuf.data(), len);
+}
+
+//
+// @fn
+// fileOpen
+//
+// @brief
+// Open the current capture file and write its section header
+// (_mutex held)
+//
+
+int
+AfiPcapWriter::fileOpen (void)
+{
+    bool        rotating = (_rotateBytes || _rotateSec);
+    std::string name     = _fileName;
+
+    if (rotating) {
+        name += "." + std::to_string(_fileSeq);
+    }
+
+    _fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        perror(name.c_str());
+        return -1;
+    }
+
+    if (rotating && _maxFiles && (_fileSeq >= _maxFiles)) {
+        std::string old = _fileName + "." +
+                          std::to_string(_fileSeq - _maxFiles);
+        unlink(old.c_str());
+    }
+
+    _files++;
+    _fileBytes   = 0;
+    _fileStartNs = afiMonotonicNs();
+    _ifsWritten  = 0;
+    writeSectionHeader();
+
+    return 0;
+}
+
+void
+AfiPcapWriter::fileClose (void)
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+int
+AfiPcapWriter::fileWrite (const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t ret = ::write(_fd, data, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write(capture)");
+            return -1;
+        }
+        data       += ret;
+        len        -= ret;
+        _fileBytes += ret;
+        _bytes     += ret;
+    }
+
+    return 0;
+}
+
+void
+AfiPcapWriter::writeSectionHeader (void)
+{
+    const char userAppl[] = "afi-client";
+    size_t     start      = 0;
+
+    _hdrBuf.clear();
+    pcapngPut32(_hdrBuf, PCAPNG_SHB);
+    pcapngPut32(_hdrBuf, 0);
+    pcapngPut32(_hdrBuf, PCAPNG_BOM);
+    pcapngPut16(_hdrBuf, 1);                    // Major version
+    pcapngPut16(_hdrBuf, 0);                    // Minor version
+    pcapngPut32(_hdrBuf, 0xffffffff);           // Section length unknown
+    pcapngPut32(_hdrBuf, 0xffffffff);
+    pcapngPutOpt(_hdrBuf, PCAPNG_OPT_SHB_USERAPPL,
+                 userAppl, sizeof(userAppl) - 1);
+    pcapngEndBlock(_hdrBuf, start);
+
+    fileWrite(_hdrBuf.data(), _hdrBuf.size());
+}
+
+void
+AfiPcapWriter::writeInterface (const Interface &ifc)
+{
+    std::ostringstream name, descr;
+    uint8_t            tsresol = 9;             // Nanoseconds
+    size_t             start   = 0;
+
+    name  << "sb" << ifc.sandboxId << "p" << ifc.portIndex;
+    descr << "AFI sandbox " << ifc.sandboxId << " port " << ifc.portIndex;
+
+    _hdrBuf.clear();
+    pcapngPut32(_hdrBuf, PCAPNG_IDB);
+    pcapngPut32(_hdrBuf, 0);
+    pcapngPut16(_hdrBuf, PCAPNG_LINKTYPE_ETHER);
+    pcapngPut16(_hdrBuf, 0);
+    pcapngPut32(_hdrBuf, _snapLen);
+    pcapngPutOpt(_hdrBuf, PCAPNG_OPT_IF_NAME,
+                 name.str().data(), name.str().size());
+    pcapngPutOpt(_hdrBuf, PCAPNG_OPT_IF_DESCR,
+                 descr.str().data(), descr.str().size());
+    pcapngPutOpt(_hdrBuf, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+    pcapngEndBlock(_hdrBuf, start);
+
+    fileWrite(_hdrBuf.data(), _hdrBuf.size());
+}
+
+//
+// @fn
+// stats
+//
+// @brief
+// Capture statistics
+//
+// @param[out]
+//     stats Statistics
+// @return void
+//
+
+void
+AfiPcapWriter::stats (Stats &stats) const
+{
+    {
+        std::lock_guard<spinlock> guard(_lock);
+        stats.pkts  = _pkts;
+        stats.drops = _drops;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    stats.bytes = _bytes;
+    stats.files = _files;
+}
+
+std::ostream &
+AfiPcapWriter::description (std::ostream &os) const
+{
+    Stats s;
+    stats(s);
+
+    os << "Capture: " << (isOpen() ? "running" : "stopped");
+    os << " packets " << s.pkts << " dropped " << s.drops;
+    os << " bytes " << s.bytes << " files " << s.files;
+
+    return os;
+}
@@ -0,0 +1,169 @@
+//
+// AfiPcapWriter.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiPcapWriter__
+#define __AfiPcapWriter__
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Utils.h"
+
+#define AFI_PCAP_BUF_SIZE       (4 * 1024 * 1024)  // Bytes, per buffer
+#define AFI_PCAP_SNAPLEN        65535
+#define AFI_PCAP_FLUSH_MS       100     // Max time a packet stays buffered
+
+//
+// pcapng capture writer
+// =====================
+//
+// Captures punted and injected packets into a pcapng file. Every
+// (sandbox, port) gets its own pcapng interface, named "sb<N>p<M>",
+// and each packet block carries its direction (punted packets are
+// inbound, injected packets outbound).
+//
+// capture() only formats the packet block into the current buffer
+// under a spinlock; a writer thread swaps buffers and writes them to
+// the file. If the writer falls behind and the buffer is full, packets
+// are dropped and counted: capturing never blocks the caller.
+//
+// Files can be rotated by size and/or age. Rotated files are named
+// <file>.<sequence number>, the oldest are removed beyond maxFiles.
+//
+class AfiPcapWriter
+{
+public:
+    //
+    // Packet direction (pcapng epb_flags)
+    //
+    typedef enum {
+        DirInbound  = 1,        //< Punted by the sandbox
+        DirOutbound = 2,        //< Injected into the sandbox
+    } Direction;
+
+    //
+    // Capture statistics
+    //
+    struct Stats {
+        uint64_t  pkts;         //< Packets captured
+        uint64_t  bytes;        //< Bytes written
+        uint64_t  drops;        //< Packets dropped, buffer full
+        uint64_t  files;        //< Files written
+    };
+
+    AfiPcapWriter(size_t bufSize = AFI_PCAP_BUF_SIZE,
+                  uint32_t snapLen = AFI_PCAP_SNAPLEN);
+    ~AfiPcapWriter();
+
+    //
+    // Start capturing to a file. rotateBytes/rotateSec 0: no rotation.
+    //
+    int open(const std::string &fileName,
+             uint64_t           rotateBytes = 0,
+             uint32_t           rotateSec   = 0,
+             uint32_t           maxFiles    = 0);
+
+    //
+    // Stop capturing, write out buffered packets and close the file
+    //
+    void close(void);
+
+    bool isOpen(void) const {
+        return _open.load(std::memory_order_relaxed);
+    }
+
+    //
+    // Capture a packet, if capturing
+    //
+    void capture(uint32_t       sandboxId,
+                 uint32_t       portIndex,
+                 Direction      dir,
+                 const uint8_t *pkt,
+                 uint32_t       pktLen) {
+        if (__builtin_expect(isOpen(), 0)) {
+            append(sandboxId, portIndex, dir, pkt, pktLen);
+        }
+    }
+
+    void stats(Stats &stats) const;
+    std::ostream &description(std::ostream &os) const;
+
+private:
+    struct Interface {
+        uint32_t  sandboxId;
+        uint32_t  portIndex;
+    };
+
+    void append(uint32_t sandboxId, uint32_t portIndex, Direction dir,
+                const uint8_t *pkt, uint32_t pktLen);
+    void writerLoop(void);
+    void flush(void);
+    int  fileOpen(void);
+    void fileClose(void);
+    int  fileWrite(const uint8_t *data, size_t len);
+    void writeSectionHeader(void);
+    void writeInterface(const Interface &ifc);
+
+    size_t                     _bufSize;
+    uint32_t                   _snapLen;
+
+    //
+    // Producer side, protected by _lock
+    //
+    mutable spinlock           _lock;
+    std::vector<uint8_t>       _buf;           //< Blocks being captured
+    size_t                     _bufLen;
+    std::vector<Interface>     _ifs;           //< Interface id -> sb, port
+    std::unordered_map<uint64_t, uint32_t> _ifIds;
+    uint64_t                   _pkts;
+    uint64_t                   _drops;
+    std::atomic<bool>          _open;
+
+    //
+    // Writer side, protected by _mutex
+    //
+    mutable std::mutex         _mutex;
+    std::condition_variable    _cv;
+    std::thread                _thread;
+    bool                       _stop;
+    std::vector<uint8_t>       _wbuf;          //< Blocks being written
+    std::vector<uint8_t>       _hdrBuf;        //< SHB/IDB scratch
+    std::string                _fileName;
+    uint64_t                   _rotateBytes;
+    uint32_t                   _rotateSec;
+    uint32_t                   _maxFiles;
+    uint32_t                   _fileSeq;
+    int                        _fd;
+    uint64_t                   _fileBytes;
+    uint64_t                   _fileStartNs;
+    size_t                     _ifsWritten;    //< IDBs in current file
+    uint64_t                   _bytes;
+    uint64_t                   _files;
+};
+
+#endif // __AfiPcapWriter__
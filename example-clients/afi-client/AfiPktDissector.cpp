@@ -0,0 +1,625 @@
+//
+// AfiPktDissector.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <algorithm>
+#include <sstream>
+#include "AfiPktDissector.h"
+
+#define AFI_DISSECT_ETH_HDR_LEN     14
+#define AFI_DISSECT_VLAN_TAG_LEN    4
+#define AFI_DISSECT_MPLS_LEN        4
+#define AFI_DISSECT_IPV4_HDR_LEN    20
+#define AFI_DISSECT_IPV6_HDR_LEN    40
+
+//
+// IPv6 extension headers skipped to reach the upper layer protocol
+//
+#define AFI_DISSECT_IPV6_HOPOPTS    0
+#define AFI_DISSECT_IPV6_ROUTING    43
+#define AFI_DISSECT_IPV6_FRAGMENT   44
+#define AFI_DISSECT_IPV6_AH         51
+#define AFI_DISSECT_IPV6_DSTOPTS    60
+
+//
+// @fn
+// parseL2
+//
+// @brief
+// Decode Ethernet header and VLAN tags
+//
+// @return void
+//
+
+void
+AfiPktDissector::parseL2 (void) const
+{
+    _done     |= DoneL2;
+    _numVlans  = 0;
+    _etherType = 0;
+    _l2End     = 0;
+
+    if (!ethValid()) {
+        _truncated = (_len > 0);
+        return;
+    }
+
+    size_t   off       = AFI_DISSECT_ETH_HDR_LEN;
+    uint16_t etherType = get16(off - 2);
+
+    while (((etherType == AFI_DISSECT_ETH_P_VLAN) ||
+            (etherType == AFI_DISSECT_ETH_P_QINQ)) &&
+           (_numVlans < AFI_DISSECT_MAX_VLANS)) {
+        if (off + AFI_DISSECT_VLAN_TAG_LEN > _len) {
+            _truncated = true;
+            return;
+        }
+        _vlanOff[_numVlans++] = off;
+        etherType = get16(off + 2);
+        off += AFI_DISSECT_VLAN_TAG_LEN;
+    }
+
+    _etherType = etherType;
+    _l2End     = off;
+}
+
+//
+// @fn
+// parseL3
+//
+// @brief
+// Decode MPLS label stack and IP header
+//
+// @return void
+//
+
+void
+AfiPktDissector::parseL3 (void) const
+{
+    decodeL2();
+
+    _done     |= DoneL3;
+    _numLabels = 0;
+    _mplsOff   = 0;
+    _ipVersion = 0;
+    _ipOff     = 0;
+    _ipEnd     = 0;
+    _ipProto   = -1;
+    _laterFrag = false;
+    _l4Off     = 0;
+
+    size_t off = _l2End;
+
+    switch (_etherType) {
+    case AFI_DISSECT_ETH_P_IPV4:
+        parseIpv4(off);
+        break;
+
+    case AFI_DISSECT_ETH_P_IPV6:
+        parseIpv6(off);
+        break;
+
+    case AFI_DISSECT_ETH_P_MPLS:
+    case AFI_DISSECT_ETH_P_MPLS_MC:
+        _mplsOff = off;
+        for (;;) {
+            if (off + AFI_DISSECT_MPLS_LEN > _len) {
+                _truncated = true;
+                return;
+            }
+            bool bos = (_pkt[off + 2] & 0x01);
+            off += AFI_DISSECT_MPLS_LEN;
+            if (_numLabels < AFI_DISSECT_MAX_LABELS) {
+                _numLabels++;
+            }
+            if (bos) {
+                break;
+            }
+        }
+        //
+        // No protocol field: guess from the first nibble
+        //
+        if (off < _len) {
+            if ((_pkt[off] >> 4) == 4) {
+                parseIpv4(off);
+            } else if ((_pkt[off] >> 4) == 6) {
+                parseIpv6(off);
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+//
+// @fn
+// parseIpv4
+//
+// @brief
+// Decode IPv4 header
+//
+// @param[in]
+//     off Offset of the IPv4 header
+// @return void
+//
+
+void
+AfiPktDissector::parseIpv4 (size_t off) const
+{
+    if (off + AFI_DISSECT_IPV4_HDR_LEN > _len) {
+        _truncated = true;
+        return;
+    }
+
+    const uint8_t *ip  = _pkt + off;
+    size_t         ihl = (ip[0] & 0x0f) * 4;
+
+    if (((ip[0] >> 4) != 4) || (ihl < AFI_DISSECT_IPV4_HDR_LEN)) {
+        return;
+    }
+    if (off + ihl > _len) {
+        _truncated = true;
+        return;
+    }
+
+    size_t totLen = get16(off + 2);
+    if (off + totLen > _len) {
+        _truncated = true;
+    }
+
+    _ipVersion = 4;
+    _ipOff     = off;
+    _ipEnd     = std::min(_len, off + std::max(totLen, ihl));
+    _ipProto   = ip[9];
+    _laterFrag = ((get16(off + 6) & 0x1fff) != 0);
+    _l4Off     = _laterFrag ? 0 : off + ihl;
+}
+
+//
+// @fn
+// parseIpv6
+//
+// @brief
+// Decode IPv6 header, skip extension headers
+//
+// @param[in]
+//     off Offset of the IPv6 header
+// @return void
+//
+
+void
+AfiPktDissector::parseIpv6 (size_t off) const
+{
+    if (off + AFI_DISSECT_IPV6_HDR_LEN > _len) {
+        _truncated = true;
+        return;
+    }
+    if ((_pkt[off] >> 4) != 6) {
+        return;
+    }
+
+    size_t payloadLen = get16(off + 4);
+    if (off + AFI_DISSECT_IPV6_HDR_LEN + payloadLen > _len) {
+        _truncated = true;
+    }
+
+    _ipVersion = 6;
+    _ipOff     = off;
+    _ipEnd     = std::min(_len, off + AFI_DISSECT_IPV6_HDR_LEN + payloadLen);
+
+    int    next = _pkt[off + 6];
+    size_t ext  = off + AFI_DISSECT_IPV6_HDR_LEN;
+
+    for (int i = 0; i < AFI_DISSECT_MAX_EXT; i++) {
+        if ((next != AFI_DISSECT_IPV6_HOPOPTS) &&
+            (next != AFI_DISSECT_IPV6_ROUTING) &&
+            (next != AFI_DISSECT_IPV6_FRAGMENT) &&
+            (next != AFI_DISSECT_IPV6_AH) &&
+            (next != AFI_DISSECT_IPV6_DSTOPTS)) {
+            break;
+        }
+        if (ext + 8 > _len) {
+            _truncated = true;
+            _ipProto   = next;
+            return;
+        }
+
+        size_t extLen;
+        if (next == AFI_DISSECT_IPV6_FRAGMENT) {
+            extLen = 8;
+            if ((get16(ext + 2) & 0xfff8) != 0) {
+                _laterFrag = true;
+            }
+        } else if (next == AFI_DISSECT_IPV6_AH) {
+            extLen = (_pkt[ext + 1] + 2) * 4;
+        } else {
+            extLen = (_pkt[ext + 1] + 1) * 8;
+        }
+
+        next = _pkt[ext];
+        ext += extLen;
+    }
+
+    _ipProto = next;
+    _l4Off   = _laterFrag ? 0 : ext;
+}
+
+//
+// @fn
+// parseL4
+//
+// @brief
+// Decode TCP, UDP, ICMP, ICMPv6 header length
+//
+// @return void
+//
+
+void
+AfiPktDissector::parseL4 (void) const
+{
+    decodeL3();
+
+    _done     |= DoneL4;
+    _l4HdrLen  = 0;
+
+    if (_ipVersion == 0) {
+        _l4Off = 0;
+        return;
+    }
+    if (_l4Off == 0) {
+        return;
+    }
+    if (_l4Off > _ipEnd) {
+        _truncated = true;
+        _l4Off     = 0;
+        return;
+    }
+
+    size_t hdrLen = 0;
+    switch (_ipProto) {
+    case AFI_DISSECT_IPPROTO_UDP:
+        hdrLen = 8;
+        break;
+
+    case AFI_DISSECT_IPPROTO_TCP:
+        if (_l4Off + 13 <= _ipEnd) {
+            hdrLen = (_pkt[_l4Off + 12] >> 4) * 4;
+            if (hdrLen < 20) {
+                return;
+            }
+        } else {
+            hdrLen = 20;
+        }
+        break;
+
+    case AFI_DISSECT_IPPROTO_ICMP:
+    case AFI_DISSECT_IPPROTO_ICMPV6:
+        hdrLen = 4;
+        break;
+
+    default:
+        return;
+    }
+
+    if (_l4Off + hdrLen > _ipEnd) {
+        _truncated = true;
+        return;
+    }
+    _l4HdrLen = hdrLen;
+}
+
+//
+// @fn
+// hasPorts
+//
+// @brief
+// TCP or UDP header with ports present
+//
+// @return true - Ports present
+//
+
+bool
+AfiPktDissector::hasPorts (void) const
+{
+    decodeL4();
+    return ((_ipProto == AFI_DISSECT_IPPROTO_TCP) ||
+            (_ipProto == AFI_DISSECT_IPPROTO_UDP)) &&
+           (_l4Off != 0) && (_l4Off + 4 <= _ipEnd);
+}
+
+AfiPktView
+AfiPktDissector::l3 (void) const
+{
+    AfiPktView view = { NULL, 0 };
+
+    decodeL3();
+    if (_ipVersion != 0) {
+        view.data = _pkt + _ipOff;
+        view.len  = _ipEnd - _ipOff;
+    }
+    return view;
+}
+
+const uint8_t *
+AfiPktDissector::ipSrc (void) const
+{
+    switch (ipVersion()) {
+    case 4:  return _pkt + _ipOff + 12;
+    case 6:  return _pkt + _ipOff + 8;
+    default: return NULL;
+    }
+}
+
+const uint8_t *
+AfiPktDissector::ipDst (void) const
+{
+    switch (ipVersion()) {
+    case 4:  return _pkt + _ipOff + 16;
+    case 6:  return _pkt + _ipOff + 24;
+    default: return NULL;
+    }
+}
+
+uint8_t
+AfiPktDissector::ipTtl (void) const
+{
+    switch (ipVersion()) {
+    case 4:  return _pkt[_ipOff + 8];
+    case 6:  return _pkt[_ipOff + 7];
+    default: return 0;
+    }
+}
+
+AfiPktView
+AfiPktDissector::l4 (void) const
+{
+    AfiPktView view = { NULL, 0 };
+
+    decodeL4();
+    if (_l4Off != 0) {
+        view.data = _pkt + _l4Off;
+        view.len  = _ipEnd - _l4Off;
+    }
+    return view;
+}
+
+uint8_t
+AfiPktDissector::tcpFlags (void) const
+{
+    decodeL4();
+    if ((_ipProto != AFI_DISSECT_IPPROTO_TCP) || (_l4HdrLen == 0)) {
+        return 0;
+    }
+    return _pkt[_l4Off + 13];
+}
+
+int
+AfiPktDissector::icmpType (void) const
+{
+    decodeL4();
+    if (((_ipProto != AFI_DISSECT_IPPROTO_ICMP) &&
+         (_ipProto != AFI_DISSECT_IPPROTO_ICMPV6)) || (_l4HdrLen == 0)) {
+        return -1;
+    }
+    return _pkt[_l4Off];
+}
+
+int
+AfiPktDissector::icmpCode (void) const
+{
+    return (icmpType() < 0) ? -1 : _pkt[_l4Off + 1];
+}
+
+AfiPktView
+AfiPktDissector::payload (void) const
+{
+    AfiPktView view = { NULL, 0 };
+
+    decodeL4();
+    if (_l4HdrLen != 0) {
+        view.data = _pkt + _l4Off + _l4HdrLen;
+        view.len  = _ipEnd - _l4Off - _l4HdrLen;
+    }
+    return view;
+}
+
+//
+// Helpers of summary
+//
+static void
+summaryMac (std::ostream &os, const uint8_t *mac)
+{
+    char buf[18];
+
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    os << buf;
+}
+
+static void
+summaryIp (std::ostream &os, int version, const uint8_t *addr)
+{
+    char buf[INET6_ADDRSTRLEN];
+
+    if (inet_ntop((version == 6) ? AF_INET6 : AF_INET, addr,
+                  buf, sizeof(buf)) != NULL) {
+        os << buf;
+    }
+}
+
+//
+// @fn
+// summaryL4
+//
+// @brief
+// Print layer 4 part of the summary
+//
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+AfiPktDissector::summaryL4 (std::ostream &os) const
+{
+    if (_laterFrag) {
+        os << " frag proto " << _ipProto;
+        return;
+    }
+
+    switch (_ipProto) {
+    case AFI_DISSECT_IPPROTO_UDP:
+        if (hasPorts()) {
+            os << " udp " << srcPort() << " > " << dstPort();
+            return;
+        }
+        break;
+
+    case AFI_DISSECT_IPPROTO_TCP:
+        if (hasPorts()) {
+            static const char flagChars[] = "FSRPAUEC";
+            std::string       flags;
+            uint8_t           f = tcpFlags();
+
+            for (int i = 0; i < 8; i++) {
+                if (f & (1 << i)) {
+                    flags += flagChars[i];
+                }
+            }
+            os << " tcp " << srcPort() << " > " << dstPort();
+            if (!flags.empty()) {
+                os << " [" << flags << "]";
+            }
+            return;
+        }
+        break;
+
+    case AFI_DISSECT_IPPROTO_ICMP:
+    case AFI_DISSECT_IPPROTO_ICMPV6:
+        if (icmpType() >= 0) {
+            bool v6      = (_ipProto == AFI_DISSECT_IPPROTO_ICMPV6);
+            int  request = v6 ? 128 : 8;
+            int  reply   = v6 ? 129 : 0;
+
+            os << (v6 ? " icmpv6" : " icmp");
+            if (((icmpType() == request) || (icmpType() == reply)) &&
+                (_l4Off + 8 <= _ipEnd)) {
+                os << ((icmpType() == request) ? " echo-request" :
+                                                 " echo-reply");
+                os << " id " << get16(_l4Off + 4);
+                os << " seq " << get16(_l4Off + 6);
+            } else {
+                os << " type " << icmpType() << " code " << icmpCode();
+            }
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    os << " proto " << _ipProto;
+}
+
+//
+// @fn
+// summary
+//
+// @brief
+// Print one line summary of the packet (no line break)
+//
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+AfiPktDissector::summary (std::ostream &os) const
+{
+    if (!ethValid()) {
+        os << "short frame, " << _len << " bytes";
+        return;
+    }
+
+    summaryMac(os, ethSrc());
+    os << " > ";
+    summaryMac(os, ethDst());
+
+    for (int i = 0; i < numVlans(); i++) {
+        os << " vlan " << vlanId(i);
+    }
+    for (int i = 0; i < numLabels(); i++) {
+        os << " mpls " << mplsLabel(i);
+        if (_pkt[_mplsOff + 4 * i + 2] & 0x01) {
+            os << "/s";
+        }
+    }
+
+    if (ipVersion() != 0) {
+        os << " ipv" << ipVersion() << " ";
+        summaryIp(os, ipVersion(), ipSrc());
+        os << " > ";
+        summaryIp(os, ipVersion(), ipDst());
+        os << " ttl " << (int)ipTtl();
+        summaryL4(os);
+    } else if ((etherType() == AFI_DISSECT_ETH_P_ARP) &&
+               (_l2End + 28 <= _len)) {
+        const uint8_t *arp = _pkt + _l2End;
+        uint16_t       op  = get16(_l2End + 6);
+
+        if (op == 1) {
+            os << " arp who-has ";
+            summaryIp(os, 4, arp + 24);
+            os << " tell ";
+            summaryIp(os, 4, arp + 14);
+        } else if (op == 2) {
+            os << " arp reply ";
+            summaryIp(os, 4, arp + 14);
+            os << " is-at ";
+            summaryMac(os, arp + 8);
+        } else {
+            os << " arp op " << op;
+        }
+    } else if (numLabels() == 0) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "0x%04x", etherType());
+        os << " ethertype " << buf;
+    }
+
+    os << ", " << _len << " bytes";
+    if (truncated()) {
+        os << " [truncated]";
+    }
+}
+
+std::string
+AfiPktDissector::summary (void) const
+{
+    std::ostringstream os;
+
+    summary(os);
+    return os.str();
+}
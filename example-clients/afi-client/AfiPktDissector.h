@@ -0,0 +1,227 @@
+//
+// AfiPktDissector.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiPktDissector__
+#define __AfiPktDissector__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <string>
+
+#define AFI_DISSECT_MAX_VLANS   4       // 802.1Q/802.1ad tags decoded
+#define AFI_DISSECT_MAX_LABELS  8       // MPLS label stack entries decoded
+#define AFI_DISSECT_MAX_EXT     8       // IPv6 extension headers skipped
+
+#define AFI_DISSECT_ETH_P_IPV4      0x0800
+#define AFI_DISSECT_ETH_P_ARP       0x0806
+#define AFI_DISSECT_ETH_P_VLAN      0x8100
+#define AFI_DISSECT_ETH_P_QINQ      0x88a8
+#define AFI_DISSECT_ETH_P_IPV6      0x86dd
+#define AFI_DISSECT_ETH_P_MPLS      0x8847
+#define AFI_DISSECT_ETH_P_MPLS_MC   0x8848
+
+#define AFI_DISSECT_IPPROTO_ICMP    1
+#define AFI_DISSECT_IPPROTO_TCP     6
+#define AFI_DISSECT_IPPROTO_UDP     17
+#define AFI_DISSECT_IPPROTO_ICMPV6  58
+
+//
+// @struct  AfiPktView
+// @brief   Bytes of a dissected packet (not owned), data NULL if absent
+//
+struct AfiPktView {
+    const uint8_t  *data;
+    size_t          len;
+
+    bool valid(void) const { return data != NULL; }
+};
+
+//
+// @class   AfiPktDissector
+// @brief   Lazy, zero copy dissector of a layer 2 packet
+//
+// The dissector keeps a pointer to the packet and offsets into it;
+// nothing is copied and the packet must outlive it. Layers are decoded
+// on first access of one of their fields, each once:
+//
+//   L2   Ethernet and up to AFI_DISSECT_MAX_VLANS 802.1Q/802.1ad tags
+//   L3   MPLS label stack (the payload is IPv4 or IPv6 as its version
+//        nibble says), IPv4 or IPv6 (extension headers skipped)
+//   L4   TCP, UDP, ICMP, ICMPv6
+//
+// Fields of layers that are absent or truncated read as 0 (addresses
+// as NULL, views as invalid); truncated() tells whether a layer was
+// cut short.
+//
+class AfiPktDissector
+{
+public:
+    AfiPktDissector(const uint8_t *pkt, size_t len)
+        : _pkt(pkt), _len(len), _done(0), _truncated(false) {
+    }
+
+    const uint8_t *packet(void) const { return _pkt; }
+    size_t length(void) const { return _len; }
+
+    //
+    // Layer 2
+    //
+    bool ethValid(void) const { return _len >= 14; }
+    const uint8_t *ethDst(void) const { return ethValid() ? _pkt : NULL; }
+    const uint8_t *ethSrc(void) const { return ethValid() ? _pkt + 6 : NULL; }
+
+    //
+    // VLAN tags, outer tag first; 0 for i not below numVlans()
+    //
+    int numVlans(void) const { decodeL2(); return _numVlans; }
+    uint16_t vlanTpid(int i) const {
+        return vlanValid(i) ? get16(_vlanOff[i] - 2) : 0;
+    }
+    uint16_t vlanId(int i) const {
+        return vlanValid(i) ? get16(_vlanOff[i]) & 0x0fff : 0;
+    }
+    uint8_t vlanPcp(int i) const {
+        return vlanValid(i) ? _pkt[_vlanOff[i]] >> 5 : 0;
+    }
+
+    //
+    // Ethertype after the VLAN tags, 0 - None
+    //
+    uint16_t etherType(void) const { decodeL2(); return _etherType; }
+
+    //
+    // MPLS label stack, top entry first; 0 for i not below numLabels()
+    //
+    int numLabels(void) const { decodeL3(); return _numLabels; }
+    uint32_t mplsLabel(int i) const {
+        return labelValid(i) ? get32(_mplsOff + 4 * i) >> 12 : 0;
+    }
+    uint8_t mplsTc(int i) const {
+        return labelValid(i) ? (_pkt[_mplsOff + 4 * i + 2] >> 1) & 7 : 0;
+    }
+    uint8_t mplsTtl(int i) const {
+        return labelValid(i) ? _pkt[_mplsOff + 4 * i + 3] : 0;
+    }
+
+    //
+    // Layer 3: IP version (4, 6, 0 - not IP), header and payload up to
+    // the IP length, addresses (ipAddrLen() bytes), protocol (IPv6:
+    // after extension headers, -1 - not IP), TTL / hop limit
+    //
+    int ipVersion(void) const { decodeL3(); return _ipVersion; }
+    AfiPktView l3(void) const;
+    const uint8_t *ipSrc(void) const;
+    const uint8_t *ipDst(void) const;
+    int ipAddrLen(void) const { return (ipVersion() == 6) ? 16 : 4; }
+    int ipProto(void) const { decodeL3(); return _ipProto; }
+    uint8_t ipTtl(void) const;
+
+    //
+    // True for IP fragments but the first: they have no L4 header
+    //
+    bool ipLaterFragment(void) const { decodeL3(); return _laterFrag; }
+
+    //
+    // Layer 4: header and payload, ports (TCP, UDP), TCP flags,
+    // ICMP/ICMPv6 type and code (-1 - none), payload after the header
+    //
+    AfiPktView l4(void) const;
+    uint16_t srcPort(void) const { return hasPorts() ? get16(_l4Off) : 0; }
+    uint16_t dstPort(void) const { return hasPorts() ? get16(_l4Off + 2) : 0; }
+    uint8_t tcpFlags(void) const;
+    int icmpType(void) const;
+    int icmpCode(void) const;
+    AfiPktView payload(void) const;
+
+    //
+    // A layer (or the frame) is shorter than its headers say
+    //
+    bool truncated(void) const { decodeL4(); return _truncated; }
+
+    //
+    // One line summary, e.g.
+    // 32:26:0a:2e:aa:f1 > 33:22:0a:2e:ff:f1 vlan 10 ipv4 103.30.10.1 >
+    // 103.30.10.3 ttl 64 icmp echo-request id 18731 seq 14658, 98 bytes
+    //
+    void summary(std::ostream &os) const;
+    std::string summary(void) const;
+
+private:
+    enum {
+        DoneL2 = 1,
+        DoneL3 = 2,
+        DoneL4 = 4,
+    };
+
+    uint16_t get16(size_t off) const {
+        return ((uint16_t)_pkt[off] << 8) | _pkt[off + 1];
+    }
+    uint32_t get32(size_t off) const {
+        return ((uint32_t)get16(off) << 16) | get16(off + 2);
+    }
+
+    void decodeL2(void) const { if (!(_done & DoneL2)) parseL2(); }
+    void decodeL3(void) const { if (!(_done & DoneL3)) parseL3(); }
+    void decodeL4(void) const { if (!(_done & DoneL4)) parseL4(); }
+    bool vlanValid(int i) const { return (i >= 0) && (i < numVlans()); }
+    bool labelValid(int i) const { return (i >= 0) && (i < numLabels()); }
+    bool hasPorts(void) const;
+
+    void parseL2(void) const;
+    void parseL3(void) const;
+    void parseL4(void) const;
+    void parseIpv4(size_t off) const;
+    void parseIpv6(size_t off) const;
+
+    void summaryL4(std::ostream &os) const;
+
+    const uint8_t   *_pkt;
+    size_t           _len;
+    mutable uint8_t  _done;         //< Layers decoded
+    mutable bool     _truncated;
+
+    //
+    // Offsets into the packet, valid once their layer is decoded
+    //
+    mutable int      _numVlans;
+    mutable uint16_t _vlanOff[AFI_DISSECT_MAX_VLANS];   //< TCI
+    mutable uint16_t _etherType;
+    mutable size_t   _l2End;        //< First byte after the VLAN tags
+    mutable int      _numLabels;
+    mutable size_t   _mplsOff;
+    mutable int      _ipVersion;
+    mutable size_t   _ipOff;
+    mutable size_t   _ipEnd;        //< End of IP packet (before padding)
+    mutable int      _ipProto;
+    mutable bool     _laterFrag;
+    mutable size_t   _l4Off;        //< 0 - No L4 header
+    mutable size_t   _l4HdrLen;     //< 0 - Unknown or truncated
+};
+
+inline std::ostream &
+operator<< (std::ostream &os, const AfiPktDissector &d)
+{
+    d.summary(os);
+    return os;
+}
+
+#endif // __AfiPktDissector__
@@ -0,0 +1,417 @@
+//
+// AfiPktTemplate.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "AfiPktTemplate.h"
+#include "Utils.h"
+
+#define AFI_ETH_P_IPV4          0x0800
+#define AFI_ETH_P_VLAN          0x8100
+#define AFI_ETH_P_QINQ          0x88a8
+#define AFI_ETH_P_MPLS          0x8847
+#define AFI_ETH_HDR_LEN         14
+#define AFI_IPPROTO_ICMP        1
+#define AFI_IPPROTO_TCP         6
+#define AFI_IPPROTO_UDP         17
+#define AFI_PKT_TMPL_MAX        2000    // Largest template frame
+
+AfiPktTemplate::AfiPktTemplate ()
+    : _vlanOff(-1),
+      _mplsOff(-1),
+      _ipOff(-1),
+      _l4Off(-1),
+      _l4Len(0),
+      _l4Csum(-1),
+      _l4Pseudo(false),
+      _l4Udp(false)
+{
+}
+
+//
+// @fn
+// build
+//
+// @brief
+// Build the template's AftPacket from a frame and locate its layers
+//
+// @param[in]
+//     sandboxId Sandbox index
+// @param[in]
+//     portIndex Output port index
+// @param[in]
+//     frame Layer 2 frame
+// @param[in]
+//     frameLen Frame length
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiPktTemplate::build (AftSandboxId   sandboxId,
+                       AftIndex       portIndex,
+                       const uint8_t *frame,
+                       int            frameLen)
+{
+    if ((frame == NULL) || (frameLen < AFI_ETH_HDR_LEN) ||
+        (frameLen > AFI_PKT_TMPL_MAX)) {
+        std::cout << "Invalid template frame" << std::endl;
+        return -1;
+    }
+
+    _pkt = AftPacket::createTransmit(frameLen, sandboxId, portIndex,
+                                     AftPacket::PacketTypeL2);
+    memcpy(_pkt->data(), frame, frameLen);
+    _fields.clear();
+    parse();
+
+    return 0;
+}
+
+int
+AfiPktTemplate::build (AftSandboxId       sandboxId,
+                       AftIndex           portIndex,
+                       const std::string &hexStr)
+{
+    std::vector<char> hex(hexStr.begin(), hexStr.end());
+    char              frame[AFI_PKT_TMPL_MAX];
+
+    hex.push_back('\0');
+    int frameLen = convertHexPktStrToPkt(hex.data(), frame, sizeof(frame));
+    if (frameLen <= 0) {
+        std::cout << "Invalid template hex string" << std::endl;
+        return -1;
+    }
+
+    return build(sandboxId, portIndex, (const uint8_t *)frame, frameLen);
+}
+
+//
+// @fn
+// retarget
+//
+// @brief
+// Move the template to another sandbox port: the frame (with its
+// current field values) goes into a new AftPacket
+//
+// @param[in]
+//     sandboxId Sandbox index
+// @param[in]
+//     portIndex Output port index
+// @return void
+//
+
+void
+AfiPktTemplate::retarget (AftSandboxId sandboxId, AftIndex portIndex)
+{
+    if ((_pkt->sandboxId() == sandboxId) && (_pkt->portIndex() == portIndex)) {
+        return;
+    }
+
+    AftPacketPtr pkt = AftPacket::createTransmit(_pkt->dataSize(), sandboxId,
+                                                 portIndex,
+                                                 AftPacket::PacketTypeL2);
+    memcpy(pkt->data(), _pkt->data(), _pkt->dataSize());
+    _pkt = pkt;
+}
+
+//
+// @fn
+// parse
+//
+// @brief
+// Locate the VLAN tag, MPLS label stack, IPv4 header and L4 header
+// and checksum of the frame
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiPktTemplate::parse (void)
+{
+    const uint8_t *p   = _pkt->data();
+    int            len = _pkt->dataSize();
+    int            off = 12;
+    uint16_t       etherType = (p[off] << 8) | p[off + 1];
+
+    _vlanOff  = _mplsOff = _ipOff = _l4Off = _l4Csum = -1;
+    _l4Len    = 0;
+    _l4Pseudo = _l4Udp = false;
+
+    off += 2;
+    while (((etherType == AFI_ETH_P_VLAN) || (etherType == AFI_ETH_P_QINQ)) &&
+           (off + 4 <= len)) {
+        if (_vlanOff < 0) {
+            _vlanOff = off;
+        }
+        etherType = (p[off + 2] << 8) | p[off + 3];
+        off += 4;
+    }
+
+    if ((etherType == AFI_ETH_P_MPLS) && (off + 4 <= len)) {
+        _mplsOff = off;
+        while (off + 4 <= len) {
+            bool bos = (p[off + 2] & 0x01) != 0;
+            off += 4;
+            if (bos) {
+                break;
+            }
+        }
+        if ((off < len) && ((p[off] >> 4) == 4)) {
+            etherType = AFI_ETH_P_IPV4;
+        } else {
+            return;
+        }
+    }
+
+    if ((etherType != AFI_ETH_P_IPV4) || (off + 20 > len) ||
+        ((p[off] >> 4) != 4)) {
+        return;
+    }
+
+    int ihl    = (p[off] & 0x0f) * 4;
+    int ipLen  = (p[off + 2] << 8) | p[off + 3];
+    int proto  = p[off + 9];
+    _ipOff     = off;
+
+    //
+    // Only the first fragment has the L4 header
+    //
+    if ((ihl < 20) || (off + ihl > len) ||
+        ((((p[off + 6] & 0x1f) << 8) | p[off + 7]) != 0)) {
+        return;
+    }
+
+    _l4Off = off + ihl;
+    _l4Len = std::min(ipLen, len - off) - ihl;
+
+    if ((proto == AFI_IPPROTO_UDP) && (_l4Len >= 8)) {
+        _l4Csum   = _l4Off + 6;
+        _l4Pseudo = true;
+        _l4Udp    = true;
+    } else if ((proto == AFI_IPPROTO_TCP) && (_l4Len >= 20)) {
+        _l4Csum   = _l4Off + 16;
+        _l4Pseudo = true;
+    } else if ((proto == AFI_IPPROTO_ICMP) && (_l4Len >= 4)) {
+        _l4Csum   = _l4Off + 2;
+    }
+}
+
+//
+// @fn
+// addField
+//
+// @brief
+// Declare a field that is set before sends
+//
+// @param[in]
+//     type Field type
+// @param[in]
+//     offset FieldL4: offset into the L4 header
+// @param[in]
+//     width FieldL4: width in bytes (1 to 4)
+// @return Field id, -1 - Frame has no such field
+//
+
+int
+AfiPktTemplate::addField (FieldType type, int offset, int width)
+{
+    Field f;
+
+    f.width  = 4;
+    f.mask   = 0xffffffff;
+    f.shift  = 0;
+    f.ipCsum = -1;
+    f.l4Csum = -1;
+
+    switch (type) {
+    case FieldIpv4Dst:
+    case FieldIpv4Src:
+        if (_ipOff < 0) {
+            return -1;
+        }
+        f.off    = _ipOff + ((type == FieldIpv4Dst) ? 16 : 12);
+        f.ipCsum = _ipOff + 10;
+        f.l4Csum = _l4Pseudo ? _l4Csum : -1;
+        break;
+
+    case FieldVlanId:
+        if (_vlanOff < 0) {
+            return -1;
+        }
+        f.off   = _vlanOff;
+        f.width = 2;
+        f.mask  = 0x0fff;
+        break;
+
+    case FieldMplsLabel:
+        if (_mplsOff < 0) {
+            return -1;
+        }
+        f.off   = _mplsOff;
+        f.mask  = 0xfffff000;
+        f.shift = 12;
+        break;
+
+    case FieldL4:
+        if ((_l4Off < 0) || (width < 1) || (width > 4) || (offset < 0) ||
+            (offset + width > _l4Len)) {
+            return -1;
+        }
+        f.off    = _l4Off + offset;
+        f.width  = width;
+        f.mask   = (width == 4) ? 0xffffffff : ((1u << (width * 8)) - 1);
+        f.l4Csum = ((f.off >= _l4Csum) && (f.off < _l4Csum + 2)) ?
+                   -1 : _l4Csum;
+        break;
+
+    default:
+        return -1;
+    }
+
+    _fields.push_back(f);
+    return _fields.size() - 1;
+}
+
+uint32_t
+AfiPktTemplate::load (const Field &f) const
+{
+    const uint8_t *p = _pkt->data() + f.off;
+    uint32_t       v = 0;
+
+    for (int i = 0; i < f.width; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+//
+// @fn
+// set
+//
+// @brief
+// Set a field and update the checksums covering it
+//
+// @param[in]
+//     fieldId Field id
+// @param[in]
+//     value Field value
+// @return void
+//
+
+void
+AfiPktTemplate::set (int fieldId, uint32_t value)
+{
+    const Field &f   = _fields[fieldId];
+    uint8_t     *p   = _pkt->data() + f.off;
+    uint32_t     old = load(f);
+    uint32_t     v   = (old & ~f.mask) | ((value << f.shift) & f.mask);
+    uint8_t      oldBytes[6];
+
+    if (v == old) {
+        return;
+    }
+
+    //
+    // Checksums are over 16 bit words; frame offsets of all checksummed
+    // headers are even. An odd last byte of the frame is padded with 0.
+    //
+    int lo = f.off & ~1;
+    int hi = (f.off + f.width + 1) & ~1;
+    memset(oldBytes, 0, sizeof(oldBytes));
+    memcpy(oldBytes, _pkt->data() + lo, std::min(hi, frameLen()) - lo);
+
+    for (int i = f.width - 1; i >= 0; i--) {
+        p[i] = v & 0xff;
+        v >>= 8;
+    }
+
+    if (f.ipCsum >= 0) {
+        csumUpdate(f.ipCsum, lo, hi - lo, oldBytes, false);
+    }
+    if (f.l4Csum >= 0) {
+        csumUpdate(f.l4Csum, lo, hi - lo, oldBytes, _l4Udp);
+    }
+}
+
+uint32_t
+AfiPktTemplate::get (int fieldId) const
+{
+    const Field &f = _fields[fieldId];
+
+    return (load(f) & f.mask) >> f.shift;
+}
+
+//
+// @fn
+// csumUpdate
+//
+// @brief
+// Update an Internet checksum for changed 16 bit words (RFC 1624,
+// eqn. 3: HC' = ~(~HC + ~m + m'))
+//
+// @param[in]
+//     csumOff Frame offset of checksum
+// @param[in]
+//     off Frame offset of changed words
+// @param[in]
+//     width Length of changed words
+// @param[in]
+//     oldBytes Changed words before the change
+// @param[in]
+//     isUdp UDP checksum: 0 is 'no checksum', computed 0 is sent as 0xffff
+// @return void
+//
+
+void
+AfiPktTemplate::csumUpdate (int            csumOff,
+                            int            off,
+                            int            width,
+                            const uint8_t *oldBytes,
+                            bool           isUdp)
+{
+    uint8_t *c   = _pkt->data() + csumOff;
+    uint16_t hc  = (c[0] << 8) | c[1];
+    uint8_t *now = _pkt->data() + off;
+    int      end = frameLen() - off;
+
+    if (isUdp && (hc == 0)) {
+        return;
+    }
+
+    uint32_t sum = (uint16_t)~hc;
+    for (int i = 0; i < width; i += 2) {
+        sum += (uint16_t)~((oldBytes[i] << 8) | oldBytes[i + 1]);
+        sum += (now[i] << 8) | ((i + 1 < end) ? now[i + 1] : 0);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+
+    hc = ~sum;
+    if (isUdp && (hc == 0)) {
+        hc = 0xffff;
+    }
+    c[0] = hc >> 8;
+    c[1] = hc & 0xff;
+}
@@ -0,0 +1,134 @@
+//
+// AfiPktTemplate.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiPktTemplate__
+#define __AfiPktTemplate__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "jnx/Aft.h"
+
+//
+// @class   AfiPktTemplate
+// @brief   Prebuilt layer 2 packet to be injected repeatedly
+//
+// A template holds a transmit AftPacket whose header is serialized
+// once and whose data is the frame to inject, so that injecting it is
+// sending (or staging) the packet's bytes as they are.
+//
+// The frame's layers are located when it is built: VLAN tags, MPLS
+// labels, IPv4 and its UDP, TCP or ICMP header. Fields that change
+// from one send to the next are declared with addField() and set with
+// set(); the IPv4 header checksum and the L4 checksum covering a field
+// are updated incrementally (RFC 1624) from the field's old and new
+// value, so that a change costs a few additions whatever the frame
+// length.
+//
+// A template is not thread safe.
+//
+class AfiPktTemplate
+{
+public:
+    typedef enum {
+        FieldIpv4Dst,       //< IPv4 destination address
+        FieldIpv4Src,       //< IPv4 source address
+        FieldVlanId,        //< VLAN id of the outer VLAN tag
+        FieldMplsLabel,     //< Label of the top MPLS label stack entry
+        FieldL4,            //< 1 to 4 bytes at an offset into the L4
+                            //  header (e.g. a sequence number)
+    } FieldType;
+
+    AfiPktTemplate();
+
+    //
+    // Build template from a frame (or from a hex string as accepted by
+    // convertHexPktStrToPkt). Returns 0 - Success, -1 - Error.
+    //
+    int build(AftSandboxId   sandboxId,
+              AftIndex       portIndex,
+              const uint8_t *frame,
+              int            frameLen);
+    int build(AftSandboxId       sandboxId,
+              AftIndex           portIndex,
+              const std::string &hexStr);
+
+    //
+    // Inject the template on another sandbox port (re-serializes the
+    // AftPacket header)
+    //
+    void retarget(AftSandboxId sandboxId, AftIndex portIndex);
+
+    //
+    // Declare a variable field. For FieldL4 offset and width give the
+    // field's place in the L4 header. Returns field id, -1 if the frame
+    // has no such field.
+    //
+    int addField(FieldType type, int offset = 0, int width = 4);
+
+    //
+    // Set / get field value (host byte order)
+    //
+    void set(int fieldId, uint32_t value);
+    uint32_t get(int fieldId) const;
+
+    bool valid(void) const { return (bool)_pkt; }
+
+    const AftPacketPtr &packet(void) const { return _pkt; }
+    AftSandboxId sandboxId(void) const { return _pkt->sandboxId(); }
+    AftIndex portIndex(void) const { return _pkt->portIndex(); }
+    const uint8_t *frame(void) const { return _pkt->data(); }
+    int frameLen(void) const { return _pkt->dataSize(); }
+
+private:
+    //
+    // A variable field: the bits of mask in the width (1 to 4) bytes at
+    // frame offset off. Checksums to update are at frame offsets
+    // ipCsum and l4Csum (-1: none).
+    //
+    struct Field {
+        int       off;
+        int       width;
+        uint32_t  mask;
+        int       shift;
+        int       ipCsum;
+        int       l4Csum;
+    };
+
+    void parse(void);
+    uint32_t load(const Field &f) const;
+    void csumUpdate(int csumOff, int off, int width,
+                    const uint8_t *oldBytes, bool isUdp);
+
+    AftPacketPtr        _pkt;       //< Header + frame
+    int                 _vlanOff;   //< Outer VLAN TCI, -1: none
+    int                 _mplsOff;   //< Top label stack entry, -1: none
+    int                 _ipOff;     //< IPv4 header, -1: none
+    int                 _l4Off;     //< L4 header, -1: none
+    int                 _l4Len;     //< L4 header and payload length
+    int                 _l4Csum;    //< L4 checksum offset, -1: none
+    bool                _l4Pseudo;  //< L4 checksum covers IPv4 addresses
+    bool                _l4Udp;     //< UDP: checksum 0 means none
+    std::vector<Field>  _fields;
+};
+
+#endif // __AfiPktTemplate__
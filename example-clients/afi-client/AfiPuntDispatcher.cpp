@@ -0,0 +1,617 @@
+//
+// AfiPuntDispatcher.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string.h>
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include "AfiPacketPool.h"
+#include "AfiPktDissector.h"
+#include "AfiPuntDispatcher.h"
+
+const AftSandboxId AfiPuntDispatcher::AnySandbox;
+const AftIndex     AfiPuntDispatcher::AnyPort;
+
+#define AFI_ETH_P_IPV4          0x0800
+#define AFI_ETH_P_ARP           0x0806
+#define AFI_ETH_P_IPV6          0x86dd
+#define AFI_ETH_P_SLOW          0x8809
+#define AFI_ETH_P_LLDP          0x88cc
+#define AFI_IP_PROTO_ICMP       1
+#define AFI_IP_PROTO_UDP        17
+#define AFI_IP_PROTO_ICMPV6     58
+#define AFI_UDP_PORT_BFD        3784
+#define AFI_UDP_PORT_BFD_MHOP   4784
+
+static const char *afiPuntClassNames[] = {
+    "none", "arp", "ipv4", "ipv6", "icmp", "icmpv6", "lacp", "lldp", "bfd",
+};
+
+//
+// @fn
+// AfiPuntDispatcher
+//
+// @brief
+// Constructor. Sets up the classes of well known protocols.
+//
+
+AfiPuntDispatcher::AfiPuntDispatcher()
+    : _nextHandlerId(0),
+      _fallbackQ(AFI_PUNT_FALLBACK_Q_MAX),
+      _fallbackHead(0),
+      _fallbackCount(0),
+      _unclassified(0),
+      _unhandled(0),
+      _fallbackDrops(0)
+{
+    std::unique_ptr<Tables> t(new Tables);
+
+    memset(t->etherClass,   0, sizeof(t->etherClass));
+    memset(t->ipProtoClass, 0, sizeof(t->ipProtoClass));
+    memset(t->udpPortClass, 0, sizeof(t->udpPortClass));
+
+    t->etherClass[AFI_ETH_P_ARP]            = AFI_PUNT_CLASS_ARP;
+    t->etherClass[AFI_ETH_P_IPV4]           = AFI_PUNT_CLASS_IPV4;
+    t->etherClass[AFI_ETH_P_IPV6]           = AFI_PUNT_CLASS_IPV6;
+    t->etherClass[AFI_ETH_P_SLOW]           = AFI_PUNT_CLASS_LACP;
+    t->etherClass[AFI_ETH_P_LLDP]           = AFI_PUNT_CLASS_LLDP;
+    t->ipProtoClass[AFI_IP_PROTO_ICMP]      = AFI_PUNT_CLASS_ICMP;
+    t->ipProtoClass[AFI_IP_PROTO_ICMPV6]    = AFI_PUNT_CLASS_ICMPV6;
+    t->udpPortClass[AFI_UDP_PORT_BFD]       = AFI_PUNT_CLASS_BFD;
+    t->udpPortClass[AFI_UDP_PORT_BFD_MHOP]  = AFI_PUNT_CLASS_BFD;
+
+    _tables = TablesPtr(t.release());
+
+    for (int c = 0; c < AFI_PUNT_CLASS_MAX; c++) {
+        _classStats[c].pkts.store(0);
+        _classStats[c].handled.store(0);
+    }
+}
+
+AfiPuntDispatcher::TablesPtr
+AfiPuntDispatcher::tables (void) const
+{
+    std::lock_guard<spinlock> guard(_tablesLock);
+    return _tables;
+}
+
+std::unique_ptr<AfiPuntDispatcher::Tables>
+AfiPuntDispatcher::tablesCopy (void) const
+{
+    return std::unique_ptr<Tables>(new Tables(*tables()));
+}
+
+void
+AfiPuntDispatcher::tablesUpdate (std::unique_ptr<Tables> t)
+{
+    TablesPtr newTables(t.release());
+
+    // Old tables are freed outside the lock, or by the last batch using them
+    std::lock_guard<spinlock> guard(_tablesLock);
+    _tables.swap(newTables);
+}
+
+//
+// @fn
+// setEtherTypeClass
+//
+// @brief
+// Map an ethertype to a punt class
+//
+// @param[in]
+//     etherType Ethertype
+// @param[in]
+//     puntClass Punt class, AFI_PUNT_CLASS_NONE to remove the mapping
+// @return void
+//
+
+void
+AfiPuntDispatcher::setEtherTypeClass (uint16_t etherType, AfiPuntClass puntClass)
+{
+    std::lock_guard<std::mutex> guard(_updateLock);
+    std::unique_ptr<Tables>     t = tablesCopy();
+
+    t->etherClass[etherType] = puntClass;
+    tablesUpdate(std::move(t));
+}
+
+//
+// @fn
+// setIpProtoClass
+//
+// @brief
+// Map an IPv4 protocol / IPv6 next header to a punt class
+//
+// @param[in]
+//     ipProto IP protocol
+// @param[in]
+//     puntClass Punt class, AFI_PUNT_CLASS_NONE to remove the mapping
+// @return void
+//
+
+void
+AfiPuntDispatcher::setIpProtoClass (uint8_t ipProto, AfiPuntClass puntClass)
+{
+    std::lock_guard<std::mutex> guard(_updateLock);
+    std::unique_ptr<Tables>     t = tablesCopy();
+
+    t->ipProtoClass[ipProto] = puntClass;
+    tablesUpdate(std::move(t));
+}
+
+//
+// @fn
+// setUdpPortClass
+//
+// @brief
+// Map a UDP destination port to a punt class
+//
+// @param[in]
+//     udpPort UDP destination port
+// @param[in]
+//     puntClass Punt class, AFI_PUNT_CLASS_NONE to remove the mapping
+// @return void
+//
+
+void
+AfiPuntDispatcher::setUdpPortClass (uint16_t udpPort, AfiPuntClass puntClass)
+{
+    std::lock_guard<std::mutex> guard(_updateLock);
+    std::unique_ptr<Tables>     t = tablesCopy();
+
+    t->udpPortClass[udpPort] = puntClass;
+    tablesUpdate(std::move(t));
+}
+
+//
+// @fn
+// registerHandler
+//
+// @brief
+// Register a handler for a punt class. Handlers registered for a
+// specific sandbox/port are preferred over wildcard handlers; among
+// equally specific handlers the first registered one wins.
+//
+// @param[in]
+//     puntClass Punt class
+// @param[in]
+//     name Handler name (statistics)
+// @param[in]
+//     handler Handler
+// @param[in]
+//     sandboxId Sandbox Id or AnySandbox
+// @param[in]
+//     portIndex Input port index or AnyPort
+// @return Handler id, -1 - Error
+//
+
+int
+AfiPuntDispatcher::registerHandler (AfiPuntClass           puntClass,
+                                    const std::string     &name,
+                                    const AfiPuntHandler  &handler,
+                                    AftSandboxId           sandboxId,
+                                    AftIndex               portIndex)
+{
+    if ((puntClass == AFI_PUNT_CLASS_NONE) || !handler) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> guard(_updateLock);
+    std::unique_ptr<Tables>     t = tablesCopy();
+    Handler                     h;
+
+    h.id        = _nextHandlerId++;
+    h.name      = name;
+    h.puntClass = puntClass;
+    h.sandboxId = sandboxId;
+    h.portIndex = portIndex;
+    h.handler   = handler;
+    t->handlers.push_back(h);
+
+    //
+    // Keep the class' handlers ordered most specific first
+    //
+    std::vector<uint16_t> &ch = t->classHandlers[puntClass];
+    auto wildcards = [&t](uint16_t i) {
+        return (t->handlers[i].sandboxId == AnySandbox) +
+               (t->handlers[i].portIndex == AnyPort);
+    };
+    ch.push_back(t->handlers.size() - 1);
+    std::stable_sort(ch.begin(), ch.end(),
+                     [&wildcards](uint16_t a, uint16_t b) {
+                         return wildcards(a) < wildcards(b);
+                     });
+
+    tablesUpdate(std::move(t));
+
+    return h.id;
+}
+
+//
+// @fn
+// unregisterHandler
+//
+// @brief
+// Unregister a handler
+//
+// @param[in]
+//     handlerId Handler id returned by registerHandler
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiPuntDispatcher::unregisterHandler (int handlerId)
+{
+    std::lock_guard<std::mutex> guard(_updateLock);
+    std::unique_ptr<Tables>     t = tablesCopy();
+
+    auto it = std::find_if(t->handlers.begin(), t->handlers.end(),
+                           [handlerId](const Handler &h) {
+                               return h.id == handlerId;
+                           });
+    if (it == t->handlers.end()) {
+        return -1;
+    }
+
+    uint16_t removed = it - t->handlers.begin();
+    t->handlers.erase(it);
+
+    for (auto &ch : t->classHandlers) {
+        ch.erase(std::remove(ch.begin(), ch.end(), removed), ch.end());
+        for (auto &i : ch) {
+            i -= (i > removed);
+        }
+    }
+
+    tablesUpdate(std::move(t));
+
+    return 0;
+}
+
+//
+// @fn
+// classify
+//
+// @brief
+// Classify a layer 2 packet
+//
+// @param[in]
+//     l2Packet Layer 2 packet
+// @param[in]
+//     l2PacketLen Layer 2 packet length
+// @return Punt class
+//
+
+AfiPuntClass
+AfiPuntDispatcher::classify (const uint8_t *l2Packet, size_t l2PacketLen) const
+{
+    TablesPtr    t = tables();
+    AfiPuntClass classes[3];
+
+    if (classify(*t, l2Packet, l2PacketLen, classes) == 0) {
+        return AFI_PUNT_CLASS_NONE;
+    }
+    return classes[0];
+}
+
+//
+// @fn
+// classify
+//
+// @brief
+// Classes of a layer 2 packet, most specific first: UDP port, IP
+// protocol, ethertype class (those that are set)
+//
+// @param[in]
+//     t Tables
+// @param[in]
+//     l2Packet Layer 2 packet
+// @param[in]
+//     l2PacketLen Layer 2 packet length
+// @param[out]
+//     classes Classes
+// @return Number of classes
+//
+
+int
+AfiPuntDispatcher::classify (const Tables  &t,
+                             const uint8_t *l2Packet,
+                             size_t         l2PacketLen,
+                             AfiPuntClass   classes[3]) const
+{
+    AfiPktDissector pkt(l2Packet, l2PacketLen);
+    int             n = 0;
+
+    uint16_t etherType = pkt.etherType();
+    if (etherType == 0) {
+        return 0;
+    }
+
+    //
+    // IP classes only for IP directly over Ethernet; labelled packets
+    // are classed by their ethertype
+    //
+    int ipProto = -1;
+    if ((etherType == AFI_ETH_P_IPV4) || (etherType == AFI_ETH_P_IPV6)) {
+        ipProto = pkt.ipProto();
+    }
+
+    if ((ipProto == AFI_IP_PROTO_UDP) && (pkt.dstPort() != 0) &&
+        (t.udpPortClass[pkt.dstPort()] != AFI_PUNT_CLASS_NONE)) {
+        classes[n++] = t.udpPortClass[pkt.dstPort()];
+    }
+
+    if ((ipProto >= 0) &&
+        (t.ipProtoClass[ipProto] != AFI_PUNT_CLASS_NONE)) {
+        classes[n++] = t.ipProtoClass[ipProto];
+    }
+
+    if (t.etherClass[etherType] != AFI_PUNT_CLASS_NONE) {
+        classes[n++] = t.etherClass[etherType];
+    }
+
+    return n;
+}
+
+//
+// @fn
+// handlerFor
+//
+// @brief
+// Handler registered for a class and the packet's sandbox and port
+//
+// @return Handler index, -1 - None
+//
+
+int
+AfiPuntDispatcher::handlerFor (const Tables       &t,
+                               AfiPuntClass        puntClass,
+                               const AftPacketPtr &pkt) const
+{
+    for (uint16_t i : t.classHandlers[puntClass]) {
+        const Handler &handler = t.handlers[i];
+        if (((handler.sandboxId == AnySandbox) ||
+             (handler.sandboxId == pkt->sandboxId())) &&
+            ((handler.portIndex == AnyPort) ||
+             (handler.portIndex == pkt->portIndex()))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//
+// @fn
+// dispatch
+//
+// @brief
+// Classify a batch of punted packets and hand them to the handlers
+// registered for their class (or the next less specific class that has
+// a handler), sandbox and port, one batch per handler. Packets without
+// a class or handler are copied to the fallback queue.
+//
+// @param[in]
+//     pkts Punted packets (cleared on return)
+// @param[in]
+//     scratch Dispatching context's scratch space
+// @return void
+//
+
+void
+AfiPuntDispatcher::dispatch (AfiPktBatch &pkts, Scratch &scratch)
+{
+    TablesPtr t = tables();
+
+    scratch.handlerBatches.resize(t->handlers.size());
+    scratch.classPkts.assign(AFI_PUNT_CLASS_MAX, 0);
+
+    uint64_t unhandled = 0;
+
+    for (auto &pkt : pkts) {
+        AfiPuntClass classes[3];
+        int          n = classify(*t, pkt->data(), pkt->dataSize(), classes);
+        int          h = -1;
+
+        scratch.classPkts[n ? classes[0] : AFI_PUNT_CLASS_NONE]++;
+        for (int i = 0; (i < n) && (h < 0); i++) {
+            h = handlerFor(*t, classes[i], pkt);
+        }
+
+        if (h >= 0) {
+            scratch.handlerBatches[h].push_back(pkt);
+        } else {
+            unhandled += (n > 0);
+            fallbackPush(pkt);
+        }
+    }
+    pkts.clear();
+
+    for (int c = 0; c < AFI_PUNT_CLASS_MAX; c++) {
+        if (scratch.classPkts[c]) {
+            _classStats[c].pkts.fetch_add(scratch.classPkts[c],
+                                          std::memory_order_relaxed);
+        }
+    }
+    _unclassified.fetch_add(scratch.classPkts[AFI_PUNT_CLASS_NONE],
+                            std::memory_order_relaxed);
+    _unhandled.fetch_add(unhandled, std::memory_order_relaxed);
+
+    for (size_t h = 0; h < t->handlers.size(); h++) {
+        AfiPktBatch &batch = scratch.handlerBatches[h];
+        if (batch.empty()) {
+            continue;
+        }
+        const Handler &handler = t->handlers[h];
+        _classStats[handler.puntClass].handled.fetch_add(
+                                 batch.size(), std::memory_order_relaxed);
+        handler.handler(handler.puntClass, batch);
+
+        // Keeps capacity: dispatching does not allocate in steady state
+        batch.clear();
+    }
+}
+
+//
+// @fn
+// fallbackPush
+//
+// @brief
+// Queue a copy of a packet to the fallback queue, dropping the oldest
+// packet if the queue is full. The packet itself goes back to its
+// pool once the batch is done. A packet too big for a copy is dropped
+// before one is allocated.
+//
+
+void
+AfiPuntDispatcher::fallbackPush (AftPacketPtr &pkt)
+{
+    if (pkt->dataSize() > AFI_PKT_POOL_DATA_MAX) {
+        _fallbackDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    AftPacketPtr copy = AfiPacketPool::createReceive();
+
+    memcpy(copy->header(), pkt->header(), pkt->headerSize());
+    memcpy(copy->data(), pkt->data(), pkt->dataSize());
+    copy->headerParse();
+
+    std::lock_guard<spinlock> guard(_fallbackLock);
+
+    size_t tail = (_fallbackHead + _fallbackCount) % _fallbackQ.size();
+    if (_fallbackCount == _fallbackQ.size()) {
+        _fallbackHead = (_fallbackHead + 1) % _fallbackQ.size();
+        _fallbackDrops.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _fallbackCount++;
+    }
+    _fallbackQ[tail].swap(copy);
+}
+
+//
+// @fn
+// fallbackPop
+//
+// @brief
+// Take the oldest packet off the fallback queue
+//
+// @param[out]
+//     pkt Packet
+// @return True if a packet was dequeued
+//
+
+bool
+AfiPuntDispatcher::fallbackPop (AftPacketPtr &pkt)
+{
+    std::lock_guard<spinlock> guard(_fallbackLock);
+
+    if (_fallbackCount == 0) {
+        return false;
+    }
+    pkt.swap(_fallbackQ[_fallbackHead]);
+    _fallbackQ[_fallbackHead].reset();
+    _fallbackHead = (_fallbackHead + 1) % _fallbackQ.size();
+    _fallbackCount--;
+
+    return true;
+}
+
+//
+// @fn
+// className
+//
+// @brief
+// Punt class name
+//
+// @param[in]
+//     puntClass Punt class
+// @return Class name
+//
+
+std::string
+AfiPuntDispatcher::className (AfiPuntClass puntClass)
+{
+    if (puntClass < sizeof(afiPuntClassNames) / sizeof(afiPuntClassNames[0])) {
+        return afiPuntClassNames[puntClass];
+    }
+
+    std::ostringstream os;
+    os << "class-" << (int)puntClass;
+    return os.str();
+}
+
+//
+// @fn
+// description
+//
+// @brief
+// Display punt dispatch statistics and handlers
+//
+// @param[in]
+//     os Output stream
+// @return Output stream
+//
+
+std::ostream &
+AfiPuntDispatcher::description (std::ostream &os) const
+{
+    TablesPtr t = tables();
+
+    os << "Class            Packets     Handled" << std::endl;
+    for (int c = 0; c < AFI_PUNT_CLASS_MAX; c++) {
+        uint64_t pkts = _classStats[c].pkts.load();
+        if ((pkts == 0) && t->classHandlers[c].empty()) {
+            continue;
+        }
+        os << std::left << std::setw(10) << className(c) << std::right;
+        os << std::setw(14) << pkts;
+        os << std::setw(12) << _classStats[c].handled.load() << std::endl;
+    }
+
+    {
+        std::lock_guard<spinlock> guard(_fallbackLock);
+        os << "Fallback: unclassified " << _unclassified.load();
+        os << " unhandled " << _unhandled.load();
+        os << " queued " << _fallbackCount;
+        os << " dropped " << _fallbackDrops.load() << std::endl;
+    }
+
+    os << "Handlers:" << std::endl;
+    for (auto &h : t->handlers) {
+        os << "  " << h.id << " " << h.name << " class " << className(h.puntClass);
+        os << " sandbox ";
+        if (h.sandboxId == AnySandbox) {
+            os << "any";
+        } else {
+            os << h.sandboxId;
+        }
+        os << " port ";
+        if (h.portIndex == AnyPort) {
+            os << "any";
+        } else {
+            os << h.portIndex;
+        }
+        os << std::endl;
+    }
+
+    return os;
+}
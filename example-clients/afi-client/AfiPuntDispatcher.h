@@ -0,0 +1,207 @@
+//
+// AfiPuntDispatcher.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiPuntDispatcher__
+#define __AfiPuntDispatcher__
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "jnx/Aft.h"
+#include "Utils.h"
+
+//
+// Punt dispatch
+// =============
+//
+// Punted packets are classified once into a punt class by looking up
+// their ethertype, IP protocol and UDP destination port in flat tables
+// (the most specific non-zero entry wins: UDP port, then IP protocol,
+// then ethertype). Handlers register for a class, optionally for one
+// sandbox and/or input port only, and receive the packets of a batch
+// that matched them as one batch. A packet whose class has no handler
+// for it goes to the handler of its next less specific class, e.g. an
+// ICMP packet to an IPv4 handler.
+//
+// Packets that are not classified or that no handler registered for
+// go to a bounded fallback queue, as copies so that they do not hold
+// on to receive pool packets; when it is full the oldest packet is
+// dropped.
+//
+// The tables are replaced (copy on write) when they are changed, so
+// dispatching takes no lock but for picking up the current tables
+// once per batch.
+//
+
+#define AFI_PUNT_FALLBACK_Q_MAX     128
+
+//
+// Punt classes
+//
+typedef enum {
+    AFI_PUNT_CLASS_NONE = 0,        //< Not classified
+    AFI_PUNT_CLASS_ARP,
+    AFI_PUNT_CLASS_IPV4,            //< IPv4, no more specific class
+    AFI_PUNT_CLASS_IPV6,            //< IPv6, no more specific class
+    AFI_PUNT_CLASS_ICMP,
+    AFI_PUNT_CLASS_ICMPV6,
+    AFI_PUNT_CLASS_LACP,            //< Slow protocols (LACP, marker)
+    AFI_PUNT_CLASS_LLDP,
+    AFI_PUNT_CLASS_BFD,             //< BFD single-hop and multi-hop
+    AFI_PUNT_CLASS_USER = 32,       //< First class free for applications
+    AFI_PUNT_CLASS_MAX  = 256,
+} AfiPuntClassEnum;
+
+typedef uint8_t                   AfiPuntClass;
+typedef std::vector<AftPacketPtr> AfiPktBatch;
+
+//
+// Punt handler: called with the packets of one sandbox of one class
+//
+typedef std::function<void (AfiPuntClass puntClass, AfiPktBatch &pkts)>
+        AfiPuntHandler;
+
+//
+// @class   AfiPuntDispatcher
+// @brief   Classifies punted packets and hands them to handlers
+//
+class AfiPuntDispatcher
+{
+public:
+    static const AftSandboxId AnySandbox = (AftSandboxId)-1;
+    static const AftIndex     AnyPort    = (AftIndex)-1;
+
+    //
+    // Per dispatching context (e.g. sandbox strand) scratch space
+    //
+    struct Scratch {
+        std::vector<AfiPktBatch>  handlerBatches;   //< Per handler
+        std::vector<uint32_t>     classPkts;        //< Per class
+    };
+
+    AfiPuntDispatcher();
+
+    //
+    // Map ethertype, IP protocol or UDP destination port to a class;
+    // AFI_PUNT_CLASS_NONE removes the mapping
+    //
+    void setEtherTypeClass(uint16_t etherType, AfiPuntClass puntClass);
+    void setIpProtoClass(uint8_t ipProto, AfiPuntClass puntClass);
+    void setUdpPortClass(uint16_t udpPort, AfiPuntClass puntClass);
+
+    //
+    // Register a handler, returns handler id
+    //
+    int registerHandler(AfiPuntClass           puntClass,
+                        const std::string     &name,
+                        const AfiPuntHandler  &handler,
+                        AftSandboxId           sandboxId = AnySandbox,
+                        AftIndex               portIndex = AnyPort);
+
+    //
+    // Unregister a handler
+    //
+    int unregisterHandler(int handlerId);
+
+    //
+    // Classify a layer 2 packet
+    //
+    AfiPuntClass classify(const uint8_t *l2Packet, size_t l2PacketLen) const;
+
+    //
+    // Dispatch a batch of punted packets
+    //
+    void dispatch(AfiPktBatch &pkts, Scratch &scratch);
+
+    //
+    // Take the oldest packet off the fallback queue
+    //
+    bool fallbackPop(AftPacketPtr &pkt);
+
+    //
+    // Class name
+    //
+    static std::string className(AfiPuntClass puntClass);
+
+    //
+    // Statistics
+    //
+    std::ostream &description(std::ostream &os) const;
+
+private:
+    struct Handler {
+        int             id;
+        std::string     name;
+        AfiPuntClass    puntClass;
+        AftSandboxId    sandboxId;
+        AftIndex        portIndex;
+        AfiPuntHandler  handler;
+    };
+
+    //
+    // Classification and handler tables, never changed once in use
+    //
+    struct Tables {
+        AfiPuntClass              etherClass[65536];
+        AfiPuntClass              ipProtoClass[256];
+        AfiPuntClass              udpPortClass[65536];
+        std::vector<Handler>      handlers;
+        std::vector<uint16_t>     classHandlers[AFI_PUNT_CLASS_MAX];
+    };
+
+    typedef std::shared_ptr<const Tables> TablesPtr;
+
+    struct ClassStats {
+        std::atomic<uint64_t>  pkts;        //< Packets classified
+        std::atomic<uint64_t>  handled;     //< Packets given to handlers
+    };
+
+    TablesPtr tables(void) const;
+    std::unique_ptr<Tables> tablesCopy(void) const;
+    void tablesUpdate(std::unique_ptr<Tables> tables);
+    int classify(const Tables &t, const uint8_t *l2Packet,
+                 size_t l2PacketLen, AfiPuntClass classes[3]) const;
+    int handlerFor(const Tables &t, AfiPuntClass puntClass,
+                   const AftPacketPtr &pkt) const;
+    void fallbackPush(AftPacketPtr &pkt);
+
+    std::mutex                 _updateLock;    //< Serializes table updates
+    mutable spinlock           _tablesLock;    //< Protects _tables
+    TablesPtr                  _tables;
+    int                        _nextHandlerId; //< _updateLock
+    ClassStats                 _classStats[AFI_PUNT_CLASS_MAX];
+
+    mutable spinlock           _fallbackLock;  //< Protects fallback queue
+    std::vector<AftPacketPtr>  _fallbackQ;     //< Ring of fallback packets
+    size_t                     _fallbackHead;  //< Oldest packet
+    size_t                     _fallbackCount; //< Packets in ring
+    std::atomic<uint64_t>      _unclassified;  //< Packets of no class
+    std::atomic<uint64_t>      _unhandled;     //< Classified, no handler
+    std::atomic<uint64_t>      _fallbackDrops; //< Oldest dropped, ring full
+};
+
+#endif // __AfiPuntDispatcher__
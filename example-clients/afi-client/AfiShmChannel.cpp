@@ -0,0 +1,363 @@
+//
+// AfiShmChannel.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <iostream>
+#include <new>
+
+#include "AfiShmChannel.h"
+
+void
+AfiShmRing::attach (void *mem, uint32_t size, bool init)
+{
+    _hdr  = (AfiShmRingHdr *)mem;
+    _data = (uint8_t *)mem + sizeof(AfiShmRingHdr);
+    _mask = size - 1;
+
+    if (init) {
+        new (_hdr) AfiShmRingHdr();
+        _hdr->tail.store(0);
+        _hdr->head.store(0);
+        _hdr->waiting.store(0);
+        _hdr->size = size;
+    }
+
+    _tailLocal = _headCache = _hdr->tail.load();
+    _headLocal = _tailCache = _hdr->head.load();
+}
+
+AfiShmChannel::AfiShmChannel ()
+    : _memFd(-1),
+      _ringSize(0),
+      _mem(MAP_FAILED),
+      _memSize(0),
+      _recvFd(-1),
+      _sendFd(-1),
+      _connFd(-1)
+{
+    _efd[0] = _efd[1] = -1;
+}
+
+AfiShmChannel::~AfiShmChannel ()
+{
+    if (_mem != MAP_FAILED) {
+        munmap(_mem, _memSize);
+    }
+    for (int fd : { _memFd, _efd[0], _efd[1], _connFd }) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+//
+// @fn
+// create
+//
+// @brief
+// Peer: create the shared memory and the doorbells of a channel
+//
+// @param[in]
+//     ringSize Bytes per ring (power of 2)
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiShmChannel::create (uint32_t ringSize)
+{
+    _ringSize = ringSize;
+    _memSize  = 2 * AfiShmRing::memSize(ringSize);
+
+    _memFd = memfd_create("afi-hostpath", MFD_CLOEXEC);
+    if ((_memFd < 0) || (ftruncate(_memFd, _memSize) < 0)) {
+        perror("memfd");
+        return -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        _efd[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_efd[i] < 0) {
+            perror("eventfd");
+            return -1;
+        }
+    }
+
+    return map(RolePeer, true);
+}
+
+//
+// @fn
+// map
+//
+// @brief
+// Map the channel's memory and set up the rings of a side: ring 0
+// carries punts (peer to client), ring 1 injects (client to peer)
+//
+// @param[in]
+//     role Side of the channel
+// @param[in]
+//     init Initialize ring headers
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiShmChannel::map (Role role, bool init)
+{
+    _mem = mmap(NULL, _memSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, _memFd, 0);
+    if (_mem == MAP_FAILED) {
+        perror("mmap(hostpath channel)");
+        return -1;
+    }
+
+    uint8_t *ring0 = (uint8_t *)_mem;
+    uint8_t *ring1 = ring0 + AfiShmRing::memSize(_ringSize);
+    bool     peer  = (role == RolePeer);
+
+    _send.attach(peer ? ring0 : ring1, _ringSize, init);
+    _recv.attach(peer ? ring1 : ring0, _ringSize, init);
+    _sendFd = _efd[peer ? 0 : 1];
+    _recvFd = _efd[peer ? 1 : 0];
+
+    return 0;
+}
+
+//
+// @fn
+// listen
+//
+// @brief
+// Peer: listening Unix domain socket clients connect to
+//
+// @param[in]
+//     path Socket path (an existing socket file is replaced)
+// @return Socket, -1 - Error
+//
+
+int
+AfiShmChannel::listen (const std::string &path)
+{
+    struct sockaddr_un addr;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (::listen(fd, 1) < 0)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//
+// @fn
+// handOver
+//
+// @brief
+// Peer: send ring size, memfd and doorbells to a connected client.
+// The channel keeps the connection to notice the client going away.
+//
+// @param[in]
+//     connFd Connected client socket
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiShmChannel::handOver (int connFd)
+{
+    int            fds[3] = { _memFd, _efd[0], _efd[1] };
+    char           control[CMSG_SPACE(sizeof(fds))];
+    struct iovec   iov;
+    struct msghdr  msg;
+
+    iov.iov_base = &_ringSize;
+    iov.iov_len  = sizeof(_ringSize);
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_RIGHTS;
+    cm->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    if (sendmsg(connFd, &msg, MSG_NOSIGNAL) < 0) {
+        perror("sendmsg(hostpath channel)");
+        return -1;
+    }
+
+    _connFd = connFd;
+    return 0;
+}
+
+//
+// @fn
+// connect
+//
+// @brief
+// Client: connect to the peer and map the channel it hands over
+//
+// @param[in]
+//     path Peer's socket path
+// @return 0 - Success, -1 - Error
+//
+
+int
+AfiShmChannel::connect (const std::string &path)
+{
+    struct sockaddr_un addr;
+    int                fds[3];
+    char               control[CMSG_SPACE(sizeof(fds))];
+    struct iovec       iov;
+    struct msghdr      msg;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        perror(path.c_str());
+        return -1;
+    }
+
+    _connFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+
+    if ((_connFd < 0) ||
+        (::connect(_connFd, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+        perror(path.c_str());
+        return -1;
+    }
+
+    iov.iov_base = &_ringSize;
+    iov.iov_len  = sizeof(_ringSize);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t ret;
+    do {
+        ret = recvmsg(_connFd, &msg, MSG_CMSG_CLOEXEC);
+    } while ((ret < 0) && (errno == EINTR));
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if ((ret != sizeof(_ringSize)) || (cm == NULL) ||
+        (cm->cmsg_type != SCM_RIGHTS) ||
+        (cm->cmsg_len != CMSG_LEN(sizeof(fds)))) {
+        std::cout << "Invalid hostpath channel from " << path << std::endl;
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+    _memFd   = fds[0];
+    _efd[0]  = fds[1];
+    _efd[1]  = fds[2];
+
+    if ((_ringSize < 2 * AFI_SHM_FRAME_MAX) ||
+        (_ringSize & (_ringSize - 1)) != 0) {
+        std::cout << "Invalid hostpath ring size " << _ringSize << std::endl;
+        return -1;
+    }
+    _memSize = 2 * AfiShmRing::memSize(_ringSize);
+
+    //
+    // A mapping beyond the end of the memfd faults when touched
+    //
+    struct stat st;
+    if ((fstat(_memFd, &st) < 0) || (st.st_size < (off_t)_memSize)) {
+        std::cout << "Hostpath channel memory smaller than its rings";
+        std::cout << std::endl;
+        return -1;
+    }
+
+    return map(RoleClient, false);
+}
+
+//
+// @fn
+// kick
+//
+// @brief
+// Ring the send doorbell if the receiving side waits for it
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiShmChannel::kick (void)
+{
+    uint64_t one = 1;
+
+    if (_send.doorbell() && (write(_sendFd, &one, sizeof(one)) < 0) &&
+        (errno != EAGAIN)) {
+        perror("write(hostpath doorbell)");
+    }
+}
+
+//
+// @fn
+// recvAck
+//
+// @brief
+// Reset the receive doorbell after it rang
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiShmChannel::recvAck (void)
+{
+    uint64_t count;
+
+    if ((read(_recvFd, &count, sizeof(count)) < 0) && (errno != EAGAIN)) {
+        perror("read(hostpath doorbell)");
+    }
+}
@@ -0,0 +1,276 @@
+//
+// AfiShmChannel.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiShmChannel__
+#define __AfiShmChannel__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+
+#define AFI_SHM_RING_SIZE       (4 * 1024 * 1024)   // Bytes per direction
+#define AFI_SHM_FRAME_MAX       4096                // Largest frame
+#define AFI_SHM_WRAP            0xffffffffu         // Record: skip to start
+
+//
+// @struct  AfiShmRingHdr
+// @brief   Shared state of a ring, producer and consumer cache lines apart
+//
+struct AfiShmRingHdr {
+    alignas(64) std::atomic<uint64_t>  tail;    //< Bytes produced
+    alignas(64) std::atomic<uint64_t>  head;    //< Bytes consumed
+    alignas(64) std::atomic<uint32_t>  waiting; //< Consumer waits on doorbell
+    uint32_t                           size;    //< Data bytes, power of 2
+};
+
+//
+// @class   AfiShmRing
+// @brief   Single producer, single consumer ring of frames in shared memory
+//
+// A frame is a 4 byte length and the frame bytes, padded to 8 bytes.
+// A frame that does not fit before the end of the ring is preceded by
+// a wrap record and goes to the start.
+//
+// The other side is not trusted: a record with a length above
+// AFI_SHM_FRAME_MAX, or that does not fit in the ring or in the bytes
+// produced, makes the consumer skip everything produced so far (and
+// count it in badRecords).
+//
+// The consumer that runs out of frames sets 'waiting' before it sleeps
+// on the ring's doorbell; the producer rings the doorbell only if
+// 'waiting' is set, so that a busy consumer costs no system calls.
+//
+class AfiShmRing
+{
+public:
+    AfiShmRing() : _hdr(NULL), _data(NULL), _mask(0),
+                   _tailLocal(0), _headCache(0), _headLocal(0),
+                   _tailCache(0), _badRecords(0) {
+    }
+
+    //
+    // Use ring at mem (header and size data bytes)
+    //
+    void attach(void *mem, uint32_t size, bool init);
+
+    static size_t memSize(uint32_t size) {
+        return sizeof(AfiShmRingHdr) + size;
+    }
+
+    //
+    // Producer: append a frame (two parts), false if the ring is full
+    //
+    bool push(const void *part1, uint32_t len1,
+              const void *part2 = NULL, uint32_t len2 = 0) {
+        uint32_t len  = len1 + len2;
+        uint64_t need = recLen(len);
+        uint64_t pos  = _tailLocal & _mask;
+        uint64_t room = _mask + 1 - pos;
+        uint64_t wrap = (need > room) ? room : 0;
+
+        if (_tailLocal + wrap + need - _headCache > _mask + 1) {
+            _headCache = _hdr->head.load(std::memory_order_acquire);
+            if (_tailLocal + wrap + need - _headCache > _mask + 1) {
+                return false;
+            }
+        }
+
+        if (wrap) {
+            *(uint32_t *)(_data + pos) = AFI_SHM_WRAP;
+            _tailLocal += wrap;
+            pos = 0;
+        }
+        *(uint32_t *)(_data + pos) = len;
+        memcpy(_data + pos + 4, part1, len1);
+        if (len2) {
+            memcpy(_data + pos + 4 + len1, part2, len2);
+        }
+        _tailLocal += need;
+        _hdr->tail.store(_tailLocal, std::memory_order_release);
+
+        return true;
+    }
+
+    //
+    // Producer: true if the consumer waits for the doorbell (clears it)
+    //
+    bool doorbell(void) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return (_hdr->waiting.load(std::memory_order_relaxed) != 0) &&
+               (_hdr->waiting.exchange(0) != 0);
+    }
+
+    //
+    // Consumer: hand up to budget frames to fn(frame, len)
+    //
+    template <typename Fn>
+    unsigned pop(Fn fn, unsigned budget) {
+        unsigned n = 0;
+
+        while (n < budget) {
+            if (_headLocal == _tailCache) {
+                _tailCache = _hdr->tail.load(std::memory_order_acquire);
+                if (_headLocal == _tailCache) {
+                    break;
+                }
+            }
+            uint64_t pos   = _headLocal & _mask;
+            uint64_t room  = _mask + 1 - pos;
+            uint64_t avail = _tailCache - _headLocal;
+            uint32_t len   = (pos & 7) ? 0 : *(const uint32_t *)(_data + pos);
+            if ((len == AFI_SHM_WRAP) && (room <= avail)) {
+                _headLocal += room;
+                continue;
+            }
+            if ((pos & 7) || (avail > _mask + 1) ||
+                (len > AFI_SHM_FRAME_MAX) || (recLen(len) > room) ||
+                (recLen(len) > avail)) {
+                _badRecords++;
+                _headLocal = _tailCache;
+                _hdr->head.store(_headLocal, std::memory_order_release);
+                break;
+            }
+            fn(_data + pos + 4, len);
+            _headLocal += recLen(len);
+            n++;
+        }
+        if (n) {
+            _hdr->head.store(_headLocal, std::memory_order_release);
+        }
+        return n;
+    }
+
+    //
+    // Consumer: announce sleeping on the doorbell. Returns false if
+    // frames came in meanwhile (waiting is cleared again).
+    //
+    bool waitArm(void) {
+        _hdr->waiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_hdr->tail.load(std::memory_order_acquire) != _headLocal) {
+            _hdr->waiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    //
+    // Consumer: number of invalid records met
+    //
+    uint64_t badRecords(void) const { return _badRecords; }
+
+private:
+    static uint64_t recLen(uint32_t len) {
+        return (4 + (uint64_t)len + 7) & ~7ULL;
+    }
+
+    AfiShmRingHdr  *_hdr;
+    uint8_t        *_data;
+    uint64_t        _mask;
+    uint64_t        _tailLocal;     //< Producer
+    uint64_t        _headCache;     //< Producer
+    uint64_t        _headLocal;     //< Consumer
+    uint64_t        _tailCache;     //< Consumer
+    uint64_t        _badRecords;    //< Consumer
+};
+
+//
+// @class   AfiShmChannel
+// @brief   Shared memory hostpath channel
+//
+// Two rings in one memfd mapping, one for punted packets (peer to
+// client), one for injected packets (client to peer), each with an
+// eventfd doorbell. Frames are AftPacket header + data, as in the
+// hostpath UDP datagrams.
+//
+// The peer (the forwarding engine side) creates the channel and hands
+// the memfd and the eventfds to the client over a Unix domain socket.
+//
+class AfiShmChannel
+{
+public:
+    typedef enum {
+        RolePeer,       //< Sends punts, receives injects
+        RoleClient,     //< Sends injects, receives punts
+    } Role;
+
+    AfiShmChannel();
+    ~AfiShmChannel();
+
+    //
+    // Peer: create channel, listen for / hand it to a client
+    //
+    int create(uint32_t ringSize = AFI_SHM_RING_SIZE);
+    static int listen(const std::string &path);
+    int handOver(int connFd);
+
+    //
+    // Client: get channel from the peer listening at path
+    //
+    int connect(const std::string &path);
+
+    //
+    // Append a frame to the send ring, false if full
+    //
+    bool send(const void *part1, uint32_t len1,
+              const void *part2 = NULL, uint32_t len2 = 0) {
+        return _send.push(part1, len1, part2, len2);
+    }
+
+    //
+    // Ring the send doorbell if the other side sleeps on it
+    //
+    void kick(void);
+
+    //
+    // Receive ring, and eventfd that becomes readable when frames are
+    // received after waitArm()
+    //
+    AfiShmRing &recvRing(void) { return _recv; }
+    int recvFd(void) const { return _recvFd; }
+
+    //
+    // Clear the receive doorbell
+    //
+    void recvAck(void);
+
+    //
+    // Peer connection (client: socket to the peer), -1 if none
+    //
+    int connFd(void) const { return _connFd; }
+
+private:
+    int  map(Role role, bool init);
+
+    int         _memFd;
+    int         _efd[2];        //< Doorbells of ring 0 and ring 1
+    uint32_t    _ringSize;
+    void       *_mem;
+    size_t      _memSize;
+    int         _recvFd;
+    int         _sendFd;
+    int         _connFd;
+    AfiShmRing  _send;
+    AfiShmRing  _recv;
+};
+
+#endif // __AfiShmChannel__
@@ -0,0 +1,97 @@
+//
+// AfiTokenBucket.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiTokenBucket__
+#define __AfiTokenBucket__
+
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+
+//
+// CLOCK_MONOTONIC in nanoseconds
+//
+static inline uint64_t
+afiMonotonicNs (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// @struct  AfiTokenBucket
+// @brief   Lock free packet rate token bucket
+//
+// Implemented as the equivalent virtual scheduling form (GCRA): the
+// bucket keeps the theoretical arrival time of the next packet and a
+// packet conforms if it is not earlier than that time less the burst
+// tolerance. Admitting a packet is one compare-and-swap, so the bucket
+// can be shared by all hostpath receivers.
+//
+struct AfiTokenBucket {
+    AfiTokenBucket() : tat(0), interval(0), tolerance(0), drops(0) {
+    }
+
+    //
+    // Configure rate (packets per second, 0: unlimited) and burst
+    // (packets). Takes effect for the next packet.
+    //
+    void configure(uint64_t pps, uint64_t burst) {
+        uint64_t iv = pps ? std::max<uint64_t>(1, 1000000000ULL / pps) : 0;
+
+        tolerance.store(iv * (std::max<uint64_t>(burst, 1) - 1),
+                        std::memory_order_relaxed);
+        interval.store(iv, std::memory_order_relaxed);
+    }
+
+    //
+    // True if a packet arriving at nowNs conforms, else counts a drop
+    //
+    bool admit(uint64_t nowNs) {
+        uint64_t iv = interval.load(std::memory_order_relaxed);
+        if (iv == 0) {
+            return true;
+        }
+
+        uint64_t tol = tolerance.load(std::memory_order_relaxed);
+        uint64_t t   = tat.load(std::memory_order_relaxed);
+        for (;;) {
+            uint64_t start = std::max(t, nowNs);
+            if (start - nowNs > tol) {
+                drops.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (tat.compare_exchange_weak(t, start + iv,
+                                          std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    std::atomic<uint64_t>  tat;         //< Theoretical arrival time (ns)
+    std::atomic<uint64_t>  interval;    //< ns per packet, 0: unlimited
+    std::atomic<uint64_t>  tolerance;   //< Burst tolerance (ns)
+    std::atomic<uint64_t>  drops;       //< Packets dropped
+};
+
+#endif // __AfiTokenBucket__
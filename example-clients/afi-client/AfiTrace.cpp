@@ -0,0 +1,441 @@
+//
+// AfiTrace.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include "Utils.h"
+#include "AfiTrace.h"
+
+std::atomic<bool> afiTraceEnabled(false);
+
+static std::mutex                  afiTraceRingsLock;
+static std::vector<AfiTraceRing *> afiTraceRings;
+static std::vector<AfiTraceRing *> afiTraceRingsFree;  //< Of exited threads
+
+//
+// Reference point taken when tracing is enabled (afiTraceRingsLock
+// keeps the pair consistent, the atomics keep each read whole)
+//
+static std::atomic<uint64_t>       afiTraceTick0(0);
+static std::atomic<uint64_t>       afiTraceNs0(0);
+
+//
+// Trace file header
+//
+struct AfiTraceFileHdr {
+    char           magic[8];
+    uint32_t       version;
+    uint32_t       recordSize;
+    AfiTraceClock  clock;
+    uint64_t       numRecords;
+};
+
+static uint64_t
+afiTraceMonotonicNs (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// @fn
+// afiTraceRingCreate
+//
+// @brief
+// Trace ring for the calling thread: the ring of a thread that has
+// exited, or a new one registered so that afiTraceSnapshot can find
+// it. A reused ring keeps its records and counters, so that the
+// records of the exited thread are shown until they are overwritten.
+//
+// @param[in] void
+// @return Trace ring
+//
+
+AfiTraceRing *
+afiTraceRingCreate (void)
+{
+    {
+        std::lock_guard<std::mutex> guard(afiTraceRingsLock);
+
+        if (!afiTraceRingsFree.empty()) {
+            AfiTraceRing *ring = afiTraceRingsFree.back();
+            afiTraceRingsFree.pop_back();
+            return ring;
+        }
+    }
+
+    void *mem = NULL;
+
+    if (posix_memalign(&mem, 64, sizeof(AfiTraceRing)) != 0) {
+        throw std::bad_alloc();
+    }
+    memset(mem, 0, sizeof(AfiTraceRing));
+
+    AfiTraceRing *ring = new (mem) AfiTraceRing;
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->begun.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(afiTraceRingsLock);
+    ring->id = afiTraceRings.size();
+    afiTraceRings.push_back(ring);
+
+    return ring;
+}
+
+//
+// @fn
+// afiTraceRingLocal
+//
+// @brief
+// Calling thread's trace ring, created on first use
+//
+// @param[in] void
+// @return Trace ring
+//
+
+AfiTraceRing *
+afiTraceRingLocal (void)
+{
+    //
+    // The owner hands the ring back when the thread exits; it is only
+    // touched when the ring is taken, the plain pointer is what
+    // recording reads
+    //
+    struct RingOwner {
+        AfiTraceRing *ring;
+
+        ~RingOwner() {
+            if (ring) {
+                std::lock_guard<std::mutex> guard(afiTraceRingsLock);
+                afiTraceRingsFree.push_back(ring);
+            }
+        }
+    };
+    static thread_local RingOwner     owner = { nullptr };
+    static thread_local AfiTraceRing *ring  = nullptr;
+
+    if (__builtin_expect(ring == nullptr, 0)) {
+        ring       = afiTraceRingCreate();
+        owner.ring = ring;
+    }
+    return ring;
+}
+
+//
+// @fn
+// afiTraceEnable
+//
+// @brief
+// Enable or disable tracing
+//
+// @param[in]
+//     enable True to enable tracing
+// @return void
+//
+
+void
+afiTraceEnable (bool enable)
+{
+    std::lock_guard<std::mutex> guard(afiTraceRingsLock);
+
+    if (enable && !afiTraceEnabled.load(std::memory_order_relaxed)) {
+        afiTraceTick0.store(afiTraceNow(), std::memory_order_relaxed);
+        afiTraceNs0.store(afiTraceMonotonicNs(), std::memory_order_relaxed);
+    }
+    afiTraceEnabled.store(enable, std::memory_order_release);
+}
+
+//
+// @fn
+// afiTraceSnapshot
+//
+// @brief
+// Copy the records of all trace rings, ordered by timestamp. Rings
+// are copied while their threads keep recording: records whose slot
+// was taken by a newer record during the copy are dropped.
+//
+// @param[out]
+//     records Trace records
+// @param[out]
+//     clock Reference points to convert timestamps
+// @return void
+//
+
+void
+afiTraceSnapshot (std::vector<AfiTraceRecord> &records,
+                  AfiTraceClock               &clock)
+{
+    records.clear();
+
+    {
+        std::lock_guard<std::mutex> guard(afiTraceRingsLock);
+
+        clock.tick0 = afiTraceTick0.load(std::memory_order_relaxed);
+        clock.ns0   = afiTraceNs0.load(std::memory_order_relaxed);
+
+        for (auto ring : afiTraceRings) {
+            uint64_t head  = ring->head.load(std::memory_order_acquire);
+            uint64_t count = std::min<uint64_t>(head, AFI_TRACE_RING_RECORDS);
+            size_t   first = records.size();
+
+            for (uint64_t i = head - count; i < head; i++) {
+                records.push_back(
+                    ring->records[i & (AFI_TRACE_RING_RECORDS - 1)]);
+            }
+
+            //
+            // Records before the oldest one that was not overwritten
+            // since (begun - AFI_TRACE_RING_RECORDS) may be torn
+            //
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t begun = ring->begun.load(std::memory_order_relaxed);
+            uint64_t valid = (begun > AFI_TRACE_RING_RECORDS) ?
+                             begun - AFI_TRACE_RING_RECORDS : 0;
+            if (valid > head - count) {
+                uint64_t torn = std::min(valid - (head - count), count);
+                records.erase(records.begin() + first,
+                              records.begin() + first + torn);
+            }
+        }
+    }
+
+    std::stable_sort(records.begin(), records.end(),
+                     [](const AfiTraceRecord &a, const AfiTraceRecord &b) {
+                         return a.timestamp < b.timestamp;
+                     });
+
+    clock.tick1 = afiTraceNow();
+    clock.ns1   = afiTraceMonotonicNs();
+}
+
+//
+// @fn
+// afiTraceTicksToNs
+//
+// @brief
+// Convert trace timestamp to ns since tracing was enabled
+//
+
+static double
+afiTraceTicksToNs (const AfiTraceClock &clock, uint64_t ticks)
+{
+    double ticksPerNs = 1.0;
+
+    if ((clock.tick1 > clock.tick0) && (clock.ns1 > clock.ns0)) {
+        ticksPerNs = (double)(clock.tick1 - clock.tick0) /
+                     (double)(clock.ns1 - clock.ns0);
+    }
+    return ((double)ticks - (double)clock.tick0) / ticksPerNs;
+}
+
+static void
+afiTraceRenderBytes (const std::string    &ctx,
+                     const AfiTraceRecord &rec,
+                     std::ostream         &os)
+{
+    char hex[AFI_TRACE_PKT_BYTES * 4];
+
+    getHex((char *)rec.bytes, rec.caplen, hex, sizeof(hex), 16);
+    os << ctx << ": (" << rec.caplen << " of " << rec.length;
+    os << " bytes)" << std::endl;
+    os << hex << std::endl;
+}
+
+//
+// @fn
+// afiTraceRender
+//
+// @brief
+// Render trace records in text format
+//
+// @param[in]
+//     records Trace records
+// @param[in]
+//     clock Reference points to convert timestamps
+// @param[in]
+//     os Output stream
+// @return void
+//
+
+void
+afiTraceRender (const std::vector<AfiTraceRecord> &records,
+                const AfiTraceClock               &clock,
+                std::ostream                      &os)
+{
+    for (const auto &rec : records) {
+        double ns = afiTraceTicksToNs(clock, rec.timestamp);
+
+        os << "[" << std::fixed << std::setprecision(9) << (ns / 1e9);
+        os << "] T" << rec.thread << " ";
+
+        switch (rec.event) {
+        case AFI_TRACE_EV_HP_RECV:
+            os << "Received packet:" << std::endl;
+            os << "----------------" << std::endl;
+            os << "Sandbox Id : " << rec.sandboxId << std::endl;
+            os << "Port Index : " << rec.portIndex << std::endl;
+            os << "Data Size  : " << rec.length    << std::endl;
+            afiTraceRenderBytes("pkt data", rec, os);
+            break;
+
+        case AFI_TRACE_EV_HP_XMIT:
+            os << "Injecting layer2 packet - ";
+            os << "Sandbox index:" << rec.sandboxId << " ";
+            os << "Port index: " << rec.portIndex << std::endl;
+            afiTraceRenderBytes("xmit pkt ", rec, os);
+            break;
+
+        case AFI_TRACE_EV_HP_DROP:
+            os << "Dropping hostpath packet (" << rec.length;
+            os << " bytes, reason " << rec.arg << ")" << std::endl;
+            break;
+
+        case AFI_TRACE_EV_ROUTE_ADD:
+            os << "Adding route ";
+            for (int i = 0; i < rec.caplen; i++) {
+                os << (i ? "." : "") << (int)rec.bytes[i];
+            }
+            os << "/" << (int)rec.prefixLen;
+            os << " ---> Node token " << rec.arg << std::endl;
+            break;
+
+        case AFI_TRACE_EV_INDEX_ENTRY_ADD:
+            os << "Index table entry pushed. ";
+            os << "(Index: " << rec.portIndex;
+            os << " target token: " << rec.arg << ")" << std::endl;
+            break;
+
+        default:
+            os << "Unknown trace event " << rec.event << std::endl;
+            break;
+        }
+    }
+}
+
+//
+// @fn
+// afiTraceDump
+//
+// @brief
+// Write records of all trace rings to a trace file
+//
+// @param[in]
+//     fileName Trace file name
+// @return 0 - Success, -1 - Error
+//
+
+int
+afiTraceDump (const std::string &fileName)
+{
+    std::vector<AfiTraceRecord> records;
+    AfiTraceFileHdr             hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    afiTraceSnapshot(records, hdr.clock);
+    strncpy(hdr.magic, AFI_TRACE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version    = AFI_TRACE_FILE_VERSION;
+    hdr.recordSize = sizeof(AfiTraceRecord);
+    hdr.numRecords = records.size();
+
+    FILE *fp = fopen(fileName.c_str(), "wb");
+    if (!fp) {
+        perror("fopen");
+        return -1;
+    }
+
+    bool ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+    if (ok && !records.empty()) {
+        ok = (fwrite(records.data(), sizeof(AfiTraceRecord),
+                     records.size(), fp) == records.size());
+    }
+    ok = (fclose(fp) == 0) && ok;
+
+    return ok ? 0 : -1;
+}
+
+//
+// @fn
+// afiTraceLoad
+//
+// @brief
+// Read a trace file written by afiTraceDump
+//
+// @param[in]
+//     fileName Trace file name
+// @param[out]
+//     records Trace records
+// @param[out]
+//     clock Reference points to convert timestamps
+// @return 0 - Success, -1 - Error
+//
+
+int
+afiTraceLoad (const std::string           &fileName,
+              std::vector<AfiTraceRecord> &records,
+              AfiTraceClock               &clock)
+{
+    AfiTraceFileHdr hdr;
+    long            fileSize;
+
+    FILE *fp = fopen(fileName.c_str(), "rb");
+    if (!fp) {
+        perror("fopen");
+        return -1;
+    }
+
+    if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+        (strncmp(hdr.magic, AFI_TRACE_FILE_MAGIC, sizeof(hdr.magic)) != 0) ||
+        (hdr.version != AFI_TRACE_FILE_VERSION) ||
+        (hdr.recordSize != sizeof(AfiTraceRecord))) {
+        std::cout << "Not an AFI trace file: " << fileName << std::endl;
+        fclose(fp);
+        return -1;
+    }
+
+    //
+    // The records the header announces must be in the file
+    //
+    if ((fseek(fp, 0, SEEK_END) != 0) || ((fileSize = ftell(fp)) < 0) ||
+        (hdr.numRecords > ((uint64_t)fileSize - sizeof(hdr)) /
+                          sizeof(AfiTraceRecord)) ||
+        (fseek(fp, sizeof(hdr), SEEK_SET) != 0)) {
+        std::cout << "Truncated AFI trace file: " << fileName << std::endl;
+        fclose(fp);
+        return -1;
+    }
+
+    records.resize(hdr.numRecords);
+    size_t numRead = records.empty() ? 0 :
+                     fread(records.data(), sizeof(AfiTraceRecord),
+                           records.size(), fp);
+    fclose(fp);
+
+    records.resize(numRead);
+    clock = hdr.clock;
+
+    return (numRead == hdr.numRecords) ? 0 : -1;
+}
@@ -0,0 +1,226 @@
+//
+// AfiTrace.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiTrace__
+#define __AfiTrace__
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//
+// Binary trace ring
+// =================
+//
+// Hot paths record fixed size (one cache line) binary records into a
+// per-thread ring instead of formatting text. Each thread owns its ring
+// and is its only writer, so recording is a handful of stores and two
+// stores of ring counters. Rings wrap and keep the most recent
+// AFI_TRACE_RING_RECORDS records; a snapshot drops the records the
+// writer may have overwritten while they were copied. The ring of a
+// thread that exits goes to the next thread that records, so there
+// are no more rings than threads recording at a time.
+//
+// Records are rendered into the familiar text format only when the
+// trace is shown (CLI 'trace-show') or, offline, by afi-trace-decode
+// from a file written with afiTraceDump().
+//
+// AFI_TRACE() costs one predictable branch when tracing is disabled at
+// run time and compiles to nothing with -DAFI_TRACE_COMPILED_OUT.
+//
+
+#define AFI_TRACE_RING_RECORDS  4096    // Per thread, power of 2
+#define AFI_TRACE_PKT_BYTES     24      // Packet bytes kept per record
+#define AFI_TRACE_FILE_MAGIC    "AFITRC1"
+#define AFI_TRACE_FILE_VERSION  2
+
+//
+// Trace events
+//
+typedef enum {
+    AFI_TRACE_EV_NONE = 0,
+    AFI_TRACE_EV_HP_RECV,           //< Hostpath packet received
+    AFI_TRACE_EV_HP_XMIT,           //< Hostpath packet injected
+    AFI_TRACE_EV_HP_DROP,           //< Hostpath packet dropped
+    AFI_TRACE_EV_ROUTE_ADD,         //< Route added
+    AFI_TRACE_EV_INDEX_ENTRY_ADD,   //< Index table entry added
+    AFI_TRACE_EV_MAX,
+} AfiTraceEvent;
+
+//
+// @struct  AfiTraceRecord
+// @brief   Fixed size binary trace record
+//
+struct AfiTraceRecord {
+    uint64_t  timestamp;    //< afiTraceNow() ticks
+    uint64_t  token;        //< Node token (event specific)
+    uint64_t  arg;          //< Event specific argument
+    uint32_t  sandboxId;    //< Sandbox id
+    uint32_t  portIndex;    //< Port index (or table index)
+    uint16_t  event;        //< AfiTraceEvent
+    uint16_t  thread;       //< Id of the ring (thread) that recorded it
+    uint16_t  length;       //< Length of the traced packet/data
+    uint8_t   caplen;       //< Number of bytes kept in bytes[]
+    uint8_t   prefixLen;    //< Route prefix length (route events)
+    uint8_t   bytes[AFI_TRACE_PKT_BYTES];
+};
+
+static_assert(sizeof(AfiTraceRecord) == 64,
+              "AfiTraceRecord must fill exactly one cache line");
+
+//
+// @struct  AfiTraceRing
+// @brief   Single writer trace ring owned by one thread
+//
+struct AfiTraceRing {
+    std::atomic<uint64_t>  head;    //< Number of records ever written
+    std::atomic<uint64_t>  begun;   //< Records begun: head, or head + 1
+                                    //  while a record is written
+    uint16_t               id;      //< Ring (thread) id
+    AfiTraceRecord         records[AFI_TRACE_RING_RECORDS];
+};
+
+//
+// @struct  AfiTraceClock
+// @brief   Pair of reference points to convert ticks to nanoseconds
+//
+struct AfiTraceClock {
+    uint64_t  tick0;        //< Ticks when tracing was enabled
+    uint64_t  ns0;          //< CLOCK_MONOTONIC ns when tracing was enabled
+    uint64_t  tick1;        //< Ticks when the snapshot was taken
+    uint64_t  ns1;          //< CLOCK_MONOTONIC ns when the snapshot was taken
+};
+
+extern std::atomic<bool> afiTraceEnabled;
+
+//
+// Trace timestamp: TSC on x86, CLOCK_MONOTONIC ns elsewhere
+//
+static inline uint64_t
+afiTraceNow (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+//
+// Calling thread's ring, created on first use
+//
+extern AfiTraceRing *afiTraceRingLocal(void);
+
+//
+// Record one trace event
+//
+static inline void
+afiTrace (AfiTraceEvent  event,
+          uint32_t       sandboxId,
+          uint32_t       portIndex,
+          uint64_t       token,
+          uint64_t       arg,
+          const void    *bytes,
+          uint32_t       length,
+          uint8_t        prefixLen = 0)
+{
+    AfiTraceRing   *ring = afiTraceRingLocal();
+    uint64_t        head = ring->head.load(std::memory_order_relaxed);
+    AfiTraceRecord &rec  = ring->records[head & (AFI_TRACE_RING_RECORDS - 1)];
+    uint32_t        caplen = (length < AFI_TRACE_PKT_BYTES) ? length :
+                                                 AFI_TRACE_PKT_BYTES;
+
+    //
+    // Tell snapshots the slot is being overwritten before writing it
+    //
+    ring->begun.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    rec.timestamp = afiTraceNow();
+    rec.token     = token;
+    rec.arg       = arg;
+    rec.sandboxId = sandboxId;
+    rec.portIndex = portIndex;
+    rec.event     = event;
+    rec.thread    = ring->id;
+    rec.length    = (length > 0xffff) ? 0xffff : length;
+    rec.caplen    = bytes ? caplen : 0;
+    rec.prefixLen = prefixLen;
+    if (bytes) {
+        memcpy(rec.bytes, bytes, caplen);
+    }
+
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+#ifdef AFI_TRACE_COMPILED_OUT
+#define AFI_TRACE(...)  do { } while (0)
+#else
+#define AFI_TRACE(...)                                  \
+    do {                                                \
+        if (__builtin_expect(afiTraceEnabled.load(      \
+                std::memory_order_relaxed), 0)) {       \
+            afiTrace(__VA_ARGS__);                      \
+        }                                               \
+    } while (0)
+#endif
+
+//
+// Enable/disable tracing
+//
+extern void afiTraceEnable(bool enable);
+
+//
+// Copy records of all rings, oldest first
+//
+extern void afiTraceSnapshot(std::vector<AfiTraceRecord> &records,
+                             AfiTraceClock               &clock);
+
+//
+// Render records in text format
+//
+extern void afiTraceRender(const std::vector<AfiTraceRecord> &records,
+                           const AfiTraceClock               &clock,
+                           std::ostream                      &os);
+
+//
+// Write all rings to a trace file (decoded by afi-trace-decode)
+//
+extern int afiTraceDump(const std::string &fileName);
+
+//
+// Read a trace file written by afiTraceDump
+//
+extern int afiTraceLoad(const std::string           &fileName,
+                        std::vector<AfiTraceRecord> &records,
+                        AfiTraceClock               &clock);
+
+#endif // __AfiTrace__
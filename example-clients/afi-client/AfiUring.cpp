@@ -0,0 +1,263 @@
+//
+// AfiUring.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "AfiUring.h"
+
+#ifdef AFI_HAVE_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup     425
+#define __NR_io_uring_enter     426
+#define __NR_io_uring_register  427
+#endif
+
+AfiUring::AfiUring ()
+    : _fd(-1),
+      _sqRing(MAP_FAILED),
+      _sqRingSize(0),
+      _cqRing(MAP_FAILED),
+      _cqRingSize(0),
+      _sqes((struct io_uring_sqe *)MAP_FAILED),
+      _sqesSize(0),
+      _sqHead(NULL),
+      _sqTail(NULL),
+      _sqMask(0),
+      _sqEntries(0),
+      _sqArray(NULL),
+      _sqLocalTail(0),
+      _sqPending(0),
+      _cqHead(NULL),
+      _cqTail(NULL),
+      _cqMask(0),
+      _cqes(NULL),
+      _bufRing((struct io_uring_buf *)MAP_FAILED),
+      _bufRingSize(0),
+      _bufMask(0),
+      _bufTail(0),
+      _bufMem((uint8_t *)MAP_FAILED),
+      _bufMemSize(0),
+      _bufSize(0)
+{
+}
+
+AfiUring::~AfiUring ()
+{
+    //
+    // Closing the ring also drops the buffer ring registration
+    //
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    if (_bufRing != MAP_FAILED) {
+        munmap(_bufRing, _bufRingSize);
+    }
+    if (_bufMem != MAP_FAILED) {
+        munmap(_bufMem, _bufMemSize);
+    }
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqesSize);
+    }
+    if ((_cqRing != MAP_FAILED) && (_cqRing != _sqRing)) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != MAP_FAILED) {
+        munmap(_sqRing, _sqRingSize);
+    }
+}
+
+//
+// @fn
+// init
+//
+// @brief
+// Set up the ring and map its queues
+//
+// @param[in]
+//     entries Submission queue entries
+// @return 0 - Success, -1 - Error (errno)
+//
+
+int
+AfiUring::init (unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    _fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (_fd < 0) {
+        return -1;
+    }
+
+    _sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        _cqRing = _sqRing;
+    } else {
+        _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            return -1;
+        }
+    }
+
+    _sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe *)mmap(NULL, _sqesSize,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE,
+                                        _fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    uint8_t *sq  = (uint8_t *)_sqRing;
+    uint8_t *cq  = (uint8_t *)_cqRing;
+
+    _sqHead      = (unsigned *)(sq + p.sq_off.head);
+    _sqTail      = (unsigned *)(sq + p.sq_off.tail);
+    _sqMask      = *(unsigned *)(sq + p.sq_off.ring_mask);
+    _sqEntries   = p.sq_entries;
+    _sqArray     = (unsigned *)(sq + p.sq_off.array);
+    _sqLocalTail = *_sqTail;
+
+    _cqHead      = (unsigned *)(cq + p.cq_off.head);
+    _cqTail      = (unsigned *)(cq + p.cq_off.tail);
+    _cqMask      = *(unsigned *)(cq + p.cq_off.ring_mask);
+    _cqes        = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return 0;
+}
+
+struct io_uring_sqe *
+AfiUring::getSqe (void)
+{
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+
+    if (_sqLocalTail - head >= _sqEntries) {
+        return NULL;
+    }
+
+    unsigned             idx = _sqLocalTail & _sqMask;
+    struct io_uring_sqe *sqe = &_sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    _sqArray[idx] = idx;
+    _sqLocalTail++;
+    _sqPending++;
+
+    return sqe;
+}
+
+int
+AfiUring::submit (unsigned waitNr)
+{
+    __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+    if ((_sqPending == 0) && (waitNr == 0)) {
+        return 0;
+    }
+
+    int ret = syscall(__NR_io_uring_enter, _fd, _sqPending, waitNr,
+                      waitNr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ret < 0) {
+        return -1;
+    }
+    _sqPending -= ret;
+
+    return ret;
+}
+
+//
+// @fn
+// bufRingSetup
+//
+// @brief
+// Allocate a fixed pool of buffers and register it as provided
+// buffer ring, with all buffers available to the kernel
+//
+// @param[in]
+//     groupId Buffer group id (sqe->buf_group)
+// @param[in]
+//     numBufs Number of buffers, power of 2, at most 32768
+// @param[in]
+//     bufSize Buffer size
+// @return 0 - Success, -1 - Error (errno)
+//
+
+int
+AfiUring::bufRingSetup (uint16_t groupId, unsigned numBufs, size_t bufSize)
+{
+    struct io_uring_buf_reg reg;
+
+    _bufRingSize = numBufs * sizeof(struct io_uring_buf);
+    _bufRing = (struct io_uring_buf *)mmap(NULL, _bufRingSize,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS,
+                                           -1, 0);
+    if (_bufRing == MAP_FAILED) {
+        return -1;
+    }
+
+    _bufMemSize = numBufs * bufSize;
+    _bufMem = (uint8_t *)mmap(NULL, _bufMemSize, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                              -1, 0);
+    if (_bufMem == MAP_FAILED) {
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)_bufRing;
+    reg.ring_entries = numBufs;
+    reg.bgid         = groupId;
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+        return -1;
+    }
+
+    _bufMask = numBufs - 1;
+    _bufSize = bufSize;
+    _bufTail = 0;
+    for (unsigned b = 0; b < numBufs; b++) {
+        bufReturn(b);
+    }
+    bufCommit();
+
+    return 0;
+}
+
+#endif // AFI_HAVE_IO_URING
@@ -0,0 +1,145 @@
+//
+// AfiUring.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __AfiUring__
+#define __AfiUring__
+
+//
+// io_uring is used through its system calls, without liburing. It
+// needs Linux 6.0 headers and kernel (multishot recvmsg, provided
+// buffer rings): build with 'make AFI_HAVE_IO_URING=1'.
+//
+#ifdef AFI_HAVE_IO_URING
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+//
+// @class   AfiUring
+// @brief   Minimal io_uring instance
+//
+// Submission and completion are done by one thread at a time.
+//
+// A ring can have one provided buffer ring: a fixed pool of equally
+// sized buffers registered with the kernel, out of which the kernel
+// picks a buffer for each completed receive. Buffers are given back
+// with bufReturn() and published to the kernel with bufCommit().
+//
+class AfiUring
+{
+public:
+    AfiUring();
+    ~AfiUring();
+
+    //
+    // Set up ring, returns 0 - Success, -1 - Error (errno)
+    //
+    int init(unsigned entries);
+
+    //
+    // Next free submission queue entry (zeroed), NULL if queue full
+    //
+    struct io_uring_sqe *getSqe(void);
+
+    //
+    // Submit queued entries and wait for waitNr completions.
+    // Returns number of entries submitted, -1 - Error (errno)
+    //
+    int submit(unsigned waitNr = 0);
+
+    //
+    // Hand available completions to fn, returns number of completions
+    //
+    template <typename Fn>
+    unsigned reap(Fn fn) {
+        unsigned head = *_cqHead;
+        unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        unsigned n    = tail - head;
+
+        for (; head != tail; head++) {
+            fn(_cqes[head & _cqMask]);
+        }
+        __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+
+        return n;
+    }
+
+    //
+    // Register provided buffer ring (numBufs power of 2)
+    //
+    int bufRingSetup(uint16_t groupId, unsigned numBufs, size_t bufSize);
+
+    uint8_t *buf(uint16_t bufId) const {
+        return _bufMem + (size_t)bufId * _bufSize;
+    }
+
+    void bufReturn(uint16_t bufId) {
+        struct io_uring_buf *b = &_bufRing[_bufTail & _bufMask];
+        b->addr = (uint64_t)(uintptr_t)buf(bufId);
+        b->len  = _bufSize;
+        b->bid  = bufId;
+        _bufTail++;
+    }
+
+    void bufCommit(void) {
+        //
+        // Ring tail shares the first entry's reserved field
+        //
+        __atomic_store_n(&_bufRing[0].resv, _bufTail, __ATOMIC_RELEASE);
+    }
+
+    size_t bufSize(void) const { return _bufSize; }
+
+private:
+    int                   _fd;
+    void                 *_sqRing;
+    size_t                _sqRingSize;
+    void                 *_cqRing;
+    size_t                _cqRingSize;
+    struct io_uring_sqe  *_sqes;
+    size_t                _sqesSize;
+
+    unsigned             *_sqHead;
+    unsigned             *_sqTail;
+    unsigned              _sqMask;
+    unsigned              _sqEntries;
+    unsigned             *_sqArray;
+    unsigned              _sqLocalTail;    //< Entries queued, not published
+    unsigned              _sqPending;      //< Entries not yet submitted
+
+    unsigned             *_cqHead;
+    unsigned             *_cqTail;
+    unsigned              _cqMask;
+    struct io_uring_cqe  *_cqes;
+
+    struct io_uring_buf  *_bufRing;
+    size_t                _bufRingSize;
+    unsigned              _bufMask;
+    uint16_t              _bufTail;
+    uint8_t              *_bufMem;
+    size_t                _bufMemSize;
+    size_t                _bufSize;
+};
+
+#endif // AFI_HAVE_IO_URING
+
+#endif // __AfiUring__
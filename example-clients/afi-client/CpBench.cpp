@@ -0,0 +1,283 @@
+//
+// CpBench.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "AfiClient.h"
+
+#define AFI_CP_BENCH_NUM_CFG_PORTS  8
+#define AFI_CP_BENCH_MAX_OBJS       1000000 // Largest size (default)
+#define AFI_CP_BENCH_SB_NAME        "cpbench"
+
+//
+// Allocation counting: every operator new of the process
+//
+static std::atomic<uint64_t> benchAllocs(0);
+
+void *
+operator new (size_t size)
+{
+    benchAllocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+    free(p);
+}
+
+//
+// Nodes the programming calls of a run refer to
+//
+struct BenchCtx {
+    AftNodeToken                rtt;
+    AftNodeToken                iTable;
+    AftNodeToken                port;
+    AftNodeToken                counter;
+    std::vector<std::string>    prefixes;   //< One /32 per object
+};
+
+typedef std::function<void(AfiClient &, BenchCtx &, uint32_t,
+                           const AftInsertPtr &)> BenchOp;
+
+//
+// Programming calls: object i of a run, added to batch (or sent if
+// NULL). A graph is a route to an ethernet encap behind two labels,
+// also reached from an index table entry.
+//
+struct BenchWorkload {
+    const char *name;
+    BenchOp     op;
+};
+
+static const BenchWorkload benchWorkloads[] = {
+    { "route", [](AfiClient &client, BenchCtx &ctx, uint32_t i,
+                  const AftInsertPtr &batch) {
+          client.addRoute(ctx.rtt, ctx.prefixes[i], ctx.port, batch);
+      } },
+    { "ether-encap", [](AfiClient &client, BenchCtx &ctx, uint32_t i,
+                        const AftInsertPtr &batch) {
+          client.addEtherEncapNode("32:26:0a:2e:cc:f3", "32:26:0a:2e:aa:f3",
+                                   "0", "0", ctx.port, batch);
+      } },
+    { "label-encap", [](AfiClient &client, BenchCtx &ctx, uint32_t i,
+                        const AftInsertPtr &batch) {
+          client.addLabelEncap("1000002", "16", ctx.port, batch);
+      } },
+    { "index-entry", [](AfiClient &client, BenchCtx &ctx, uint32_t i,
+                        const AftInsertPtr &batch) {
+          client.addIndexTableEntry(ctx.iTable, i, ctx.port, batch);
+      } },
+    { "list", [](AfiClient &client, BenchCtx &ctx, uint32_t i,
+                 const AftInsertPtr &batch) {
+          client.createList({ ctx.counter, ctx.port }, batch);
+      } },
+    { "graph", [](AfiClient &client, BenchCtx &ctx, uint32_t i,
+                  const AftInsertPtr &batch) {
+          AftNodeToken encap = client.addEtherEncapNode("32:26:0a:2e:cc:f5",
+                                                        "32:26:0a:2e:aa:f5",
+                                                        "0", "0", ctx.port,
+                                                        batch);
+          AftNodeToken labels = client.addLabelEncap("1000002", "16", encap,
+                                                     batch);
+          client.addIndexTableEntry(ctx.iTable, i, labels, batch);
+          client.addRoute(ctx.rtt, ctx.prefixes[i], labels, batch);
+      } },
+};
+
+static double
+benchSeconds (std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// Open a fresh sandbox (quietly) with the nodes a run of numObjs
+// objects refers to. Returns 0 - Success, -1 - Failure.
+//
+static int
+benchOpen (AfiClient &client, BenchCtx &ctx, uint32_t numObjs)
+{
+    std::streambuf *out = std::cout.rdbuf(NULL);
+    int ret = client.openSandbox(AFI_CP_BENCH_SB_NAME,
+                                 AFI_CP_BENCH_NUM_CFG_PORTS);
+    std::cout.rdbuf(out);
+    if (ret != 0) {
+        return -1;
+    }
+
+    ctx.port    = client.getOuputPortToken(1);
+    ctx.rtt     = client.addRouteTable("rtt0", ctx.port);
+    ctx.iTable  = client.createIndexTable("packet.ether.vlan1", numObjs);
+    ctx.counter = client.addCounterNode();
+    return 0;
+}
+
+static void
+benchClose (AfiClient &client)
+{
+    client.localServer()->close(AFI_CP_BENCH_SB_NAME);
+    client.localServer()->release(AFI_CP_BENCH_SB_NAME);
+}
+
+static uint64_t
+benchWireBytes (AfiClient &client)
+{
+    AfiLocalSandbox stats;
+    client.localServer()->sandbox(AFI_CP_BENCH_SB_NAME, stats, false);
+    return stats.wireBytes;
+}
+
+//
+// One workload at one size: objects built into one insert and sent at
+// once (build, then send), and sent one by one (client)
+//
+static int
+benchRun (AfiClient &client, const BenchWorkload &w, BenchCtx &ctx,
+          uint32_t numObjs)
+{
+    if (benchOpen(client, ctx, numObjs) != 0) {
+        return -1;
+    }
+
+    AftInsertPtr insert = AftInsert::create(client.sandbox());
+
+    uint64_t allocs = benchAllocs.load();
+    auto     start  = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < numObjs; i++) {
+        w.op(client, ctx, i, insert);
+    }
+    double   buildSecs   = benchSeconds(start);
+    uint64_t buildAllocs = benchAllocs.load() - allocs;
+
+    uint64_t wire = benchWireBytes(client);
+    allocs = benchAllocs.load();
+    start  = std::chrono::steady_clock::now();
+    client.sandbox()->send(insert);
+    double   sendSecs   = benchSeconds(start);
+    uint64_t sendAllocs = benchAllocs.load() - allocs;
+    wire = benchWireBytes(client) - wire;
+
+    insert.reset();
+    benchClose(client);
+
+    if (benchOpen(client, ctx, numObjs) != 0) {
+        return -1;
+    }
+    allocs = benchAllocs.load();
+    start  = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < numObjs; i++) {
+        w.op(client, ctx, i, AftInsertPtr());
+    }
+    double   clientSecs   = benchSeconds(start);
+    uint64_t clientAllocs = benchAllocs.load() - allocs;
+    benchClose(client);
+
+    std::cout << std::setw(12) << w.name << std::setw(9) << numObjs;
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << std::setw(12) << numObjs / buildSecs;
+    std::cout << std::setprecision(1);
+    std::cout << std::setw(8) << (double)buildAllocs / numObjs;
+    std::cout << std::setprecision(0);
+    std::cout << std::setw(12) << numObjs / sendSecs;
+    std::cout << std::setprecision(1);
+    std::cout << std::setw(8) << (double)sendAllocs / numObjs;
+    std::cout << std::setw(9) << (double)wire / numObjs;
+    std::cout << std::setprecision(0);
+    std::cout << std::setw(12) << numObjs / clientSecs;
+    std::cout << std::setprecision(1);
+    std::cout << std::setw(8) << (double)clientAllocs / numObjs;
+    std::cout << std::endl;
+    return 0;
+}
+
+//
+// Control plane benchmark main
+//
+// Programs a sandbox of the local AFI server (no RPC delay) with each
+// kind of object, at sizes 1, 10, ... up to the largest. Client side
+// construction (objects, parameters, AftInsert::push) is timed apart
+// from sending the insert (local transport, model update and wire size
+// estimate); sending each object on its own is timed end to end.
+// Rates are objects per second (graphs for graph).
+//
+int
+main(int argc, char *argv[])
+{
+    uint32_t maxObjs = (argc > 1) ? std::strtoul(argv[1], NULL, 0) :
+                                    AFI_CP_BENCH_MAX_OBJS;
+
+    std::vector<std::string> workloads;
+    for (int i = 2; i < argc; i++) {
+        workloads.push_back(argv[i]);
+    }
+
+    boost::asio::io_service ioService;
+    AfiClient client(ioService, AFI_LOCAL_ADDR_PREFIX, "127.0.0.1:0", 0,
+                     false, false);
+    BenchCtx  ctx;
+
+    for (uint32_t i = 0; i < maxObjs; i++) {
+        ctx.prefixes.push_back("10." + std::to_string((i >> 16) & 0xff) +
+                               "." + std::to_string((i >> 8) & 0xff) + "." +
+                               std::to_string(i & 0xff) + "/32");
+    }
+
+    std::cout << "                          ---- Build ----";
+    std::cout << " ------------ Send -----------";
+    std::cout << " ---- Client ----" << std::endl;
+    std::cout << "    Workload  Objects       ops/s  allocs";
+    std::cout << "       ops/s  allocs  wire B";
+    std::cout << "       ops/s  allocs" << std::endl;
+
+    for (const BenchWorkload &w : benchWorkloads) {
+        bool selected = workloads.empty();
+        for (const std::string &name : workloads) {
+            selected |= (name == w.name);
+        }
+        if (!selected) {
+            continue;
+        }
+        for (uint32_t n = 1; n <= maxObjs; n *= 10) {
+            if (benchRun(client, w, ctx, n) != 0) {
+                std::cout << "Cannot open sandbox" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+//
+// HexBench.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <stdlib.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AfiHex.h"
+
+#define AFI_HEX_BENCH_PKT_LEN   1500    // Packet bytes per operation
+#define AFI_HEX_BENCH_COLS      16      // pktTrace() columns
+
+//
+// Run op for about seconds, return bytes of input per second
+//
+template <typename Op>
+static double
+benchRate (double seconds, size_t inputLen, Op op)
+{
+    auto     start = std::chrono::steady_clock::now();
+    uint64_t n     = 0;
+    double   elapsed;
+
+    do {
+        for (int i = 0; i < 1000; i++) {
+            op();
+        }
+        n += 1000;
+        elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < seconds);
+
+    return n * inputLen / elapsed;
+}
+
+//
+// Hex benchmark main
+//
+// Decodes test packet style hex strings (digits in groups of 4 with
+// spaces, and without spaces) and encodes packets in the pktTrace()
+// format with every kernel the CPU supports. Kernels are checked to
+// agree with the scalar one first.
+//
+int
+main(int argc, char *argv[])
+{
+    double seconds = (argc > 1) ? std::strtod(argv[1], NULL) : 1;
+
+    std::vector<uint8_t> pkt(AFI_HEX_BENCH_PKT_LEN);
+    for (size_t i = 0; i < pkt.size(); i++) {
+        pkt[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    std::string spaced, dense;
+    const char *digits = "0123456789abcdef";
+    for (size_t i = 0; i < pkt.size(); i++) {
+        if ((i > 0) && ((i % 2) == 0)) {
+            spaced += ' ';
+        }
+        spaced += digits[pkt[i] >> 4];
+        spaced += digits[pkt[i] & 0x0f];
+    }
+    for (char c : spaced) {
+        if (c != ' ') {
+            dense += c;
+        }
+    }
+
+    std::vector<uint8_t> bin(pkt.size());
+    std::vector<char>    hex(pkt.size() * 4 + 1);
+    std::string          reference;
+
+    std::cout << "    Kernel  Dec spaced MB/s  Dec dense MB/s    Enc MB/s";
+    std::cout << "  Enc ns/pkt" << std::endl;
+
+    for (AfiHexKernel kernel : { AfiHexScalar, AfiHexSse42, AfiHexAvx2 }) {
+        if (afiHexKernelSet(kernel) != 0) {
+            std::cout << std::setw(10) << afiHexKernelName(kernel);
+            std::cout << "  (not supported)" << std::endl;
+            continue;
+        }
+
+        //
+        // Check
+        //
+        size_t len = afiHexEncode(pkt.data(), pkt.size(), hex.data(),
+                                  hex.size(), AFI_HEX_BENCH_COLS);
+        if (reference.empty()) {
+            reference.assign(hex.data(), len);
+        }
+        if ((afiHexDecode(spaced.data(), spaced.size(), bin.data(),
+                          bin.size()) != (int)pkt.size()) ||
+            (bin != pkt) || (reference.compare(hex.data()) != 0)) {
+            std::cout << afiHexKernelName(kernel) << ": wrong result";
+            std::cout << std::endl;
+            return 1;
+        }
+
+        double decSpaced = benchRate(seconds, spaced.size(), [&] {
+            afiHexDecode(spaced.data(), spaced.size(), bin.data(),
+                         bin.size());
+        });
+        double decDense = benchRate(seconds, dense.size(), [&] {
+            afiHexDecode(dense.data(), dense.size(), bin.data(), bin.size());
+        });
+        double enc = benchRate(seconds, pkt.size(), [&] {
+            afiHexEncode(pkt.data(), pkt.size(), hex.data(), hex.size(),
+                         AFI_HEX_BENCH_COLS);
+        });
+
+        std::cout << std::setw(10) << afiHexKernelName(kernel);
+        std::cout << std::fixed << std::setprecision(0);
+        std::cout << std::setw(17) << decSpaced / 1e6;
+        std::cout << std::setw(16) << decDense / 1e6;
+        std::cout << std::setw(12) << enc / 1e6;
+        std::cout << std::setw(12) << pkt.size() / enc * 1e9 << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,603 @@
+//
+// HpBench.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "AfiClient.h"
+#include <poll.h>
+
+#define AFI_BENCH_HP_PORT       19002   // Hostpath port of benchmarked client
+#define AFI_BENCH_SENDERS       2       // Punt traffic sender threads
+#define AFI_BENCH_BATCH         64      // Datagrams per sendmmsg
+#define AFI_BENCH_SANDBOXES     4
+#define AFI_BENCH_PORTS         8
+#define AFI_BENCH_PINGS         2000    // Inject/punt round trips measured
+#define AFI_BENCH_PING_WAIT_MS  100     // Round trip considered lost
+#define AFI_BENCH_POLL_MS       10      // Stop check interval
+#define AFI_BENCH_SWEEP_PINGS   500     // Round trips measured per sweep row
+
+//
+// 64 byte IPv4/UDP frame
+//
+static char benchFrameHex[] =
+    "a224 4fce 94b4 3226 0a2e fff1 0800 4500"
+    "0032 0000 4000 4011 0000 0a00 0001 0a00"
+    "0002 3039 3039 001e 0000 0001 0203 0405"
+    "0607 0809 0a0b 0c0d 0e0f 1011 1213 1415";
+
+//
+// Sweep: frame sizes, bursts (datagrams per sendmmsg / packets per
+// injectL2Packets) and threads (punt senders and hostpath receivers)
+//
+static const int benchSweepSizes[]   = { 64, 128, 256, 512, 1024, 1500 };
+static const int benchSweepBursts[]  = { 1, 8, 64 };
+static const int benchSweepThreads[] = { 1, 2, 4 };
+
+//
+// The benchmark frame padded to frameLen bytes (64 - 1500), IPv4 and
+// UDP lengths set accordingly
+//
+static std::vector<uint8_t>
+benchFrame (int frameLen)
+{
+    std::vector<uint8_t> frame(AFI_HP_PKT_MAX);
+    int len = convertHexPktStrToPkt(benchFrameHex, (char *)frame.data(),
+                                    frame.size());
+
+    for (int i = len; i < frameLen; i++) {
+        frame[i] = (uint8_t)i;
+    }
+    frame.resize(frameLen);
+    frame[16] = (frameLen - 14) >> 8;
+    frame[17] = (frameLen - 14) & 0xff;
+    frame[38] = (frameLen - 34) >> 8;
+    frame[39] = (frameLen - 34) & 0xff;
+    return frame;
+}
+
+static double
+benchSeconds (std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// Punt traffic sender: sends datagrams in the AftPacket format the
+// sandbox punts in, round robin over sandboxes and ports, burst per
+// sendmmsg
+//
+static void
+benchSend (const uint8_t *frame, int frameLen, int burst, double seconds,
+           std::atomic<uint64_t> &sent)
+{
+    AfiPacketPool             pool(AftPacket::PacketDirTransmit,
+                                   AFI_BENCH_BATCH);
+    std::vector<AftPacketPtr> pkts;
+    struct iovec              iov[AFI_BENCH_BATCH];
+    struct mmsghdr            msgs[AFI_BENCH_BATCH];
+    struct sockaddr_in        dst;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family      = AF_INET;
+    dst.sin_port        = htons(AFI_BENCH_HP_PORT);
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((fd < 0) || (connect(fd, (struct sockaddr *)&dst, sizeof(dst)) < 0)) {
+        perror("bench socket");
+        return;
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < AFI_BENCH_BATCH; i++) {
+        pkts.push_back(pool.getTransmit(frameLen, i % AFI_BENCH_SANDBOXES,
+                                        i % AFI_BENCH_PORTS,
+                                        AftPacket::PacketTypeL2));
+        memcpy(pkts[i]->data(), frame, frameLen);
+        iov[i].iov_base = pkts[i]->header();
+        iov[i].iov_len  = pkts[i]->size();
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    auto     start = std::chrono::steady_clock::now();
+    uint64_t n     = 0;
+    while (benchSeconds(start) < seconds) {
+        int ret = sendmmsg(fd, msgs, burst, 0);
+        if (ret > 0) {
+            n += ret;
+        }
+    }
+    sent += n;
+
+    close(fd);
+}
+
+//
+// Shared memory engine's punt traffic sender: appends the same
+// AftPacket frames to the punt ring, one doorbell per burst. A full
+// ring is waited on.
+//
+static void
+benchSendShm (const uint8_t *frame, int frameLen, int burst, double seconds,
+              AfiShmChannel &chan, std::atomic<uint64_t> &sent)
+{
+    AfiPacketPool             pool(AftPacket::PacketDirTransmit,
+                                   AFI_BENCH_BATCH);
+    std::vector<AftPacketPtr> pkts;
+
+    for (int i = 0; i < AFI_BENCH_BATCH; i++) {
+        pkts.push_back(pool.getTransmit(frameLen, i % AFI_BENCH_SANDBOXES,
+                                        i % AFI_BENCH_PORTS,
+                                        AftPacket::PacketTypeL2));
+        memcpy(pkts[i]->data(), frame, frameLen);
+    }
+
+    auto     start = std::chrono::steady_clock::now();
+    uint64_t n     = 0;
+    while (benchSeconds(start) < seconds) {
+        for (int i = 0; i < burst; i++) {
+            while (!chan.send(pkts[i]->header(), pkts[i]->size())) {
+                chan.kick();
+                std::this_thread::yield();
+            }
+        }
+        chan.kick();
+        n += burst;
+    }
+    sent += n;
+}
+
+//
+// @class   BenchShmPeer
+// @brief   In-process forwarding engine end of the shared memory channel
+//
+// Hands the channel to the client connecting and drains injected
+// packets; echoing, it appends them to the punt ring as they come.
+//
+class BenchShmPeer
+{
+public:
+    BenchShmPeer() : echo(false), injected(0), _listenFd(-1), _stop(false) {
+    }
+
+    ~BenchShmPeer() {
+        _stop = true;
+        if (_listenFd >= 0) {
+            shutdown(_listenFd, SHUT_RDWR);
+        }
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        if (_listenFd >= 0) {
+            close(_listenFd);
+            unlink(_path.c_str());
+        }
+    }
+
+    int start(const std::string &path) {
+        _path     = path;
+        _listenFd = AfiShmChannel::listen(path);
+        if ((_listenFd < 0) || (chan.create() != 0)) {
+            perror(path.c_str());
+            return -1;
+        }
+        _thread = std::thread([this] { this->run(); });
+        return 0;
+    }
+
+    AfiShmChannel          chan;
+    std::atomic<bool>      echo;        //< Punt injected packets back
+    std::atomic<uint64_t>  injected;    //< Injected packets received
+
+private:
+    void run(void) {
+        int connFd = accept(_listenFd, NULL, NULL);
+        if ((connFd < 0) || (chan.handOver(connFd) != 0)) {
+            perror("bench peer");
+            return;
+        }
+
+        AfiShmRing &ring = chan.recvRing();
+        while (!_stop.load(std::memory_order_relaxed)) {
+            bool     echoing = echo.load(std::memory_order_acquire);
+            unsigned n = ring.pop([this, echoing](const uint8_t *frame,
+                                                  uint32_t       len) {
+                                      if (echoing) {
+                                          this->chan.send(frame, len);
+                                      }
+                                  }, AFI_BENCH_BATCH);
+            injected.fetch_add(n, std::memory_order_relaxed);
+            if (echoing && n) {
+                chan.kick();
+            }
+            if ((n == 0) && ring.waitArm()) {
+                struct pollfd pfd = { chan.recvFd(), POLLIN, 0 };
+                if (poll(&pfd, 1, AFI_BENCH_POLL_MS) > 0) {
+                    chan.recvAck();
+                }
+            }
+        }
+    }
+
+    std::string        _path;
+    int                _listenFd;
+    std::thread        _thread;
+    std::atomic<bool>  _stop;
+};
+
+//
+// UDP engines' peer: returns the datagrams injected to the sink
+// socket to the client's hostpath port
+//
+static void
+benchEcho (int fd, std::atomic<bool> &stop)
+{
+    struct sockaddr_in dst;
+    struct timeval     tv = { 0, AFI_BENCH_POLL_MS * 1000 };
+    uint8_t            buf[AFI_HP_PKT_MAX];
+
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family      = AF_INET;
+    dst.sin_port        = htons(AFI_BENCH_HP_PORT);
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    //
+    // Drop what the throughput run left
+    //
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        if (len > 0) {
+            sendto(fd, buf, len, 0, (struct sockaddr *)&dst, sizeof(dst));
+        }
+    }
+}
+
+//
+// Round trips of burst packets at a time: injected, returned by the
+// peer and dispatched to the punt handler. Records the time until the
+// whole burst is back.
+//
+static void
+benchRoundTrips (AfiClient &client, uint8_t *frame, int frameLen, int burst,
+                 int numPings, std::atomic<uint64_t> &punted,
+                 AfiHistogram &rtt)
+{
+    AfiL2PktVector pkts;
+    for (int i = 0; i < burst; i++) {
+        AfiL2Pkt pkt = { 0, frame, frameLen };
+        pkts.push_back(pkt);
+    }
+
+    for (int i = 0; i < numPings; i++) {
+        uint64_t before  = punted.load();
+        uint64_t startNs = afiMonotonicNs();
+        uint64_t rttNs   = 0;
+
+        int ret = (burst == 1) ?
+                  client.injectL2Packet(0, 0, frame, frameLen) :
+                  (client.injectL2Packets(0, pkts) == burst ? 0 : -1);
+        if (ret != 0) {
+            return;
+        }
+        while (rttNs < AFI_BENCH_PING_WAIT_MS * 1000000ULL) {
+            bool back = (punted.load() - before >= (uint64_t)burst);
+            rttNs = afiMonotonicNs() - startNs;
+            if (back) {
+                rtt.record(rttNs);
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+//
+// Punt traffic from numSenders threads (the shared memory ring has a
+// single producer: one) for seconds. Returns packets sent and punted
+// packets dispatched.
+//
+static void
+benchPunt (AfiHpEngine engine, BenchShmPeer &peer, const uint8_t *frame,
+           int frameLen, int burst, int numSenders, double seconds,
+           std::atomic<uint64_t> &punted, uint64_t &numSent,
+           uint64_t &numPunted)
+{
+    std::atomic<uint64_t>    sent(0);
+    uint64_t                 before = punted.load();
+    std::vector<std::thread> senders;
+
+    if (engine == AfiHpEngineShm) {
+        senders.push_back(std::thread(benchSendShm, frame, frameLen, burst,
+                                      seconds, std::ref(peer.chan),
+                                      std::ref(sent)));
+    } else {
+        for (int i = 0; i < numSenders; i++) {
+            senders.push_back(std::thread(benchSend, frame, frameLen, burst,
+                                          seconds, std::ref(sent)));
+        }
+    }
+    for (auto &t : senders) {
+        t.join();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    numSent   = sent;
+    numPunted = punted - before;
+}
+
+//
+// Inject burst packets per injectL2Packets call for seconds, every
+// other one 4 bytes shorter if mixed. Returns packets per second.
+//
+static double
+benchInject (AfiClient &client, uint8_t *frame, int frameLen, int burst,
+             bool mixed, double seconds)
+{
+    AfiL2PktVector pkts;
+    for (int i = 0; i < burst; i++) {
+        AfiL2Pkt pkt = { (AftIndex)(i % AFI_BENCH_PORTS), frame,
+                         (mixed && (i & 1)) ? frameLen - 4 : frameLen };
+        pkts.push_back(pkt);
+    }
+
+    auto     start = std::chrono::steady_clock::now();
+    uint64_t n     = 0;
+    while (benchSeconds(start) < seconds) {
+        int ret = client.injectL2Packets(0, pkts);
+        if (ret > 0) {
+            n += ret;
+        }
+    }
+    return n / benchSeconds(start);
+}
+
+//
+// Round trips through the echoing peer (UDP engines: an echo thread on
+// the sink socket)
+//
+static void
+benchEchoRoundTrips (AfiClient &client, AfiHpEngine engine,
+                     BenchShmPeer &peer, BOOST_UDP::socket &sink,
+                     uint8_t *frame, int frameLen, int burst, int numPings,
+                     std::atomic<uint64_t> &punted, AfiHistogram &rtt)
+{
+    std::atomic<bool> stop(false);
+    std::thread       echo;
+
+    if (engine == AfiHpEngineShm) {
+        peer.echo = true;
+    } else {
+        echo = std::thread(benchEcho, sink.native_handle(), std::ref(stop));
+    }
+    benchRoundTrips(client, frame, frameLen, burst, numPings, punted, rtt);
+    peer.echo = false;
+    stop = true;
+    if (echo.joinable()) {
+        echo.join();
+    }
+}
+
+//
+// Benchmark one hostpath engine: punted packets received and
+// dispatched per second, injected packets sent per second, and
+// inject to punt round trip latency through an echoing peer.
+//
+// Sweeping, each frame size and burst is a row (numHpRcvrs punt
+// senders) of rates, throughput in Gbit/s of layer 2 frames, drops
+// and round trip latency of a burst.
+//
+static int
+benchEngine (const std::string &afiServerAddr, AfiHpEngine engine,
+             int numHpRcvrs, double seconds, bool sweep)
+{
+    boost::asio::io_service io_service;
+
+    //
+    // UDP engines: injected packets go to a sink socket nobody reads
+    // until it echoes. Shared memory engine: the peer is in-process.
+    //
+    BOOST_UDP::socket sink(io_service,
+                BOOST_UDP::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    std::string sinkAddr = "127.0.0.1:" +
+                           std::to_string(sink.local_endpoint().port());
+
+    BenchShmPeer peer;
+    if (engine == AfiHpEngineShm) {
+        sinkAddr = "/tmp/afi-hp-bench." + std::to_string(getpid()) + ".sock";
+        if (peer.start(sinkAddr) != 0) {
+            return -1;
+        }
+    }
+
+    AfiClient client(io_service, afiServerAddr, sinkAddr, AFI_BENCH_HP_PORT,
+                     true, false, numHpRcvrs, engine);
+
+    std::atomic<uint64_t> punted(0);
+    client.setPuntRateLimit(AfiPuntDispatcher::AnySandbox,
+                            AfiPuntDispatcher::AnyPort, 0, 0);
+    client.puntDispatcher().registerHandler(AFI_PUNT_CLASS_IPV4, "bench",
+        [&punted](AfiPuntClass puntClass, AfiPktBatch &pkts) {
+            punted += pkts.size();
+        });
+
+    if (sweep) {
+        for (int size : benchSweepSizes) {
+            std::vector<uint8_t> frame = benchFrame(size);
+
+            for (int burst : benchSweepBursts) {
+                uint64_t     sent, numPunted;
+                AfiHistogram rtt;
+
+                benchPunt(engine, peer, frame.data(), size, burst,
+                          numHpRcvrs, seconds, punted, sent, numPunted);
+                double injPps = benchInject(client, frame.data(), size,
+                                            burst, false, seconds / 2);
+                benchEchoRoundTrips(client, engine, peer, sink, frame.data(),
+                                    size, burst, AFI_BENCH_SWEEP_PINGS,
+                                    punted, rtt);
+
+                uint64_t drops = sent - std::min(numPunted, sent);
+
+                std::cout << std::setw(10) << afiHpEngineName(engine);
+                std::cout << std::setw(4) << numHpRcvrs;
+                std::cout << std::setw(6) << size;
+                std::cout << std::setw(6) << burst;
+                std::cout << std::fixed << std::setprecision(3);
+                std::cout << std::setw(10) << sent / seconds / 1e6;
+                std::cout << std::setw(10) << numPunted / seconds / 1e6;
+                std::cout << std::setw(10) << numPunted * size * 8 /
+                                              seconds / 1e9;
+                std::cout << std::setw(10) << drops;
+                std::cout << std::setw(10) << injPps / 1e6;
+                std::cout << std::setw(10) << injPps * size * 8 / 1e9;
+                std::cout << std::setprecision(1);
+                std::cout << std::setw(9) << rtt.percentile(0.5) / 1e3;
+                std::cout << std::setw(9) << rtt.percentile(0.99) / 1e3;
+                std::cout << std::setw(9) << rtt.percentile(0.999) / 1e3;
+                std::cout << std::endl;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<uint8_t> frame = benchFrame(64);
+    int                  frameLen = frame.size();
+
+    //
+    // Receive
+    //
+    uint64_t sent, numPunted;
+    benchPunt(engine, peer, frame.data(), frameLen, AFI_BENCH_BATCH,
+              AFI_BENCH_SENDERS, seconds, punted, sent, numPunted);
+
+    double rxMpps = numPunted / seconds / 1e6;
+    double loss   = sent ? 100.0 * (sent - std::min(numPunted, sent)) /
+                           sent : 0;
+
+    //
+    // Inject: equally sized frames (GSO) and alternating sizes
+    //
+    double txMpps[2];
+    for (int mixed = 0; mixed < 2; mixed++) {
+        txMpps[mixed] = benchInject(client, frame.data(), frameLen,
+                                    AFI_BENCH_BATCH, mixed, seconds / 2) / 1e6;
+    }
+
+    //
+    // Round trips
+    //
+    AfiHistogram rtt;
+    benchEchoRoundTrips(client, engine, peer, sink, frame.data(), frameLen, 1,
+                        AFI_BENCH_PINGS, punted, rtt);
+
+    std::cout << std::setw(10) << afiHpEngineName(engine);
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(11) << sent / seconds / 1e6;
+    std::cout << std::setw(11) << rxMpps;
+    std::cout << std::setprecision(1) << std::setw(8) << loss;
+    std::cout << std::setprecision(3);
+    std::cout << std::setw(11) << txMpps[0];
+    std::cout << std::setw(11) << txMpps[1];
+    std::cout << std::setprecision(1);
+    std::cout << std::setw(9) << rtt.percentile(0.5) / 1e3;
+    std::cout << std::setw(9) << rtt.percentile(0.99) / 1e3 << std::endl;
+
+    return 0;
+}
+
+//
+// Hostpath benchmark main
+//
+// Runs the hostpath engines against loopback traffic (the shared
+// memory engine against an in-process peer), one after the other, with
+// the same punt dispatch and inject paths.
+//
+// With sweep, each engine is run with 1, 2 and 4 hostpath receivers
+// (as many punt senders) over frame sizes and bursts.
+//
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cout << std::endl;
+        std::cout << "\tUsage:" << std::endl;
+        std::cout << "\tafi-hp-bench <afi-server-address> [<seconds>";
+        std::cout << " [<num-hostpath-receivers> [<engine> ...]]]" << std::endl;
+        std::cout << "\tafi-hp-bench <afi-server-address> sweep [<seconds>";
+        std::cout << " [<engine> ...]]" << std::endl;
+        std::cout << "\t<engine> : asio, recvmmsg, io_uring or shm";
+        std::cout << " (default all)";
+        std::cout << std::endl << std::endl;
+        return 1;
+    }
+
+    std::string afiServerAddr(argv[1]);
+    bool        sweep      = (argc > 2) && (std::string(argv[2]) == "sweep");
+    int         arg        = sweep ? 3 : 2;
+    double      seconds    = (argc > arg) ? std::strtod(argv[arg], NULL) :
+                                            (sweep ? 0.5 : 5);
+    int         numHpRcvrs = 2;
+
+    arg++;
+    if (!sweep) {
+        numHpRcvrs = (argc > arg) ? std::strtoul(argv[arg], NULL, 0) : 2;
+        arg++;
+    }
+
+    std::vector<AfiHpEngine> engines;
+    for (int i = arg; i < argc; i++) {
+        AfiHpEngine engine;
+        if (afiHpEngineParse(argv[i], engine) != 0) {
+            std::cout << "Unknown engine " << argv[i] << std::endl;
+            return 1;
+        }
+        engines.push_back(engine);
+    }
+    if (engines.empty()) {
+        engines = { AfiHpEngineAsio, AfiHpEngineRecvmmsg, AfiHpEngineUring,
+                    AfiHpEngineShm };
+    }
+
+    if (sweep) {
+        std::cout << "    Engine Thr  Size Burst Sent Mpps Punt Mpps";
+        std::cout << " Punt Gbps     Drops  Inj Mpps  Inj Gbps";
+        std::cout << "  Lat p50  Lat p99 p99.9 (us)" << std::endl;
+
+        for (AfiHpEngine engine : engines) {
+            for (int threads : benchSweepThreads) {
+                benchEngine(afiServerAddr, engine, threads, seconds, true);
+            }
+        }
+        return 0;
+    }
+
+    std::cout << "    Engine  Sent Mpps  Punt Mpps  Loss %";
+    std::cout << "   Inj Mpps InjMix Mpps  RTT p50  RTT p99 (us)" << std::endl;
+
+    for (AfiHpEngine engine : engines) {
+        benchEngine(afiServerAddr, engine, numHpRcvrs, seconds, false);
+    }
+
+    return 0;
+}
@@ -30,15 +30,27 @@ displayUsage (void)
     std::cout << std::endl;
     std::cout << "\tUsage:"                                      << std::endl;
     std::cout << "\tafi-client <afi-server-address> <afi-hospath-address>";
+    std::cout << " [<num-hostpath-receivers> [<hostpath-engine>]]";
     std::cout << std::endl;
     std::cout << "\t<afi-server-address>  : "                    << std::endl;
     std::cout << "\t    Address where AFI server is listening "  << std::endl;
-    std::cout << "\t    for connection from AFI client/s"        << std::endl;
+    std::cout << "\t    for connection from AFI client/s,"       << std::endl;
+    std::cout << "\t    local[:<latency-us>[:<jitter-us>]] for the" << std::endl;
+    std::cout << "\t    in-process stand-in (offline runs)"      << std::endl;
     std::cout << "\t<afi-hospath-address> : "                    << std::endl;
-    std::cout << "\t    Address (UDP server) to send hostpath packets";
+    std::cout << "\t    Address (UDP server) to send hostpath packets,";
     std::cout << std::endl;
+    std::cout << "\t    shm engine: Unix socket of the hostpath peer";
+    std::cout << " (afi-hp-shm-bridge)" << std::endl;
+    std::cout << "\t<num-hostpath-receivers> : "                << std::endl;
+    std::cout << "\t    Hostpath receiver threads (default 1)"   << std::endl;
+    std::cout << "\t<hostpath-engine> : "                       << std::endl;
+    std::cout << "\t    asio (default), recvmmsg, io_uring or shm" << std::endl;
     std::cout << "\tExamples:"                                   << std::endl;
     std::cout << "\tafi-client 128.0.0.16:50051 128.0.0.16:9002" << std::endl;
+    std::cout << "\tafi-client 128.0.0.16:50051 /tmp/afi-hp.sock 1 shm";
+    std::cout << std::endl;
+    std::cout << "\tafi-client local:200:50 127.0.0.1:9002"     << std::endl;
     std::cout << std::endl;
 }
 
@@ -48,12 +60,23 @@ displayUsage (void)
 int 
 main(int argc, char *argv[])
 {
-    if (argc != 3) {
+    if ((argc < 3) || (argc > 5)) {
         displayUsage();
         exit(1);
     }
     std::string afiServerAddr(argv[1]);
     std::string afiHostpathAddr(argv[2]);
+    AfiLocalDelay localDelay;
+    if (AfiLocalServer::parseAddr(afiServerAddr, localDelay) < 0) {
+        displayUsage();
+        exit(1);
+    }
+    int numHpRcvrs = (argc >= 4) ? std::strtoul(argv[3], NULL, 0) : 1;
+    AfiHpEngine hpEngine = AfiHpEngineAsio;
+    if ((argc == 5) && (afiHpEngineParse(argv[4], hpEngine) != 0)) {
+        displayUsage();
+        exit(1);
+    }
 
     boost::asio::io_service io_service;
 
@@ -62,7 +85,9 @@ main(int argc, char *argv[])
                         afiHostpathAddr,          // AFI hostpath address
                         AFT_CLIENT_HOSTPATH_PORT, // jnx/AftPacket.h
                         true,                     // start hostpath server 
-                        false);                   // tracing
+                        false,                    // tracing
+                        numHpRcvrs,               // hostpath receivers
+                        hpEngine);                // hostpath I/O engine
 
     //
     // Start this AFI client's 
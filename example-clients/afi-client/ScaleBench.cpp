@@ -0,0 +1,340 @@
+//
+// ScaleBench.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "AfiClient.h"
+
+#define AFI_SCALE_NUM_CFG_PORTS 8
+#define AFI_SCALE_ROUTES        1000000 // Routes installed (default)
+#define AFI_SCALE_NEXT_HOPS     64      // Shared next hops (default)
+#define AFI_SCALE_BATCH         1000    // Routes per insert / remove
+#define AFI_SCALE_CHURN         10      // One route in this many churns
+#define AFI_SCALE_SB_NAME       "scale"
+#define AFI_SCALE_RESULTS       "afi-scale-bench.csv"
+
+//
+// Heap accounting: operator new calls, bytes allocated and bytes live
+// (as malloc_usable_size() counts them). Not counted while a thread
+// runs the local server (scaleUncounted).
+//
+static std::atomic<uint64_t> scaleAllocs(0);
+static std::atomic<uint64_t> scaleAllocBytes(0);
+static std::atomic<int64_t>  scaleLiveBytes(0);
+static thread_local bool     scaleUncounted = false;
+
+void *
+operator new (size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    if (!scaleUncounted) {
+        size_t usable = malloc_usable_size(p);
+        scaleAllocs.fetch_add(1, std::memory_order_relaxed);
+        scaleAllocBytes.fetch_add(usable, std::memory_order_relaxed);
+        scaleLiveBytes.fetch_add(usable, std::memory_order_relaxed);
+    }
+    return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+    if (p != NULL) {
+        if (!scaleUncounted) {
+            scaleLiveBytes.fetch_sub(malloc_usable_size(p),
+                                     std::memory_order_relaxed);
+        }
+        free(p);
+    }
+}
+
+//
+// Process memory: resident set size now and at its peak (bytes)
+//
+static uint64_t
+scaleRss (void)
+{
+    long  size, pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &size, &pages) != 2) {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return (uint64_t)pages * sysconf(_SC_PAGESIZE);
+}
+
+static uint64_t
+scalePeakRss (void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+//
+// Counters at the start of a phase
+//
+struct ScaleMark {
+    std::chrono::steady_clock::time_point   start;
+    uint64_t                                allocs;
+    uint64_t                                allocBytes;
+    int64_t                                 liveBytes;
+
+    ScaleMark() : start(std::chrono::steady_clock::now()),
+                  allocs(scaleAllocs.load()),
+                  allocBytes(scaleAllocBytes.load()),
+                  liveBytes(scaleLiveBytes.load()) {
+    }
+};
+
+//
+// One phase's results. Built bytes are those of the objects of the
+// inserts (removes) when built, before they are sent; retained bytes
+// are live heap bytes added by the phase, once all was sent. All are
+// the client's: the local server keeps no model and what it allocates
+// applying a send is not counted.
+//
+struct ScaleResult {
+    std::string phase;
+    uint64_t    routes;
+    double      seconds;
+    uint64_t    allocs;
+    uint64_t    allocBytes;
+    int64_t     builtBytes;
+    int64_t     retainedBytes;
+    uint64_t    rss;
+    uint64_t    peakRss;
+};
+
+//
+// Send an insert or remove. The local server applies it on the calling
+// thread, with heap accounting off.
+//
+template <typename Msg>
+static void
+scaleSend (AfiClient &client, const Msg &msg)
+{
+    scaleUncounted = (client.localServer() != nullptr);
+    client.sandbox()->send(msg);
+    scaleUncounted = false;
+}
+
+//
+// Install (or remove) the routes with index i where i % step == 0, in
+// batches, to next hop (i + shift) % number of next hops
+//
+static ScaleResult
+scaleRun (AfiClient &client, const std::string &phase, bool remove,
+          AftNodeToken rtt, const std::vector<std::string> &prefixes,
+          const std::vector<AftNodeToken> &nextHops, uint32_t step,
+          uint32_t shift)
+{
+    ScaleMark    mark;
+    ScaleResult  res;
+    int64_t      built = 0;
+    AftInsertPtr insert;
+    AftRemovePtr removes;
+    uint32_t     inBatch = 0;
+
+    res.phase  = phase;
+    res.routes = 0;
+
+    for (uint32_t i = 0; i < prefixes.size(); i += step) {
+        int64_t before = scaleLiveBytes.load();
+
+        if (remove) {
+            if (!removes) {
+                removes = AftRemove::create();
+            }
+            client.removeRoute(rtt, prefixes[i], removes);
+        } else {
+            if (!insert) {
+                insert = AftInsert::create(client.sandbox());
+            }
+            client.addRoute(rtt, prefixes[i],
+                            nextHops[(i + shift) % nextHops.size()], insert);
+        }
+        built += scaleLiveBytes.load() - before;
+        res.routes++;
+
+        if ((++inBatch == AFI_SCALE_BATCH) ||
+            (i + step >= prefixes.size())) {
+            if (remove) {
+                scaleSend(client, removes);
+                removes.reset();
+            } else {
+                scaleSend(client, insert);
+                insert.reset();
+            }
+            inBatch = 0;
+        }
+    }
+
+    res.seconds       = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() -
+                            mark.start).count();
+    res.allocs        = scaleAllocs.load() - mark.allocs;
+    res.allocBytes    = scaleAllocBytes.load() - mark.allocBytes;
+    res.builtBytes    = built;
+    res.retainedBytes = scaleLiveBytes.load() - mark.liveBytes;
+    res.rss           = scaleRss();
+    res.peakRss       = scalePeakRss();
+    return res;
+}
+
+static void
+scalePrint (const ScaleResult &res)
+{
+    uint64_t routes = res.routes ? res.routes : 1;
+
+    std::cout << std::setw(10) << res.phase << std::setw(9) << res.routes;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(9) << res.seconds;
+    std::cout << std::setprecision(0);
+    std::cout << std::setw(11) << res.routes / res.seconds;
+    std::cout << std::setprecision(1);
+    std::cout << std::setw(9) << (double)res.allocs / routes;
+    std::cout << std::setw(10) << (double)res.builtBytes / routes;
+    std::cout << std::setw(10) << (double)res.retainedBytes / routes;
+    std::cout << std::setprecision(0);
+    std::cout << std::setw(9) << res.rss / 1e6;
+    std::cout << std::setw(9) << res.peakRss / 1e6 << std::endl;
+}
+
+//
+// Route scale main
+//
+// Installs routes (distinct /24s from 1.0.0.0) to shared next hops,
+// ethernet encaps to a port, into a routing table in batches; then
+// churns one route in AFI_SCALE_CHURN: withdraws them and installs
+// them again to other next hops. Per phase, client side wall time,
+// allocations, heap bytes per route and RSS are printed and written to
+// a CSV file. Allocations and heap bytes are the client's only; RSS is
+// the process's, with the local server in it.
+//
+// Routes are IPv4 only: addRoute() keys on packet.ip4.daddr.
+//
+int
+main(int argc, char *argv[])
+{
+    if ((argc > 1) && (argv[1][0] == '-')) {
+        std::cout << std::endl;
+        std::cout << "\tUsage:" << std::endl;
+        std::cout << "\tafi-scale-bench [<afi-server-address> [<num-routes>";
+        std::cout << " [<num-next-hops> [<results-file>]]]]" << std::endl;
+        std::cout << "\t<afi-server-address> : default " AFI_LOCAL_ADDR_PREFIX;
+        std::cout << ", sandbox " AFI_SCALE_SB_NAME << std::endl;
+        std::cout << std::endl;
+        return 1;
+    }
+
+    std::string afiServerAddr = (argc > 1) ? argv[1] : AFI_LOCAL_ADDR_PREFIX;
+    uint32_t    numRoutes     = (argc > 2) ? std::strtoul(argv[2], NULL, 0) :
+                                             AFI_SCALE_ROUTES;
+    uint32_t    numNextHops   = (argc > 3) ? std::strtoul(argv[3], NULL, 0) :
+                                             AFI_SCALE_NEXT_HOPS;
+    std::string resultsFile   = (argc > 4) ? argv[4] : AFI_SCALE_RESULTS;
+
+    if ((numRoutes == 0) || (numRoutes > (223u << 16)) ||
+        (numNextHops == 0)) {
+        std::cout << "Invalid number of routes or next hops" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> prefixes;
+    prefixes.reserve(numRoutes);
+    for (uint32_t i = 0; i < numRoutes; i++) {
+        prefixes.push_back(std::to_string(1 + (i >> 16)) + "." +
+                           std::to_string((i >> 8) & 0xff) + "." +
+                           std::to_string(i & 0xff) + ".0/24");
+    }
+
+    boost::asio::io_service ioService;
+    AfiClient client(ioService, afiServerAddr, "127.0.0.1:0", 0, false, false);
+
+    if (client.openSandbox(AFI_SCALE_SB_NAME, AFI_SCALE_NUM_CFG_PORTS) != 0) {
+        return 1;
+    }
+    if (client.localServer()) {
+        client.localServer()->setKeepModel(false);
+    }
+
+    std::vector<AftNodeToken> nextHops;
+    for (uint32_t i = 0; i < numNextHops; i++) {
+        char smac[32];
+        snprintf(smac, sizeof(smac), "32:26:0a:2e:%02x:%02x",
+                 (i >> 8) & 0xff, i & 0xff);
+        nextHops.push_back(client.addEtherEncapNode("32:26:0a:2e:cc:f1", smac,
+                               "0", "0",
+                               client.getOuputPortToken(
+                                        i % AFI_SCALE_NUM_CFG_PORTS)));
+    }
+    AftNodeToken rtt = client.addRouteTable("rtt0", AFT_NODE_TOKEN_DISCARD);
+
+    std::ofstream results(resultsFile);
+    if (!results) {
+        std::cout << "Cannot open " << resultsFile << std::endl;
+        return 1;
+    }
+    results << "phase,routes,seconds,routes_per_sec,allocs,alloc_bytes,"
+               "built_bytes,retained_bytes,rss_bytes,peak_rss_bytes"
+            << std::endl;
+
+    std::cout << "     Phase   Routes  Seconds   Routes/s  Allocs/r";
+    std::cout << "  Built B/r Retain B/r  RSS MB  Peak MB" << std::endl;
+
+    std::vector<ScaleResult> phases;
+    phases.push_back(scaleRun(client, "install", false, rtt, prefixes,
+                              nextHops, 1, 0));
+    phases.push_back(scaleRun(client, "withdraw", true, rtt, prefixes,
+                              nextHops, AFI_SCALE_CHURN, 0));
+    phases.push_back(scaleRun(client, "reinstall", false, rtt, prefixes,
+                              nextHops, AFI_SCALE_CHURN, 1));
+
+    for (const ScaleResult &res : phases) {
+        scalePrint(res);
+        results << res.phase << "," << res.routes << "," << res.seconds << ","
+                << res.routes / res.seconds << "," << res.allocs << ","
+                << res.allocBytes << "," << res.builtBytes << ","
+                << res.retainedBytes << "," << res.rss << "," << res.peakRss
+                << std::endl;
+    }
+
+    std::cout << "Results written to " << resultsFile << std::endl;
+    return 0;
+}
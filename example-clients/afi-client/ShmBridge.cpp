@@ -0,0 +1,274 @@
+//
+// ShmBridge.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "jnx/Aft.h"
+#include "AfiShmChannel.h"
+
+#define AFI_BRIDGE_BATCH        64      // Datagrams per recvmmsg/sendmmsg
+#define AFI_BRIDGE_POLL_MS      100     // Stop check interval
+#define AFI_BRIDGE_RCVBUF_SIZE  (8 * 1024 * 1024)
+
+//
+// Bridge statistics, per client
+//
+struct BridgeStats {
+    BridgeStats() : punts(0), puntDrops(0), injects(0), injectErrors(0) {
+    }
+
+    std::atomic<uint64_t>  punts;           //< UDP to channel
+    std::atomic<uint64_t>  puntDrops;       //< Channel full
+    std::atomic<uint64_t>  injects;         //< Channel to UDP
+    std::atomic<uint64_t>  injectErrors;    //< sendmmsg failed
+};
+
+//
+// Punts: hostpath datagrams from the sandbox to the punt ring,
+// one doorbell per batch
+//
+static void
+bridgePunts (int udpFd, AfiShmChannel &chan, std::atomic<bool> &stop,
+             BridgeStats &stats)
+{
+    static uint8_t  bufs[AFI_BRIDGE_BATCH][AFI_SHM_FRAME_MAX];
+    struct iovec    iov[AFI_BRIDGE_BATCH];
+    struct mmsghdr  msgs[AFI_BRIDGE_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < AFI_BRIDGE_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len  = sizeof(bufs[i]);
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        int n = recvmmsg(udpFd, msgs, AFI_BRIDGE_BATCH, MSG_WAITFORONE, NULL);
+        if (n <= 0) {
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            if (chan.send(bufs[i], msgs[i].msg_len)) {
+                stats.punts++;
+            } else {
+                stats.puntDrops++;
+            }
+        }
+        chan.kick();
+    }
+}
+
+//
+// Injects: frames of the inject ring to the sandbox's hostpath address
+// until the client goes away
+//
+static void
+bridgeInjects (int udpFd, AfiShmChannel &chan, BridgeStats &stats)
+{
+    static uint8_t  bufs[AFI_BRIDGE_BATCH][AFI_SHM_FRAME_MAX];
+    struct iovec    iov[AFI_BRIDGE_BATCH];
+    struct mmsghdr  msgs[AFI_BRIDGE_BATCH];
+    AfiShmRing     &ring = chan.recvRing();
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < AFI_BRIDGE_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    for (;;) {
+        int n = 0;
+        ring.pop([&n, &iov](const uint8_t *frame, uint32_t len) {
+                     memcpy(iov[n].iov_base, frame, len);
+                     iov[n++].iov_len = len;
+                 }, AFI_BRIDGE_BATCH);
+
+        for (int sent = 0; sent < n; ) {
+            int ret = sendmmsg(udpFd, &msgs[sent], n - sent, 0);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                stats.injectErrors += n - sent;
+                break;
+            }
+            sent += ret;
+            stats.injects += ret;
+        }
+
+        if ((n == AFI_BRIDGE_BATCH) || !ring.waitArm()) {
+            continue;
+        }
+
+        struct pollfd pfds[2] = { { chan.recvFd(), POLLIN, 0 },
+                                  { chan.connFd(), POLLIN, 0 } };
+        if ((poll(pfds, 2, -1) < 0) && (errno != EINTR)) {
+            perror("poll");
+            return;
+        }
+        if (pfds[0].revents) {
+            chan.recvAck();
+        }
+        if (pfds[1].revents) {
+            //
+            // The client sends nothing on the socket: readable is closed
+            //
+            return;
+        }
+    }
+}
+
+//
+// Usage
+//
+static void
+displayUsage (void)
+{
+    std::cout << std::endl;
+    std::cout << "\tUsage:" << std::endl;
+    std::cout << "\tafi-hp-shm-bridge <socket-path> <afi-hospath-address>";
+    std::cout << " [<hostpath-port>]" << std::endl;
+    std::cout << "\t<socket-path> : " << std::endl;
+    std::cout << "\t    Unix socket afi-client connects to with the shm";
+    std::cout << " hostpath engine" << std::endl;
+    std::cout << "\t<afi-hospath-address> : " << std::endl;
+    std::cout << "\t    Address (UDP server) to send hostpath packets";
+    std::cout << std::endl;
+    std::cout << "\t<hostpath-port> : " << std::endl;
+    std::cout << "\t    UDP port punted packets are received on (default ";
+    std::cout << AFT_CLIENT_HOSTPATH_PORT << ")" << std::endl;
+    std::cout << "\tExamples:" << std::endl;
+    std::cout << "\tafi-hp-shm-bridge /tmp/afi-hp.sock 128.0.0.16:9002";
+    std::cout << std::endl;
+    std::cout << "\tafi-client 128.0.0.16:50051 /tmp/afi-hp.sock 1 shm";
+    std::cout << std::endl << std::endl;
+}
+
+//
+// Shared memory hostpath bridge main
+//
+// Stands in for a forwarding engine co-located with afi-client: hands
+// a shared memory hostpath channel to each client connecting (one at
+// a time) and carries its packets over the hostpath UDP protocol.
+//
+int
+main(int argc, char *argv[])
+{
+    if ((argc < 3) || (argc > 4)) {
+        displayUsage();
+        return 1;
+    }
+
+    std::string sockPath(argv[1]);
+    std::string hpAddr(argv[2]);
+    int         port = (argc > 3) ? std::strtoul(argv[3], NULL, 0) :
+                                    AFT_CLIENT_HOSTPATH_PORT;
+
+    std::string::size_type colon = hpAddr.rfind(':');
+    struct addrinfo        hints, *dst;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if ((colon == std::string::npos) ||
+        (getaddrinfo(hpAddr.substr(0, colon).c_str(),
+                     hpAddr.substr(colon + 1).c_str(), &hints, &dst) != 0)) {
+        std::cout << "Invalid hostpath address " << hpAddr << std::endl;
+        return 1;
+    }
+
+    //
+    // Punts arrive on the hostpath port, injects leave to the sandbox
+    //
+    struct sockaddr_in local;
+    struct timeval     tv = { 0, AFI_BRIDGE_POLL_MS * 1000 };
+    int                rcvbuf = AFI_BRIDGE_RCVBUF_SIZE;
+
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port   = htons(port);
+
+    int udpFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if ((udpFd < 0) ||
+        (bind(udpFd, (struct sockaddr *)&local, sizeof(local)) < 0) ||
+        (connect(udpFd, dst->ai_addr, dst->ai_addrlen) < 0)) {
+        perror("hostpath socket");
+        return 1;
+    }
+    freeaddrinfo(dst);
+    setsockopt(udpFd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(udpFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    int listenFd = AfiShmChannel::listen(sockPath);
+    if (listenFd < 0) {
+        perror(sockPath.c_str());
+        return 1;
+    }
+
+    for (;;) {
+        int connFd = accept(listenFd, NULL, NULL);
+        if (connFd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            return 1;
+        }
+
+        AfiShmChannel chan;
+        if ((chan.create() != 0) || (chan.handOver(connFd) != 0)) {
+            close(connFd);
+            continue;
+        }
+        std::cout << "Client connected" << std::endl;
+
+        BridgeStats       stats;
+        std::atomic<bool> stop(false);
+        std::thread       punts(bridgePunts, udpFd, std::ref(chan),
+                                std::ref(stop), std::ref(stats));
+
+        bridgeInjects(udpFd, chan, stats);
+
+        stop = true;
+        punts.join();
+
+        std::cout << "Client disconnected: punts " << stats.punts;
+        std::cout << " (dropped " << stats.puntDrops << "), injects ";
+        std::cout << stats.injects << " (failed " << stats.injectErrors;
+        std::cout << ")" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+//
+// TraceDecode.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <iostream>
+#include "AfiTrace.h"
+
+//
+// AFI trace decoder main
+//
+// Renders a binary trace file written by the AFI client
+// ('trace-dump' CLI command) in text format.
+//
+int
+main(int argc, char *argv[])
+{
+    std::vector<AfiTraceRecord> records;
+    AfiTraceClock               clock;
+
+    if (argc != 2) {
+        std::cout << std::endl;
+        std::cout << "\tUsage:" << std::endl;
+        std::cout << "\tafi-trace-decode <trace-file>" << std::endl;
+        std::cout << std::endl;
+        return 1;
+    }
+
+    if (afiTraceLoad(argv[1], records, clock) != 0) {
+        return 1;
+    }
+
+    afiTraceRender(records, clock, std::cout);
+    return 0;
+}
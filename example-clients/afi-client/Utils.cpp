@@ -26,6 +26,9 @@
 #include <stdio.h>
 #include <string>
 #include <unistd.h>
+#include <ctype.h>
+#include <string.h>
+#include "AfiHex.h"
 #include "Utils.h"
 
 //
@@ -33,7 +36,7 @@
 // getHex
 //
 // @brief
-// Converts a char into bunary string
+// Converts a buffer into hex string ("%02X " per byte)
 //
 // @param[in]
 //     buf Value to be converted to hex string
@@ -57,65 +60,53 @@ getHex (char *buf,
         int hex_len, 
         int num_col)
 {
-    int i;
-#define ONE_BYTE_HEX_STRING_SIZE   3
-  unsigned int byte_no = 0;
-
-  if (buf_len <= 0) {
-      if (hex_len > 0) {
-        hex_[0] = '\0';
-      }
-      return;
-  }
-
-  if(hex_len < ONE_BYTE_HEX_STRING_SIZE + 1)
-  {
-      return;
-  }
-
-  do {
-         for (i = 0; ((i < num_col) && (buf_len > 0) && (hex_len > 0)); ++i )
-         {
-            snprintf(hex_, hex_len, "%02X ", buf[byte_no++] & 0xff);
-            hex_ += ONE_BYTE_HEX_STRING_SIZE;
-            hex_len -=ONE_BYTE_HEX_STRING_SIZE;
-            buf_len--;
-         }
-         if (buf_len > 1)
-         {
-             snprintf(hex_, hex_len, "\n");
-             hex_ += 1;
-         }
-  } while ((buf_len) > 0 && (hex_len > 0));
+    if (hex_len <= 0) {
+        return;
+    }
 
+    afiHexEncode((const uint8_t *)buf, (buf_len > 0) ? buf_len : 0,
+                 hex_, hex_len, num_col);
 }
 
 //
 // @fn
-// convertCharToInt
+// hexDecode
 //
 // @brief
-// Converts a char to integer
+// Decodes hex string, reporting invalid strings
 //
 // @param[in]
-//     input_char Character to be converted to integer
-// @return  integer corresponding to the input character
+//     source Hex String
+// @param[Out]
+//     target_buff Target buffer where binary string will be stored
+// @param[in]
+//     target_buff_len Target buffer length
+// @return  Number of bytes in output binary string, -1 - Error
 //
 
 static int
-convertCharToInt (char input_char)
+hexDecode (const char* source, 
+           char* target_buff, 
+           int   target_buff_len)
 {
-  if(input_char >= '0' && input_char <= '9') {
-    return input_char - '0';
-  }
-  if(input_char >= 'A' && input_char <= 'F') {
-    return input_char - 'A' + 10;
-  }
-  if(input_char >= 'a' && input_char <= 'f') {
-    return input_char - 'a' + 10;
-  }
-  std::cout<<"Error: Invalid "<< input_char <<std::endl;
-  return 0;
+    size_t len = strlen(source);
+    size_t errPos;
+
+    int num_bytes = afiHexDecode(source, len, (uint8_t *)target_buff,
+                                 (target_buff_len > 0) ? target_buff_len : 0,
+                                 &errPos);
+    if (num_bytes < 0) {
+        if (errPos == len) {
+            std::cout << "Error: Odd number of hex digits" << std::endl;
+        } else if (!isxdigit((unsigned char)source[errPos])) {
+            std::cout << "Error: Invalid hex character '" << source[errPos];
+            std::cout << "' at offset " << errPos << std::endl;
+        } else {
+            std::cout << "Error: Hex string exceeds " << target_buff_len;
+            std::cout << " bytes at offset " << errPos << std::endl;
+        }
+    }
+    return num_bytes;
 }
 
 //
@@ -126,12 +117,13 @@ convertCharToInt (char input_char)
 // Converts hex string to corresponding binary string
 //
 // @param[in]
-//     source Hex String - Null terminated with even nuber of [0-9a-f] characters
+//     source Hex String - Null terminated with even number of [0-9a-fA-F]
+//            characters, white space is skipped
 // @param[Out]
 //     target_buff Target buffer where binary string will be stored
 // @param[in]
 //     target_buff_len Target buffer length
-// @return  Nunber of bytes in output binary string 
+// @return  Number of bytes in output binary string, -1 - Error
 //
 
 int
@@ -139,18 +131,7 @@ convertHexStringToBinary (const char* source,
                           char* target_buff, 
                           int   target_buff_len)
 {
-  int num_bytes = 0;
-  while(*source && source[1])
-  {
-    if (num_bytes >= target_buff_len) {
-        return -1;
-    }
-
-    *(target_buff++) = convertCharToInt(*source)*16 + convertCharToInt(source[1]);
-    source += 2;
-    num_bytes++;
-  }
-  return num_bytes;
+    return hexDecode(source, target_buff, target_buff_len);
 }
 
 //
@@ -186,8 +167,8 @@ getRidOfSpacesFromString (char* source)
 //
 // @brief
 // Coverts packet hex string to binary packet.
-// Any spaces present in packet hex string will be
-// removed before converting to binary packet.
+// Spaces present in packet hex string are skipped
+// while it is converted, in one pass.
 //
 // @param[in]
 //     hex_pkt_str Packet Hex String - 
@@ -195,7 +176,7 @@ getRidOfSpacesFromString (char* source)
 //     pkt_buff Target packet buffer where binary will be stored
 // @param[in]
 //     pkt_buff_len Target packet buffer length
-// @return  Packet length
+// @return  Packet length, -1 - Error
 //
 
 int
@@ -203,10 +184,7 @@ convertHexPktStrToPkt (char* hex_pkt_str,
                        char* pkt_buff, 
                        int   pkt_buff_len)
 {
-    int pkt_len;
-    getRidOfSpacesFromString(hex_pkt_str);
-    pkt_len = convertHexStringToBinary(hex_pkt_str, pkt_buff, pkt_buff_len);
-    return pkt_len;
+    return hexDecode(hex_pkt_str, pkt_buff, pkt_buff_len);
 }
 
 //
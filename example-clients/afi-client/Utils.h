@@ -22,6 +22,8 @@
 #ifndef __Utils__
 #define __Utils__
 
+#include <stdint.h>
+#include <time.h>
 #include <string>
 #include <boost/atomic.hpp>
 
@@ -45,6 +47,18 @@ public:
   }
 };
 
+//
+// CLOCK_REALTIME in nanoseconds, the clock of SO_TIMESTAMPNS
+//
+static inline uint64_t
+afiRealtimeNs (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void getHex(char *buf, int buf_len, char *hex_, int hex_len, int num_col);
 int convertHexStringToBinary(const char* source, 
                              char* target_buff, 
                              int   target_buff_len);
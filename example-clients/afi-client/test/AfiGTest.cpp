@@ -25,9 +25,20 @@
 #include "TestPacket.h"
 #include "TestUtils.h"
 #include "TapIf.h"
+#include "TestCapture.h"
+#include "TestSandbox.h"
+#include "TestPktBuilder.h"
+#include "../AfiPktTemplate.h"
+#include "../AfiPktDissector.h"
+#include "../AfiHex.h"
+#include "../Utils.h"
+#include "../AfiPacketPool.h"
+#include "../AfiPuntDispatcher.h"
 #include "../AfiClient.h"
+#include "../AfiDataplane.h"
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <ctime>
 
 //
@@ -85,36 +96,55 @@
 // Sandbox CLI configuration
 // =========================
 //
-// root@vcp-vm# show forwarding-options forwarding-sandbox green
-// size medium;
-// port p0 {
-//     interface ge-0/0/0;
-// }
-// port p1 {
-//     interface ge-0/0/1;
-// }
-// port p2 {
-//     interface ge-0/0/2;
-// }
-// port p3 {
-//     interface ge-0/0/3;
-// }
-// port p4 {
-//     interface ge-0/0/4;
+// Sandboxes own disjoint sets of ports (tools/docker/cfg/junos_config.txt)
+//
+// root@vcp-vm# show forwarding-options forwarding-sandbox
+// green {
+//     size medium;
+//     port p0 {
+//         interface ge-0/0/0;
+//     }
+//     port p1 {
+//         interface ge-0/0/1;
+//     }
 // }
-// port p5 {
-//     interface ge-0/0/5;
+// routing {
+//     size small;
+//     port p0 {
+//         interface ge-0/0/2;
+//     }
+//     port p1 {
+//         interface ge-0/0/3;
+//     }
 // }
-// port p6 {
-//     interface ge-0/0/6;
+// l2vpn {
+//     size small;
+//     port p0 {
+//         interface ge-0/0/4;
+//     }
+//     port p1 {
+//         interface ge-0/0/5;
+//     }
 // }
-// port p7 {
-//     interface ge-0/0/7;
+// spare {
+//     size small;
+//     port p0 {
+//         interface ge-0/0/6;
+//     }
+//     port p1 {
+//         interface ge-0/0/7;
+//     }
 // }
 //
 // [edit]
 // root@vcp-vm#
 //
+// Each test runs in the sandbox that has the ports it uses (tSandboxes
+// below). Tests in different sandboxes run concurrently
+// (run-afi-gtest), those sharing one wait for each other; each moves
+// the vmx_linkN and tapN interfaces of its ports into a network
+// namespace of its own while it runs (TestSandbox).
+//
 // root@de5cf35cd169:~# ifconfig | grep tap
 // tap0      Link encap:Ethernet  HWaddr 32:26:0a:2e:cc:f0
 // tap1      Link encap:Ethernet  HWaddr 32:26:0a:2e:cc:f1
@@ -144,7 +174,7 @@ const std::string afiHospathAddr  = "128.0.0.16:9002";  // udp
 const std::string sbName          = "green";
 const std::string sbIPv4RttName   = "rtt0";
 
-#define SB_INDEX               1
+#define TAP_READ_POLL_MS       100     // Tap reader stop check interval
 
 #define SB_P0_PORT_INDEX       0
 #define SB_P1_PORT_INDEX       1
@@ -155,8 +185,24 @@ const std::string sbIPv4RttName   = "rtt0";
 #define SB_P6_PORT_INDEX       6
 #define SB_P7_PORT_INDEX       7
 
-#define SB_NUM_CFG_PORTS       8
-#define SB_PUNT_PORT_INDEX     SB_NUM_CFG_PORTS
+
+//
+// Test sandboxes: sandbox, its ports in sandbox port index order (the
+// punt port follows), and whether the client hostpath port is used.
+// The hostpath sandbox index is learnt at run time (sandboxIndex()).
+//
+const std::vector<TestSandboxConfig> tSandboxes = {
+    { "SandboxOpen",          "spare",       { 6, 7 },      false },
+    { "CounterNode",          "green",       { 0, 1 },      false },
+    { "DisacrdNode",          "green",       { 0, 1 },      false },
+    { "SandboxHostpathPunt",  "green",       { 0, 1 },      true  },
+    { "SandboxL2Inject",      "green",       { 0, 1 },      true  },
+    { "IPv4Routing",          "routing",     { 2, 3 },      false },
+    { "MPLS_L2VPN_Encap",     "l2vpn",       { 4, 5 },      false },
+    { "MPLS_L2VPN_Decap",     "l2vpn",       { 4, 5 },      false },
+};
+
+typedef TestSandbox AFI;
 
 //
 //                  |
@@ -249,64 +295,47 @@ const std::string TAP5_IP_ADDR_STR = "103.30.50.3";
 const std::string TAP6_IP_ADDR_STR = "103.30.60.3";
 const std::string TAP7_IP_ADDR_STR = "103.30.70.3";
 
-AfiClient *aficlient;
 std::string gTestTimeStr;
 std::string gtestOutputDirName;
 std::string gtestExpectedDirName = "GTEST_EXPECTED";
-std::string tsharkBinary = "/usr/bin/tshark"; 
 std::atomic<bool> test_complete(false);
+std::atomic<bool> tap_ready(false);
+
+//
+// In-process capture of the interfaces a test checks, and the packets
+// expected on them
+//
+TestCapture tCapture;
+std::map<std::string, std::vector<TestCapture::Frame>> tExpectedFrames;
+size_t tExpectedCount;
 
 void getTimeStr(std::string &timeStr);
 void tapIfReadPkts(std::string &tapName);
-static void tStartTsharkCapture(std::string &tcName,
-                                std::string &tName,
-                                std::vector<std::string> &interfaces);
+static void waitTapReady(void);
+static void tStartCapture(std::string &tcName,
+                          std::string &tName,
+                          std::vector<std::string> &interfaces);
 static void tVerifyPackets(std::string &tcName,
                          std::string &tName,
                          std::vector<std::string> &interfaces);
 
-static void stopTsharkCapture(void);
+static void stopCapture(void);
 //
 // Sandbox open
 //
 //  +------------------------------------------------+
 //  |                                                |
-//  o p0 ge-0/0/0 In                 Out ge-0/0/0 p0 o
-//  |                                                |
-//  o p1 ge-0/0/1 In                 Out ge-0/0/1 p1 o
-//  |                                                |
-//  o p2 ge-0/0/2 In                 Out ge-0/0/2 p2 o
+//  o p0 ge-0/0/6 In                 Out ge-0/0/6 p0 o
 //  |                                                |
-//  o p3 ge-0/0/3 In                 Out ge-0/0/3 p3 o
-//  |                                                |
-//  o p4 ge-0/0/4 In                 Out ge-0/0/4 p4 o
-//  |                                                |
-//  o p5 ge-0/0/5 In                 Out ge-0/0/5 p5 o
-//  |                                                |
-//  o p6 ge-0/0/6 In                 Out ge-0/0/6 p6 o
-//  |                                                |
-//  o p7 ge-0/0/7 In                 Out ge-0/0/7 p7 o
+//  o p1 ge-0/0/7 In                 Out ge-0/0/7 p1 o
 //  |                   Sandbox                      |
 //  +------------------------------------------------+
 //
  
-TEST(AFI, SandboxOpen)
+TEST_F(AFI, SandboxOpen)
 {
-    int ret = 0;
-
-    boost::asio::io_service io_service;
-
-    aficlient = new AfiClient(io_service,
-                              afiServerAddr,
-                              afiHospathAddr,
-                              AFT_CLIENT_HOSTPATH_PORT,
-                              false, false);
-
-    ASSERT_TRUE(aficlient != NULL);
-
-    ret = aficlient->openSandbox(sbName, SB_NUM_CFG_PORTS);
-
-    EXPECT_EQ(ret, 0);
+    ASSERT_TRUE(_client != NULL);
+    EXPECT_TRUE(_client->sandbox() != nullptr);
 }
 
 //
@@ -327,7 +356,7 @@ TEST(AFI, SandboxOpen)
 //    Input Packet
 //
 
-TEST(AFI, CounterNode)
+TEST_F(AFI, CounterNode)
 {
     int ret = 0;
     std::string tcName = "AFI";
@@ -336,28 +365,28 @@ TEST(AFI, CounterNode)
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_0_VMX_IF_NAME);
     capture_ifs.push_back(GE_0_0_1_VMX_IF_NAME);
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
 
-    AftNodeToken cntrToken  = aficlient->addCounterNode();
+    AftNodeToken cntrToken  = _client->addCounterNode();
 
     AftNodeToken outputPortToken = 
-                 aficlient->getOuputPortToken(SB_P1_PORT_INDEX);
+                 _client->getOuputPortToken(port(SB_P1_PORT_INDEX));
 
     AftTokenVector tokVec;
 
     tokVec = {cntrToken, outputPortToken};
 
-    AftNodeToken listToken  = aficlient->createList(tokVec);
+    AftNodeToken listToken  = _client->createList(tokVec);
 
-    ret = aficlient->setInputPortNextNode(SB_P0_PORT_INDEX, listToken);
+    ret = _client->setInputPortNextNode(port(SB_P0_PORT_INDEX), listToken);
     EXPECT_EQ(0, ret);
 
 
-    ret = SendRawEth(VMX_LINK0_NAME_STR, 
+    ret = sendRawEth(SB_P0_PORT_INDEX, 
                      TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO);
     EXPECT_EQ(0, ret);
 
-    stopTsharkCapture();
+    stopCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
@@ -377,25 +406,25 @@ TEST(AFI, CounterNode)
 //    Input Packet
 //
 
-TEST(AFI, DisacrdNode)
+TEST_F(AFI, DisacrdNode)
 {
     int ret = 0;
     std::string tcName = "AFI";
     std::string tName  = "DisacrdNode";
 
 
-    AftNodeToken token  = aficlient->addDiscardNode();
-    ret = aficlient->setInputPortNextNode(SB_P0_PORT_INDEX, token);
+    AftNodeToken token  = _client->addDiscardNode();
+    ret = _client->setInputPortNextNode(port(SB_P0_PORT_INDEX), token);
     EXPECT_EQ(0, ret);
 
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_0_VMX_IF_NAME);
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
  
-    ret = SendRawEth(VMX_LINK0_NAME_STR, 
+    ret = sendRawEth(SB_P0_PORT_INDEX, 
                      TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO);
     EXPECT_EQ(0, ret);
-    stopTsharkCapture();
+    stopCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
@@ -420,7 +449,7 @@ TEST(AFI, DisacrdNode)
 //
 
 void 
-readPuntedPkts(std::string &ctx, int num_pkts, 
+readPuntedPkts(AfiClient *client, std::string &ctx, int num_pkts, 
                TestPacketLibrary::TestPacketId tcPktNum)
 {
     int ret;
@@ -435,10 +464,15 @@ readPuntedPkts(std::string &ctx, int num_pkts,
     int pkt_len = testPkt->getEtherPacket(pkt_buff, PKT_BUFF_SIZE);
 
     while (!test_complete.load()) {
-        ret = aficlient->recvHostPathPacket(pkt);
+        ret = client->recvHostPathPacket(pkt);
         EXPECT_EQ(0, ret);
         EXPECT_EQ(pkt->dataSize(), pkt_len);
 
+        AfiPktDissector sent((const uint8_t *)pkt_buff, pkt_len);
+        AfiPktDissector rcvd(pkt->data(), pkt->dataSize());
+
+        std::cout << "Sent packet  : " << sent << std::endl;
+        std::cout << "Received pkt : " << rcvd << std::endl;
         pktTrace("Sent packet", pkt_buff, pkt_len);
         pktTrace("Received pkt", (char *)(pkt->data()), pkt->dataSize());
 
@@ -446,6 +480,17 @@ readPuntedPkts(std::string &ctx, int num_pkts,
         // TBD: FIXME
         //EXPECT_EQ(0, ret);
 
+        //
+        // Layer 2 header may be rewritten on the way, the IP packet not
+        //
+        AfiPktView sentL3 = sent.l3();
+        AfiPktView rcvdL3 = rcvd.l3();
+        ASSERT_TRUE(sentL3.valid());
+        ASSERT_TRUE(rcvdL3.valid());
+        EXPECT_EQ(sentL3.len, rcvdL3.len);
+        EXPECT_EQ(0, memcmp(sentL3.data, rcvdL3.data,
+                            std::min(sentL3.len, rcvdL3.len)));
+
         rcvd_num_pkts++;
         if (rcvd_num_pkts >= num_pkts) {
             break;
@@ -453,38 +498,39 @@ readPuntedPkts(std::string &ctx, int num_pkts,
     }
 }
 
-TEST(AFI, SandboxHostpathPunt)
+TEST_F(AFI, SandboxHostpathPunt)
 {
     int ret = 0;
     int num_pkts_to_send = 1;
     std::string tcName = "AFI";
     std::string tName  = "SandboxHostpathPunt";
-    ASSERT_TRUE(aficlient != NULL);
+    ASSERT_TRUE(_client != NULL);
 
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_0_VMX_IF_NAME);
 
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
  
     test_complete.store(false);
-    boost::thread hpRecvThread(boost::bind(&readPuntedPkts, boost::ref(tName), 
-             num_pkts_to_send, TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO));
+    boost::thread hpRecvThread(boost::bind(&readPuntedPkts, _client,
+             boost::ref(tName), num_pkts_to_send,
+             TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO));
     //
     // Set up punt for packets incoming on port p0
     //
-    AftNodeToken puntPortToken  = aficlient->getOuputPortToken(SB_PUNT_PORT_INDEX);
+    AftNodeToken puntPortToken  = _client->getOuputPortToken(puntPort());
 
-    ret = aficlient->setInputPortNextNode(SB_P0_PORT_INDEX, puntPortToken);
+    ret = _client->setInputPortNextNode(port(SB_P0_PORT_INDEX), puntPortToken);
     EXPECT_EQ(0, ret);
 
 
     for (int i = 0; i < num_pkts_to_send; i++) {
-        ret = SendRawEth(VMX_LINK0_NAME_STR, 
+        ret = sendRawEth(SB_P0_PORT_INDEX, 
                          TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO);
         EXPECT_EQ(0, ret);
-        sleep(1); 
     }
 
+    stopCapture();
     test_complete.store(true);
 
     if (hpRecvThread.timed_join( boost::posix_time::seconds(5))) {
@@ -493,7 +539,6 @@ TEST(AFI, SandboxHostpathPunt)
         std::cerr<<"\nTimed out!\n";
     }
 
-    stopTsharkCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
@@ -520,23 +565,30 @@ TEST(AFI, SandboxHostpathPunt)
 //               
 //    
 
-TEST(AFI, SandboxL2Inject)
+TEST_F(AFI, SandboxL2Inject)
 {
     int ret = 0;
     std::string tcName = "AFI";
     std::string tName  = "SandboxL2Inject";
-    ASSERT_TRUE(aficlient != NULL);
+    ASSERT_TRUE(_client != NULL);
 
+    AftSandboxId sbIndex;
+    ASSERT_EQ(0, sandboxIndex(SB_P1_PORT_INDEX, sbIndex))
+        << "Hostpath sandbox index not learnt";
 
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_1_VMX_IF_NAME);
 
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
     
     std::string tapName = TAP1_NAME_STR;
 
     test_complete.store(false);
-    boost::thread tapThread(boost::bind(&tapIfReadPkts, boost::ref(tapName)));
+    boost::thread tapThread([this, &tapName] {
+        EXPECT_EQ(0, enterNetns());
+        tapIfReadPkts(tapName);
+    });
+    waitTapReady();
 
     TestPacket* testPkt = testPacketLibrary.getTestPacket(
                         TestPacketLibrary::TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP1);
@@ -549,14 +601,14 @@ TEST(AFI, SandboxL2Inject)
 
     const int num_pkts_to_send = 1;
     for (int i = 0; i < num_pkts_to_send; i++) {
-        ret = aficlient->injectL2Packet(SB_INDEX,          // Sandbox Index
-                                        SB_P1_PORT_INDEX,  // Port Index
-                                        (uint8_t *)pkt_buff, pkt_len);
+        ret = _client->injectL2Packet(sbIndex,                 // Sandbox Index
+                                      port(SB_P1_PORT_INDEX),  // Port Index
+                                      (uint8_t *)pkt_buff, pkt_len);
 
         EXPECT_EQ(0, ret);
-        sleep(1); 
     }
 
+    stopCapture();
     test_complete.store(true);
 
     if (tapThread.timed_join( boost::posix_time::seconds(5))) {
@@ -567,7 +619,6 @@ TEST(AFI, SandboxL2Inject)
 
     EXPECT_EQ(0, ret);
 
-    stopTsharkCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
@@ -592,7 +643,7 @@ TEST(AFI, SandboxL2Inject)
 
 #define SB_ROUTE_PREFIX_R1 "103.30.30.0/24"
 
-TEST(AFI, IPv4Routing)
+TEST_F(AFI, IPv4Routing)
 {
     int ret = 0;
     std::string tcName = "AFI";
@@ -601,54 +652,58 @@ TEST(AFI, IPv4Routing)
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_2_VMX_IF_NAME);
     capture_ifs.push_back(GE_0_0_3_VMX_IF_NAME);
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
 
     AftNodeToken puntPortToken;
     AftNodeToken rttToken;
     AftNodeToken rtTargetPortToken;
     AftNodeToken etherEncapToken;
 
-    ASSERT_TRUE(aficlient != NULL);
+    ASSERT_TRUE(_client != NULL);
 
     std::string tapName = TAP3_NAME_STR;
 
     test_complete.store(false);
-    boost::thread tapThread(boost::bind(&tapIfReadPkts, boost::ref(tapName)));
+    boost::thread tapThread([this, &tapName] {
+        EXPECT_EQ(0, enterNetns());
+        tapIfReadPkts(tapName);
+    });
+    waitTapReady();
 
     //
     // Create Routing Table
     //
-    puntPortToken = aficlient->getOuputPortToken(SB_PUNT_PORT_INDEX);
+    puntPortToken = _client->getOuputPortToken(puntPort());
 
-    rttToken = aficlient->addRouteTable(sbIPv4RttName, puntPortToken);
+    rttToken = _client->addRouteTable(sbIPv4RttName, puntPortToken);
 
-    ret = aficlient->setInputPortNextNode(SB_P2_PORT_INDEX,
+    ret = _client->setInputPortNextNode(port(SB_P2_PORT_INDEX),
                                           rttToken);
 
     //
     // Add route to routing table
     //
-    rtTargetPortToken  = aficlient->getOuputPortToken(SB_P3_PORT_INDEX);
+    rtTargetPortToken  = _client->getOuputPortToken(port(SB_P3_PORT_INDEX));
 
-    etherEncapToken = aficlient->addEtherEncapNode(
+    etherEncapToken = _client->addEtherEncapNode(
                                              TAP3_MAC_STR,     // dst mac
                                              GE_0_0_3_MAC_STR, // src mac
                                              "0",
                                              "0",
                                              rtTargetPortToken);
 
-    ret = aficlient->addRoute(rttToken, SB_ROUTE_PREFIX_R1, etherEncapToken);
+    ret = _client->addRoute(rttToken, SB_ROUTE_PREFIX_R1, etherEncapToken);
 
     EXPECT_EQ(0, ret);
 
     const int num_pkts_to_send = 1;
     for (int i = 0; i < num_pkts_to_send; i++) {
-        ret = SendRawEth(VMX_LINK2_NAME_STR,
+        ret = sendRawEth(SB_P2_PORT_INDEX,
                   TestPacketLibrary::TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3);
         EXPECT_EQ(0, ret);
-        sleep(1); 
     }
 
+    stopCapture();
     test_complete.store(true);
 
     if (tapThread.timed_join( boost::posix_time::seconds(5))) {
@@ -658,7 +713,6 @@ TEST(AFI, IPv4Routing)
     }
 
     EXPECT_EQ(0, ret);
-    stopTsharkCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
@@ -686,7 +740,7 @@ const int MPLS_L2VPN_VLAN_ID = 11;
 const int INDEX_TABLE_NUM_ENTRIES = 25;
 const std::string vlan1_field_name ("packet.ether.vlan1");
 
-TEST(AFI, MPLS_L2VPN_Encap)
+TEST_F(AFI, MPLS_L2VPN_Encap)
 {
     int ret = 0;
     std::string tcName = "AFI";
@@ -695,29 +749,33 @@ TEST(AFI, MPLS_L2VPN_Encap)
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_4_VMX_IF_NAME);
     capture_ifs.push_back(GE_0_0_5_VMX_IF_NAME);
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
 
     AftNodeToken targetPortToken;
     AftNodeToken labelEncapToken;
 
-    ASSERT_TRUE(aficlient != NULL);
+    ASSERT_TRUE(_client != NULL);
 
     std::string tapName = TAP5_NAME_STR;
 
     test_complete.store(false);
-    boost::thread tapThread(boost::bind(&tapIfReadPkts, boost::ref(tapName)));
+    boost::thread tapThread([this, &tapName] {
+        EXPECT_EQ(0, enterNetns());
+        tapIfReadPkts(tapName);
+    });
+    waitTapReady();
 
-    AftNodeToken iTableToken =  aficlient->createIndexTable(vlan1_field_name, 
+    AftNodeToken iTableToken =  _client->createIndexTable(vlan1_field_name, 
                                                    INDEX_TABLE_NUM_ENTRIES);
 
-    ret = aficlient->setInputPortNextNode(SB_P4_PORT_INDEX,
+    ret = _client->setInputPortNextNode(port(SB_P4_PORT_INDEX),
                                           iTableToken);
 
-    targetPortToken  = aficlient->getOuputPortToken(SB_P5_PORT_INDEX);
+    targetPortToken  = _client->getOuputPortToken(port(SB_P5_PORT_INDEX));
 
 
 
-    AftNodeToken etherEncapToken = aficlient->addEtherEncapNode(
+    AftNodeToken etherEncapToken = _client->addEtherEncapNode(
                                              TAP5_MAC_STR,     // dst mac
                                              GE_0_0_5_MAC_STR, // src mac
                                              "0",
@@ -729,22 +787,22 @@ TEST(AFI, MPLS_L2VPN_Encap)
     // Outer label: 1000002
     // Inner label: 16
     //
-    labelEncapToken = aficlient->addLabelEncap("1000002", 
+    labelEncapToken = _client->addLabelEncap("1000002", 
                                                "16", 
                                                etherEncapToken);
 
-    ret = aficlient->addIndexTableEntry(iTableToken, 
+    ret = _client->addIndexTableEntry(iTableToken, 
                                         MPLS_L2VPN_VLAN_ID, 
                                         labelEncapToken);
 
     const int num_pkts_to_send = 1;
     for (int i = 0; i < num_pkts_to_send; i++) {
-        ret = SendRawEth(VMX_LINK4_NAME_STR,
+        ret = sendRawEth(SB_P4_PORT_INDEX,
                   TestPacketLibrary::TEST_PKT_ID_IPV4_VLAN);
         EXPECT_EQ(0, ret);
-        sleep(1); 
     }
 
+    stopCapture();
     test_complete.store(true);
 
     if (tapThread.timed_join( boost::posix_time::seconds(5))) {
@@ -754,7 +812,6 @@ TEST(AFI, MPLS_L2VPN_Encap)
     }
 
     EXPECT_EQ(0, ret);
-    stopTsharkCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
@@ -776,7 +833,7 @@ TEST(AFI, MPLS_L2VPN_Encap)
 //                  |                                              |
 //                  |                                              |
 
-TEST(AFI, MPLS_L2VPN_Decap)
+TEST_F(AFI, MPLS_L2VPN_Decap)
 {
     int ret = 0;
     std::string tcName = "AFI";
@@ -785,39 +842,43 @@ TEST(AFI, MPLS_L2VPN_Decap)
     std::vector<std::string> capture_ifs;
     capture_ifs.push_back(GE_0_0_4_VMX_IF_NAME);
     capture_ifs.push_back(GE_0_0_5_VMX_IF_NAME);
-    tStartTsharkCapture(tcName, tName, capture_ifs);
+    tStartCapture(tcName, tName, capture_ifs);
 
-    ASSERT_TRUE(aficlient != NULL);
+    ASSERT_TRUE(_client != NULL);
 
     std::string tapName = TAP4_NAME_STR;
 
     test_complete.store(false);
-    boost::thread tapThread(boost::bind(&tapIfReadPkts, boost::ref(tapName)));
+    boost::thread tapThread([this, &tapName] {
+        EXPECT_EQ(0, enterNetns());
+        tapIfReadPkts(tapName);
+    });
+    waitTapReady();
 
-    AftNodeToken iTableToken =  aficlient->createIndexTable(
+    AftNodeToken iTableToken =  _client->createIndexTable(
                                                    vlan1_field_name, 
                                                    INDEX_TABLE_NUM_ENTRIES);
 
-    AftNodeToken labelDecapToken = aficlient->addLabelDecap(iTableToken);
+    AftNodeToken labelDecapToken = _client->addLabelDecap(iTableToken);
 
-    ret = aficlient->setInputPortNextNode(SB_P5_PORT_INDEX,
+    ret = _client->setInputPortNextNode(port(SB_P5_PORT_INDEX),
                                           labelDecapToken);
 
-    AftNodeToken outputPortToken = aficlient->getOuputPortToken(
-                                                   SB_P4_PORT_INDEX);
+    AftNodeToken outputPortToken = _client->getOuputPortToken(
+                                                   port(SB_P4_PORT_INDEX));
 
-    ret = aficlient->addIndexTableEntry(iTableToken, 
+    ret = _client->addIndexTableEntry(iTableToken, 
                                         MPLS_L2VPN_VLAN_ID, 
                                         outputPortToken);
 
     const int num_pkts_to_send = 1;
     for (int i = 0; i < num_pkts_to_send; i++) {
-        ret = SendRawEth(VMX_LINK5_NAME_STR,
+        ret = sendRawEth(SB_P5_PORT_INDEX,
                   TestPacketLibrary::TEST_PKT_ID_MPLS_L2VLAN);
         EXPECT_EQ(0, ret);
-        sleep(1); 
     }
 
+    stopCapture();
     test_complete.store(true);
 
     if (tapThread.timed_join( boost::posix_time::seconds(5))) {
@@ -827,10 +888,1370 @@ TEST(AFI, MPLS_L2VPN_Decap)
     }
 
     EXPECT_EQ(0, ret);
-    stopTsharkCapture();
     tVerifyPackets(tcName, tName, capture_ifs);
 }
 
+//
+// Packet template
+//
+// Fields set on a template must leave it equal to the frame written
+// with the new field values, whose checksums are computed in full.
+// These tests need no sandbox.
+//
+
+static const PktBuild::Mac tDstMac("a2:24:4f:ce:94:b4");
+static const PktBuild::Mac tSrcMac("32:26:0a:2e:ff:f1");
+
+static const uint32_t tTmplAddrs[] = {
+    PktBuild::ipv4Parse("103.30.70.3"), PktBuild::ipv4Parse("103.30.70.4"),
+    PktBuild::ipv4Parse("10.0.0.1"),    PktBuild::ipv4Parse("255.255.255.255"),
+    PktBuild::ipv4Parse("0.0.0.0"),     PktBuild::ipv4Parse("128.0.0.1"),
+};
+
+static void
+tExpectTmplFrame (const AfiPktTemplate &tmpl, const TestPktFrame &expected)
+{
+    ASSERT_EQ(expected.size(), (size_t)tmpl.frameLen());
+    EXPECT_TRUE(memcmp(tmpl.frame(), expected.data(), expected.size()) == 0)
+        << "Template:" << std::endl
+        << AfiPktDissector(tmpl.frame(), tmpl.frameLen()) << std::endl
+        << "Expected:" << std::endl
+        << AfiPktDissector(expected.data(), expected.size());
+}
+
+TEST(AfiPktTemplate, Ipv4AddrUdpCsum)
+{
+    using namespace PktBuild;
+
+    TestPktFrame   frame(Ether(tDstMac, tSrcMac) / Dot1Q(11) /
+                         IPv4("103.30.70.1", "103.30.70.3") /
+                         Udp(1024, 4789) / Fill(37));
+    AfiPktTemplate tmpl;
+
+    ASSERT_EQ(0, tmpl.build(0, 0, frame.data(), frame.size()));
+    int dst = tmpl.addField(AfiPktTemplate::FieldIpv4Dst);
+    int src = tmpl.addField(AfiPktTemplate::FieldIpv4Src);
+    ASSERT_GE(dst, 0);
+    ASSERT_GE(src, 0);
+
+    for (uint32_t d : tTmplAddrs) {
+        for (uint32_t s : tTmplAddrs) {
+            tmpl.set(dst, d);
+            tmpl.set(src, s);
+            EXPECT_EQ(d, tmpl.get(dst));
+            tExpectTmplFrame(tmpl, TestPktFrame(Ether(tDstMac, tSrcMac) /
+                                                Dot1Q(11) / IPv4(s, d) /
+                                                Udp(1024, 4789) / Fill(37)));
+        }
+    }
+}
+
+TEST(AfiPktTemplate, UdpPortCsum)
+{
+    using namespace PktBuild;
+
+    TestPktFrame   frame(Ether(tDstMac, tSrcMac) / Mpls(299776) /
+                         IPv4("103.30.70.1", "103.30.70.3") /
+                         Udp(1024, 4789) / Fill(18));
+    AfiPktTemplate tmpl;
+
+    ASSERT_EQ(0, tmpl.build(0, 0, frame.data(), frame.size()));
+    int sport = tmpl.addField(AfiPktTemplate::FieldL4, 0, 2);
+    int ports = tmpl.addField(AfiPktTemplate::FieldL4, 0, 4);
+    ASSERT_GE(sport, 0);
+    ASSERT_GE(ports, 0);
+
+    for (uint32_t port = 0; port <= 0xffff; port += 0x0fff) {
+        tmpl.set(sport, port);
+        tExpectTmplFrame(tmpl, TestPktFrame(Ether(tDstMac, tSrcMac) /
+                                            Mpls(299776) /
+                                            IPv4("103.30.70.1", "103.30.70.3") /
+                                            Udp(port, 4789) / Fill(18)));
+    }
+
+    tmpl.set(ports, 0xfffe0001);
+    tExpectTmplFrame(tmpl, TestPktFrame(Ether(tDstMac, tSrcMac) /
+                                        Mpls(299776) /
+                                        IPv4("103.30.70.1", "103.30.70.3") /
+                                        Udp(0xfffe, 0x0001) / Fill(18)));
+}
+
+TEST(AfiPktTemplate, UdpNoCsum)
+{
+    using namespace PktBuild;
+
+    TestPktFrame         frame(Ether(tDstMac, tSrcMac) /
+                               IPv4("103.30.70.1", "103.30.70.3") /
+                               Udp(1024, 4789) / Fill(20));
+    std::vector<uint8_t> bytes(frame.bytes());
+    AfiPktTemplate       tmpl;
+
+    //
+    // UDP checksum 0: none, stays 0
+    //
+    bytes[14 + 20 + 6] = bytes[14 + 20 + 7] = 0;
+    ASSERT_EQ(0, tmpl.build(0, 0, bytes.data(), bytes.size()));
+    int dst = tmpl.addField(AfiPktTemplate::FieldIpv4Dst);
+    ASSERT_GE(dst, 0);
+
+    for (uint32_t d : tTmplAddrs) {
+        tmpl.set(dst, d);
+
+        TestPktFrame expected(Ether(tDstMac, tSrcMac) /
+                              IPv4(PktBuild::ipv4Parse("103.30.70.1"), d) /
+                              Udp(1024, 4789) / Fill(20));
+        ASSERT_EQ(expected.size(), (size_t)tmpl.frameLen());
+        EXPECT_EQ(0, memcmp(tmpl.frame(), expected.data(), 14 + 20 + 6));
+        EXPECT_EQ(0, tmpl.frame()[14 + 20 + 6]);
+        EXPECT_EQ(0, tmpl.frame()[14 + 20 + 7]);
+        EXPECT_EQ(0, memcmp(tmpl.frame() + 14 + 20 + 8,
+                            expected.data() + 14 + 20 + 8,
+                            expected.size() - (14 + 20 + 8)));
+    }
+}
+
+TEST(AfiPktTemplate, IcmpCsum)
+{
+    using namespace PktBuild;
+
+    TestPktFrame   frame(Ether(tDstMac, tSrcMac) / Dot1Q(70) /
+                         IPv4("103.30.70.1", "103.30.70.3") /
+                         Icmp(8, 0, 0x492b, 0) / Fill(57));
+    AfiPktTemplate tmpl;
+
+    ASSERT_EQ(0, tmpl.build(0, 0, frame.data(), frame.size()));
+    int seq  = tmpl.addField(AfiPktTemplate::FieldL4, 6, 2);
+    int dst  = tmpl.addField(AfiPktTemplate::FieldIpv4Dst);
+    int vlan = tmpl.addField(AfiPktTemplate::FieldVlanId);
+    ASSERT_GE(seq, 0);
+    ASSERT_GE(dst, 0);
+    ASSERT_GE(vlan, 0);
+
+    //
+    // Odd offset: id low byte and seq high byte
+    //
+    int mid = tmpl.addField(AfiPktTemplate::FieldL4, 5, 2);
+    ASSERT_GE(mid, 0);
+
+    for (uint32_t s = 0; s <= 0xffff; s += 0x0101) {
+        tmpl.set(seq, s);
+        tmpl.set(dst, tTmplAddrs[s % 6]);
+        tmpl.set(vlan, s & 0x0fff);
+        tExpectTmplFrame(tmpl, TestPktFrame(Ether(tDstMac, tSrcMac) /
+                                            Dot1Q(s & 0x0fff) /
+                                            IPv4(PktBuild::ipv4Parse(
+                                                     "103.30.70.1"),
+                                                 tTmplAddrs[s % 6]) /
+                                            Icmp(8, 0, 0x492b, s) /
+                                            Fill(57)));
+    }
+
+    tmpl.set(mid, 0xc3d4);
+    EXPECT_EQ(0xd400u, tmpl.get(seq) & 0xff00);
+    tExpectTmplFrame(tmpl, TestPktFrame(Ether(tDstMac, tSrcMac) /
+                                        Dot1Q(0x0fff) /
+                                        IPv4(PktBuild::ipv4Parse(
+                                                 "103.30.70.1"),
+                                             tTmplAddrs[0xffff % 6]) /
+                                        Icmp(8, 0, 0x49c3,
+                                             (0xd4 << 8) | 0xff) /
+                                        Fill(57)));
+}
+
+//
+// Packet dissector
+//
+// Frames of the test packet library and frames built here, whole and
+// cut short, dissected layer by layer. These tests need no sandbox.
+//
+
+static const PktBuild::Mac tDisDstMac("33:22:0a:2e:ff:f1");
+static const PktBuild::Mac tDisSrcMac("32:26:0a:2e:aa:f1");
+
+//
+// IPv6 2001:db8::1 > 2001:db8::2, hop limit 64, next header first
+// (payload length set by the caller)
+//
+#define T_DIS_IPV6_HDR(next)                                            \
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x00, (next), 64,                     \
+    0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01,      \
+    0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02
+
+#define T_DIS_IPV6_PLEN_OFF     4
+
+//
+// Hop-by-hop options, destination options, fragment (first, more
+// fragments), UDP 4660 > 53 with 4 bytes of payload
+//
+static const uint8_t tDisIpv6ExtUdp[] = {
+    T_DIS_IPV6_HDR(0),
+    60, 0, 0x01, 0x04, 0, 0, 0, 0,
+    44, 1, 0x01, 0x0c, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    17, 0, 0x00, 0x01, 0x12, 0x34, 0x56, 0x78,
+    0x12, 0x34, 0x00, 0x35, 0x00, 0x0c, 0x00, 0x00,
+    0xde, 0xad, 0xbe, 0xef,
+};
+
+#define T_DIS_IPV6_FRAG_OFF     (40 + 8 + 16 + 2)
+#define T_DIS_IPV6_L4_OFF       (40 + 8 + 16 + 8)
+
+//
+// Authentication header (96 bit ICV), TCP 179 > 49152 SYN
+//
+static const uint8_t tDisIpv6AhTcp[] = {
+    T_DIS_IPV6_HDR(51),
+    6, 4, 0, 0, 0x00, 0x00, 0x10, 0x01, 0, 0, 0, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0x00, 0xb3, 0xc0, 0x00, 0, 0, 0, 1, 0, 0, 0, 0,
+    0x50, 0x02, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+};
+
+//
+// Frame bytes, IPv6 payload length filled in for the raw headers above
+//
+static std::vector<uint8_t>
+tDisIpv6Frame (const uint8_t *ip, size_t len)
+{
+    TestPktFrame frame(PktBuild::Ether(tDisDstMac, tDisSrcMac, 0x86dd) /
+                       PktBuild::Bytes(ip, len));
+    std::vector<uint8_t> pkt(frame.bytes());
+
+    pkt[14 + T_DIS_IPV6_PLEN_OFF]     = (len - 40) >> 8;
+    pkt[14 + T_DIS_IPV6_PLEN_OFF + 1] = (len - 40) & 0xff;
+    return pkt;
+}
+
+static const std::vector<uint8_t> &
+tDisLibFrame (TestPacketLibrary::TestPacketId id)
+{
+    return testPacketLibrary.getTestPacket(id)->frame().bytes();
+}
+
+TEST(AfiPktDissector, Vlan)
+{
+    const std::vector<uint8_t> &pkt =
+        tDisLibFrame(TestPacketLibrary::TEST_PKT_ID_IPV4_VLAN);
+    AfiPktDissector dis(pkt.data(), pkt.size());
+    uint8_t         src[] = { 103, 30, 60, 2 };
+
+    EXPECT_TRUE(dis.ethValid());
+    ASSERT_EQ(1, dis.numVlans());
+    EXPECT_EQ(0x8100, dis.vlanTpid(0));
+    EXPECT_EQ(11, dis.vlanId(0));
+    EXPECT_EQ(0, dis.vlanPcp(0));
+    EXPECT_EQ(0, dis.vlanId(1));
+    EXPECT_EQ(0, dis.vlanId(-1));
+    EXPECT_EQ(0x0800, dis.etherType());
+    EXPECT_EQ(0, dis.numLabels());
+
+    ASSERT_EQ(4, dis.ipVersion());
+    EXPECT_EQ(0, memcmp(dis.ipSrc(), src, sizeof(src)));
+    EXPECT_EQ(1, dis.ipProto());
+    EXPECT_EQ(64, dis.ipTtl());
+    EXPECT_EQ(pkt.size() - 18, dis.l3().len);
+    EXPECT_EQ(8, dis.icmpType());
+    EXPECT_EQ(0, dis.icmpCode());
+    EXPECT_EQ(0, dis.srcPort());
+    EXPECT_EQ(0, dis.dstPort());
+    EXPECT_FALSE(dis.truncated());
+}
+
+TEST(AfiPktDissector, QinQ)
+{
+    using namespace PktBuild;
+
+    TestPktFrame    frame(Ether(tDisDstMac, tDisSrcMac, 0x88a8) /
+                          Dot1Q(100, 5) / Dot1Q(11, 3) /
+                          IPv4("103.30.60.2", "103.30.60.1") /
+                          Udp(1234, 53) / Fill(20));
+    AfiPktDissector dis(frame.data(), frame.size());
+
+    ASSERT_EQ(2, dis.numVlans());
+    EXPECT_EQ(0x88a8, dis.vlanTpid(0));
+    EXPECT_EQ(100, dis.vlanId(0));
+    EXPECT_EQ(5, dis.vlanPcp(0));
+    EXPECT_EQ(0x8100, dis.vlanTpid(1));
+    EXPECT_EQ(11, dis.vlanId(1));
+    EXPECT_EQ(3, dis.vlanPcp(1));
+    EXPECT_EQ(0x0800, dis.etherType());
+    EXPECT_EQ(17, dis.ipProto());
+    EXPECT_EQ(1234, dis.srcPort());
+    EXPECT_EQ(53, dis.dstPort());
+    EXPECT_EQ(20u, dis.payload().len);
+    EXPECT_FALSE(dis.truncated());
+
+    //
+    // Tags past AFI_DISSECT_MAX_VLANS are left undecoded
+    //
+    TestPktFrame    deep(Ether(tDisDstMac, tDisSrcMac) / Dot1Q(1) / Dot1Q(2) /
+                         Dot1Q(3) / Dot1Q(4) / Dot1Q(5) /
+                         IPv4("103.30.60.2", "103.30.60.1") /
+                         Udp(1234, 53) / Fill(20));
+    AfiPktDissector deepDis(deep.data(), deep.size());
+
+    ASSERT_EQ(AFI_DISSECT_MAX_VLANS, deepDis.numVlans());
+    EXPECT_EQ(4, deepDis.vlanId(AFI_DISSECT_MAX_VLANS - 1));
+    EXPECT_EQ(0x8100, deepDis.etherType());
+    EXPECT_EQ(0, deepDis.ipVersion());
+    EXPECT_EQ(0, deepDis.srcPort());
+}
+
+TEST(AfiPktDissector, MplsLabelStack)
+{
+    using namespace PktBuild;
+
+    //
+    // Labels over an Ethernet frame: not IP
+    //
+    const std::vector<uint8_t> &l2vpn =
+        tDisLibFrame(TestPacketLibrary::TEST_PKT_ID_MPLS_L2VLAN);
+    AfiPktDissector dis(l2vpn.data(), l2vpn.size());
+
+    EXPECT_EQ(0, dis.numVlans());
+    EXPECT_EQ(0x8847, dis.etherType());
+    ASSERT_EQ(2, dis.numLabels());
+    EXPECT_EQ(200u, dis.mplsLabel(0));
+    EXPECT_EQ(4, dis.mplsTc(0));
+    EXPECT_EQ(0x47, dis.mplsTtl(0));
+    EXPECT_EQ(200u, dis.mplsLabel(1));
+    EXPECT_EQ(0, dis.mplsTc(1));
+    EXPECT_EQ(0xff, dis.mplsTtl(1));
+    EXPECT_EQ(0u, dis.mplsLabel(2));
+    EXPECT_EQ(0, dis.ipVersion());
+    EXPECT_EQ(-1, dis.ipProto());
+    EXPECT_FALSE(dis.truncated());
+
+    //
+    // Labels over IPv4, more than AFI_DISSECT_MAX_LABELS of them
+    //
+    TestPktFrame    deep(Ether(tDisDstMac, tDisSrcMac) / Mpls(16) /
+                         Mpls(17) / Mpls(18) / Mpls(19) / Mpls(20) /
+                         Mpls(21) / Mpls(22) / Mpls(23) / Mpls(24) /
+                         Mpls(1048575, 1, 7) /
+                         IPv4("103.30.60.2", "103.30.60.1") /
+                         Udp(1234, 53) / Fill(20));
+    AfiPktDissector deepDis(deep.data(), deep.size());
+
+    ASSERT_EQ(AFI_DISSECT_MAX_LABELS, deepDis.numLabels());
+    EXPECT_EQ(16u, deepDis.mplsLabel(0));
+    EXPECT_EQ(23u, deepDis.mplsLabel(AFI_DISSECT_MAX_LABELS - 1));
+    ASSERT_EQ(4, deepDis.ipVersion());
+    EXPECT_EQ(53, deepDis.dstPort());
+    EXPECT_FALSE(deepDis.truncated());
+
+    //
+    // No bottom of stack before the end of the frame
+    //
+    static const uint8_t noBos[] = { 0x00, 0x0c, 0x80, 0x40 };
+    TestPktFrame    cut(Ether(tDisDstMac, tDisSrcMac, 0x8847) / Bytes(noBos));
+    AfiPktDissector cutDis(cut.data(), cut.size());
+
+    EXPECT_EQ(1, cutDis.numLabels());
+    EXPECT_EQ(200u, cutDis.mplsLabel(0));
+    EXPECT_EQ(0, cutDis.ipVersion());
+    EXPECT_TRUE(cutDis.truncated());
+}
+
+TEST(AfiPktDissector, Ipv6ExtHeaders)
+{
+    std::vector<uint8_t> pkt = tDisIpv6Frame(tDisIpv6ExtUdp,
+                                             sizeof(tDisIpv6ExtUdp));
+    {
+        AfiPktDissector dis(pkt.data(), pkt.size());
+
+        EXPECT_EQ(0x86dd, dis.etherType());
+        ASSERT_EQ(6, dis.ipVersion());
+        EXPECT_EQ(16, dis.ipAddrLen());
+        EXPECT_EQ(0x02, dis.ipDst()[15]);
+        EXPECT_EQ(64, dis.ipTtl());
+        EXPECT_EQ(17, dis.ipProto());
+        EXPECT_FALSE(dis.ipLaterFragment());
+        EXPECT_EQ(pkt.data() + 14 + T_DIS_IPV6_L4_OFF, dis.l4().data);
+        EXPECT_EQ(0x1234, dis.srcPort());
+        EXPECT_EQ(53, dis.dstPort());
+        EXPECT_EQ(4u, dis.payload().len);
+        EXPECT_FALSE(dis.truncated());
+    }
+
+    //
+    // Later fragment: no L4 header
+    //
+    pkt[14 + T_DIS_IPV6_FRAG_OFF + 1] = 0x08;
+    {
+        AfiPktDissector dis(pkt.data(), pkt.size());
+
+        EXPECT_EQ(17, dis.ipProto());
+        EXPECT_TRUE(dis.ipLaterFragment());
+        EXPECT_FALSE(dis.l4().valid());
+        EXPECT_EQ(0, dis.srcPort());
+        EXPECT_FALSE(dis.truncated());
+    }
+
+    //
+    // Cut in the destination options header
+    //
+    {
+        AfiPktDissector dis(pkt.data(), 14 + 40 + 8 + 4);
+
+        EXPECT_EQ(6, dis.ipVersion());
+        EXPECT_EQ(60, dis.ipProto());
+        EXPECT_FALSE(dis.l4().valid());
+        EXPECT_EQ(0, dis.srcPort());
+        EXPECT_TRUE(dis.truncated());
+    }
+
+    std::vector<uint8_t> ah = tDisIpv6Frame(tDisIpv6AhTcp,
+                                            sizeof(tDisIpv6AhTcp));
+    {
+        AfiPktDissector dis(ah.data(), ah.size());
+
+        EXPECT_EQ(6, dis.ipProto());
+        EXPECT_EQ(179, dis.srcPort());
+        EXPECT_EQ(49152, dis.dstPort());
+        EXPECT_EQ(0x02, dis.tcpFlags());
+        EXPECT_EQ(0u, dis.payload().len);
+        EXPECT_FALSE(dis.truncated());
+    }
+}
+
+TEST(AfiPktDissector, Truncated)
+{
+    const std::vector<uint8_t> &pkt =
+        tDisLibFrame(TestPacketLibrary::TEST_PKT_ID_IPV4_VLAN);
+    {
+        AfiPktDissector dis(pkt.data(), 0);
+
+        EXPECT_FALSE(dis.ethValid());
+        EXPECT_FALSE(dis.truncated());
+    }
+    {
+        AfiPktDissector dis(pkt.data(), 13);
+
+        EXPECT_FALSE(dis.ethValid());
+        EXPECT_EQ(NULL, dis.ethDst());
+        EXPECT_EQ(0, dis.numVlans());
+        EXPECT_EQ(0, dis.ipVersion());
+        EXPECT_TRUE(dis.truncated());
+    }
+    {
+        AfiPktDissector dis(pkt.data(), 16);
+
+        EXPECT_TRUE(dis.ethValid());
+        EXPECT_EQ(0, dis.numVlans());
+        EXPECT_EQ(0, dis.etherType());
+        EXPECT_TRUE(dis.truncated());
+    }
+    {
+        AfiPktDissector dis(pkt.data(), 18 + 10);
+
+        EXPECT_EQ(1, dis.numVlans());
+        EXPECT_EQ(0x0800, dis.etherType());
+        EXPECT_EQ(0, dis.ipVersion());
+        EXPECT_FALSE(dis.l3().valid());
+        EXPECT_EQ(NULL, dis.ipSrc());
+        EXPECT_TRUE(dis.truncated());
+    }
+    {
+        AfiPktDissector dis(pkt.data(), 18 + 20);
+
+        EXPECT_EQ(4, dis.ipVersion());
+        EXPECT_EQ(20u, dis.l3().len);
+        EXPECT_EQ(-1, dis.icmpType());
+        EXPECT_FALSE(dis.payload().valid());
+        EXPECT_TRUE(dis.truncated());
+    }
+    {
+        AfiPktDissector dis(pkt.data(), 18 + 20 + 4);
+
+        EXPECT_EQ(8, dis.icmpType());
+        EXPECT_EQ(0u, dis.payload().len);
+        EXPECT_TRUE(dis.truncated());
+    }
+}
+
+TEST(AfiPktDissector, HasPorts)
+{
+    using namespace PktBuild;
+
+    TestPktFrame frame(Ether(tDisDstMac, tDisSrcMac) /
+                       IPv4("103.30.60.2", "103.30.60.1") /
+                       Udp(5000, 6000) / Fill(8));
+    std::vector<uint8_t> pkt(frame.bytes());
+
+    //
+    // Ports, but not all of the UDP header
+    //
+    {
+        AfiPktDissector dis(pkt.data(), 14 + 20 + 4);
+
+        EXPECT_EQ(5000, dis.srcPort());
+        EXPECT_EQ(6000, dis.dstPort());
+        EXPECT_FALSE(dis.payload().valid());
+        EXPECT_TRUE(dis.truncated());
+    }
+    {
+        AfiPktDissector dis(pkt.data(), 14 + 20 + 3);
+
+        EXPECT_EQ(0, dis.srcPort());
+        EXPECT_EQ(0, dis.dstPort());
+        EXPECT_TRUE(dis.truncated());
+    }
+
+    //
+    // IPv4 total length short of the ports: the bytes after it are
+    // Ethernet padding
+    //
+    {
+        std::vector<uint8_t> padded(pkt);
+
+        padded[14 + 2] = 0;
+        padded[14 + 3] = 20 + 2;
+
+        AfiPktDissector dis(padded.data(), padded.size());
+
+        EXPECT_EQ(22u, dis.l3().len);
+        EXPECT_EQ(0, dis.srcPort());
+        EXPECT_EQ(0, dis.dstPort());
+    }
+
+    //
+    // Later IPv4 fragment
+    //
+    TestPktFrame frag(Ether(tDisDstMac, tDisSrcMac) /
+                      IPv4("103.30.60.2", "103.30.60.1", 64, 7, 0x0001) /
+                      Udp(5000, 6000) / Fill(8));
+    {
+        AfiPktDissector dis(frag.data(), frag.size());
+
+        EXPECT_TRUE(dis.ipLaterFragment());
+        EXPECT_EQ(17, dis.ipProto());
+        EXPECT_EQ(0, dis.srcPort());
+        EXPECT_FALSE(dis.l4().valid());
+    }
+}
+
+//
+// Hex decoding
+//
+// Every decode kernel the CPU supports must give the results of the
+// scalar one: the bytes, or the offset of the first invalid character,
+// of the first digit that does not fit, or the string length for an
+// odd number of digits. These tests need no sandbox.
+//
+
+static const AfiHexKernel tHexKernels[] = {
+    AfiHexScalar, AfiHexSse42, AfiHexAvx2,
+};
+
+#define T_HEX_NUM_KERNELS   (sizeof(tHexKernels) / sizeof(tHexKernels[0]))
+
+//
+// Byte i of the test strings, its digits upper case for even i
+//
+static uint8_t
+tHexByte (size_t i)
+{
+    return (i * 37 + 5) & 0xff;
+}
+
+//
+// Digits of numDigits / 2 test bytes (a last odd digit is the high
+// nibble of the next one), a space after every spaceEvery digits
+// (0 - no spaces). digitPos (unless NULL) gets the offset of each digit.
+//
+static std::string
+tHexString (size_t numDigits, size_t spaceEvery,
+            std::vector<size_t> *digitPos = NULL)
+{
+    static const char upper[] = "0123456789ABCDEF";
+    static const char lower[] = "0123456789abcdef";
+    std::string       s;
+
+    for (size_t d = 0; d < numDigits; d++) {
+        const char *digits = (d & 2) ? lower : upper;
+        uint8_t     b      = tHexByte(d / 2);
+
+        if (digitPos) {
+            digitPos->push_back(s.size());
+        }
+        s += digits[(d & 1) ? (b & 0x0f) : (b >> 4)];
+        if (spaceEvery && (((d + 1) % spaceEvery) == 0)) {
+            s += ((d / spaceEvery) & 1) ? "\n" : " \t";
+        }
+    }
+    return s;
+}
+
+class AfiHexDecode : public ::testing::Test
+{
+protected:
+    virtual void SetUp() {
+        _kernel = afiHexKernelGet();
+    }
+
+    virtual void TearDown() {
+        afiHexKernelSet(_kernel);
+    }
+
+    //
+    // Switch to kernel k of tHexKernels. Returns false if the CPU does
+    // not support it.
+    //
+    bool useKernel(size_t k) {
+        if (afiHexKernelSet(tHexKernels[k]) != 0) {
+            std::cout << afiHexKernelName(tHexKernels[k])
+                      << " not supported, not tested" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    AfiHexKernel _kernel;
+};
+
+TEST_F(AfiHexDecode, Valid)
+{
+    for (size_t k = 0; k < T_HEX_NUM_KERNELS; k++) {
+        if (!useKernel(k)) {
+            continue;
+        }
+        SCOPED_TRACE(afiHexKernelName(tHexKernels[k]));
+
+        for (size_t spaceEvery : { 0, 2, 7, 33 }) {
+            for (size_t numDigits = 0; numDigits <= 200; numDigits += 2) {
+                std::string          s = tHexString(numDigits, spaceEvery);
+                std::vector<uint8_t> bin(numDigits / 2 + 1, 0xee);
+                size_t               errPos = ~(size_t)0;
+
+                ASSERT_EQ((int)numDigits / 2,
+                          afiHexDecode(s.data(), s.size(), bin.data(),
+                                       numDigits / 2, &errPos))
+                    << "\"" << s << "\"";
+                for (size_t i = 0; i < numDigits / 2; i++) {
+                    ASSERT_EQ(tHexByte(i), bin[i]) << "byte " << i;
+                }
+                EXPECT_EQ(0xee, bin[numDigits / 2]);
+                EXPECT_EQ(~(size_t)0, errPos);
+            }
+        }
+    }
+}
+
+TEST_F(AfiHexDecode, OddLength)
+{
+    for (size_t k = 0; k < T_HEX_NUM_KERNELS; k++) {
+        if (!useKernel(k)) {
+            continue;
+        }
+        SCOPED_TRACE(afiHexKernelName(tHexKernels[k]));
+
+        for (size_t spaceEvery : { 0, 3, 32 }) {
+            for (size_t numDigits = 1; numDigits <= 199; numDigits += 2) {
+                std::string          s = tHexString(numDigits, spaceEvery) +
+                                         " ";
+                std::vector<uint8_t> bin(numDigits);
+                size_t               errPos = 0;
+
+                ASSERT_EQ(-1, afiHexDecode(s.data(), s.size(), bin.data(),
+                                           bin.size(), &errPos))
+                    << "\"" << s << "\"";
+                EXPECT_EQ(s.size(), errPos) << "\"" << s << "\"";
+            }
+        }
+    }
+}
+
+TEST_F(AfiHexDecode, BadDigit)
+{
+    static const char bad[] = { 'g', 'G', '/', ':', '@', '`', '\v', '\0',
+                                '\x80', '\xff' };
+
+    //
+    // A bad character at every offset: in the vector blocks, at their
+    // ends, and in the scalar tail after the last whole block (the
+    // lengths are not all multiples of 16 and 32 characters)
+    //
+    for (size_t k = 0; k < T_HEX_NUM_KERNELS; k++) {
+        if (!useKernel(k)) {
+            continue;
+        }
+        SCOPED_TRACE(afiHexKernelName(tHexKernels[k]));
+
+        for (size_t spaceEvery : { 0, 5 }) {
+            for (size_t numDigits : { 16, 30, 32, 34, 64, 70, 96, 130 }) {
+                std::string          good = tHexString(numDigits, spaceEvery);
+                std::vector<uint8_t> bin(numDigits / 2);
+
+                for (size_t pos = 0; pos < good.size(); pos++) {
+                    for (size_t b = 0; b < sizeof(bad); b++) {
+                        std::string s = good;
+                        size_t      errPos = 0;
+
+                        s[pos] = bad[b];
+                        ASSERT_EQ(-1, afiHexDecode(s.data(), s.size(),
+                                                   bin.data(), bin.size(),
+                                                   &errPos))
+                            << "\"" << s << "\"";
+                        ASSERT_EQ(pos, errPos) << "\"" << s << "\"";
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_F(AfiHexDecode, DstTooShort)
+{
+    for (size_t k = 0; k < T_HEX_NUM_KERNELS; k++) {
+        if (!useKernel(k)) {
+            continue;
+        }
+        SCOPED_TRACE(afiHexKernelName(tHexKernels[k]));
+
+        for (size_t spaceEvery : { 0, 6 }) {
+            std::vector<size_t>  digitPos;
+            std::string          s = tHexString(128, spaceEvery, &digitPos);
+            std::vector<uint8_t> bin(64);
+
+            for (size_t dstLen = 0; dstLen < 64; dstLen++) {
+                size_t errPos = 0;
+
+                ASSERT_EQ(-1, afiHexDecode(s.data(), s.size(), bin.data(),
+                                           dstLen, &errPos));
+                ASSERT_EQ(digitPos[2 * dstLen], errPos) << dstLen;
+            }
+        }
+    }
+}
+
+TEST_F(AfiHexDecode, Utils)
+{
+    for (size_t k = 0; k < T_HEX_NUM_KERNELS; k++) {
+        if (!useKernel(k)) {
+            continue;
+        }
+        SCOPED_TRACE(afiHexKernelName(tHexKernels[k]));
+
+        char buf[4];
+
+        EXPECT_EQ(3, convertHexStringToBinary(" 0a\t1B\nff ", buf,
+                                              sizeof(buf)));
+        EXPECT_EQ(0, memcmp(buf, "\x0a\x1b\xff", 3));
+        EXPECT_EQ(-1, convertHexStringToBinary("0a1", buf, sizeof(buf)));
+        EXPECT_EQ(-1, convertHexStringToBinary("0a1x", buf, sizeof(buf)));
+        EXPECT_EQ(-1, convertHexStringToBinary("0a1b2c3d4e", buf,
+                                               sizeof(buf)));
+
+        char pkt[] = "00 11 22 33 44";
+        EXPECT_EQ(-1, convertHexPktStrToPkt(pkt, buf, sizeof(buf)));
+        EXPECT_EQ(4, convertHexPktStrToPkt(pkt + 3, buf, sizeof(buf)));
+        EXPECT_EQ(0, memcmp(buf, "\x11\x22\x33\x44", 4));
+    }
+}
+
+//
+// Punt dispatch
+//
+// Packets of known sandboxes and ports dispatched to handlers, and to
+// the fallback queue when no handler takes them. These tests need no
+// sandbox.
+//
+
+#define T_PUNT_SB       3
+#define T_PUNT_PORT     2
+
+//
+// Punted packet of the frame, from sandbox and port
+//
+static AftPacketPtr
+tPuntPkt (const TestPktFrame &frame,
+          AftSandboxId        sandboxId = T_PUNT_SB,
+          AftIndex            portIndex = T_PUNT_PORT)
+{
+    AftPacketPtr pkt = AftPacket::createTransmit(frame.size(), sandboxId,
+                                                 portIndex,
+                                                 AftPacket::PacketTypeL2);
+    memcpy(pkt->data(), frame.data(), frame.size());
+    return pkt;
+}
+
+static TestPktFrame
+tPuntUdpFrame (uint16_t dstPort)
+{
+    using namespace PktBuild;
+
+    return TestPktFrame(Ether(tDisDstMac, tDisSrcMac) /
+                        IPv4("103.30.60.2", "103.30.60.1") /
+                        Udp(49152, dstPort) / Fill(24));
+}
+
+static TestPktFrame
+tPuntIcmpFrame (void)
+{
+    using namespace PktBuild;
+
+    return TestPktFrame(Ether(tDisDstMac, tDisSrcMac) /
+                        IPv4("103.30.60.2", "103.30.60.1") /
+                        Icmp(8, 0, 0x3edd, 1) / Fill(24));
+}
+
+//
+// Handler recording the packets it got
+//
+struct TPuntSeen {
+    std::string   handler;
+    AfiPuntClass  puntClass;
+    AftPacketPtr  pkt;
+};
+
+static AfiPuntHandler
+tPuntRecorder (const std::string &name, std::vector<TPuntSeen> &seen)
+{
+    return [name, &seen](AfiPuntClass puntClass, AfiPktBatch &pkts) {
+        for (auto &pkt : pkts) {
+            TPuntSeen s = { name, puntClass, pkt };
+            seen.push_back(s);
+        }
+    };
+}
+
+//
+// Dispatch a packet on its own. Returns the name of the handler that
+// got it, "" if it went to the fallback queue.
+//
+static std::string
+tPuntDispatch (AfiPuntDispatcher      &dispatcher,
+               std::vector<TPuntSeen> &seen,
+               const AftPacketPtr     &pkt,
+               AfiPuntClass           *puntClass = NULL)
+{
+    AfiPuntDispatcher::Scratch scratch;
+    AfiPktBatch                batch(1, pkt);
+
+    seen.clear();
+    dispatcher.dispatch(batch, scratch);
+    EXPECT_TRUE(batch.empty());
+    if (seen.empty()) {
+        return "";
+    }
+    EXPECT_EQ(1u, seen.size());
+    EXPECT_EQ(pkt, seen[0].pkt);
+    if (puntClass) {
+        *puntClass = seen[0].puntClass;
+    }
+    return seen[0].handler;
+}
+
+TEST(AfiPuntDispatcher, Classify)
+{
+    using namespace PktBuild;
+
+    AfiPuntDispatcher dispatcher;
+    TestPktFrame      bfd    = tPuntUdpFrame(3784);
+    TestPktFrame      udp    = tPuntUdpFrame(5000);
+    TestPktFrame      icmp   = tPuntIcmpFrame();
+    TestPktFrame      lldp(Ether(tDisDstMac, tDisSrcMac, 0x88cc) / Fill(46));
+    TestPktFrame      other(Ether(tDisDstMac, tDisSrcMac, 0x88b5) / Fill(46));
+    TestPktFrame      mpls(Ether(tDisDstMac, tDisSrcMac) / Mpls(16) /
+                           IPv4("103.30.60.2", "103.30.60.1") /
+                           Udp(49152, 3784) / Fill(24));
+
+    EXPECT_EQ(AFI_PUNT_CLASS_BFD, dispatcher.classify(bfd.data(), bfd.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_IPV4, dispatcher.classify(udp.data(), udp.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_ICMP,
+              dispatcher.classify(icmp.data(), icmp.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_LLDP,
+              dispatcher.classify(lldp.data(), lldp.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_NONE,
+              dispatcher.classify(other.data(), other.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_NONE,
+              dispatcher.classify(mpls.data(), mpls.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_NONE, dispatcher.classify(udp.data(), 13));
+
+    //
+    // Application classes, and mappings removed
+    //
+    dispatcher.setUdpPortClass(5000, AFI_PUNT_CLASS_USER);
+    dispatcher.setEtherTypeClass(0x88b5, AFI_PUNT_CLASS_USER + 1);
+    dispatcher.setIpProtoClass(1, AFI_PUNT_CLASS_NONE);
+    dispatcher.setUdpPortClass(3784, AFI_PUNT_CLASS_NONE);
+
+    EXPECT_EQ(AFI_PUNT_CLASS_USER, dispatcher.classify(udp.data(), udp.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_USER + 1,
+              dispatcher.classify(other.data(), other.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_IPV4,
+              dispatcher.classify(icmp.data(), icmp.size()));
+    EXPECT_EQ(AFI_PUNT_CLASS_IPV4, dispatcher.classify(bfd.data(), bfd.size()));
+}
+
+TEST(AfiPuntDispatcher, MostSpecificFirst)
+{
+    using namespace PktBuild;
+
+    const AftSandboxId     anySb = AfiPuntDispatcher::AnySandbox;
+    AfiPuntDispatcher      dispatcher;
+    std::vector<TPuntSeen> seen;
+    AfiPuntClass           puntClass;
+    TestPktFrame           icmp = tPuntIcmpFrame();
+    TestPktFrame           bfd  = tPuntUdpFrame(3784);
+    TestPktFrame           lldp(Ether(tDisDstMac, tDisSrcMac, 0x88cc) /
+                                Fill(46));
+
+    //
+    // Least specific handlers first: the order they are tried in is
+    // not the order they were registered in
+    //
+    int ipv4 = dispatcher.registerHandler(AFI_PUNT_CLASS_IPV4, "ipv4",
+                                          tPuntRecorder("ipv4", seen));
+    int any  = dispatcher.registerHandler(AFI_PUNT_CLASS_ICMP, "icmp",
+                                          tPuntRecorder("icmp", seen));
+    int sb   = dispatcher.registerHandler(AFI_PUNT_CLASS_ICMP, "icmp-sb",
+                                          tPuntRecorder("icmp-sb", seen),
+                                          T_PUNT_SB);
+    int port = dispatcher.registerHandler(AFI_PUNT_CLASS_ICMP, "icmp-port",
+                                          tPuntRecorder("icmp-port", seen),
+                                          anySb, T_PUNT_PORT);
+    int both = dispatcher.registerHandler(AFI_PUNT_CLASS_ICMP, "icmp-sb-port",
+                                          tPuntRecorder("icmp-sb-port", seen),
+                                          T_PUNT_SB, T_PUNT_PORT);
+    int bfdSb = dispatcher.registerHandler(AFI_PUNT_CLASS_BFD, "bfd-sb",
+                                           tPuntRecorder("bfd-sb", seen),
+                                           T_PUNT_SB);
+    ASSERT_GE(ipv4, 0);
+    ASSERT_GE(any, 0);
+    ASSERT_GE(sb, 0);
+    ASSERT_GE(port, 0);
+    ASSERT_GE(both, 0);
+    ASSERT_GE(bfdSb, 0);
+    EXPECT_EQ(-1, dispatcher.registerHandler(AFI_PUNT_CLASS_NONE, "none",
+                                             tPuntRecorder("none", seen)));
+
+    EXPECT_EQ("icmp-sb-port",
+              tPuntDispatch(dispatcher, seen, tPuntPkt(icmp), &puntClass));
+    EXPECT_EQ(AFI_PUNT_CLASS_ICMP, puntClass);
+    EXPECT_EQ("icmp-sb", tPuntDispatch(dispatcher, seen,
+                                       tPuntPkt(icmp, T_PUNT_SB, 5)));
+    EXPECT_EQ("icmp-port", tPuntDispatch(dispatcher, seen,
+                                         tPuntPkt(icmp, 4, T_PUNT_PORT)));
+    EXPECT_EQ("icmp", tPuntDispatch(dispatcher, seen, tPuntPkt(icmp, 4, 5)));
+
+    //
+    // A class without a handler for the packet's sandbox: the next less
+    // specific class' handler gets it
+    //
+    EXPECT_EQ("bfd-sb",
+              tPuntDispatch(dispatcher, seen, tPuntPkt(bfd), &puntClass));
+    EXPECT_EQ(AFI_PUNT_CLASS_BFD, puntClass);
+    EXPECT_EQ("ipv4", tPuntDispatch(dispatcher, seen, tPuntPkt(bfd, 4),
+                                    &puntClass));
+    EXPECT_EQ(AFI_PUNT_CLASS_IPV4, puntClass);
+    EXPECT_EQ("", tPuntDispatch(dispatcher, seen, tPuntPkt(lldp)));
+
+    //
+    // One batch: each handler gets its packets in order
+    //
+    AfiPuntDispatcher::Scratch scratch;
+    AfiPktBatch                batch;
+
+    batch.push_back(tPuntPkt(icmp));
+    batch.push_back(tPuntPkt(bfd, 4));
+    batch.push_back(tPuntPkt(icmp, 4, 5));
+    batch.push_back(tPuntPkt(icmp));
+    AfiPktBatch sent(batch);
+
+    seen.clear();
+    dispatcher.dispatch(batch, scratch);
+    EXPECT_TRUE(batch.empty());
+    ASSERT_EQ(4u, seen.size());
+    EXPECT_EQ("ipv4", seen[0].handler);
+    EXPECT_EQ(sent[1], seen[0].pkt);
+    EXPECT_EQ("icmp", seen[1].handler);
+    EXPECT_EQ(sent[2], seen[1].pkt);
+    EXPECT_EQ("icmp-sb-port", seen[2].handler);
+    EXPECT_EQ(sent[0], seen[2].pkt);
+    EXPECT_EQ("icmp-sb-port", seen[3].handler);
+    EXPECT_EQ(sent[3], seen[3].pkt);
+
+    //
+    // Unregistered handlers are passed over
+    //
+    EXPECT_EQ(0, dispatcher.unregisterHandler(both));
+    EXPECT_EQ(-1, dispatcher.unregisterHandler(both));
+    EXPECT_EQ("icmp-sb", tPuntDispatch(dispatcher, seen, tPuntPkt(icmp)));
+    EXPECT_EQ(0, dispatcher.unregisterHandler(sb));
+    EXPECT_EQ("icmp-port", tPuntDispatch(dispatcher, seen, tPuntPkt(icmp)));
+    EXPECT_EQ(0, dispatcher.unregisterHandler(port));
+    EXPECT_EQ(0, dispatcher.unregisterHandler(any));
+    EXPECT_EQ("ipv4", tPuntDispatch(dispatcher, seen, tPuntPkt(icmp),
+                                    &puntClass));
+    EXPECT_EQ(AFI_PUNT_CLASS_IPV4, puntClass);
+    EXPECT_EQ("bfd-sb", tPuntDispatch(dispatcher, seen, tPuntPkt(bfd)));
+}
+
+TEST(AfiPuntDispatcher, FallbackOverflow)
+{
+    using namespace PktBuild;
+
+    AfiPuntDispatcher          dispatcher;
+    AfiPuntDispatcher::Scratch scratch;
+    AfiPktBatch                batch;
+    AfiPktBatch                sent;
+    AftPacketPtr               pkt;
+    TestPktFrame               frame(Ether(tDisDstMac, tDisSrcMac, 0x88b5) /
+                                     Fill(46));
+    const size_t               extra = 5;
+
+    //
+    // The ring wraps: the oldest packets are dropped for the last ones
+    //
+    for (size_t i = 0; i < AFI_PUNT_FALLBACK_Q_MAX + extra; i++) {
+        batch.push_back(tPuntPkt(frame, T_PUNT_SB, i));
+    }
+    sent = batch;
+
+    //
+    // Too big to be copied: dropped
+    //
+    AftPacketPtr big = AftPacket::createTransmit(AFI_PKT_POOL_DATA_MAX + 1,
+                                                 T_PUNT_SB, 1000,
+                                                 AftPacket::PacketTypeL2);
+    memcpy(big->data(), frame.data(), frame.size());
+    batch.push_back(big);
+
+    dispatcher.dispatch(batch, scratch);
+    EXPECT_TRUE(batch.empty());
+
+    for (size_t i = extra; i < AFI_PUNT_FALLBACK_Q_MAX + extra; i++) {
+        ASSERT_TRUE(dispatcher.fallbackPop(pkt)) << i;
+        EXPECT_NE(sent[i], pkt);
+        EXPECT_EQ(T_PUNT_SB, pkt->sandboxId());
+        EXPECT_EQ(i, pkt->portIndex());
+        ASSERT_EQ((int)frame.size(), (int)pkt->dataSize());
+        EXPECT_EQ(0, memcmp(pkt->data(), frame.data(), frame.size()));
+    }
+    EXPECT_FALSE(dispatcher.fallbackPop(pkt));
+
+    std::ostringstream os;
+    dispatcher.description(os);
+    EXPECT_NE(std::string::npos,
+              os.str().find("queued 0 dropped " +
+                            std::to_string(extra + 1)))
+        << os.str();
+
+    //
+    // Queued again once emptied
+    //
+    std::vector<TPuntSeen> seen;
+
+    EXPECT_EQ("", tPuntDispatch(dispatcher, seen,
+                                tPuntPkt(frame, T_PUNT_SB, 7)));
+    ASSERT_TRUE(dispatcher.fallbackPop(pkt));
+    EXPECT_EQ(7u, pkt->portIndex());
+    EXPECT_FALSE(dispatcher.fallbackPop(pkt));
+}
+
+//
+// Local server address
+//
+
+TEST(AfiLocalServer, ParseAddr)
+{
+    static const struct {
+        const char *addr;
+        int         ret;
+        uint32_t    latencyUs;
+        uint32_t    jitterUs;
+    } cases[] = {
+        { "local",                 1, 0,        0 },
+        { "local:200",             1, 200,      0 },
+        { "local:200:50",          1, 200,      50 },
+        { "local:0:0",             1, 0,        0 },
+        { "local:10000000",        1, 10000000, 0 },
+        { "127.0.0.1:50051",       0, 0,        0 },
+        { "localhost:50051",       0, 0,        0 },
+        { "loc",                   0, 0,        0 },
+        { "local:abc",            -1, 0,        0 },
+        { "local:",               -1, 0,        0 },
+        { "local::50",            -1, 0,        0 },
+        { "local:200:",           -1, 0,        0 },
+        { "local:200x",           -1, 0,        0 },
+        { "local:200:50x",        -1, 0,        0 },
+        { "local:200:50:1",       -1, 0,        0 },
+        { "local:-1",             -1, 0,        0 },
+        { "local:+1",             -1, 0,        0 },
+        { "local: 1",             -1, 0,        0 },
+        { "local:0x10",           -1, 0,        0 },
+        { "local:10000001",       -1, 0,        0 },
+        { "local:200:99999999999999999999", -1, 0, 0 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        AfiLocalDelay delay;
+
+        delay.latencyUs = 7;
+        delay.jitterUs  = 7;
+        EXPECT_EQ(cases[i].ret, AfiLocalServer::parseAddr(cases[i].addr,
+                                                          delay))
+            << cases[i].addr;
+        if (cases[i].ret != 0) {
+            EXPECT_EQ(cases[i].latencyUs, delay.latencyUs) << cases[i].addr;
+            EXPECT_EQ(cases[i].jitterUs, delay.jitterUs) << cases[i].addr;
+        }
+    }
+
+    //
+    // Trailing NUL
+    //
+    AfiLocalDelay delay;
+    EXPECT_EQ(-1, AfiLocalServer::parseAddr(std::string("local:200\0", 10),
+                                            delay));
+}
+
+//
+// Packet pool
+//
+
+TEST(AfiPacketPool, ExhaustedOversize)
+{
+    AfiPacketPool        pool(AftPacket::PacketDirTransmit, 2);
+    AfiPacketPool::Stats s;
+
+    //
+    // Too big for a pooled packet: from the heap, the pool is not
+    // exhausted
+    //
+    AftPacketPtr big = pool.getTransmit(AFI_PKT_POOL_DATA_MAX + 1, 1, 2,
+                                        AftPacket::PacketTypeL2);
+    ASSERT_TRUE(big != nullptr);
+    EXPECT_EQ(AFI_PKT_POOL_DATA_MAX + 1, big->dataSize());
+    pool.stats(s);
+    EXPECT_EQ(1u, s.gets);
+    EXPECT_EQ(1u, s.oversize);
+    EXPECT_EQ(0u, s.exhausted);
+    EXPECT_EQ(0u, s.inUse);
+
+    AftPacketPtr a = pool.getTransmit(64, 1, 2, AftPacket::PacketTypeL2);
+    AftPacketPtr b = pool.getTransmit(64, 1, 3, AftPacket::PacketTypeL2);
+    AftPacketPtr c = pool.getTransmit(64, 1, 4, AftPacket::PacketTypeL2);
+    EXPECT_EQ(4u, c->portIndex());
+    pool.stats(s);
+    EXPECT_EQ(4u, s.gets);
+    EXPECT_EQ(1u, s.oversize);
+    EXPECT_EQ(1u, s.exhausted);
+    EXPECT_EQ(2u, s.inUse);
+
+    a.reset();
+    AftPacketPtr d = pool.getTransmit(AFI_PKT_POOL_DATA_MAX, 1, 5,
+                                      AftPacket::PacketTypeL2);
+    pool.stats(s);
+    EXPECT_EQ(1u, s.oversize);
+    EXPECT_EQ(1u, s.exhausted);
+    EXPECT_EQ(2u, s.inUse);
+}
+
+//
+// Software dataplane
+//
+// The topologies of the AFI tests are programmed into a sandbox of the
+// local AFI server, compiled, and the tests' packets run through them.
+// These tests need no vMX.
+//
+
+#define DP_NUM_CFG_PORTS    8
+#define DP_PUNT_PORT        DP_NUM_CFG_PORTS
+
+static const PktBuild::Mac dpEncapDstMac("32:26:0a:2e:cc:f3");
+static const PktBuild::Mac dpEncapSrcMac("32:26:0a:2e:aa:f3");
+
+class AfiDpGraph : public ::testing::Test
+{
+protected:
+    AfiDpGraph() : _client(_ioService, "local", "127.0.0.1:0", 0, false,
+                           false), _frameLen(0) {
+    }
+
+    virtual void SetUp() {
+        ASSERT_EQ(0, _client.openSandbox(sbName, DP_NUM_CFG_PORTS));
+    }
+
+    void compile(void) {
+        AfiLocalSandbox model;
+
+        ASSERT_TRUE(_client.localServer()->sandbox(sbName, model));
+        ASSERT_EQ(0, _dp.compile(_client.sandbox(), model));
+    }
+
+    //
+    // Run a test packet received on port, expecting verdict (and
+    // outPort if forwarded)
+    //
+    void run(AftIndex port, TestPacketLibrary::TestPacketId pktId,
+             AfiDpVerdict verdict, AftIndex outPort = 0) {
+        TestPacket *testPkt = testPacketLibrary.getTestPacket(pktId);
+
+        _frameLen = testPkt->getEtherPacket((char *)_frame, sizeof(_frame));
+        ASSERT_GT(_frameLen, 0);
+        ASSERT_EQ(0, _pkt.load(port, _frame, _frameLen));
+        _dp.runPkt(_pkt, 0);
+
+        EXPECT_EQ(verdict, _pkt.verdict) << _dp.pathDescription(_pkt);
+        if (verdict == AfiDpForward) {
+            EXPECT_EQ(outPort, _pkt.outPort) << _dp.pathDescription(_pkt);
+        }
+    }
+
+    //
+    // The packet sent ends with the last len bytes of the frame
+    //
+    void expectTail(int len) {
+        ASSERT_GE((int)_pkt.len, len);
+        EXPECT_EQ(0, memcmp(_pkt.data + _pkt.len - len,
+                            _frame + _frameLen - len, len));
+    }
+
+    boost::asio::io_service _ioService;
+    AfiClient               _client;
+    AfiDataplane            _dp;
+    AfiDpPkt                _pkt;
+    uint8_t                 _frame[AFI_DP_PKT_MAX];
+    int                     _frameLen;
+};
+
+TEST_F(AfiDpGraph, CounterList)
+{
+    AftNodeToken   cntrToken = _client.addCounterNode();
+    AftTokenVector tokVec    = { cntrToken, _client.getOuputPortToken(1) };
+
+    ASSERT_EQ(0, _client.setInputPortNextNode(0,
+                                              _client.createList(tokVec)));
+    compile();
+
+    run(0, TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO, AfiDpForward, 1);
+
+    //
+    // Untagged IPv4 leaves without its Ethernet header
+    //
+    EXPECT_EQ((uint32_t)_frameLen - 14, _pkt.len);
+    expectTail(_frameLen - 14);
+
+    uint64_t pkts = 0, bytes = 0;
+    EXPECT_TRUE(_dp.counter(cntrToken, pkts, bytes));
+    EXPECT_EQ(1u, pkts);
+}
+
+TEST_F(AfiDpGraph, Discard)
+{
+    ASSERT_EQ(0, _client.setInputPortNextNode(6, _client.addDiscardNode()));
+    compile();
+
+    run(6, TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO, AfiDpDiscard);
+    run(DP_NUM_CFG_PORTS, TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO,
+        AfiDpNoNext);                                   // No such port
+}
+
+//
+// Routes with host bits set and short ones must land where their
+// prefix says (and not past the end of the table)
+//
+TEST_F(AfiDpGraph, IPv4Routing)
+{
+    AftNodeToken rttToken = _client.addRouteTable("rtt0",
+                                _client.getOuputPortToken(DP_PUNT_PORT));
+    ASSERT_EQ(0, _client.setInputPortNextNode(2, rttToken));
+
+    AftNodeToken encapToken = _client.addEtherEncapNode("32:26:0a:2e:cc:f3",
+                                                        "32:26:0a:2e:aa:f3",
+                                                        "0", "0",
+                                                _client.getOuputPortToken(3));
+    EXPECT_EQ(0, _client.addRoute(rttToken, "192.168.1.1/1",
+                                  _client.getOuputPortToken(5)));
+    EXPECT_EQ(0, _client.addRoute(rttToken, "103.30.15.255/20",
+                                  _client.getOuputPortToken(6)));
+    EXPECT_EQ(0, _client.addRoute(rttToken, "103.30.30.0/24", encapToken));
+    EXPECT_EQ(0, _client.addRoute(rttToken, "103.30.0.77/24",
+                                  _client.getOuputPortToken(7)));
+    EXPECT_EQ(0, _client.addRoute(rttToken, "103.30.10.5/29",
+                                  _client.getOuputPortToken(4)));
+    compile();
+
+    //
+    // 103.30.30.3: /24, Ethernet header of the encap in front
+    //
+    run(2, TestPacketLibrary::TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3,
+        AfiDpForward, 3);
+    ASSERT_EQ((uint32_t)_frameLen, _pkt.len);
+    EXPECT_EQ(0, memcmp(_pkt.data, dpEncapDstMac.b, 6));
+    EXPECT_EQ(0, memcmp(_pkt.data + 6, dpEncapSrcMac.b, 6));
+    EXPECT_EQ(0x08, _pkt.data[12]);
+    EXPECT_EQ(0x00, _pkt.data[13]);
+    expectTail(_frameLen - 14);
+
+    //
+    // 103.30.0.1: 103.30.0.77/24 is 103.30.0.0/24
+    //
+    run(2, TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO, AfiDpForward, 7);
+
+    //
+    // 103.30.10.3: 103.30.10.5/29 is 103.30.10.0/29
+    //
+    run(2, TestPacketLibrary::TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP1,
+        AfiDpForward, 4);
+
+    //
+    // 103.30.80.3: outside 103.30.15.255/20 (103.30.0.0/20) and
+    // 192.168.1.1/1 (128.0.0.0/1): default
+    //
+    run(2, TestPacketLibrary::TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP2,
+        AfiDpForward, DP_PUNT_PORT);
+}
+
+TEST_F(AfiDpGraph, MPLS_L2VPN_Encap)
+{
+    AftNodeToken iTableToken = _client.createIndexTable("packet.ether.vlan1",
+                                                        25);
+    ASSERT_EQ(0, _client.setInputPortNextNode(4, iTableToken));
+
+    AftNodeToken encapToken = _client.addEtherEncapNode("32:26:0a:2e:cc:f3",
+                                                        "32:26:0a:2e:aa:f3",
+                                                        "0", "0",
+                                                _client.getOuputPortToken(5));
+    EXPECT_EQ(0, _client.addIndexTableEntry(iTableToken, 11,
+                    _client.addLabelEncap("1000002", "16", encapToken)));
+    compile();
+
+    //
+    // VLAN 11 frame, as it is, under labels 1000002, 16 and Ethernet
+    //
+    run(4, TestPacketLibrary::TEST_PKT_ID_IPV4_VLAN, AfiDpForward, 5);
+    ASSERT_EQ((uint32_t)_frameLen + 14 + 8, _pkt.len);
+    expectTail(_frameLen);
+
+    AfiPktDissector out(_pkt.data, _pkt.len);
+    EXPECT_EQ(0, memcmp(out.ethDst(), dpEncapDstMac.b, 6));
+    ASSERT_EQ(2, out.numLabels());
+    EXPECT_EQ(1000002u, out.mplsLabel(0));
+    EXPECT_EQ(16u, out.mplsLabel(1));
+}
+
+TEST_F(AfiDpGraph, MPLS_L2VPN_Decap)
+{
+    AftNodeToken iTableToken = _client.createIndexTable("packet.ether.vlan1",
+                                                        25);
+    ASSERT_EQ(0, _client.setInputPortNextNode(5,
+                                    _client.addLabelDecap(iTableToken)));
+    EXPECT_EQ(0, _client.addIndexTableEntry(iTableToken, 11,
+                                            _client.getOuputPortToken(4)));
+    compile();
+
+    //
+    // Labels 200, 200 popped: the VLAN 11 frame under them
+    //
+    run(5, TestPacketLibrary::TEST_PKT_ID_MPLS_L2VLAN, AfiDpForward, 4);
+    EXPECT_EQ((uint32_t)_frameLen - 14 - 8, _pkt.len);
+    expectTail(_frameLen - 14 - 8);
+}
+
 void 
 getTimeStr(std::string &timeStr)
 {
@@ -855,66 +2276,71 @@ tapIfReadPkts(std::string &tapName)
     int tap_fd = tapIf.init();
     EXPECT_GT(tap_fd, 0);
 
+    tap_ready.store(true);
+
     while (!test_complete.load()) {
-        ret = tapIf.ifRead();
+        ret = tapIf.ifRead(TAP_READ_POLL_MS);
     }
 }
 
-static std::string 
-getShellCmdOutput(std::string &cmd) 
+//
+// Wait for the tap reader thread to have the tap open
+//
+static void
+waitTapReady (void)
 {
-    std::array<char, 128> buff;
-
-    std::string output;
-    std::shared_ptr<FILE> pipe(popen(cmd.c_str(), "r"), pclose);
-    if (!pipe) throw std::runtime_error("popen() failed!");
-    while (!feof(pipe.get())) {
-        if (fgets(buff.data(), 128, pipe.get()) != NULL)
-            output += buff.data();
+    while (!tap_ready.load()) {
+        usleep(1000);
     }
-    return output;
+    tap_ready.store(false);
 }
 
+//
+// Start capturing on the interfaces a test checks. Capturing is on
+// when this returns.
+//
 static void 
-tStartTsharkCapture (std::string &tcName,
-                      std::string &tName,
-                      std::vector<std::string> &interfaces)
+tStartCapture (std::string &tcName,
+               std::string &tName,
+               std::vector<std::string> &interfaces)
 {
     int ret;
-    std::string cmd, cmd_output;
+    std::string cmd;
     std::string tDir = tcName + "/" + tName;
     std::string tOutputDir = gtestOutputDirName + "/" + tDir;
+    std::string tExpectedDir = gtestExpectedDirName + "/" + tDir;
   
     cmd = "mkdir -p " + tOutputDir;
     ret = system(cmd.c_str());
     EXPECT_EQ(0, ret);
 
+    tExpectedFrames.clear();
+    tExpectedCount = 0;
     for(auto interface : interfaces) {
+        std::string ifExpectedPcapFile = tExpectedDir + "/" + interface  + ".pcap";
 
-        std::string ifPcapFile = tOutputDir + "/" + interface  + ".pcap";
-        std::string ifstderrFile = tOutputDir + "/" + interface  + ".stderr";
-        std::string tsharkCmd = tsharkBinary + " -i " + interface + 
-                             " -w " + ifPcapFile + " 2> " + ifstderrFile + " < /dev/null &";
-
-        ret = system(tsharkCmd.c_str());
-        EXPECT_EQ(0, ret);
-
-        cmd = "cat " + ifstderrFile;
-        cmd_output = getShellCmdOutput(cmd);
-        while (cmd_output.find("Capturing on") != std::string::npos) {
-            sleep (1);
-            cmd_output = getShellCmdOutput(cmd);
-        }
-        sleep (1);
+        ret = TestCapture::readFile(ifExpectedPcapFile,
+                                    tExpectedFrames[interface]);
+        EXPECT_EQ(0, ret) << ifExpectedPcapFile;
+        tExpectedCount += tExpectedFrames[interface].size();
+    }
 
-        //cmd = "rm -f " + ifstderrFile;
-        //cmd_output = getShellCmdOutput(cmd);
-    } 
+    ret = tCapture.start(interfaces);
+    EXPECT_EQ(0, ret);
+}
 
-    //
-    // tshark takes somet to run
-    //
-    sleep(15);
+//
+// Stop capturing once the expected packets are in and the interfaces
+// went quiet (or on timeout)
+//
+static void
+stopCapture (void)
+{
+    if (!tCapture.quiesce(tExpectedCount)) {
+        std::cout << "Captured " << tCapture.count() << " of ";
+        std::cout << tExpectedCount << " expected packets" << std::endl;
+    }
+    tCapture.stop();
 }
 
 static void
@@ -922,62 +2348,43 @@ tVerifyPackets (std::string &tcName,
                 std::string &tName,
                 std::vector<std::string> &interfaces)
 {
-    int ret = 0;
-    std::string cmd;
     std::string tDir = tcName + "/" + tName;
     std::string tOutputDir = gtestOutputDirName + "/" + tDir;
     std::string tExpectedDir = gtestExpectedDirName + "/" + tDir;
 
     for(auto interface : interfaces) {
         std::string ifPcapFile = tOutputDir + "/" + interface  + ".pcap";
-        std::string ifPktsFile = tOutputDir + "/" + interface  + ".pkts";
         std::string ifExpectedPcapFile = tExpectedDir + "/" + interface  + ".pcap";
-        std::string ifExpectedPktsFile = tOutputDir + "/" + interface  + ".pkts.expected";
 
-        cmd = tsharkBinary + " -nx " + " -r " + ifExpectedPcapFile + " > " + ifExpectedPktsFile + " 2> /dev/null";
-        ret = system(cmd.c_str());
-        EXPECT_EQ(0, ret);
-        cmd = tsharkBinary + " -nx " + " -r " + ifPcapFile + " > " + ifPktsFile + " 2> /dev/null";
-        ret = system(cmd.c_str());
-        EXPECT_EQ(0, ret);
-        cmd = "diff " + ifExpectedPktsFile + " " + ifPktsFile;
-        std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
-        std::cout << cmd << std::endl;
-        std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
-        ret = system(cmd.c_str());
-        EXPECT_EQ(0, ret);
+        std::vector<TestCapture::Frame> &expected = tExpectedFrames[interface];
+        std::vector<TestCapture::Frame>  actual   = tCapture.frames(interface);
+
+        EXPECT_EQ(0, tCapture.write(interface, ifPcapFile));
+        EXPECT_EQ(expected.size(), actual.size()) << interface;
 
-        if (ret != 0) {
-            // diff present
-            std::cout << "Expected packets and actual packets differ" << std::endl;
-            std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
-            std::cout << "Expected: " << ifExpectedPcapFile << std::endl;
-            std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
-            cmd = tsharkBinary + " -nVx " + " -r " + ifExpectedPcapFile + " 2> /dev/null";
-            std::cout << getShellCmdOutput(cmd);
-            std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
-            std::cout << "Actual: "<< ifPcapFile << std::endl;
-            std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
-            cmd = tsharkBinary + " -nVx " + " -r " + ifPcapFile + " 2> /dev/null";
-            std::cout << getShellCmdOutput(cmd);
-        } else {
+        if (expected == actual) {
             // No diff
             std::cout << "SUCCESS: Actual packets matches with expected packets" << std::endl;
+            continue;
         }
-    } 
-}
 
-static
-void stopTsharkCapture (void)
-{
-    int ret;
-    std::string cmd = "ps -auwx | grep tshark | grep -v grep";
-    std::string cmd_output = getShellCmdOutput(cmd);
-    while (cmd_output.find("tshark") != std::string::npos) {
-        sleep (1);
-        system("/usr/bin/pkill tshark");
-        cmd_output = getShellCmdOutput(cmd);
-    }
+        // diff present
+        ADD_FAILURE() << "Expected packets and actual packets differ on " << interface;
+        std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
+        std::cout << "Expected: " << ifExpectedPcapFile << std::endl;
+        std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
+        for (auto &frame : expected) {
+            std::cout << AfiPktDissector(frame.data(), frame.size()) << std::endl;
+            pktTrace("Expected pkt", (char *)frame.data(), frame.size());
+        }
+        std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
+        std::cout << "Actual: "<< ifPcapFile << std::endl;
+        std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
+        for (auto &frame : actual) {
+            std::cout << AfiPktDissector(frame.data(), frame.size()) << std::endl;
+            pktTrace("Actual pkt", (char *)frame.data(), frame.size());
+        }
+    } 
 }
 
 //
@@ -986,20 +2393,24 @@ void stopTsharkCapture (void)
 int main(int argc, char **argv) {
     
     getTimeStr(gTestTimeStr);
-    std::cout<<gTestTimeStr;
+    std::cout<<gTestTimeStr<<std::endl;
 
-    gtestOutputDirName = "GTEST_" + gTestTimeStr;
+    //
+    // Test processes run concurrently by run-afi-gtest share the
+    // output directory
+    //
+    const char *outputDir = getenv("AFI_GTEST_OUTPUT_DIR");
+    gtestOutputDirName = outputDir ? outputDir : "GTEST_" + gTestTimeStr;
     std::string mk_gtestOutputDirName_cmd = "mkdir -p " + gtestOutputDirName;
 
     system(mk_gtestOutputDirName_cmd.c_str());
 
+    TestSandbox::setConfigs(tSandboxes, afiServerAddr, afiHospathAddr);
+
+    //
+    // Tests open their own sandboxes: any one runs alone, e.g.
+    // --gtest_filter=AFI.IPv4Routing
+    //
     ::testing::InitGoogleTest(&argc, argv);
-    ::testing::GTEST_FLAG(filter) = "*";
-    //::testing::GTEST_FLAG(filter) = "*SandboxOpen*:*CounterNode*";
-    //::testing::GTEST_FLAG(filter) = "*SandboxOpen*:*SandboxHostpathPunt*";
-    //::testing::GTEST_FLAG(filter) = "*SandboxOpen*:*SandboxL2Inject*";
-    //::testing::GTEST_FLAG(filter) = "*SandboxOpen*:*IPv4Routing*";
-    //::testing::GTEST_FLAG(filter) = "*SandboxOpen*:*MPLS_L2VPN_Encap*";
-    //::testing::GTEST_FLAG(filter) = "*SandboxOpen*:*MPLS_L2VPN_Decap*";
     return RUN_ALL_TESTS();
 }
@@ -0,0 +1,284 @@
+//
+// DpBench.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestPacket.h"
+#include "TestCapture.h"
+#include "../AfiClient.h"
+#include "../AfiDataplane.h"
+
+#define DP_BENCH_BATCH          64      // Packets per run()
+#define DP_BENCH_NUM_CFG_PORTS  8
+#define DP_BENCH_PUNT_PORT      DP_BENCH_NUM_CFG_PORTS
+#define DP_BENCH_NO_OUTPUT      ((AftIndex)-1)
+
+const std::string dpSbName          = "green";
+const std::string dpExpectedDirName = "GTEST_EXPECTED/AFI";
+
+//
+// Workloads: packets of the AfiGTest tests on the sandbox they program,
+// with the output expected by the test (discard and punt have none)
+//
+struct DpWorkload {
+    const char                       *name;
+    const char                       *tName;        //< AfiGTest test
+    TestPacketLibrary::TestPacketId   pktId;
+    AftIndex                          inPort;
+    AfiDpVerdict                      verdict;
+    AftIndex                          outPort;
+};
+
+static const DpWorkload dpWorkloads[] = {
+    { "counter",     "CounterNode",
+      TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO,                0,
+      AfiDpForward, 1 },
+    { "discard",     "DisacrdNode",
+      TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO,                6,
+      AfiDpDiscard, DP_BENCH_NO_OUTPUT },
+    { "route",       "IPv4Routing",
+      TestPacketLibrary::TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3, 2,
+      AfiDpForward, 3 },
+    { "route-punt",  "IPv4Routing",
+      TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO,                2,
+      AfiDpForward, DP_BENCH_PUNT_PORT },
+    { "l2vpn-encap", "MPLS_L2VPN_Encap",
+      TestPacketLibrary::TEST_PKT_ID_IPV4_VLAN,                     4,
+      AfiDpForward, 5 },
+    { "l2vpn-decap", "MPLS_L2VPN_Decap",
+      TestPacketLibrary::TEST_PKT_ID_MPLS_L2VLAN,                   5,
+      AfiDpForward, 4 },
+};
+
+static AfiDpPkt dpPkts[DP_BENCH_BATCH];
+
+static uint64_t
+dpNowNs (void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Program the AfiGTest topologies, each on its own input port, and
+// numRoutes random routes (outside 103/8) to p7 into the routing table
+//
+static void
+dpProgram (AfiClient &client, uint32_t numRoutes)
+{
+    //
+    // p0: counter, p1
+    //
+    AftNodeToken cntrToken = client.addCounterNode();
+    AftTokenVector tokVec  = { cntrToken, client.getOuputPortToken(1) };
+    client.setInputPortNextNode(0, client.createList(tokVec));
+
+    //
+    // p6: discard
+    //
+    client.setInputPortNextNode(6, client.addDiscardNode());
+
+    //
+    // p2: routing table (default punt), 103.30.30.0/24 to p3
+    //
+    AftNodeToken rttToken = client.addRouteTable("rtt0",
+                                client.getOuputPortToken(DP_BENCH_PUNT_PORT));
+    client.setInputPortNextNode(2, rttToken);
+
+    AftNodeToken encapToken = client.addEtherEncapNode("32:26:0a:2e:cc:f3",
+                                                       "32:26:0a:2e:aa:f3",
+                                                       "0", "0",
+                                                client.getOuputPortToken(3));
+    client.addRoute(rttToken, "103.30.30.0/24", encapToken);
+
+    std::mt19937 rand(1);
+    AftNodeToken p7Token = client.getOuputPortToken(7);
+    for (uint32_t i = 0; i < numRoutes; i++) {
+        uint32_t addr = rand();
+        uint32_t len  = 16 + rand() % 17;
+        if ((addr >> 24) == 103) {
+            addr ^= 0x01000000;
+        }
+        addr &= ~0u << (32 - len);
+
+        std::string prefix = std::to_string(addr >> 24) + "." +
+                             std::to_string((addr >> 16) & 0xff) + "." +
+                             std::to_string((addr >> 8) & 0xff) + "." +
+                             std::to_string(addr & 0xff) + "/" +
+                             std::to_string(len);
+        client.addRoute(rttToken, prefix, p7Token);
+    }
+
+    //
+    // p4: VLAN 11 to labels 1000002/16 and ethernet, p5
+    //
+    AftNodeToken iTableToken = client.createIndexTable("packet.ether.vlan1",
+                                                       25);
+    client.setInputPortNextNode(4, iTableToken);
+    encapToken = client.addEtherEncapNode("32:26:0a:2e:cc:f5",
+                                          "32:26:0a:2e:aa:f5", "0", "0",
+                                          client.getOuputPortToken(5));
+    client.addIndexTableEntry(iTableToken, 11,
+                              client.addLabelEncap("1000002", "16",
+                                                   encapToken));
+
+    //
+    // p5: label decap, VLAN 11 to p4
+    //
+    iTableToken = client.createIndexTable("packet.ether.vlan1", 25);
+    client.setInputPortNextNode(5, client.addLabelDecap(iTableToken));
+    client.addIndexTableEntry(iTableToken, 11, client.getOuputPortToken(4));
+}
+
+//
+// Run a workload's packet once and compare the result with what the
+// AfiGTest test expects. Returns 0 - As expected, -1 - Not.
+//
+static int
+dpVerify (AfiDataplane &dp, const DpWorkload &w, const uint8_t *frame,
+          size_t frameLen)
+{
+    AfiDpPkt &pkt = dpPkts[0];
+
+    pkt.load(w.inPort, frame, frameLen);
+    dp.runPkt(pkt, 0);
+
+    if ((pkt.verdict != w.verdict) ||
+        ((w.verdict == AfiDpForward) && (pkt.outPort != w.outPort))) {
+        std::cout << w.name << ": " << dp.pathDescription(pkt) << ": ";
+        std::cout << afiDpVerdictName((AfiDpVerdict)pkt.verdict);
+        std::cout << ", expected output port " << w.outPort << std::endl;
+        return -1;
+    }
+    if ((w.outPort == DP_BENCH_NO_OUTPUT) ||
+        (w.outPort == DP_BENCH_PUNT_PORT)) {
+        return 0;
+    }
+
+    std::string fileName = dpExpectedDirName + "/" + w.tName +
+                           "/ge-0.0." + std::to_string(w.outPort) +
+                           "-vmx1.pcap";
+    std::vector<TestCapture::Frame> expected;
+    if (TestCapture::readFile(fileName, expected) != 0) {
+        std::cout << w.name << ": cannot read " << fileName << std::endl;
+        return -1;
+    }
+    for (const TestCapture::Frame &f : expected) {
+        if ((f.size() == pkt.len) &&
+            (memcmp(f.data(), pkt.data, pkt.len) == 0)) {
+            return 0;
+        }
+    }
+    std::cout << w.name << ": output differs from " << fileName << std::endl;
+    return -1;
+}
+
+//
+// Dataplane benchmark main
+//
+// Programs the AfiGTest topologies into a sandbox of the local AFI
+// server, compiles it and checks the output of each test's packet
+// against the test's expected capture. Then runs each packet in
+// batches for about seconds on one core and reports the rate of every
+// path taken. Run from the test directory (expected captures).
+//
+int
+main(int argc, char *argv[])
+{
+    double   seconds   = (argc > 1) ? std::strtod(argv[1], NULL) : 1;
+    uint32_t numRoutes = (argc > 2) ? std::strtoul(argv[2], NULL, 0) : 0;
+    int      failed    = 0;
+
+    boost::asio::io_service ioService;
+    AfiClient client(ioService, "local", "127.0.0.1:0", 0, false, false);
+
+    if (client.openSandbox(dpSbName, DP_BENCH_NUM_CFG_PORTS) != 0) {
+        std::cout << "Cannot open sandbox " << dpSbName << std::endl;
+        return 1;
+    }
+    dpProgram(client, numRoutes);
+
+    AfiLocalSandbox model;
+    AfiDataplane    dp;
+    client.localServer()->sandbox(dpSbName, model);
+
+    auto start = std::chrono::steady_clock::now();
+    if (dp.compile(client.sandbox(), model) != 0) {
+        std::cout << "Cannot compile sandbox " << dpSbName << std::endl;
+        return 1;
+    }
+    double compileMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start).count();
+    dp.description(std::cout);
+    std::cout << "Compiled in " << std::fixed << std::setprecision(1);
+    std::cout << compileMs << " ms" << std::endl << std::endl;
+
+    std::cout << "    Workload    Mpps  ns/pkt  Verdict      Path" << std::endl;
+
+    for (const DpWorkload &w : dpWorkloads) {
+        TestPacket *testPkt = testPacketLibrary.getTestPacket(w.pktId);
+        uint8_t     frame[AFI_DP_PKT_MAX];
+        int         frameLen = testPkt->getEtherPacket((char *)frame,
+                                                       sizeof(frame));
+
+        if ((frameLen < 0) || (dpVerify(dp, w, frame, frameLen) != 0)) {
+            failed++;
+            continue;
+        }
+
+        dp.clearPaths();
+        uint64_t n = 0;
+        double   elapsed;
+        start = std::chrono::steady_clock::now();
+        do {
+            for (int b = 0; b < 1000; b++) {
+                uint64_t nowNs = dpNowNs();
+                for (int i = 0; i < DP_BENCH_BATCH; i++) {
+                    dpPkts[i].load(w.inPort, frame, frameLen);
+                }
+                dp.run(dpPkts, DP_BENCH_BATCH, nowNs);
+            }
+            n += 1000 * DP_BENCH_BATCH;
+            elapsed = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < seconds);
+
+        for (const auto &path : dp.paths()) {
+            std::cout << std::setw(12) << w.name << std::setprecision(2);
+            std::cout << std::setw(8) << path.second.pkts / elapsed / 1e6;
+            std::cout << std::setprecision(1);
+            std::cout << std::setw(8) << elapsed * 1e9 / n << "  ";
+            std::cout << std::left << std::setw(11);
+            std::cout << afiDpVerdictName(path.second.verdict) << std::right;
+            std::cout << "  " << path.second.description << std::endl;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -48,6 +48,7 @@
 #include <stdarg.h>
 
 #include "TapIf.h"
+#include "../AfiPktDissector.h"
 
 //
 // @fn
@@ -106,12 +107,13 @@ TapIf::tapAlloc(char *dev, int flags)
 // @brief
 // Reads interface
 //
-// @param[in] void
+// @param[in]
+//     timeoutMs Wait for a packet up to (milliseconds)
 // @return  0 - Success, -1 - Error
 //
 
 int 
-TapIf::ifRead(void)
+TapIf::ifRead(int timeoutMs)
 {
     int ret;
     int maxfd;
@@ -124,7 +126,7 @@ TapIf::ifRead(void)
     FD_SET(_tapFd, &rd_set);
     maxfd = _tapFd;
 
-    struct timeval tv = {1, 0};   // 1 seconds!
+    struct timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
     std::cout << "Calling select for fd " << std::dec<< _tapFd ;
     std::cout << "(interface "<< _ifName << ")"<< std::endl;
     ret = select(maxfd + 1, &rd_set, NULL, NULL, &tv);
@@ -146,6 +148,7 @@ TapIf::ifRead(void)
 
         std::cout << "Read " << std::dec << nread << " bytes from the interface " ;
         std::cout <<  "(fd " << std::dec<< _tapFd << "name "<< _ifName << ")"<< std::endl;
+        std::cout << AfiPktDissector((const uint8_t *)data, nread) << std::endl;
         pktTrace("Packet data", data, nread);
 
     } else {
@@ -49,7 +49,7 @@ public:
 	}
 
     int tapAlloc(char *dev, int flags);
-	int ifRead(void);
+	int ifRead(int timeoutMs = 1000);
 
 private:
     char _ifName[IFNAMSIZ];
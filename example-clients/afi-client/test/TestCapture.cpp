@@ -0,0 +1,402 @@
+//
+// TestCapture.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "TestCapture.h"
+
+#define TEST_PCAPNG_SHB             0x0a0d0d0a
+#define TEST_PCAPNG_IDB             0x00000001
+#define TEST_PCAPNG_SPB             0x00000003
+#define TEST_PCAPNG_EPB             0x00000006
+#define TEST_PCAPNG_BYTE_ORDER      0x1a2b3c4d
+#define TEST_PCAP_MAGIC             0xa1b2c3d4
+#define TEST_PCAP_MAGIC_NS          0xa1b23c4d
+
+TestCapture::TestCapture () : _stop(false), _count(0)
+{
+}
+
+TestCapture::~TestCapture ()
+{
+    stop();
+}
+
+//
+// @fn
+// start
+//
+// @brief
+// Bind a capture socket to each interface, then start the capture
+// threads. Packets already queued are dropped: the capture starts
+// with an empty socket.
+//
+// @param[in]
+//     interfaces Interface names
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestCapture::start (const std::vector<std::string> &interfaces)
+{
+    stop();
+
+    _ifs.clear();
+    _count = 0;
+    _stop  = false;
+
+    for (auto &name : interfaces) {
+        std::unique_ptr<Interface> ifc(new Interface);
+        struct ifreq               ifr;
+        struct sockaddr_ll         sll;
+
+        ifc->name     = name;
+        ifc->linkType = TEST_CAPTURE_LINKTYPE_ETHERNET;
+
+        //
+        // Protocol 0 until bound: the socket sees no packet of another
+        // interface
+        //
+        if ((ifc->fd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+            perror("socket");
+            return -1;
+        }
+
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+        if (ioctl(ifc->fd, SIOCGIFINDEX, &ifr) < 0) {
+            perror(name.c_str());
+            close(ifc->fd);
+            return -1;
+        }
+
+        memset(&sll, 0, sizeof(sll));
+        sll.sll_family   = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_ALL);
+        sll.sll_ifindex  = ifr.ifr_ifindex;
+
+        if (ioctl(ifc->fd, SIOCGIFHWADDR, &ifr) == 0) {
+            if (ifr.ifr_hwaddr.sa_family == ARPHRD_NONE) {
+                ifc->linkType = TEST_CAPTURE_LINKTYPE_RAW;
+            }
+        }
+
+        if (bind(ifc->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+            perror("bind(capture)");
+            close(ifc->fd);
+            return -1;
+        }
+
+        _ifs.push_back(std::move(ifc));
+    }
+
+    for (auto &ifc : _ifs) {
+        ifc->thread = std::thread(&TestCapture::captureLoop, this, ifc.get());
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// captureLoop
+//
+// @brief
+// Capture thread: read packets of an interface until stopped
+//
+// @param[in]
+//     ifc Interface
+// @return void
+//
+
+void
+TestCapture::captureLoop (Interface *ifc)
+{
+    std::vector<uint8_t> buf(TEST_CAPTURE_SNAPLEN);
+    struct pollfd        pfd = { ifc->fd, POLLIN, 0 };
+
+    while (!_stop.load()) {
+        int ret = poll(&pfd, 1, TEST_CAPTURE_POLL_MS);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll(capture)");
+            return;
+        }
+        if (ret == 0) {
+            continue;
+        }
+
+        ssize_t len = recv(ifc->fd, buf.data(), buf.size(), MSG_DONTWAIT);
+        if (len < 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> guard(_mutex);
+        ifc->frames.push_back(Frame(buf.begin(), buf.begin() + len));
+        _count++;
+        _cv.notify_all();
+    }
+}
+
+bool
+TestCapture::quiesce (size_t expected, int idleMs, int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeoutMs);
+    auto idle     = std::chrono::milliseconds(idleMs);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (;;) {
+        size_t count = _count;
+        auto   now   = std::chrono::steady_clock::now();
+
+        if (now >= deadline) {
+            break;
+        }
+
+        //
+        // Until the expected packets are in, wait for them; then for
+        // idleMs more without a packet
+        //
+        if (count < expected) {
+            _cv.wait_until(lock, deadline);
+        } else if (_cv.wait_until(lock, std::min(now + idle, deadline)) ==
+                       std::cv_status::timeout && (_count == count)) {
+            break;
+        }
+    }
+
+    return _count >= expected;
+}
+
+void
+TestCapture::stop (void)
+{
+    _stop = true;
+
+    for (auto &ifc : _ifs) {
+        if (ifc->thread.joinable()) {
+            ifc->thread.join();
+        }
+        if (ifc->fd >= 0) {
+            close(ifc->fd);
+            ifc->fd = -1;
+        }
+    }
+}
+
+std::vector<TestCapture::Frame>
+TestCapture::frames (const std::string &ifName)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    for (auto &ifc : _ifs) {
+        if (ifc->name == ifName) {
+            return ifc->frames;
+        }
+    }
+    return std::vector<Frame>();
+}
+
+size_t
+TestCapture::count (void)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _count;
+}
+
+//
+// pcapng blocks: type, total length, body, total length (32 bit
+// aligned)
+//
+static void
+pcapngPut32 (std::string &out, uint32_t v)
+{
+    out.append((const char *)&v, sizeof(v));
+}
+
+static void
+pcapngBlock (std::ofstream &file, uint32_t type, const std::string &body)
+{
+    std::string block;
+    uint32_t    len = 12 + ((body.size() + 3) & ~3);
+
+    pcapngPut32(block, type);
+    pcapngPut32(block, len);
+    block += body;
+    block.append(len - 12 - body.size(), '\0');
+    pcapngPut32(block, len);
+
+    file.write(block.data(), block.size());
+}
+
+//
+// @fn
+// write
+//
+// @brief
+// Write the packets captured on an interface to a pcapng file
+//
+// @param[in]
+//     ifName Interface name
+// @param[in]
+//     fileName File name
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestCapture::write (const std::string &ifName, const std::string &fileName)
+{
+    uint16_t linkType = TEST_CAPTURE_LINKTYPE_ETHERNET;
+    for (auto &ifc : _ifs) {
+        if (ifc->name == ifName) {
+            linkType = ifc->linkType;
+        }
+    }
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        perror(fileName.c_str());
+        return -1;
+    }
+
+    std::string body;
+    pcapngPut32(body, TEST_PCAPNG_BYTE_ORDER);
+    pcapngPut32(body, 1);                       // Version 1.0
+    pcapngPut32(body, 0xffffffff);              // Section length unknown
+    pcapngPut32(body, 0xffffffff);
+    pcapngBlock(file, TEST_PCAPNG_SHB, body);
+
+    body.clear();
+    pcapngPut32(body, linkType);
+    pcapngPut32(body, TEST_CAPTURE_SNAPLEN);
+    pcapngBlock(file, TEST_PCAPNG_IDB, body);
+
+    for (auto &frame : frames(ifName)) {
+        body.clear();
+        pcapngPut32(body, 0);                   // Interface 0
+        pcapngPut32(body, 0);                   // No timestamps: the
+        pcapngPut32(body, 0);                   // files are compared
+        pcapngPut32(body, frame.size());
+        pcapngPut32(body, frame.size());
+        body.append((const char *)frame.data(), frame.size());
+        pcapngBlock(file, TEST_PCAPNG_EPB, body);
+    }
+
+    return file.good() ? 0 : -1;
+}
+
+//
+// @fn
+// readFile
+//
+// @brief
+// Read the packets of a pcapng or pcap file (host byte order)
+//
+// @param[in]
+//     fileName File name
+// @param[out]
+//     frames Packets
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestCapture::readFile (const std::string &fileName, std::vector<Frame> &frames)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) {
+        return -1;
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    size_t               off = 0;
+
+    auto get32 = [&data](size_t o) {
+        uint32_t v;
+        memcpy(&v, &data[o], sizeof(v));
+        return v;
+    };
+
+    frames.clear();
+    if (data.size() < 24) {
+        return -1;
+    }
+
+    if ((get32(0) == TEST_PCAP_MAGIC) || (get32(0) == TEST_PCAP_MAGIC_NS)) {
+        for (off = 24; off + 16 <= data.size(); ) {
+            uint32_t capLen = get32(off + 8);
+            if (off + 16 + capLen > data.size()) {
+                return -1;
+            }
+            frames.push_back(Frame(&data[off + 16], &data[off + 16] + capLen));
+            off += 16 + capLen;
+        }
+        return 0;
+    }
+
+    if ((get32(0) != TEST_PCAPNG_SHB) ||
+        (get32(8) != TEST_PCAPNG_BYTE_ORDER)) {
+        return -1;
+    }
+
+    while (off + 12 <= data.size()) {
+        uint32_t type = get32(off);
+        uint32_t len  = get32(off + 4);
+
+        if ((len < 12) || (off + len > data.size())) {
+            return -1;
+        }
+        if ((type == TEST_PCAPNG_EPB) && (len >= 32)) {
+            uint32_t capLen = get32(off + 20);
+            if (28 + capLen > len) {
+                return -1;
+            }
+            frames.push_back(Frame(&data[off + 28], &data[off + 28] + capLen));
+        } else if ((type == TEST_PCAPNG_SPB) && (len >= 16)) {
+            uint32_t capLen = std::min(get32(off + 8), len - 16);
+            frames.push_back(Frame(&data[off + 12], &data[off + 12] + capLen));
+        }
+        off += len;
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+//
+// TestCapture.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __TestCapture__
+#define __TestCapture__
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEST_CAPTURE_SNAPLEN        65535
+#define TEST_CAPTURE_POLL_MS        50      // Stop check interval
+#define TEST_CAPTURE_IDLE_MS        200     // Quiet time to call it quiesced
+#define TEST_CAPTURE_TIMEOUT_MS     5000    // Give up waiting after
+
+#define TEST_CAPTURE_LINKTYPE_ETHERNET  1
+#define TEST_CAPTURE_LINKTYPE_RAW       101
+
+//
+// In-process packet capture
+// =========================
+//
+// Captures the packets sent and received on a set of interfaces into
+// memory, one AF_PACKET socket and thread per interface, in place of
+// tshark. start() returns once every socket is bound to its interface:
+// from then on no packet is missed, there is nothing to wait for.
+//
+// quiesce() waits until the packets the test expects have been seen
+// and the interfaces went quiet, or until a timeout; stop() then ends
+// the threads. Captured packets can be compared with, and written as,
+// pcapng files.
+//
+class TestCapture
+{
+public:
+    typedef std::vector<uint8_t> Frame;
+
+    TestCapture();
+    ~TestCapture();
+
+    //
+    // Start capturing on interfaces. Returns 0 - Success, -1 - Error.
+    //
+    int start(const std::vector<std::string> &interfaces);
+
+    //
+    // Wait until at least expected packets are captured (all
+    // interfaces) and none came in for idleMs, at most timeoutMs.
+    // Returns true if expected packets were captured.
+    //
+    bool quiesce(size_t expected,
+                 int    idleMs    = TEST_CAPTURE_IDLE_MS,
+                 int    timeoutMs = TEST_CAPTURE_TIMEOUT_MS);
+
+    //
+    // Stop capturing; captured packets are kept until the next start()
+    //
+    void stop(void);
+
+    //
+    // Packets captured on an interface, in capture order
+    //
+    std::vector<Frame> frames(const std::string &ifName);
+
+    size_t count(void);
+
+    //
+    // pcapng (or pcap) file I/O. Return 0 - Success, -1 - Error.
+    //
+    int write(const std::string &ifName, const std::string &fileName);
+    static int readFile(const std::string &fileName,
+                        std::vector<Frame> &frames);
+
+private:
+    struct Interface {
+        std::string         name;
+        int                 fd;
+        uint16_t            linkType;
+        std::vector<Frame>  frames;
+        std::thread         thread;
+    };
+
+    void captureLoop(Interface *ifc);
+
+    std::vector<std::unique_ptr<Interface>> _ifs;
+    std::atomic<bool>       _stop;
+
+    std::mutex              _mutex;     //< Frames, counts
+    std::condition_variable _cv;
+    size_t                  _count;
+};
+
+#endif // __TestCapture__
@@ -21,169 +21,117 @@
 
 #include "TestPacket.h"
 
+using namespace PktBuild;
+
 //
 // Test Packet Library
 //
 TestPacketLibrary testPacketLibrary;
 
+//
+// ICMP echo payloads: 16 bytes of timestamp (as sent by ping), then
+// bytes counting up from 0x10
+//
+#define TEST_PKT_ECHO_FILL_LEN  40
+
+static const uint8_t echoTsTap[]  = { 0xee, 0x7c, 0x56, 0x58, 0x00, 0x00,
+                                      0x00, 0x00, 0x0a, 0x30, 0x0b, 0x00,
+                                      0x00, 0x00, 0x00, 0x00 };
+static const uint8_t echoTsPunt[] = { 0x06, 0xf8, 0x85, 0x58, 0x00, 0x00,
+                                      0x00, 0x00, 0xbb, 0x23, 0x00, 0x00,
+                                      0x00, 0x00, 0x00, 0x00 };
+static const uint8_t echoTsVlan[] = { 0x0b, 0x21, 0x41, 0x58, 0x00, 0x00,
+                                      0x00, 0x00, 0x2d, 0x6e, 0x02, 0x00,
+                                      0x00, 0x00, 0x00, 0x00 };
 
 void TestPacketLibrary::buildTestPacketLibrary(void)
 {
-    TestPacket *testPkt;
-
     //
     // TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP1
     //
     // Mac tap1 32:26:0a:2e:cc:f1
-	// Src IP : 103.30.10.1
-	// Dst IP : 103.30.10.3
+    // Src IP : 103.30.10.1
+    // Dst IP : 103.30.10.3
     //
-    testPkt = new TestPacket();
-
-    //testPkt->setDstMac("32:26:0a:2e:cc:f1");
-    testPkt->setDstMac("33:22:0a:2e:ff:f1");
-    testPkt->setSrcMac("32:26:0A:2E:aa:F1");
-    testPkt->setEtherType(ETH_P_IP); // 0x0800 
-    testPkt->setEtherPayloadStr(
-		"4500 0054 dacc 4000 4001 7d9c"
-        "671e 0a01 671e 0a03" 
-        "0800 5cba 492b 3942 ee7c 5658 0000"
-		"0000 0a30 0b00 0000 0000 1011 1213 1415"
-		"1617 1819 1a1b 1c1d 1e1f 2021 2223 2425"
-		"2627 2829 2a2b 2c2d 2e2f 3031 3233 3435"
-		"3637");
-
-    _testPacketLibrary[TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP1] = testPkt;
+    _testPacketLibrary[TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP1] = new TestPacket(
+        Ether("33:22:0a:2e:ff:f1", "32:26:0a:2e:aa:f1") /
+        IPv4("103.30.10.1", "103.30.10.3", 64, 0xdacc) /
+        Icmp(8, 0, 0x492b, 0x3942) /
+        Bytes(echoTsTap) / Fill(TEST_PKT_ECHO_FILL_LEN, 0x10));
 
     //
     // TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP2
     //
-    // Mac tap2 7a:44:b9:85:3e:10 
-	// Src IP : 103.30.80.1
-	// Dst IP : 103.30.80.3
-    testPkt = new TestPacket();
-
-    testPkt->setDstMac("7A:44:B9:85:3E:10");
-    testPkt->setSrcMac("32:26:0A:2E:FF:F3");
-    testPkt->setEtherType(ETH_P_IP); // 0x0800 
-    testPkt->setEtherPayloadStr(
-		"4500 0054 dacc 4000 4001 f19b"
-		"671e 5001 671e 5003 "
-		"0800 5cba 492b 3942 ee7c 5658 0000"
-		"0000 0a30 0b00 0000 0000 1011 1213 1415"
-		"1617 1819 1a1b 1c1d 1e1f 2021 2223 2425"
-		"2627 2829 2a2b 2c2d 2e2f 3031 3233 3435"
-		"3637");
-
-    _testPacketLibrary[TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP2] = testPkt;
-
+    // Mac tap2 7a:44:b9:85:3e:10
+    // Src IP : 103.30.80.1
+    // Dst IP : 103.30.80.3
+    //
+    _testPacketLibrary[TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP2] = new TestPacket(
+        Ether("7a:44:b9:85:3e:10", "32:26:0a:2e:ff:f3") /
+        IPv4("103.30.80.1", "103.30.80.3", 64, 0xdacc) /
+        Icmp(8, 0, 0x492b, 0x3942) /
+        Bytes(echoTsTap) / Fill(TEST_PKT_ECHO_FILL_LEN, 0x10));
 
-    // tap2 mac     : 32:26:0a:2e:cc:f2
-    // ge-0/0/2 mac : 32:26:0a:2e:aa:f2
     //
     // TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3
     //
-    // tap3 mac : 7a:44:b9:85:3e:10 
-	// 
-	// Src IP : 103.30.20.2
-	// Dst IP : 103.30.30.3
-    testPkt = new TestPacket();
-
-    testPkt->setDstMac("32:26:0a:2e:aa:f2");
-    testPkt->setSrcMac("32:26:0A:2E:BB:F2");
-    testPkt->setEtherType(ETH_P_IP); // 0x0800 
-    testPkt->setEtherPayloadStr(
-		"4500 0054 dacc 4000 4001 5f9c"
-		"671e 1401 671e 1E03"
-		"0800 5cba 492b 3942 ee7c 5658 0000"
-		"0000 0a30 0b00 0000 0000 1011 1213 1415"
-		"1617 1819 1a1b 1c1d 1e1f 2021 2223 2425"
-		"2627 2829 2a2b 2c2d 2e2f 3031 3233 3435"
-		"3637");
-
-    _testPacketLibrary[TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3] = testPkt;
-
+    // tap2 mac     : 32:26:0a:2e:cc:f2
+    // ge-0/0/2 mac : 32:26:0a:2e:aa:f2
+    // tap3 mac     : 7a:44:b9:85:3e:10
+    // Src IP : 103.30.20.1
+    // Dst IP : 103.30.30.3
+    //
+    _testPacketLibrary[TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3] =
+        new TestPacket(
+            Ether("32:26:0a:2e:aa:f2", "32:26:0a:2e:bb:f2") /
+            IPv4("103.30.20.1", "103.30.30.3", 64, 0xdacc) /
+            Icmp(8, 0, 0x492b, 0x3942) /
+            Bytes(echoTsTap) / Fill(TEST_PKT_ECHO_FILL_LEN, 0x10));
 
     //
     // TEST_PKT_ID_PUNT_ICMP_ECHO
     //
-	// Src IP : 103.30.00.2
-	// Dst IP : 103.30.00.1
-    testPkt = new TestPacket();
-
-    testPkt->setEtherType(ETH_P_IP); // 0x0800 
-    testPkt->setDstMac("33:22:0A:2E:AA:F1");
-    testPkt->setEtherPayloadStr(
-        "4500 0054 a038 4000 4001 cc31"
-		"671e 0002 671e 0001 "
-		"0800 bf46 3271 0001 06f8 8558"
-        "0000 0000 bb23 0000 0000 0000 1011 1213"
-        "1415 1617 1819 1a1b 1c1d 1e1f 2021 2223"
-        "2425 2627 2829 2a2b 2c2d 2e2f 3031 3233"
-        "3435 3637");
-
-    _testPacketLibrary[TEST_PKT_ID_PUNT_ICMP_ECHO] = testPkt;
-
+    // Src IP : 103.30.0.2
+    // Dst IP : 103.30.0.1
+    //
+    _testPacketLibrary[TEST_PKT_ID_PUNT_ICMP_ECHO] = new TestPacket(
+        Ether("33:22:0a:2e:aa:f1") /
+        IPv4("103.30.0.2", "103.30.0.1", 64, 0xa038) /
+        Icmp(8, 0, 0x3271, 0x0001) /
+        Bytes(echoTsPunt) / Fill(TEST_PKT_ECHO_FILL_LEN, 0x10));
 
     //
     // TEST_PKT_ID_IPV4_VLAN
     //
-    testPkt = new TestPacket();
-
-    testPkt->setEtherType(ETH_P_8021Q); // 0x8100 
-    testPkt->setDstMac("33:22:0a:2e:ff:f1");
-
-    testPkt->setEtherPayloadStr(
-        "000b 0800 4500 0054 40b3 4000"
-        "4001 b3b6 671e 3c02 671e 3c01 0800 fbe6"
-        "3edd 8281 0b21 4158 0000 0000 2d6e 0200"
-        "0000 0000 1011 1213 1415 1617 1819 1a1b"
-        "1c1d 1e1f 2021 2223 2425 2627 2829 2a2b"
-        "2c2d 2e2f 3031 3233 3435 3637");
-#if 0
-
-    testPkt->setEtherPayloadStr(
-        "000c 8847 000c 81ff 3322 0a2e fff1 5ed8 f932"
-        "bd85 8100 000b 0800 4500 0054 40b3 4000"
-        "4001 b3b6 671e 3c02 671e 3c01 0800 fbe6"
-        "3edd 8281 0b21 4158 0000 0000 2d6e 0200"
-        "0000 0000 1011 1213 1415 1617 1819 1a1b"
-        "1c1d 1e1f 2021 2223 2425 2627 2829 2a2b"
-        "2c2d 2e2f 3031 3233 3435 3637");
-#endif
-
-    _testPacketLibrary[TEST_PKT_ID_IPV4_VLAN] = testPkt;
-
+    // VLAN 11
+    // Src IP : 103.30.60.2
+    // Dst IP : 103.30.60.1
+    //
+    _testPacketLibrary[TEST_PKT_ID_IPV4_VLAN] = new TestPacket(
+        Ether("33:22:0a:2e:ff:f1") / Dot1Q(11) /
+        IPv4("103.30.60.2", "103.30.60.1", 64, 0x40b3) /
+        Icmp(8, 0, 0x3edd, 0x8281) /
+        Bytes(echoTsVlan) / Fill(TEST_PKT_ECHO_FILL_LEN, 0x10));
 
     //
     // TEST_PKT_ID_MPLS_L2VLAN
     //
-    testPkt = new TestPacket();
-
-    testPkt->setEtherType(ETH_P_MPLS_UC); // 0x8847 
-    testPkt->setDstMac("33:22:0a:2e:ff:f1");
-    testPkt->setEtherPayloadStr(
-        "000c 8847 000c 81ff 3322 0a2e fff1 5ed8 f932"
-        "bd85 8100 000b 0800 4500 0054 40b3 4000"
-        "4001 b3b6 671e 3c02 671e 3c01 0800 fbe6"
-        "3edd 8281 0b21 4158 0000 0000 2d6e 0200"
-        "0000 0000 1011 1213 1415 1617 1819 1a1b"
-        "1c1d 1e1f 2021 2223 2425 2627 2829 2a2b"
-        "2c2d 2e2f 3031 3233 3435 3637");
-
-    _testPacketLibrary[TEST_PKT_ID_MPLS_L2VLAN] = testPkt;
+    // Labels 200, 200 over the TEST_PKT_ID_IPV4_VLAN frame
+    //
+    _testPacketLibrary[TEST_PKT_ID_MPLS_L2VLAN] = new TestPacket(
+        Ether("33:22:0a:2e:ff:f1") / Mpls(200, 0x47, 4) / Mpls(200, 0xff) /
+        Ether("33:22:0a:2e:ff:f1", "5e:d8:f9:32:bd:85") / Dot1Q(11) /
+        IPv4("103.30.60.2", "103.30.60.1", 64, 0x40b3) /
+        Icmp(8, 0, 0x3edd, 0x8281) /
+        Bytes(echoTsVlan) / Fill(TEST_PKT_ECHO_FILL_LEN, 0x10));
 }
 
 void TestPacketLibrary::destroyTestPacketLibrary(void)
 {
-    TestPacket *testPkt;
-
     TestPacketLibraryMap::iterator itr = _testPacketLibrary.begin();
 
     while (itr != _testPacketLibrary.end()) {
-        TestPacket *testPkt = itr->second;
+        delete itr->second;
         itr = _testPacketLibrary.erase(itr);
-        ++itr;
     }
-
 }
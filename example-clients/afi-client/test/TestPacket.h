@@ -23,110 +23,37 @@
 #define __TestPacket__
 
 #include <netinet/ether.h>
-#include <vector>
+#include <string.h>
 #include <map>
-#include <boost/algorithm/string.hpp>
-#include "../Utils.h"
+#include "TestPktBuilder.h"
 
 #define MAC_ADDR_LEN            6
-#define ETHER_PAYLOAD_BUF_SIZE	5000
+#define ETH_HEADER_LEN          14
 
+//
+// Test packet: a frame written once from its headers
+//
 class TestPacket {
 public:
-
-    //
-    //
-    //
-	int setSrcMac(const std::string &mac) {
-		int i;
-        std::vector<std::string> mac_sub_strings;
-        boost::split(mac_sub_strings, mac, boost::is_any_of(":"));
-
-		for (i = 0; i < MAC_ADDR_LEN; i++) {
-            _srcMac[i] = std::strtoull(mac_sub_strings.at(i).c_str(), NULL, 16);
-        }
+    template <typename Layers>
+    TestPacket(const Layers &layers) : _frame(layers) {
     }
 
-	int *getSrcMac(void) {
-	    return _srcMac;
-	}
-
-    //
-    //
-    //
-	int setDstMac(const std::string &mac) {
-		int i;
-        std::vector<std::string> mac_sub_strings;
-        boost::split(mac_sub_strings, mac, boost::is_any_of(":"));
-
-		for (i = 0; i < MAC_ADDR_LEN; i++) {
-            _dstMac[i] = std::strtoull(mac_sub_strings.at(i).c_str(), NULL, 16);
-        }
+    const TestPktFrame &frame(void) const {
+        return _frame;
     }
 
-	int *getDstMac(void) {
-	    return _dstMac;
-	}
-
     //
-	//
-	//
-	int getEtherType(void) {
-        return _etherType;
-    }
-
-	void setEtherType(int  etherType) {
-        _etherType = etherType;
-    }
-
+    // Copy the frame to pktData. Returns frame length, -1 if the buffer
+    // is too short.
     //
-	//
-	//
-	int setEtherPayloadStr(const std::string &etherPayloadStr) {
-        strncpy(_etherPayload, etherPayloadStr.c_str(), ETHER_PAYLOAD_BUF_SIZE);
-		_etherPayload[ETHER_PAYLOAD_BUF_SIZE - 1] = '\0';
+    int getEtherPacket(char *pktData, int pktDataBuffLen) {
+        size_t len = _frame.copy((uint8_t *)pktData, pktDataBuffLen);
+        return (len > 0) ? (int)len : -1;
     }
 
-	char *getEtherPayloadStr(void) {
-	      return _etherPayload;
-	}
-
-
-	int getEtherPacket(char *pktData, int pktDataBuffLen) {
-#define ETH_HEADER_LEN    14
-        int i = 0;
-
-        if (pktDataBuffLen < ETH_HEADER_LEN) {
-		    return -1;
-		}
-
-		for (i = 0; i < MAC_ADDR_LEN; i++) {
-            pktData[i] = _dstMac[i];
-        }
-
-		for (i = 0; i < MAC_ADDR_LEN; i++) {
-            pktData[MAC_ADDR_LEN + i] = _srcMac[i];
-        }
-
-        pktData[ETH_HEADER_LEN - 2] = ((_etherType >> 8) & 0xFF);
-        pktData[ETH_HEADER_LEN - 1] = ((_etherType) & 0xFF);
-
-		int pktDataLen = convertHexPktStrToPkt(_etherPayload, 
-				  							   &pktData[ETH_HEADER_LEN], 
-											   pktDataBuffLen - ETH_HEADER_LEN);
-	    return (ETH_HEADER_LEN + pktDataLen);
-	}
-
 private:
-	int  _srcMac[MAC_ADDR_LEN];
-	int  _dstMac[MAC_ADDR_LEN];
-
-	// 
-	// ETH_P_IP =  0x0800
-	//
-	//
-	int  _etherType;
-	char _etherPayload[ETHER_PAYLOAD_BUF_SIZE];
+    TestPktFrame _frame;
 };
 
 
@@ -0,0 +1,47 @@
+//
+// TestPktBuilder.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include "TestPktBuilder.h"
+
+//
+// @fn
+// copy
+//
+// @brief
+// Copy frame to a buffer
+//
+// @param[in]
+//     buf Buffer
+// @param[in]
+//     bufLen Buffer length
+// @return Frame length, 0 - Buffer too short
+//
+
+size_t
+TestPktFrame::copy (uint8_t *buf, size_t bufLen) const
+{
+    if (bufLen < _data.size()) {
+        return 0;
+    }
+    memcpy(buf, _data.data(), _data.size());
+    return _data.size();
+}
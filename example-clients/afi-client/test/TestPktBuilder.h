@@ -0,0 +1,512 @@
+//
+// TestPktBuilder.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __TestPktBuilder__
+#define __TestPktBuilder__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+//
+// Test packet builder
+// ===================
+//
+// Test frames are composed of typed headers, outermost first:
+//
+//   Ether("33:22:0a:2e:ff:f1") / Dot1Q(11) /
+//   IPv4("103.30.60.2", "103.30.60.1") / Icmp(8, 0, 0x3edd, 0x8281) /
+//   Fill(56)
+//
+// Ether types, IP protocols, the MPLS bottom of stack bit, IPv4 and
+// UDP lengths and the IPv4, ICMP and UDP checksums are filled in when
+// the frame is written. Type and protocol fields given as 0 are taken
+// from the next header.
+//
+// Headers and their compositions are literal types: MAC and IPv4
+// addresses in text are parsed and frame lengths computed at compile
+// time, so a composition can be a constexpr and size a std::array.
+// (C++11 constexpr functions cannot write into a buffer, so the bytes
+// themselves are written at run time, once, by TestPktFrame.)
+//
+namespace PktBuild {
+
+#define PKT_BUILD_ETH_P_IPV4        0x0800
+#define PKT_BUILD_ETH_P_VLAN        0x8100
+#define PKT_BUILD_ETH_P_MPLS        0x8847
+#define PKT_BUILD_IPPROTO_ICMP      1
+#define PKT_BUILD_IPPROTO_UDP       17
+
+//
+// Text to addresses, at compile time for literals
+//
+constexpr uint8_t
+hexNibble (char c)
+{
+    return ((c >= '0') && (c <= '9')) ? c - '0' :
+           ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10 :
+           ((c >= 'A') && (c <= 'F')) ? c - 'A' + 10 : 0;
+}
+
+constexpr uint8_t
+macByte (const char *s, int i)
+{
+    return (hexNibble(s[3 * i]) << 4) | hexNibble(s[3 * i + 1]);
+}
+
+constexpr uint32_t
+ipv4Parse (const char *s, uint32_t addr = 0, uint32_t octet = 0)
+{
+    return (*s == '\0') ? (addr << 8) | octet :
+           (*s == '.')  ? ipv4Parse(s + 1, (addr << 8) | octet, 0) :
+                          ipv4Parse(s + 1, addr, octet * 10 + (*s - '0'));
+}
+
+//
+// MAC address, "xx:xx:xx:xx:xx:xx" (either case)
+//
+struct Mac {
+    constexpr Mac() : b{0, 0, 0, 0, 0, 0} {
+    }
+    constexpr Mac(const char *s)
+        : b{macByte(s, 0), macByte(s, 1), macByte(s, 2),
+            macByte(s, 3), macByte(s, 4), macByte(s, 5)} {
+    }
+
+    uint8_t b[6];
+};
+
+//
+// Ones' complement sum of 16 bit words, and its checksum
+//
+inline uint32_t
+csumAdd (uint32_t sum, const uint8_t *p, size_t len)
+{
+    for (; len > 1; p += 2, len -= 2) {
+        sum += ((uint32_t)p[0] << 8) | p[1];
+    }
+    if (len) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    return sum;
+}
+
+inline uint16_t
+csumFold (uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum & 0xffff;
+}
+
+inline void
+put16 (uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+inline void
+put32 (uint8_t *p, uint32_t v)
+{
+    put16(p, v >> 16);
+    put16(p + 2, v & 0xffff);
+}
+
+//
+// Frame layout recorded while the frame is written, for the UDP
+// pseudo header
+//
+struct Layout {
+    const uint8_t *base;
+    int            ipOff;       //< Innermost IPv4 header, -1: none
+};
+
+//
+// A header is written in two steps: put<Next>() writes its fields
+// knowing the type of the header that follows (NoNext at the end of
+// the frame) and the number of bytes after it, seal() fills in the
+// checksum once the bytes after it are written. These say what a
+// header is to the header in front of it.
+//
+struct NoNext {
+    static const uint16_t EtherType = 0;
+    static const uint8_t  IpProto   = 0;
+    static const bool     IsMpls    = false;
+};
+
+//
+// Ethernet header
+//
+struct Ether : NoNext {
+    constexpr Ether(Mac dst_ = Mac(), Mac src_ = Mac(), uint16_t type_ = 0)
+        : dst(dst_), src(src_), type(type_) {
+    }
+
+    constexpr size_t len(void) const { return 14; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t, Layout &) const {
+        memcpy(p, dst.b, 6);
+        memcpy(p + 6, src.b, 6);
+        put16(p + 12, type ? type : Next::EtherType);
+    }
+    void seal(uint8_t *, size_t) const {
+    }
+
+    Mac       dst;
+    Mac       src;
+    uint16_t  type;         //< 0: from next header
+};
+
+//
+// 802.1Q tag
+//
+struct Dot1Q {
+    static const uint16_t EtherType = PKT_BUILD_ETH_P_VLAN;
+    static const uint8_t  IpProto   = 0;
+    static const bool     IsMpls    = false;
+
+    constexpr Dot1Q(uint16_t vid_ = 0, uint8_t pcp_ = 0, uint16_t type_ = 0)
+        : vid(vid_), pcp(pcp_), type(type_) {
+    }
+
+    constexpr size_t len(void) const { return 4; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t, Layout &) const {
+        put16(p, (pcp << 13) | (vid & 0x0fff));
+        put16(p + 2, type ? type : Next::EtherType);
+    }
+    void seal(uint8_t *, size_t) const {
+    }
+
+    uint16_t  vid;
+    uint8_t   pcp;
+    uint16_t  type;         //< 0: from next header
+};
+
+//
+// MPLS label stack entry, bottom of stack unless another one follows
+//
+struct Mpls {
+    static const uint16_t EtherType = PKT_BUILD_ETH_P_MPLS;
+    static const uint8_t  IpProto   = 0;
+    static const bool     IsMpls    = true;
+
+    constexpr Mpls(uint32_t label_ = 0, uint8_t ttl_ = 64, uint8_t tc_ = 0)
+        : label(label_), ttl(ttl_), tc(tc_) {
+    }
+
+    constexpr size_t len(void) const { return 4; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t, Layout &) const {
+        put32(p, (label << 12) | ((tc & 7) << 9) |
+                 ((Next::IsMpls ? 0 : 1) << 8) | ttl);
+    }
+    void seal(uint8_t *, size_t) const {
+    }
+
+    uint32_t  label;
+    uint8_t   ttl;
+    uint8_t   tc;
+};
+
+//
+// IPv4 header without options
+//
+struct IPv4 {
+    static const uint16_t EtherType = PKT_BUILD_ETH_P_IPV4;
+    static const uint8_t  IpProto   = 0;
+    static const bool     IsMpls    = false;
+
+    constexpr IPv4(const char *src_, const char *dst_, uint8_t ttl_ = 64,
+                   uint16_t id_ = 0, uint16_t frag_ = 0x4000,
+                   uint8_t proto_ = 0, uint8_t tos_ = 0)
+        : src(ipv4Parse(src_)), dst(ipv4Parse(dst_)), ttl(ttl_), id(id_),
+          frag(frag_), proto(proto_), tos(tos_) {
+    }
+    constexpr IPv4(uint32_t src_, uint32_t dst_, uint8_t ttl_ = 64,
+                   uint16_t id_ = 0, uint16_t frag_ = 0x4000,
+                   uint8_t proto_ = 0, uint8_t tos_ = 0)
+        : src(src_), dst(dst_), ttl(ttl_), id(id_), frag(frag_),
+          proto(proto_), tos(tos_) {
+    }
+
+    constexpr size_t len(void) const { return 20; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t payloadLen, Layout &layout) const {
+        p[0] = 0x45;
+        p[1] = tos;
+        put16(p + 2, 20 + payloadLen);
+        put16(p + 4, id);
+        put16(p + 6, frag);
+        p[8] = ttl;
+        p[9] = proto ? proto : Next::IpProto;
+        put16(p + 10, 0);
+        put32(p + 12, src);
+        put32(p + 16, dst);
+
+        layout.ipOff = p - layout.base;
+    }
+    void seal(uint8_t *p, size_t) const {
+        put16(p + 10, csumFold(csumAdd(0, p, 20)));
+    }
+
+    uint32_t  src;
+    uint32_t  dst;
+    uint8_t   ttl;
+    uint16_t  id;
+    uint16_t  frag;         //< Flags and fragment offset, default DF
+    uint8_t   proto;        //< 0: from next header
+    uint8_t   tos;
+};
+
+//
+// ICMP header: type, code, and for echo id and sequence number (rest
+// of header otherwise)
+//
+struct Icmp {
+    static const uint16_t EtherType = 0;
+    static const uint8_t  IpProto   = PKT_BUILD_IPPROTO_ICMP;
+    static const bool     IsMpls    = false;
+
+    constexpr Icmp(uint8_t type_ = 8, uint8_t code_ = 0, uint16_t id_ = 0,
+                   uint16_t seq_ = 0)
+        : type(type_), code(code_), id(id_), seq(seq_) {
+    }
+
+    constexpr size_t len(void) const { return 8; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t, Layout &) const {
+        p[0] = type;
+        p[1] = code;
+        put16(p + 2, 0);
+        put16(p + 4, id);
+        put16(p + 6, seq);
+    }
+    void seal(uint8_t *p, size_t payloadLen) const {
+        put16(p + 2, csumFold(csumAdd(0, p, 8 + payloadLen)));
+    }
+
+    uint8_t   type;
+    uint8_t   code;
+    uint16_t  id;
+    uint16_t  seq;
+};
+
+//
+// UDP header. The checksum covers the IPv4 pseudo header of the IPv4
+// header in front of it.
+//
+struct Udp {
+    static const uint16_t EtherType = 0;
+    static const uint8_t  IpProto   = PKT_BUILD_IPPROTO_UDP;
+    static const bool     IsMpls    = false;
+
+    constexpr Udp(uint16_t sport_ = 0, uint16_t dport_ = 0)
+        : sport(sport_), dport(dport_) {
+    }
+
+    constexpr size_t len(void) const { return 8; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t payloadLen, Layout &layout) const {
+        put16(p, sport);
+        put16(p + 2, dport);
+        put16(p + 4, 8 + payloadLen);
+
+        //
+        // Stash the pseudo header sum in the checksum field, seal()
+        // sums it with the rest
+        //
+        uint32_t pseudo = IpProto + 8 + payloadLen;
+        if (layout.ipOff >= 0) {
+            pseudo = csumAdd(pseudo, layout.base + layout.ipOff + 12, 8);
+        }
+        put16(p + 6, ~csumFold(pseudo) & 0xffff);
+    }
+    void seal(uint8_t *p, size_t payloadLen) const {
+        uint16_t csum = csumFold(csumAdd(0, p, 8 + payloadLen));
+        put16(p + 6, csum ? csum : 0xffff);
+    }
+
+    uint16_t  sport;
+    uint16_t  dport;
+};
+
+//
+// Payload: len bytes counting up from first (modulo 256)
+//
+struct Fill : NoNext {
+    constexpr Fill(size_t len_, uint8_t first_ = 0)
+        : fillLen(len_), first(first_) {
+    }
+
+    constexpr size_t len(void) const { return fillLen; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t, Layout &) const {
+        for (size_t i = 0; i < fillLen; i++) {
+            p[i] = first + i;
+        }
+    }
+    void seal(uint8_t *, size_t) const {
+    }
+
+    size_t    fillLen;
+    uint8_t   first;
+};
+
+//
+// Payload: bytes given (not copied until the frame is written)
+//
+struct Bytes : NoNext {
+    constexpr Bytes(const uint8_t *data_, size_t len_)
+        : data(data_), dataLen(len_) {
+    }
+    template <size_t N>
+    constexpr Bytes(const uint8_t (&data_)[N]) : data(data_), dataLen(N) {
+    }
+
+    constexpr size_t len(void) const { return dataLen; }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t, Layout &) const {
+        memcpy(p, data, dataLen);
+    }
+    void seal(uint8_t *, size_t) const {
+    }
+
+    const uint8_t *data;
+    size_t         dataLen;
+};
+
+//
+// Composition of headers, Head in front of Tail (a header or another
+// composition)
+//
+template <typename Head, typename Tail>
+struct Stack {
+    static const uint16_t EtherType = Head::EtherType;
+    static const uint8_t  IpProto   = Head::IpProto;
+    static const bool     IsMpls    = Head::IsMpls;
+
+    constexpr Stack(const Head &head_, const Tail &tail_)
+        : head(head_), tail(tail_) {
+    }
+
+    constexpr size_t len(void) const { return head.len() + tail.len(); }
+
+    template <typename Next>
+    void put(uint8_t *p, size_t payloadLen, Layout &layout) const {
+        size_t tailLen = tail.len() + payloadLen;
+
+        head.template put<Tail>(p, tailLen, layout);
+        tail.template put<Next>(p + head.len(), payloadLen, layout);
+        tail.seal(p + head.len(), payloadLen);
+        head.seal(p, tailLen);
+    }
+    void seal(uint8_t *, size_t) const {
+    }
+
+    Head  head;
+    Tail  tail;
+};
+
+//
+// a / b: b appended to the innermost header of a
+//
+template <typename A, typename B>
+struct Append {
+    typedef Stack<A, B> type;
+
+    static constexpr type make(const A &a, const B &b) {
+        return type(a, b);
+    }
+};
+
+template <typename Head, typename Tail, typename B>
+struct Append<Stack<Head, Tail>, B> {
+    typedef Stack<Head, typename Append<Tail, B>::type> type;
+
+    static constexpr type make(const Stack<Head, Tail> &a, const B &b) {
+        return type(a.head, Append<Tail, B>::make(a.tail, b));
+    }
+};
+
+template <typename A, typename B>
+constexpr typename Append<A, B>::type
+operator/ (const A &a, const B &b)
+{
+    return Append<A, B>::make(a, b);
+}
+
+} // namespace PktBuild
+
+//
+// @class   TestPktFrame
+// @brief   Frame written from a header composition
+//
+// Frames whose fields change from one send to the next are sent from
+// an AfiPktTemplate built from the frame, which updates the checksums
+// incrementally.
+//
+class TestPktFrame
+{
+public:
+    TestPktFrame() {
+    }
+
+    template <typename Layers>
+    TestPktFrame(const Layers &layers) {
+        build(layers);
+    }
+
+    template <typename Layers>
+    void build(const Layers &layers) {
+        _data.assign(layers.len(), 0);
+
+        PktBuild::Layout layout = { _data.data(), -1 };
+        layers.template put<PktBuild::NoNext>(_data.data(), 0, layout);
+        layers.seal(_data.data(), 0);
+    }
+
+    const uint8_t *data(void) const { return _data.data(); }
+    size_t size(void) const { return _data.size(); }
+    const std::vector<uint8_t> &bytes(void) const { return _data; }
+
+    //
+    // Copy frame to buf. Returns frame length, 0 if buf is too short.
+    //
+    size_t copy(uint8_t *buf, size_t bufLen) const;
+
+private:
+    std::vector<uint8_t>  _data;
+};
+
+#endif // __TestPktBuilder__
@@ -0,0 +1,702 @@
+//
+// TestPktIo.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include "TestPktIo.h"
+
+//
+// Offset of frame data in a send ring frame
+//
+#define TEST_PKT_IO_TX_DATA_OFF     TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+#define TEST_PKT_IO_FRAME_DATA_MAX  (TEST_PKT_IO_FRAME_SIZE - \
+                                     TEST_PKT_IO_TX_DATA_OFF)
+#define TEST_PKT_IO_TX_BLOCK_SIZE   (TEST_PKT_IO_FRAME_SIZE * 32)
+
+std::mutex TestPktIo::_registryLock;
+std::map<std::string, std::unique_ptr<TestPktIo>> TestPktIo::_registry;
+
+static inline uint64_t
+testMonotonicNs (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// @fn
+// get
+//
+// @brief
+// Packet I/O of an interface. Set up on first use and kept until
+// released (or for the life of the test program).
+//
+// @param[in]
+//     ifNameStr Interface name
+// @return Packet I/O, NULL - Error
+//
+
+TestPktIo *
+TestPktIo::get (const std::string &ifNameStr)
+{
+    std::lock_guard<std::mutex> guard(_registryLock);
+
+    auto it = _registry.find(ifNameStr);
+    if (it != _registry.end()) {
+        return it->second.get();
+    }
+
+    std::unique_ptr<TestPktIo> pktIo(new TestPktIo(ifNameStr));
+    if (pktIo->init() != 0) {
+        return NULL;
+    }
+
+    TestPktIo *ret = pktIo.get();
+    _registry[ifNameStr] = std::move(pktIo);
+
+    return ret;
+}
+
+void
+TestPktIo::release (const std::string &ifNameStr)
+{
+    std::lock_guard<std::mutex> guard(_registryLock);
+
+    _registry.erase(ifNameStr);
+}
+
+TestPktIo::TestPktIo (const std::string &ifNameStr)
+    : _ifIndex(0),
+      _txFd(-1),
+      _txRing(NULL),
+      _txRingSize(0),
+      _txHead(0),
+      _txSlotFrame(TEST_PKT_IO_TX_FRAMES, -1),
+      _txPending(0),
+      _rxFd(-1),
+      _rxRing(NULL),
+      _rxRingSize(0),
+      _rxBlock(0)
+{
+    strncpy(_ifName, ifNameStr.c_str(), IFNAMSIZ);
+    _ifName[IFNAMSIZ - 1] = '\0';
+    memset(_mac, 0, sizeof(_mac));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+TestPktIo::~TestPktIo ()
+{
+    if (_txRing) {
+        munmap(_txRing, _txRingSize);
+    }
+    if (_txFd >= 0) {
+        close(_txFd);
+    }
+    if (_rxRing) {
+        munmap(_rxRing, _rxRingSize);
+    }
+    if (_rxFd >= 0) {
+        close(_rxFd);
+    }
+}
+
+//
+// @fn
+// ringSetup
+//
+// @brief
+// Set up and map a TPACKET_V3 ring
+//
+// @param[in]
+//     fd AF_PACKET socket
+// @param[in]
+//     ringType PACKET_TX_RING or PACKET_RX_RING
+// @param[in]
+//     blockSize, blockNr, frameSize, frameNr Ring geometry
+// @param[in]
+//     blockTmo Receive block retire timeout (ms)
+// @param[out]
+//     ring Mapped ring
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestPktIo::ringSetup (int       fd,
+                      int       ringType,
+                      uint32_t  blockSize,
+                      uint32_t  blockNr,
+                      uint32_t  frameSize,
+                      uint32_t  frameNr,
+                      uint32_t  blockTmo,
+                      uint8_t **ring)
+{
+    int                  version = TPACKET_V3;
+    struct tpacket_req3  req;
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+                   &version, sizeof(version)) < 0) {
+        perror("PACKET_VERSION");
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size     = blockSize;
+    req.tp_block_nr       = blockNr;
+    req.tp_frame_size     = frameSize;
+    req.tp_frame_nr       = frameNr;
+    req.tp_retire_blk_tov = blockTmo;
+
+    if (setsockopt(fd, SOL_PACKET, ringType, &req, sizeof(req)) < 0) {
+        perror((ringType == PACKET_TX_RING) ? "PACKET_TX_RING" :
+                                              "PACKET_RX_RING");
+        return -1;
+    }
+
+    void *addr = mmap(NULL, (size_t)blockSize * blockNr,
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap(packet ring)");
+        return -1;
+    }
+
+    *ring = (uint8_t *)addr;
+
+    return 0;
+}
+
+//
+// @fn
+// init
+//
+// @brief
+// Open the send socket on the interface and map its ring
+//
+// @param[in] void
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestPktIo::init (void)
+{
+    struct ifreq        ifr;
+    struct sockaddr_ll  sll;
+
+    //
+    // Send socket: protocol 0, it receives nothing
+    //
+    if ((_txFd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, _ifName, IFNAMSIZ - 1);
+    if (ioctl(_txFd, SIOCGIFINDEX, &ifr) < 0) {
+        perror("SIOCGIFINDEX");
+        return -1;
+    }
+    _ifIndex = ifr.ifr_ifindex;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, _ifName, IFNAMSIZ - 1);
+    if (ioctl(_txFd, SIOCGIFHWADDR, &ifr) < 0) {
+        perror("SIOCGIFHWADDR");
+        return -1;
+    }
+    memcpy(_mac, ifr.ifr_hwaddr.sa_data, sizeof(_mac));
+
+    _txRingSize = (size_t)TEST_PKT_IO_FRAME_SIZE * TEST_PKT_IO_TX_FRAMES;
+    if (ringSetup(_txFd, PACKET_TX_RING, TEST_PKT_IO_TX_BLOCK_SIZE,
+                  _txRingSize / TEST_PKT_IO_TX_BLOCK_SIZE,
+                  TEST_PKT_IO_FRAME_SIZE, TEST_PKT_IO_TX_FRAMES,
+                  0, &_txRing) != 0) {
+        return -1;
+    }
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = 0;
+    sll.sll_ifindex  = _ifIndex;
+    if (bind(_txFd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        perror("bind(send)");
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// rxInit
+//
+// @brief
+// Open the receive socket on the interface and map its ring, once
+//
+// @param[in] void
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestPktIo::rxInit (void)
+{
+    struct sockaddr_ll  sll;
+
+    if (_rxRing) {
+        return 0;
+    }
+    if (_ifIndex == 0) {
+        std::cout << _ifName << ": not initialized" << std::endl;
+        return -1;
+    }
+
+    if ((_rxFd < 0) &&
+        ((_rxFd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)) {
+        perror("socket");
+        return -1;
+    }
+
+    _rxRingSize = (size_t)TEST_PKT_IO_RX_BLOCK_SIZE * TEST_PKT_IO_RX_BLOCKS;
+    if (ringSetup(_rxFd, PACKET_RX_RING, TEST_PKT_IO_RX_BLOCK_SIZE,
+                  TEST_PKT_IO_RX_BLOCKS, TEST_PKT_IO_FRAME_SIZE,
+                  _rxRingSize / TEST_PKT_IO_FRAME_SIZE,
+                  TEST_PKT_IO_RX_BLOCK_TMO_MS, &_rxRing) != 0) {
+        return -1;
+    }
+
+#ifdef PACKET_IGNORE_OUTGOING
+    //
+    // Keep packets sent on the interface out of the ring (Linux 4.20)
+    //
+    int one = 1;
+    setsockopt(_rxFd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex  = _ifIndex;
+    if (bind(_rxFd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        perror("bind(receive)");
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// addFrame
+//
+// @brief
+// Build a frame from the test packet library, with the interface
+// MAC address as source MAC address
+//
+// @param[in]
+//     tcPktNum Test packet id
+// @return Frame id, -1 - Error
+//
+
+int
+TestPktIo::addFrame (TestPacketLibrary::TestPacketId tcPktNum)
+{
+    TestPacket *testPkt = testPacketLibrary.getTestPacket(tcPktNum);
+    char        frame[TEST_PKT_IO_FRAME_DATA_MAX];
+
+    if (!testPkt) {
+        std::cout << "No test packet " << tcPktNum << std::endl;
+        return -1;
+    }
+
+    int frameLen = testPkt->getEtherPacket(frame, sizeof(frame));
+    if (frameLen <= ETH_HEADER_LEN) {
+        std::cout << "Test packet " << tcPktNum << " invalid" << std::endl;
+        return -1;
+    }
+
+    memcpy(&frame[MAC_ADDR_LEN], _mac, MAC_ADDR_LEN);
+
+    return addFrame((uint8_t *)frame, frameLen);
+}
+
+int
+TestPktIo::addFrame (const uint8_t *frame, uint32_t frameLen)
+{
+    if ((frameLen == 0) || (frameLen > TEST_PKT_IO_FRAME_DATA_MAX)) {
+        std::cout << "Frame length " << frameLen << " invalid" << std::endl;
+        return -1;
+    }
+
+    _frames.push_back(std::vector<uint8_t>(frame, frame + frameLen));
+
+    return _frames.size() - 1;
+}
+
+int
+TestPktIo::frameId (TestPacketLibrary::TestPacketId tcPktNum)
+{
+    auto it = _libFrames.find(tcPktNum);
+    if (it != _libFrames.end()) {
+        return it->second;
+    }
+
+    int id = addFrame(tcPktNum);
+    if (id >= 0) {
+        _libFrames[tcPktNum] = id;
+    }
+
+    return id;
+}
+
+//
+// @fn
+// txKick
+//
+// @brief
+// Have the kernel send the frames queued in the send ring
+//
+
+int
+TestPktIo::txKick (void)
+{
+    if (_txPending == 0) {
+        return 0;
+    }
+
+    _txPending = 0;
+    _stats.txKicks++;
+
+    if ((::send(_txFd, NULL, 0, MSG_DONTWAIT) < 0) &&
+        (errno != EAGAIN) && (errno != ENOBUFS)) {
+        perror("send(packet ring)");
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// @fn
+// txWait
+//
+// @brief
+// Wait for the next send ring slot to be free
+//
+
+int
+TestPktIo::txWait (void)
+{
+    struct pollfd pfd = { _txFd, POLLOUT, 0 };
+
+    for (;;) {
+        int ret = poll(&pfd, 1, 1000);
+        if (ret > 0) {
+            return 0;
+        }
+        if ((ret < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (ret < 0) {
+            perror("poll(send)");
+        } else {
+            std::cout << _ifName << ": send ring stuck" << std::endl;
+        }
+        return -1;
+    }
+}
+
+//
+// @fn
+// send
+//
+// @brief
+// Send frames in turn, count frames in total, at pps packets per
+// second (0: as fast as possible)
+//
+// @param[in]
+//     frameIds Frame ids
+// @param[in]
+//     count Number of frames to send
+// @param[in]
+//     pps Packets per second
+// @return Number of frames sent, -1 - Error
+//
+
+int64_t
+TestPktIo::send (int frameId, uint64_t count, uint64_t pps)
+{
+    return send(std::vector<int>(1, frameId), count, pps);
+}
+
+int64_t
+TestPktIo::send (const std::vector<int> &frameIds,
+                 uint64_t                count,
+                 uint64_t                pps)
+{
+    for (int id : frameIds) {
+        if ((id < 0) || (id >= (int)_frames.size())) {
+            std::cout << "Frame id " << id << " invalid" << std::endl;
+            return -1;
+        }
+    }
+
+    return sendLoop(count, pps,
+                    [this, &frameIds] (uint8_t *data, uint32_t slot,
+                                       uint64_t n) {
+        int                         id    = frameIds[n % frameIds.size()];
+        const std::vector<uint8_t> &frame = _frames[id];
+
+        if (_txSlotFrame[slot] != id) {
+            memcpy(data, frame.data(), frame.size());
+            _txSlotFrame[slot] = id;
+        }
+        return (uint32_t)frame.size();
+    });
+}
+
+//
+// @fn
+// send
+//
+// @brief
+// Send count frames written by fill straight into the send ring, at
+// pps packets per second (0: as fast as possible)
+//
+// @param[in]
+//     fill Writes frame n (cut to TEST_PKT_IO_FRAME_DATA_MAX bytes),
+//     returns its length
+// @param[in]
+//     count Number of frames to send
+// @param[in]
+//     pps Packets per second
+// @return Number of frames sent, -1 - Error
+//
+
+int64_t
+TestPktIo::send (const TxFill &fill, uint64_t count, uint64_t pps)
+{
+    return sendLoop(count, pps,
+                    [this, &fill] (uint8_t *data, uint32_t slot,
+                                   uint64_t n) {
+        _txSlotFrame[slot] = -1;
+        return std::min<uint32_t>(fill(data, n), TEST_PKT_IO_FRAME_DATA_MAX);
+    });
+}
+
+//
+// @fn
+// sendLoop
+//
+// @brief
+// Paced send loop: fill ring slots in bursts and kick the kernel
+//
+// @param[in]
+//     count Number of frames to send
+// @param[in]
+//     pps Packets per second, 0 - As fast as possible
+// @param[in]
+//     fill Writes frame n into ring slot data, returns its length
+// @return Number of frames sent, -1 - Error
+//
+
+int64_t
+TestPktIo::sendLoop (uint64_t count, uint64_t pps, const SlotFill &fill)
+{
+    uint64_t startNs = testMonotonicNs();
+    uint64_t sent    = 0;
+
+    while (sent < count) {
+        uint64_t burst = std::min<uint64_t>(count - sent,
+                                            TEST_PKT_IO_TX_BURST);
+
+        //
+        // Pace: send no more than the rate allows up to now
+        //
+        if (pps) {
+            uint64_t nowNs   = testMonotonicNs();
+            uint64_t allowed = (nowNs - startNs) * pps / 1000000000ULL + 1;
+
+            if (allowed <= sent) {
+                uint64_t dueNs = startNs + sent * 1000000000ULL / pps;
+                struct timespec ts;
+                ts.tv_sec  = (dueNs - nowNs) / 1000000000ULL;
+                ts.tv_nsec = (dueNs - nowNs) % 1000000000ULL;
+                nanosleep(&ts, NULL);
+                continue;
+            }
+            burst = std::min(burst, allowed - sent);
+        }
+
+        for (uint64_t i = 0; i < burst; i++) {
+            struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)
+                         (_txRing + (size_t)_txHead * TEST_PKT_IO_FRAME_SIZE);
+            uint32_t status = __atomic_load_n(&hdr->tp_status,
+                                              __ATOMIC_ACQUIRE);
+
+            if (status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+                if ((txKick() != 0) || (txWait() != 0)) {
+                    return sent ? (int64_t)sent : -1;
+                }
+                status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+            }
+            if (status == TP_STATUS_WRONG_FORMAT) {
+                _stats.txErrors++;
+            }
+
+            uint32_t len = fill((uint8_t *)hdr + TEST_PKT_IO_TX_DATA_OFF,
+                                _txHead, sent);
+
+            hdr->tp_len         = len;
+            hdr->tp_snaplen     = len;
+            hdr->tp_next_offset = 0;
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+                             __ATOMIC_RELEASE);
+
+            _txHead = (_txHead + 1) % TEST_PKT_IO_TX_FRAMES;
+            _txPending++;
+            _stats.txPkts++;
+            _stats.txBytes += len;
+            sent++;
+        }
+
+        if (txKick() != 0) {
+            return sent;
+        }
+    }
+
+    return sent;
+}
+
+//
+// @fn
+// receive
+//
+// @brief
+// Hand the packets of the ready receive ring blocks to handler
+//
+// @param[in]
+//     handler Receive handler
+// @param[in]
+//     timeoutMs Time to wait for a block (-1: forever)
+// @return Number of packets, -1 - Error
+//
+
+int
+TestPktIo::receive (const RxHandler &handler, int timeoutMs)
+{
+    int  pkts   = 0;
+    bool polled = false;
+
+    if (rxInit() != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < TEST_PKT_IO_RX_BLOCKS; ) {
+        struct tpacket_block_desc *bd = (struct tpacket_block_desc *)
+                    (_rxRing + (size_t)_rxBlock * TEST_PKT_IO_RX_BLOCK_SIZE);
+
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+              TP_STATUS_USER)) {
+            if ((pkts > 0) || (b > 0) || polled) {
+                break;
+            }
+
+            struct pollfd pfd = { _rxFd, POLLIN | POLLERR, 0 };
+            int           ret = poll(&pfd, 1, timeoutMs);
+            if ((ret < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (ret < 0) {
+                perror("poll(receive)");
+                return -1;
+            }
+            polled = true;
+            continue;
+        }
+
+        uint8_t *p = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+        for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+            struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)p;
+            struct sockaddr_ll  *sll = (struct sockaddr_ll *)
+                        (p + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+            if (sll->sll_pkttype != PACKET_OUTGOING) {
+                handler(p + hdr->tp_mac, hdr->tp_snaplen);
+                _stats.rxPkts++;
+                _stats.rxBytes += hdr->tp_snaplen;
+                pkts++;
+            }
+            p += hdr->tp_next_offset;
+        }
+
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                         __ATOMIC_RELEASE);
+        _rxBlock = (_rxBlock + 1) % TEST_PKT_IO_RX_BLOCKS;
+        _stats.rxBlocks++;
+        b++;
+    }
+
+    return pkts;
+}
+
+void
+TestPktIo::stats (Stats &stats)
+{
+    struct tpacket_stats_v3 st;
+    socklen_t               len = sizeof(st);
+
+    //
+    // Kernel counters are cleared on read
+    //
+    if ((_rxFd >= 0) &&
+        getsockopt(_rxFd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+        _stats.rxDrops += st.tp_drops;
+    }
+
+    stats = _stats;
+}
+
+std::ostream &
+TestPktIo::description (std::ostream &os)
+{
+    Stats s;
+    stats(s);
+
+    os << _ifName << ": tx " << s.txPkts << " pkts " << s.txBytes;
+    os << " bytes " << s.txKicks << " kicks " << s.txErrors << " errors,";
+    os << " rx " << s.rxPkts << " pkts " << s.rxBytes << " bytes ";
+    os << s.rxBlocks << " blocks " << s.rxDrops << " drops";
+
+    return os;
+}
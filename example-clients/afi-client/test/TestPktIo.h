@@ -0,0 +1,193 @@
+//
+// TestPktIo.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __TestPktIo__
+#define __TestPktIo__
+
+#include <stdint.h>
+#include <net/if.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "TestPacket.h"
+
+#define TEST_PKT_IO_FRAME_SIZE      2048        // Ring frame size
+#define TEST_PKT_IO_TX_FRAMES       1024        // Send ring frames
+#define TEST_PKT_IO_TX_BURST        64          // Frames per send() kick
+#define TEST_PKT_IO_RX_BLOCK_SIZE   (1 << 20)   // Receive ring block size
+#define TEST_PKT_IO_RX_BLOCKS       16          // Receive ring blocks
+#define TEST_PKT_IO_RX_BLOCK_TMO_MS 10          // Retire partial block after
+
+//
+// Test packet I/O
+// ===============
+//
+// Persistent per interface packet sender and receiver on TPACKET_V3
+// (PACKET_MMAP) rings, one AF_PACKET socket for each direction. The
+// receive ring is only set up when first needed (rxInit, receive), so
+// that interfaces that are only sent on do not pin its memory.
+//
+// Test frames are built once (addFrame) and then sent by index, in
+// bursts of up to TEST_PKT_IO_TX_BURST frames per send() system call,
+// optionally paced to a packet rate. A ring slot that still holds the
+// frame to send is not copied again. Frames that vary can instead be
+// written straight into the ring slots by a TxFill.
+//
+// Received packets are handed over a whole ring block at a time;
+// packets sent on the interface are skipped.
+//
+// Sending and receiving may be done from two different threads, but
+// each by one thread at a time.
+//
+class TestPktIo
+{
+public:
+    //
+    // Receive handler: packet data and length
+    //
+    typedef std::function<void (const uint8_t *pkt, uint32_t pktLen)> RxHandler;
+
+    //
+    // Send frame writer: writes frame n into the send ring slot data
+    // and returns its length (up to TEST_PKT_IO_FRAME_SIZE less the
+    // slot header)
+    //
+    typedef std::function<uint32_t (uint8_t *data, uint64_t n)> TxFill;
+
+    struct Stats {
+        uint64_t  txPkts;
+        uint64_t  txBytes;
+        uint64_t  txErrors;         //< Frames rejected by the kernel
+        uint64_t  txKicks;          //< send() calls
+        uint64_t  rxPkts;
+        uint64_t  rxBytes;
+        uint64_t  rxBlocks;
+        uint64_t  rxDrops;          //< Dropped by kernel, ring full
+    };
+
+    //
+    // Packet I/O of an interface, set up on first use; NULL on error
+    //
+    static TestPktIo *get(const std::string &ifNameStr);
+
+    //
+    // Close the packet I/O of an interface (moved to another network
+    // namespace); the next get() sets it up again
+    //
+    static void release(const std::string &ifNameStr);
+
+    TestPktIo(const std::string &ifNameStr);
+    ~TestPktIo();
+
+    int init(void);
+
+    //
+    // Set up the receive socket and ring, if not done yet. Packets
+    // arriving before are not seen.
+    //
+    int rxInit(void);
+
+    //
+    // Build a frame, returns frame id or -1. Test library frames get
+    // the interface MAC address as source MAC address.
+    //
+    int addFrame(TestPacketLibrary::TestPacketId tcPktNum);
+    int addFrame(const uint8_t *frame, uint32_t frameLen);
+
+    //
+    // Frame id of a test library frame, built on first use
+    //
+    int frameId(TestPacketLibrary::TestPacketId tcPktNum);
+
+    //
+    // Send frame count times, at pps packets per second (0: as fast
+    // as possible). Returns number of frames sent, -1 on error.
+    //
+    int64_t send(int frameId, uint64_t count = 1, uint64_t pps = 0);
+
+    //
+    // Send frames in turn, count frames in total
+    //
+    int64_t send(const std::vector<int> &frameIds, uint64_t count,
+                 uint64_t pps = 0);
+
+    //
+    // Send count frames written by fill in place, for frames that
+    // change from one to the next (flows, sequence numbers)
+    //
+    int64_t send(const TxFill &fill, uint64_t count, uint64_t pps = 0);
+
+    //
+    // Hand received packets to handler, waiting up to timeoutMs for
+    // the first block. Returns number of packets, -1 on error.
+    //
+    int receive(const RxHandler &handler, int timeoutMs);
+
+    void stats(Stats &stats);
+    std::ostream &description(std::ostream &os);
+
+    const std::vector<uint8_t> &frame(int frameId) const {
+        return _frames.at(frameId);
+    }
+
+    const uint8_t *mac(void) const { return _mac; }
+
+private:
+    typedef std::function<uint32_t (uint8_t *data, uint32_t slot,
+                                    uint64_t n)> SlotFill;
+
+    int  ringSetup(int fd, int ringType, uint32_t blockSize,
+                   uint32_t blockNr, uint32_t frameSize, uint32_t frameNr,
+                   uint32_t blockTmo, uint8_t **ring);
+    int  txWait(void);
+    int  txKick(void);
+    int64_t sendLoop(uint64_t count, uint64_t pps, const SlotFill &fill);
+
+    char                      _ifName[IFNAMSIZ];
+    int                       _ifIndex;
+    uint8_t                   _mac[6];
+
+    std::vector<std::vector<uint8_t>> _frames;  //< Prebuilt frames
+    std::map<TestPacketLibrary::TestPacketId, int> _libFrames;
+
+    int                       _txFd;
+    uint8_t                  *_txRing;
+    size_t                    _txRingSize;
+    uint32_t                  _txHead;         //< Next send ring slot
+    std::vector<int>          _txSlotFrame;    //< Frame in slot, -1: none
+    uint32_t                  _txPending;      //< Frames not kicked
+
+    int                       _rxFd;
+    uint8_t                  *_rxRing;
+    size_t                    _rxRingSize;
+    uint32_t                  _rxBlock;        //< Next receive ring block
+
+    Stats                     _stats;
+
+    static std::mutex         _registryLock;
+    static std::map<std::string, std::unique_ptr<TestPktIo>> _registry;
+};
+
+#endif // __TestPktIo__
@@ -0,0 +1,488 @@
+//
+// TestSandbox.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <boost/thread.hpp>
+#include "TestPktIo.h"
+#include "TestSandbox.h"
+#include "TestUtils.h"
+
+std::vector<TestSandboxConfig> TestSandbox::_configs;
+std::string                    TestSandbox::_afiServerAddr;
+std::string                    TestSandbox::_afiHostpathAddr;
+
+//
+// Run a shell command (ip), returns its exit status
+//
+static int
+testShell (const std::string &cmd)
+{
+    int ret = system(cmd.c_str());
+
+    if (ret != 0) {
+        std::cout << "Failed: " << cmd << std::endl;
+    }
+    return ret;
+}
+
+//
+// Test side interfaces of port pN
+//
+static std::vector<std::string>
+testPortIfs (int n)
+{
+    return { "vmx_link" + std::to_string(n), "tap" + std::to_string(n) };
+}
+
+//
+// File keeping the addresses of an interface while it is in a test
+// namespace (read back after a crash too)
+//
+static std::string
+testIfAddrFile (const std::string &ifName)
+{
+    return std::string(TEST_SB_LOCK_DIR) + "/afi-gtest." + ifName + ".addr";
+}
+
+//
+// @fn
+// testIfAddrSave
+//
+// @brief
+// Save the addresses of an interface (ip -o addr show), moving it to
+// another namespace drops them. IPv6 link local addresses are left
+// out, the kernel adds them back itself.
+//
+// @param[in]
+//     ifName Interface
+// @return 0 - Success, -1 - Error
+//
+
+static int
+testIfAddrSave (const std::string &ifName)
+{
+    std::string cmd = "ip -o addr show dev " + ifName;
+    FILE *ip = popen(cmd.c_str(), "r");
+    if (ip == NULL) {
+        perror(cmd.c_str());
+        return -1;
+    }
+
+    std::ofstream file(testIfAddrFile(ifName));
+    char          line[512];
+
+    //
+    // e.g. "7: tap0    inet 103.30.00.2/24 brd 103.30.00.255 scope ..."
+    //
+    while (fgets(line, sizeof(line), ip) != NULL) {
+        std::istringstream fields(line);
+        std::string        field, family, addr;
+
+        while ((fields >> field) && (field != "inet") && (field != "inet6")) {
+        }
+        family = field;
+        if (!(fields >> addr) || (addr.compare(0, 5, "fe80:") == 0)) {
+            continue;
+        }
+        file << family << " " << addr << std::endl;
+    }
+
+    if ((pclose(ip) != 0) || !file) {
+        std::cout << "Failed: " << cmd << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+//
+// @fn
+// testIfAddrRestore
+//
+// @brief
+// Add the saved addresses of an interface back, if any were saved,
+// and drop the file
+//
+// @param[in]
+//     ifName Interface
+// @return void
+//
+
+static void
+testIfAddrRestore (const std::string &ifName)
+{
+    std::string   path = testIfAddrFile(ifName);
+    std::ifstream file(path);
+    std::string   family, addr;
+
+    if (!file) {
+        return;
+    }
+    while (file >> family >> addr) {
+        system(("ip addr add " + addr + ((family == "inet") ? " brd +" : "") +
+                " dev " + ifName + " 2>/dev/null").c_str());
+    }
+    unlink(path.c_str());
+}
+
+void
+TestSandbox::setConfigs (const std::vector<TestSandboxConfig> &configs,
+                         const std::string &afiServerAddr,
+                         const std::string &afiHostpathAddr)
+{
+    _configs         = configs;
+    _afiServerAddr   = afiServerAddr;
+    _afiHostpathAddr = afiHostpathAddr;
+}
+
+//
+// @fn
+// SetUp
+//
+// @brief
+// Lease the test's ports, move their interfaces into the test's
+// network namespace, and open the test's sandbox with its own client
+//
+// @return void
+//
+
+void
+TestSandbox::SetUp (void)
+{
+    const ::testing::TestInfo *info =
+                ::testing::UnitTest::GetInstance()->current_test_info();
+
+    for (auto &config : _configs) {
+        if (config.testName == info->name()) {
+            _config = &config;
+            break;
+        }
+    }
+    ASSERT_TRUE(_config != NULL) << "No sandbox for test " << info->name();
+
+    std::vector<int> ports(_config->ports);
+    std::sort(ports.begin(), ports.end());
+    for (int n : ports) {
+        ASSERT_EQ(0, leaseResource("p" + std::to_string(n)));
+    }
+    if (_config->hostpath) {
+        ASSERT_EQ(0, leaseResource("hostpath"));
+    }
+
+    ASSERT_EQ(0, netnsSetup());
+
+    //
+    // Tests that do not use the hostpath leave its port to the others
+    //
+    _client = new AfiClient(_ioService, _afiServerAddr, _afiHostpathAddr,
+                            _config->hostpath ? AFT_CLIENT_HOSTPATH_PORT : 0,
+                            false, false);
+
+    ASSERT_EQ(0, _client->openSandbox(_config->sbName,
+                                      _config->ports.size()));
+}
+
+//
+// @fn
+// TearDown
+//
+// @brief
+// Release the sandbox, the namespace and the leases
+//
+// @return void
+//
+
+void
+TestSandbox::TearDown (void)
+{
+    if (_client != NULL) {
+        _client->closeSandbox();
+        delete _client;
+        _client = NULL;
+    }
+
+    netnsCleanup();
+
+    for (int fd : _leaseFds) {
+        close(fd);
+    }
+    _leaseFds.clear();
+}
+
+AftIndex
+TestSandbox::port (int n) const
+{
+    auto it = std::find(_config->ports.begin(), _config->ports.end(), n);
+
+    EXPECT_TRUE(it != _config->ports.end()) << "Port p" << n << " not leased";
+    return it - _config->ports.begin();
+}
+
+//
+// @fn
+// sendRawEth
+//
+// @brief
+// Send a test packet on vmx_linkN: the calling thread switches to the
+// test's namespace for the send and back
+//
+// @param[in]
+//     n Port
+// @param[in]
+//     tcPktNum Test packet id
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestSandbox::sendRawEth (int n, TestPacketLibrary::TestPacketId tcPktNum)
+{
+    int self = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (self < 0) {
+        perror("netns");
+        return -1;
+    }
+    if (enterNetns() != 0) {
+        close(self);
+        return -1;
+    }
+
+    int ret = SendRawEth("vmx_link" + std::to_string(n), tcPktNum);
+
+    if (setns(self, CLONE_NEWNET) != 0) {
+        perror("setns");
+        ret = -1;
+    }
+    close(self);
+    return ret;
+}
+
+int
+TestSandbox::enterNetns (void)
+{
+    if ((_netnsFd < 0) || (setns(_netnsFd, CLONE_NEWNET) != 0)) {
+        perror("setns");
+        return -1;
+    }
+    return 0;
+}
+
+//
+// @fn
+// sandboxIndex
+//
+// @brief
+// Learn the hostpath sandbox index of the test's sandbox: port pN is
+// set to punt, probes are sent on vmx_linkN until one comes back on
+// the client hostpath port, and the port is set back to discard. The
+// probes stop after TEST_SB_PROBE_MAX; the punt is waited for until
+// TEST_SB_PROBE_WAIT_MS after the last one.
+//
+// @param[in]
+//     n Port
+// @param[out]
+//     index Hostpath sandbox index
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestSandbox::sandboxIndex (int n, AftSandboxId &index)
+{
+    if (!_config->hostpath) {
+        std::cout << "Test " << _config->testName << " has no hostpath"
+                  << std::endl;
+        return -1;
+    }
+    if (_client->setInputPortNextNode(port(n),
+                        _client->getOuputPortToken(puntPort())) != 0) {
+        return -1;
+    }
+
+    std::atomic<bool> punted(false);
+    boost::thread probeThread([this, n, &punted] {
+        for (int i = 0; !punted.load(); i++) {
+            if (i == TEST_SB_PROBE_MAX) {
+                std::cout << "No punt from p" << n << " after "
+                          << TEST_SB_PROBE_MAX << " probes" << std::endl;
+                break;
+            }
+            sendRawEth(n, TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO);
+            usleep(TEST_SB_PROBE_MS * 1000);
+        }
+    });
+
+    AftPacketPtr pkt = AftPacket::createReceive();
+    int ret = _client->recvHostPathPacket(pkt,
+                        TEST_SB_PROBE_MAX * TEST_SB_PROBE_MS +
+                        TEST_SB_PROBE_WAIT_MS);
+    int err = errno;
+
+    punted.store(true);
+    probeThread.join();
+
+    if (ret == 0) {
+        index = pkt->sandboxId();
+    } else if (err == ETIMEDOUT) {
+        std::cout << "No punt from p" << n << std::endl;
+    }
+    if (_client->setInputPortNextNode(port(n), AFT_NODE_TOKEN_DISCARD) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+//
+// @fn
+// leaseResource
+//
+// @brief
+// Take the lock file of a port or of the client hostpath port,
+// waiting for the test process holding it. The lease ends when the
+// lock file is closed, by TearDown() or when the process exits.
+//
+// @param[in]
+//     name Resource name
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestSandbox::leaseResource (const std::string &name)
+{
+    std::string path = std::string(TEST_SB_LOCK_DIR) + "/afi-gtest." + name +
+                       ".lock";
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        perror(path.c_str());
+        return -1;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        std::cout << "Waiting for " << name << std::endl;
+        if (flock(fd, LOCK_EX) != 0) {
+            perror(path.c_str());
+            close(fd);
+            return -1;
+        }
+    }
+
+    _leaseFds.push_back(fd);
+    return 0;
+}
+
+//
+// @fn
+// netnsSetup
+//
+// @brief
+// Create the test's namespace and move the interfaces of its ports
+// into it, saving their addresses first (they come up there without
+// addresses: test packets are raw frames)
+//
+// @return 0 - Success, -1 - Error
+//
+
+int
+TestSandbox::netnsSetup (void)
+{
+    _netns = TEST_SB_NETNS_PREFIX + _config->sbName;
+
+    //
+    // Left by a test that crashed
+    //
+    netnsCleanup();
+
+    if (testShell("ip netns add " + _netns) != 0) {
+        return -1;
+    }
+    for (int n : _config->ports) {
+        for (auto &ifName : testPortIfs(n)) {
+            TestPktIo::release(ifName);
+            if ((testIfAddrSave(ifName) != 0) ||
+                (testShell("ip link set dev " + ifName + " netns " +
+                           _netns) != 0) ||
+                (testShell("ip netns exec " + _netns + " ip link set dev " +
+                           ifName + " up") != 0)) {
+                return -1;
+            }
+        }
+    }
+
+    std::string path = "/var/run/netns/" + _netns;
+    _netnsFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_netnsFd < 0) {
+        perror(path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+//
+// @fn
+// netnsCleanup
+//
+// @brief
+// Move the interfaces of the test's ports back to the initial
+// namespace (deleting the namespace would destroy them) and delete
+// the namespace, if there is one. Addresses saved for the interfaces
+// are added back, also when a crash left no namespace behind.
+//
+// @return void
+//
+
+void
+TestSandbox::netnsCleanup (void)
+{
+    if (_netnsFd >= 0) {
+        close(_netnsFd);
+        _netnsFd = -1;
+    }
+    if (_netns.empty()) {
+        return;
+    }
+    bool exists = (access(("/var/run/netns/" + _netns).c_str(), F_OK) == 0);
+
+    for (int n : _config->ports) {
+        for (auto &ifName : testPortIfs(n)) {
+            if (exists) {
+                TestPktIo::release(ifName);
+                system(("ip netns exec " + _netns + " ip link set dev " +
+                        ifName + " netns 1 2>/dev/null").c_str());
+                system(("ip link set dev " + ifName +
+                        " up 2>/dev/null").c_str());
+            }
+            testIfAddrRestore(ifName);
+        }
+    }
+    if (exists) {
+        testShell("ip netns del " + _netns);
+    }
+}
@@ -0,0 +1,131 @@
+//
+// TestSandbox.h
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __TestSandbox__
+#define __TestSandbox__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "TestPacket.h"
+#include "../AfiClient.h"
+
+#define TEST_SB_LOCK_DIR        "/tmp"          // Port and hostpath leases
+#define TEST_SB_NETNS_PREFIX    "afi-gtest-"    // Test network namespaces
+#define TEST_SB_PROBE_MS        100             // Hostpath index probe interval
+#define TEST_SB_PROBE_MAX       50              // Probes sent before giving up
+#define TEST_SB_PROBE_WAIT_MS   1000            // Wait for the last probe
+
+//
+// Sandbox of a test: sandbox configured on the vMX, the ge-0/0/N ports
+// it has (port pN, in sandbox port index order) and whether the test
+// punts or injects through the client hostpath port. Tests sharing a
+// sandbox list all of its ports, so that they share its leases too.
+//
+struct TestSandboxConfig {
+    std::string         testName;
+    std::string         sbName;
+    std::vector<int>    ports;
+    bool                hostpath;
+};
+
+//
+// @class   TestSandbox
+// @brief   Test fixture: per test AFI client, sandbox, ports and
+//          network namespace
+//
+// Each test gets its own AFI client and sandbox, looked up by test
+// name among the configs given to setConfigs(), so that tests can run
+// concurrently, each in its own process (run-afi-gtest):
+//
+//  - The ports a test uses are leased, with file locks shared by all
+//    test processes, in ascending order. Tests on different ports run
+//    side by side; tests sharing a port (or the client hostpath port)
+//    wait for each other.
+//
+//  - The vmx_linkN / tapN pairs of the leased ports are moved into a
+//    network namespace of the test, so that nothing else sends on or
+//    reads from them. Test packets are sent (sendRawEth) and tap
+//    readers run (enterNetns) inside it; captures on the vMX side
+//    ge-0.0.N-vmx1 interfaces are not affected. Their addresses are
+//    saved to a file before the move and added back after it.
+//
+// TearDown() releases the sandbox and moves the interfaces back. A
+// namespace left by a test that crashed is cleaned up on next use.
+//
+class TestSandbox : public ::testing::Test
+{
+public:
+    static void setConfigs(const std::vector<TestSandboxConfig> &configs,
+                           const std::string &afiServerAddr,
+                           const std::string &afiHostpathAddr);
+
+protected:
+    TestSandbox() : _config(NULL), _client(NULL), _netnsFd(-1) {
+    }
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+    //
+    // Sandbox port index of port pN, punt port index
+    //
+    AftIndex port(int n) const;
+    AftIndex puntPort(void) const { return _config->ports.size(); }
+
+    //
+    // Hostpath sandbox index, learnt from a probe punted from port pN
+    // (the vMX assigns it). Returns 0 - Success, -1 - Error.
+    //
+    int sandboxIndex(int n, AftSandboxId &index);
+
+    //
+    // Send a test packet on vmx_linkN in the test's namespace
+    //
+    int sendRawEth(int n, TestPacketLibrary::TestPacketId tcPktNum);
+
+    //
+    // Move the calling thread into the test's namespace (tap readers).
+    // Returns 0 - Success, -1 - Error.
+    //
+    int enterNetns(void);
+
+    const TestSandboxConfig    *_config;
+    AfiClient                  *_client;
+
+private:
+    int  leaseResource(const std::string &name);
+    int  netnsSetup(void);
+    void netnsCleanup(void);
+
+    boost::asio::io_service     _ioService;
+    std::vector<int>            _leaseFds;
+    std::string                 _netns;
+    int                         _netnsFd;
+
+    static std::vector<TestSandboxConfig>  _configs;
+    static std::string                     _afiServerAddr;
+    static std::string                     _afiHostpathAddr;
+};
+
+#endif // __TestSandbox__
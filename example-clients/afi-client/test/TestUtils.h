@@ -24,6 +24,8 @@
 
 #include <net/if.h>
 #include <linux/if_tun.h>
+#include <string>
+#include "TestPacket.h"
 
 extern int SendRawEth (const std::string &ifNameStr, TestPacketLibrary::TestPacketId tcPktNum);
 
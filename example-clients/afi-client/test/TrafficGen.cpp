@@ -0,0 +1,513 @@
+//
+// TrafficGen.cpp
+//
+// Advanced Forwarding Interface : AFI client examples
+//
+// Created by Sandesh Kumar Sodhi, January 2017
+// Copyright (c) [2017] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestPacket.h"
+#include "TestPktIo.h"
+#include "../AfiPktTemplate.h"
+
+#define TRAFFIC_GEN_MAGIC       0x41464947  // "AFIG", starts a stamp
+#define TRAFFIC_GEN_STAMP_OFF   24          // L4 offset of the stamp: after
+                                            // ICMP echo header and ping
+                                            // timestamp
+#define TRAFFIC_GEN_STAMP_LEN   12          // Magic, stream, sequence number
+#define TRAFFIC_GEN_FLOWS       256         // Default flows of a variation
+#define TRAFFIC_GEN_CHUNK       65536       // Frames per send() unpaced
+#define TRAFFIC_GEN_RX_POLL_MS  100
+#define TRAFFIC_GEN_DRAIN_MS    1000        // Receive after the last send
+
+//
+// Frames of the test packet library by name
+//
+struct GenPacket {
+    const char                       *name;
+    TestPacketLibrary::TestPacketId   id;
+};
+
+static const GenPacket genPackets[] = {
+    { "echo-tap1", TestPacketLibrary::TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP1 },
+    { "echo-tap2", TestPacketLibrary::TEST_PKT_ID_IPV4_ECHO_REQ_TO_TAP2 },
+    { "route",
+      TestPacketLibrary::TEST_PKT_ID_IPV4_ROUTER_ICMP_ECHO_TO_TAP3 },
+    { "punt",      TestPacketLibrary::TEST_PKT_ID_PUNT_ICMP_ECHO },
+    { "vlan",      TestPacketLibrary::TEST_PKT_ID_IPV4_VLAN },
+    { "mpls",      TestPacketLibrary::TEST_PKT_ID_MPLS_L2VLAN },
+};
+
+//
+// Flow variation: field counts up from its value in the frame, count
+// values per stream, then starts over
+//
+struct GenFlow {
+    AfiPktTemplate::FieldType  type;
+    uint32_t                   count;
+};
+
+struct GenConfig {
+    std::vector<std::string>  ifNames;      //< Send interfaces
+    const GenPacket          *pkt;
+    int                       threads;
+    uint64_t                  pps;          //< All threads, 0: no limit
+    uint64_t                  bps;          //< Frame bits per second
+    double                    seconds;
+    std::vector<GenFlow>      flows;
+    bool                      stamp;        //< Stream and sequence number
+    std::string               rxIfName;     //< Count stamps received on
+};
+
+//
+// A stream: the frames one thread sends on its own send ring
+//
+struct GenStream {
+    uint32_t            index;
+    std::string         ifName;
+    uint64_t            pps;                //< 0: no limit
+    uint64_t            sent;
+    uint64_t            bytes;
+    double              elapsed;
+    TestPktIo::Stats    stats;
+    int                 error;
+
+    //
+    // Receive side
+    //
+    uint64_t            rxPkts;
+    uint64_t            rxNextSeq;          //< Highest sequence number + 1
+    uint64_t            rxReordered;        //< Below an earlier one
+};
+
+static std::atomic<bool> genRxStop(false);
+
+static void
+genUsage (const char *prog)
+{
+    std::cout << "Usage: " << prog << " -i <interface> [-i <interface>...]";
+    std::cout << std::endl;
+    std::cout << "       [-p <packet>] [-t <threads>] [-r <pps> | -b <bps>]";
+    std::cout << " [-d <seconds>]" << std::endl;
+    std::cout << "       [-f ip|vlan|label[:<count>]...] [-s]";
+    std::cout << " [-c <receive interface>]" << std::endl;
+    std::cout << "Packets:";
+    for (const GenPacket &p : genPackets) {
+        std::cout << " " << p.name;
+    }
+    std::cout << std::endl;
+}
+
+//
+// Parse a flow variation, e.g. "vlan:100". Returns 0 - Success,
+// -1 - Error.
+//
+static int
+genParseFlow (const std::string &str, GenFlow &flow)
+{
+    std::string field = str.substr(0, str.find(':'));
+
+    if (field == "ip") {
+        flow.type = AfiPktTemplate::FieldIpv4Dst;
+    } else if (field == "vlan") {
+        flow.type = AfiPktTemplate::FieldVlanId;
+    } else if (field == "label") {
+        flow.type = AfiPktTemplate::FieldMplsLabel;
+    } else {
+        return -1;
+    }
+
+    flow.count = TRAFFIC_GEN_FLOWS;
+    if (field.size() < str.size()) {
+        flow.count = std::strtoul(str.c_str() + field.size() + 1, NULL, 0);
+    }
+    return (flow.count > 0) ? 0 : -1;
+}
+
+static void
+genPut32 (uint8_t *p, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(p, &value, sizeof(value));
+}
+
+//
+// Send a stream: the frame, with the interface MAC address as source,
+// varied and stamped into the send ring slots for the configured time
+//
+static void
+genSend (const GenConfig &cfg, const std::vector<uint8_t> &pktFrame,
+         GenStream &s)
+{
+    TestPktIo io(s.ifName);
+
+    if (io.init() != 0) {
+        s.error = 1;
+        return;
+    }
+
+    std::vector<uint8_t> frame(pktFrame);
+    memcpy(&frame[6], io.mac(), 6);
+
+    AfiPktTemplate tmpl;
+    if (tmpl.build(0, 0, frame.data(), frame.size()) != 0) {
+        s.error = 1;
+        return;
+    }
+
+    std::vector<int>      flowIds;
+    std::vector<uint32_t> flowBases;
+    for (const GenFlow &flow : cfg.flows) {
+        int id = tmpl.addField(flow.type);
+        if (id < 0) {
+            std::cout << cfg.pkt->name << ": no field to vary" << std::endl;
+            s.error = 1;
+            return;
+        }
+        flowIds.push_back(id);
+        flowBases.push_back(tmpl.get(id));
+    }
+
+    //
+    // Stamp in the L4 payload (checksum kept right), or in the last
+    // bytes of frames without an L4 header (e.g. MPLS over Ethernet)
+    //
+    int seqId  = -1;
+    int rawOff = -1;
+    if (cfg.stamp) {
+        int magicId  = tmpl.addField(AfiPktTemplate::FieldL4,
+                                     TRAFFIC_GEN_STAMP_OFF, 4);
+        int streamId = tmpl.addField(AfiPktTemplate::FieldL4,
+                                     TRAFFIC_GEN_STAMP_OFF + 4, 4);
+        seqId        = tmpl.addField(AfiPktTemplate::FieldL4,
+                                     TRAFFIC_GEN_STAMP_OFF + 8, 4);
+        if ((magicId >= 0) && (streamId >= 0) && (seqId >= 0)) {
+            tmpl.set(magicId, TRAFFIC_GEN_MAGIC);
+            tmpl.set(streamId, s.index);
+        } else {
+            seqId  = -1;
+            rawOff = tmpl.frameLen() - TRAFFIC_GEN_STAMP_LEN;
+        }
+    }
+
+    uint64_t done = 0;
+    auto     fill = [&] (uint8_t *data, uint64_t n) {
+        uint64_t seq = done + n;
+
+        for (size_t i = 0; i < flowIds.size(); i++) {
+            tmpl.set(flowIds[i],
+                     flowBases[i] + (uint32_t)(seq % cfg.flows[i].count));
+        }
+        if (seqId >= 0) {
+            tmpl.set(seqId, (uint32_t)seq);
+        }
+        memcpy(data, tmpl.frame(), tmpl.frameLen());
+        if (rawOff >= 0) {
+            genPut32(data + rawOff, TRAFFIC_GEN_MAGIC);
+            genPut32(data + rawOff + 4, s.index);
+            genPut32(data + rawOff + 8, (uint32_t)seq);
+        }
+        return (uint32_t)tmpl.frameLen();
+    };
+
+    auto   start = std::chrono::steady_clock::now();
+    double elapsed;
+
+    do {
+        uint64_t count = s.pps ? (uint64_t)(s.pps * cfg.seconds) :
+                                 TRAFFIC_GEN_CHUNK;
+        int64_t  sent  = io.send(fill, count, s.pps);
+
+        if (sent < 0) {
+            s.error = 1;
+            break;
+        }
+        done += sent;
+        elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+    } while (!s.pps && (elapsed < cfg.seconds));
+
+    s.sent    = done;
+    s.bytes   = done * tmpl.frameLen();
+    s.elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+    io.stats(s.stats);
+}
+
+//
+// Count stamped frames received per stream until genRxStop
+//
+static void
+genReceive (const std::string &ifName, std::vector<GenStream> &streams,
+            uint64_t &rxOther, int &error)
+{
+    TestPktIo io(ifName);
+    uint8_t   magic[4];
+
+    if ((io.init() != 0) || (io.rxInit() != 0)) {
+        error = 1;
+        return;
+    }
+    genPut32(magic, TRAFFIC_GEN_MAGIC);
+
+    auto handler = [&] (const uint8_t *pkt, uint32_t pktLen) {
+        const uint8_t *p = (const uint8_t *)memmem(pkt, pktLen, magic,
+                                                    sizeof(magic));
+        uint32_t stream, seq;
+
+        if ((p == NULL) || (p + TRAFFIC_GEN_STAMP_LEN > pkt + pktLen)) {
+            rxOther++;
+            return;
+        }
+        memcpy(&stream, p + 4, sizeof(stream));
+        memcpy(&seq, p + 8, sizeof(seq));
+        stream = ntohl(stream);
+        seq    = ntohl(seq);
+        if (stream >= streams.size()) {
+            rxOther++;
+            return;
+        }
+
+        GenStream &s = streams[stream];
+        s.rxPkts++;
+        if (seq < s.rxNextSeq) {
+            s.rxReordered++;
+        } else {
+            s.rxNextSeq = (uint64_t)seq + 1;
+        }
+    };
+
+    while (!genRxStop) {
+        if (io.receive(handler, TRAFFIC_GEN_RX_POLL_MS) < 0) {
+            error = 1;
+            return;
+        }
+    }
+}
+
+//
+// Traffic generator main
+//
+// Sends a test library frame from threads threads, each with send
+// ring of its own on one of the interfaces (taken in turn), for about
+// seconds, at the packet or bit rate given split evenly among the
+// threads, or as fast as possible. Fields of the frame may count up
+// over a number of flows. Stamped frames carry their stream (thread)
+// and a sequence number; frames received on the receive interface are
+// matched to their streams to count losses and reordering.
+//
+int
+main(int argc, char *argv[])
+{
+    GenConfig cfg;
+    int       opt;
+
+    cfg.pkt     = &genPackets[2];
+    cfg.threads = 0;
+    cfg.pps     = 0;
+    cfg.bps     = 0;
+    cfg.seconds = 10;
+    cfg.stamp   = false;
+
+    while ((opt = getopt(argc, argv, "i:p:t:r:b:d:f:sc:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            cfg.ifNames.push_back(optarg);
+            break;
+        case 'p':
+            cfg.pkt = NULL;
+            for (const GenPacket &p : genPackets) {
+                if (strcmp(p.name, optarg) == 0) {
+                    cfg.pkt = &p;
+                }
+            }
+            if (cfg.pkt == NULL) {
+                std::cout << "Unknown packet " << optarg << std::endl;
+                genUsage(argv[0]);
+                return 1;
+            }
+            break;
+        case 't':
+            cfg.threads = std::strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            cfg.pps = std::strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            cfg.bps = std::strtod(optarg, NULL);
+            break;
+        case 'd':
+            cfg.seconds = std::strtod(optarg, NULL);
+            break;
+        case 'f': {
+            GenFlow flow;
+            if (genParseFlow(optarg, flow) != 0) {
+                std::cout << "Invalid flow variation " << optarg << std::endl;
+                genUsage(argv[0]);
+                return 1;
+            }
+            cfg.flows.push_back(flow);
+            break;
+        }
+        case 's':
+            cfg.stamp = true;
+            break;
+        case 'c':
+            cfg.rxIfName = optarg;
+            break;
+        default:
+            genUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.ifNames.empty() || (cfg.seconds <= 0) ||
+        (cfg.pps && cfg.bps)) {
+        genUsage(argv[0]);
+        return 1;
+    }
+    if (cfg.threads <= 0) {
+        cfg.threads = cfg.ifNames.size();
+    }
+    if (!cfg.rxIfName.empty()) {
+        cfg.stamp = true;
+    }
+
+    TestPacket *testPkt = testPacketLibrary.getTestPacket(cfg.pkt->id);
+    char        buf[TEST_PKT_IO_FRAME_SIZE];
+    int         frameLen = testPkt->getEtherPacket(buf, sizeof(buf));
+    if (frameLen < 0) {
+        std::cout << cfg.pkt->name << ": cannot build frame" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> frame(buf, buf + frameLen);
+
+    if (cfg.bps) {
+        cfg.pps = std::max<uint64_t>(cfg.bps / (frameLen * 8), 1);
+    }
+
+    std::vector<GenStream> streams(cfg.threads);
+    for (int i = 0; i < cfg.threads; i++) {
+        GenStream &s = streams[i];
+        memset(&s.stats, 0, sizeof(s.stats));
+        s.index       = i;
+        s.ifName      = cfg.ifNames[i % cfg.ifNames.size()];
+        s.pps         = cfg.pps / cfg.threads +
+                        (((uint64_t)i < cfg.pps % cfg.threads) ? 1 : 0);
+        s.sent        = s.bytes = 0;
+        s.elapsed     = 0;
+        s.error       = 0;
+        s.rxPkts      = s.rxNextSeq = s.rxReordered = 0;
+        if (cfg.pps && !s.pps) {
+            std::cout << "Rate below one packet per second per thread";
+            std::cout << std::endl;
+            return 1;
+        }
+    }
+
+    uint64_t    rxOther = 0;
+    int         rxError = 0;
+    std::thread receiver;
+    if (!cfg.rxIfName.empty()) {
+        receiver = std::thread(genReceive, std::cref(cfg.rxIfName),
+                               std::ref(streams), std::ref(rxOther),
+                               std::ref(rxError));
+    }
+
+    std::vector<std::thread> senders;
+    for (GenStream &s : streams) {
+        senders.push_back(std::thread(genSend, std::cref(cfg),
+                                      std::cref(frame), std::ref(s)));
+    }
+    for (std::thread &t : senders) {
+        t.join();
+    }
+    if (receiver.joinable()) {
+        usleep(TRAFFIC_GEN_DRAIN_MS * 1000);
+        genRxStop = true;
+        receiver.join();
+    }
+
+    std::cout << cfg.pkt->name << ", " << frameLen << " byte frames";
+    std::cout << std::endl;
+    std::cout << "  Stream  Interface        Sent      Kpps     Mbps";
+    std::cout << "  TxErr";
+    if (!cfg.rxIfName.empty()) {
+        std::cout << "   Received      Lost  Reord";
+    }
+    std::cout << std::endl;
+
+    uint64_t totalSent = 0, totalBytes = 0, totalRx = 0;
+    double   totalPps = 0, totalBps = 0;
+    int      failed = rxError;
+
+    for (const GenStream &s : streams) {
+        double pps = s.elapsed ? s.sent / s.elapsed : 0;
+        double bps = s.elapsed ? s.bytes * 8 / s.elapsed : 0;
+
+        std::cout << std::setw(8) << s.index << "  " << std::left;
+        std::cout << std::setw(12) << s.ifName << std::right;
+        std::cout << std::setw(11) << s.sent;
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << std::setw(10) << pps / 1e3;
+        std::cout << std::setw(9) << bps / 1e6;
+        std::cout << std::setw(7) << s.stats.txErrors;
+        if (!cfg.rxIfName.empty()) {
+            std::cout << std::setw(11) << s.rxPkts;
+            std::cout << std::setw(10);
+            std::cout << ((s.sent > s.rxPkts) ? s.sent - s.rxPkts : 0);
+            std::cout << std::setw(7) << s.rxReordered;
+        }
+        if (s.error) {
+            std::cout << "  (failed)";
+        }
+        std::cout << std::endl;
+
+        totalSent  += s.sent;
+        totalBytes += s.bytes;
+        totalRx    += s.rxPkts;
+        totalPps   += pps;
+        totalBps   += bps;
+        failed     += s.error;
+    }
+
+    std::cout << std::setw(8) << "total" << "  " << std::setw(12) << "";
+    std::cout << std::setw(11) << totalSent;
+    std::cout << std::setw(10) << totalPps / 1e3;
+    std::cout << std::setw(9) << totalBps / 1e6;
+    if (!cfg.rxIfName.empty()) {
+        std::cout << std::setw(7) << "" << std::setw(11) << totalRx;
+        std::cout << std::setw(10);
+        std::cout << ((totalSent > totalRx) ? totalSent - totalRx : 0);
+        std::cout << std::endl << "Not stamped or unknown stream: ";
+        std::cout << rxOther;
+    }
+    std::cout << std::endl;
+
+    return failed ? 1 : 0;
+}